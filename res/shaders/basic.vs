@@ -5,9 +5,31 @@ in vec3 a_normal;
 in vec4 a_color;
 in vec2 a_uv;
 
-uniform mat4 u_model;
-uniform mat4 u_viewprojection;
-uniform vec3 u_camera_position;
+#ifdef USE_INSTANCING
+in mat4 u_model; //per instance (see Mesh::render_instanced)
+//slot of the shared texture per instance, only set for materials with one (see RenderQueue)
+in vec4 a_texture_rect;
+in float a_texture_layer;
+out vec4 v_texture_rect;
+flat out float v_texture_layer;
+//color of the material per instance, for the materials grouped by color (see Material::color_per_instance)
+in vec4 a_instance_color;
+flat out vec4 v_instance_color;
+#else
+//per draw, a range of the FrameRingBuffer (see uniform_buffer.h)
+layout(std140) uniform ObjectBlock {
+	mat4 u_model;
+};
+#endif
+
+//shared by every shader, updated once per frame
+layout(std140) uniform FrameBlock {
+	mat4 u_view;
+	mat4 u_projection;
+	mat4 u_viewprojection;
+	vec3 u_camera_position;
+	float u_time;
+};
 
 //this will store the color for the pixel shader
 out vec3 v_position;
@@ -31,6 +53,12 @@ void main()
 	//store the texture coordinates
 	v_uv = a_uv;
 
+#ifdef USE_INSTANCING
+	v_texture_rect = a_texture_rect;
+	v_texture_layer = a_texture_layer;
+	v_instance_color = a_instance_color;
+#endif
+
 	//calcule the position of the vertex using the matrices
 	gl_Position = u_viewprojection * vec4( v_world_position, 1.0 );
 }
\ No newline at end of file
@@ -2,11 +2,36 @@
 
 in vec2 v_uv;
 
+#ifdef USE_TEXTURE_ARRAY
+uniform sampler2DArray u_texture;
+#else
 uniform sampler2D u_texture;
+#endif
+
+#ifdef USE_INSTANCING
+//per instance, so the materials sharing the texture are drawn together
+in vec4 v_texture_rect;
+flat in float v_texture_layer;
+#else
+uniform vec4 u_texture_rect; //offset and scale of the uvs inside an atlas, (0,0,1,1) for a whole texture
+uniform float u_texture_layer;
+#endif
 
 out vec4 FragColor;
 
 void main()
 {
-	FragColor = texture(u_texture, v_uv);
+#ifdef USE_INSTANCING
+	vec4 rect = v_texture_rect;
+	float layer = v_texture_layer;
+#else
+	vec4 rect = u_texture_rect;
+	float layer = u_texture_layer;
+#endif
+	vec2 uv = rect.xy + v_uv * rect.zw;
+#ifdef USE_TEXTURE_ARRAY
+	FragColor = texture(u_texture, vec3(uv, layer));
+#else
+	FragColor = texture(u_texture, uv);
+#endif
 }
\ No newline at end of file
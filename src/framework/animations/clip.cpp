@@ -0,0 +1,155 @@
+#include "clip.h"
+
+#include <cmath>
+#include <algorithm>
+
+// interpolation helpers for every value type
+static vec3 interpolate(const vec3& a, const vec3& b, float t)
+{
+	return lerp(a, b, t);
+}
+
+static quat interpolate(const quat& a, const quat& b, float t)
+{
+	// take the shortest path
+	if (dot(a, b) < 0.0f)
+		return nlerp(a, -b, t);
+	return nlerp(a, b, t);
+}
+
+static vec3 hermite(float t, const vec3& p1, const vec3& s1, const vec3& p2, const vec3& s2)
+{
+	float tt = t * t;
+	float ttt = tt * t;
+	float h1 = 2.0f * ttt - 3.0f * tt + 1.0f;
+	float h2 = -2.0f * ttt + 3.0f * tt;
+	float h3 = ttt - 2.0f * tt + t;
+	float h4 = ttt - tt;
+	return p1 * h1 + p2 * h2 + s1 * h3 + s2 * h4;
+}
+
+static quat hermite(float t, const quat& p1, const quat& s1, const quat& _p2, const quat& s2)
+{
+	float tt = t * t;
+	float ttt = tt * t;
+	float h1 = 2.0f * ttt - 3.0f * tt + 1.0f;
+	float h2 = -2.0f * ttt + 3.0f * tt;
+	float h3 = ttt - 2.0f * tt + t;
+	float h4 = ttt - tt;
+	quat p2 = dot(p1, _p2) < 0.0f ? -_p2 : _p2;
+	return normalized(p1 * h1 + p2 * h2 + s1 * h3 + s2 * h4);
+}
+
+template<typename T>
+int Track<T>::frame_index(float time) const
+{
+	// binary search, keys are sorted by time
+	std::vector<float>::const_iterator it = std::upper_bound(times.begin(), times.end(), time);
+	return std::max(0, (int)(it - times.begin()) - 1);
+}
+
+template<typename T>
+T Track<T>::sample(float time) const
+{
+	unsigned int num_keys = size();
+	if (num_keys == 0)
+		return T();
+	if (num_keys == 1 || time <= times.front())
+		return value(0);
+	if (time >= times.back())
+		return value(num_keys - 1);
+
+	int key = frame_index(time);
+	float delta = times[key + 1] - times[key];
+	float t = delta > 0.0f ? (time - times[key]) / delta : 0.0f;
+
+	switch (interpolation)
+	{
+	case INTERPOLATION_CONSTANT:
+		return value(key);
+	case INTERPOLATION_CUBIC:
+		// tangents are stored scaled by time, glTF style
+		return hermite(t, values[key * 3 + 1], values[key * 3 + 2] * delta, values[(key + 1) * 3 + 1], values[(key + 1) * 3] * delta);
+	default:
+		return interpolate(value(key), value(key + 1), t);
+	}
+}
+
+template class Track<vec3>;
+template class Track<quat>;
+
+float TransformTrack::get_start_time() const
+{
+	float start = 1e10f;
+	if (position.size()) start = std::min(start, position.get_start_time());
+	if (rotation.size()) start = std::min(start, rotation.get_start_time());
+	if (scale.size()) start = std::min(start, scale.get_start_time());
+	return start;
+}
+
+float TransformTrack::get_end_time() const
+{
+	float end = -1e10f;
+	if (position.size()) end = std::max(end, position.get_end_time());
+	if (rotation.size()) end = std::max(end, rotation.get_end_time());
+	if (scale.size()) end = std::max(end, scale.get_end_time());
+	return end;
+}
+
+Transform TransformTrack::sample(const Transform& reference, float time) const
+{
+	Transform result = reference;
+	if (position.size())
+		result.position = position.sample(time);
+	if (rotation.size())
+		result.rotation = rotation.sample(time);
+	if (scale.size())
+		result.scale = scale.sample(time);
+	return result;
+}
+
+void Clip::recalculate_duration()
+{
+	start_time = 0.0f;
+	end_time = 0.0f;
+	bool first = true;
+	for (unsigned int i = 0; i < tracks.size(); ++i)
+	{
+		float start = tracks[i].get_start_time();
+		float end = tracks[i].get_end_time();
+		if (end < start)
+			continue; // empty track
+		start_time = first ? start : std::min(start_time, start);
+		end_time = first ? end : std::max(end_time, end);
+		first = false;
+	}
+}
+
+float Clip::adjust_time(float time) const
+{
+	float duration = get_duration();
+	if (duration <= 0.0f)
+		return start_time;
+
+	if (looping)
+	{
+		time = fmodf(time - start_time, duration);
+		if (time < 0.0f)
+			time += duration;
+		return time + start_time;
+	}
+	return std::clamp(time, start_time, end_time);
+}
+
+float Clip::sample(Pose& pose, float time) const
+{
+	time = adjust_time(time);
+	for (unsigned int i = 0; i < tracks.size(); ++i)
+	{
+		unsigned int joint = tracks[i].joint_id;
+		if (joint >= pose.size())
+			continue;
+		pose.set_local_transform(joint, tracks[i].sample(pose.get_local_transform(joint), time));
+	}
+	return time;
+}
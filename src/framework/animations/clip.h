@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include "pose.h"
+
+enum eInterpolation {
+	INTERPOLATION_CONSTANT, // step
+	INTERPOLATION_LINEAR,
+	INTERPOLATION_CUBIC // hermite spline, every key stores in tangent, value and out tangent
+};
+
+// Keyframes of a single property (position, rotation or scale) of a joint
+template<typename T>
+class Track
+{
+public:
+	eInterpolation interpolation = INTERPOLATION_LINEAR;
+	std::vector<float> times;
+	std::vector<T> values; // one per key (three per key if cubic)
+
+	unsigned int size() const { return (unsigned int)times.size(); }
+	float get_start_time() const { return times.size() ? times.front() : 0.0f; }
+	float get_end_time() const { return times.size() ? times.back() : 0.0f; }
+
+	// Get the value of the track at the given time (clamped to the track range)
+	T sample(float time) const;
+
+protected:
+	// Get the index of the last key before time
+	int frame_index(float time) const;
+	T value(unsigned int key) const { return interpolation == INTERPOLATION_CUBIC ? values[key * 3 + 1] : values[key]; }
+};
+
+// All the tracks that animate one joint
+struct TransformTrack
+{
+	unsigned int joint_id = 0;
+	Track<vec3> position;
+	Track<quat> rotation;
+	Track<vec3> scale;
+
+	float get_start_time() const;
+	float get_end_time() const;
+	// Overwrites in the transform the properties that are animated
+	Transform sample(const Transform& reference, float time) const;
+};
+
+// Animation clip: a set of transform tracks over time
+class Clip
+{
+public:
+	std::string name;
+	std::vector<TransformTrack> tracks;
+	float start_time = 0.0f;
+	float end_time = 0.0f;
+	bool looping = true;
+
+	float get_duration() const { return end_time - start_time; }
+	// Recompute the start and end time from the tracks
+	void recalculate_duration();
+	// Wrap (looping) or clamp the time to the clip range
+	float adjust_time(float time) const;
+	// Write the animated joints in the pose, returns the adjusted time
+	float sample(Pose& pose, float time) const;
+};
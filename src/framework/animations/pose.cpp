@@ -87,4 +87,15 @@ std::vector<mat4> Pose::get_global_matrices()
 	}
 
 	return out;
-}
\ No newline at end of file
+}
+
+// interpolate every local transform, the parents are taken from the target pose
+void Pose::blend(const Pose& from, const Pose& to, float t)
+{
+	unsigned int num_joints = (unsigned int)to.joints.size();
+	resize(num_joints);
+	for (unsigned int i = 0; i < num_joints; i++) {
+		parents[i] = to.parents[i];
+		joints[i] = i < from.joints.size() ? mix(from.joints[i], to.joints[i], t) : to.joints[i];
+	}
+}
@@ -35,4 +35,7 @@ public:
 	// Get the global transformation matrix (world space) of a specific joint 
 	mat4 get_global_matrix(unsigned int id);
 	Transform operator[](unsigned int index);
+
+	// Set the pose as the local interpolation of two poses of the same skeleton (t = 0 is from, t = 1 is to)
+	void blend(const Pose& from, const Pose& to, float t);
 };
\ No newline at end of file
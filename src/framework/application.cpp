@@ -5,6 +5,10 @@
 #include "animations/pose.h"
 #include "animations/skeleton.h"
 
+#include "graphics/uniform_buffer.h"
+
+#include <algorithm>
+
 Camera* Application::camera = nullptr;
 Application* Application::instance;
 
@@ -16,6 +20,15 @@ void Application::init(GLFWwindow* window)
 
     flag_grid = true;
     flag_wireframe = false;
+    flag_culling = true;
+
+    // start compiling every permutation of the material shaders, the materials draw with a flat shader until theirs are ready
+    Shader::precompile("res/shaders/basic.vs", "res/shaders/flat.fs", SHADER_FEATURE_INSTANCING);
+    Shader::precompile("res/shaders/basic.vs", "res/shaders/normal.fs", SHADER_FEATURE_INSTANCING);
+    Shader::precompile("res/shaders/basic.vs", "res/shaders/texture.fs", SHADER_FEATURE_INSTANCING | SHADER_FEATURE_TEXTURE_ARRAY);
+
+    // the shaders using a file are reloaded when it is saved
+    Shader::watch_folder("res/shaders");
 
     // Create camera
     camera = new Camera();
@@ -32,27 +45,30 @@ void Application::init(GLFWwindow* window)
     
     */
 
+    // loaded in the background, the spheres are drawn once it is uploaded
+    MeshHandle sphere = Mesh::get_async("res/meshes/sphere.obj");
+
     // Add spheres for quaternion demo
     Entity* dot_ent = new Entity("Dot Sphere");
-    dot_ent->mesh = Mesh::get("res/meshes/sphere.obj");
+    dot_ent->mesh = sphere.get_mesh();
     dot_ent->material = new FlatMaterial();
     dot_ent->set_transform(Transform(vec3(-3.f, 0.f, 0.f), quat(), vec3(1.f)));
     entity_list.push_back(dot_ent);
 
     Entity* cross_ent = new Entity("Cross Sphere");
-    cross_ent->mesh = Mesh::get("res/meshes/sphere.obj");
+    cross_ent->mesh = sphere.get_mesh();
     cross_ent->material = new NormalMaterial();
     cross_ent->set_transform(Transform(vec3(-1.f, 0.f, 0.f), quat(), vec3(1.f)));
     entity_list.push_back(cross_ent);
 
     Entity* quat_ent = new Entity("Quat Sphere");
-    quat_ent->mesh = Mesh::get("res/meshes/sphere.obj");
+    quat_ent->mesh = sphere.get_mesh();
     quat_ent->material = new NormalMaterial();
     quat_ent->set_transform(Transform(vec3(1.f, 0.f, 0.f), quat(), vec3(1.f)));
     entity_list.push_back(quat_ent);
 
     Entity* lerp_ent = new Entity("Lerp Sphere");
-    lerp_ent->mesh = Mesh::get("res/meshes/sphere.obj");
+    lerp_ent->mesh = sphere.get_mesh();
     lerp_ent->material = new FlatMaterial();
     lerp_ent->set_transform(Transform(vec3(8.f, 0.f, 0.f), quat(), vec3(1.f)));
     entity_list.push_back(lerp_ent);
@@ -86,22 +102,33 @@ void Application::init(GLFWwindow* window)
 
     LineHelper* quat_l7 = new LineHelper(vec3(1.f, 0.f, 0.f), vec3(0.f, 0.f, 1.f));
     entity_list.push_back(quat_l7);
+
+    // looked up once, the handle is resolved every frame
+    lerp_sphere = EntityRegistry::get()->find("Lerp Sphere");
+
+    // the plain and skinned entities are drawn by the store, the helpers keep their own render
+    for (unsigned int i = 0; i < entity_list.size(); i++) {
+        entity_store.import(entity_list[i]);
+    }
 }
 
 void Application::update(float dt)
 {
-    float curr_time = glfwGetTime();
+    // worlds of the previous step, render interpolates from them
+    TransformHierarchy::get()->save_previous();
+
+    simulation_time += dt;
+    float curr_time = (float)simulation_time;
     float t = (sin(curr_time) + 1.0f) * 0.5f; // t oscila entre 0 y 1
 
     vec3 start_pos(-3.f, 0.f, 0.f);
     vec3 end_pos(3.f, 0.f, 0.f);
 
     // Aplicar interpolacin lineal a la posicin de la sphere
-    for (auto& entity : entity_list) {
-        if (entity->name == "Lerp Sphere") {
-            vec3 interpolated_pos = lerp(start_pos, end_pos, t);
-            entity->set_transform(Transform(interpolated_pos, quat(), vec3(1.f)));
-        }
+    Entity* lerp_entity = EntityRegistry::get()->resolve(lerp_sphere);
+    if (lerp_entity) {
+        vec3 interpolated_pos = lerp(start_pos, end_pos, t);
+        lerp_entity->set_transform(Transform(interpolated_pos, quat(), vec3(1.f)));
     }
 
     // Actualizar entidades de la escena
@@ -109,7 +136,20 @@ void Application::update(float dt)
         entity_list[i]->update(dt);
     }
 
+    // world matrices of the entities that moved (or whose parent moved)
+    TransformHierarchy::get()->update();
+
+    // systems of the store, linear passes over its components
+    entity_store.sync_imported();
+    entity_store.update_animators();
+    entity_store.update_transforms();
+    entity_store.update_bounds();
+
+    // refit the moved entities in the scene tree
+    update_scene_tree();
+
     // Mouse update
+    previous_camera = { camera->eye, camera->center, camera->up };
     vec2 delta = last_mouse_position - mouse_position;
     if (orbiting) {
         camera->orbit(-delta.x * dt, delta.y * dt);
@@ -118,6 +158,7 @@ void Application::update(float dt)
         camera->move(vec2(delta.x * dt, -delta.y * dt));
     }
     last_mouse_position = mouse_position;
+    step_camera = { camera->eye, camera->center, camera->up };
 }
 
 
@@ -133,15 +174,227 @@ void Application::render()
     glEnable(GL_CULL_FACE); // render both sides of every triangle
     glEnable(GL_DEPTH_TEST); // check the occlusions using the Z buffer
 
+    // the camera between the last two steps too, only what the steps moved so the changes outside update (the scroll) stay
+    sCameraState camera_state = { camera->eye, camera->center, camera->up };
+    if (interpolation_alpha < 1.0f) {
+        float t = 1.0f - interpolation_alpha;
+        camera->look_at(camera->eye - (step_camera.eye - previous_camera.eye) * t,
+            camera->center - (step_camera.center - previous_camera.center) * t,
+            normalized(camera->up - (step_camera.up - previous_camera.up) * t));
+    }
+
+    // camera and time for every shader with the FrameBlock, bound once for the whole frame
+    // the time is the simulation one between the last two steps, like the transforms
+    double render_time = simulation_time - (1.0 - interpolation_alpha) / simulation_hz;
+    UniformBuffer::update_frame_uniforms(camera, (float)render_time);
+
+    // transforms between the last two simulation steps (the skinned entities and the skeletons blend their poses in render)
+    TransformHierarchy::get()->begin_interpolation(interpolation_alpha);
+    if (interpolation_alpha < 1.0f) {
+        entity_store.update_transforms();
+        entity_store.update_bounds();
+        // the tree and proxy_bounds get the interpolated bounds, so the culling tests what is drawn
+        update_scene_tree();
+    }
+
+    // skip the entities outside the camera, the store ones included
+    cull_entities();
+    entity_store.update_skinning(interpolation_alpha);
+
+    render_queue.begin(camera);
     for (unsigned int i = 0; i < entity_list.size(); i++)
     {         
         entity_list[i]->render(camera);        
     }
+    num_visible_store_entities = entity_store.submit(&render_queue, camera);
+    render_queue.flush();
+
+    // highlight the picked entity
+    Entity* selected = EntityRegistry::get()->resolve(selected_entity);
+    if (selected && selected->mesh) {
+        mat4 model = selected->get_world_model();
+        selected->mesh->render_bounding(model);
+    }
+    TransformHierarchy::get()->end_interpolation();
+    if (interpolation_alpha < 1.0f) {
+        camera->look_at(camera_state.eye, camera_state.center, camera_state.up);
+    }
 
     // Draw the floor grid
     if (flag_grid) draw_grid();
 }
 
+void Application::update_scene_tree()
+{
+    // walk the whole hierarchy, the children of hidden entities are not rendered either
+    std::vector<std::pair<Entity*, bool>> stack;
+    for (size_t i = entity_list.size(); i > 0; --i) {
+        stack.push_back(std::make_pair(entity_list[i - 1], false));
+    }
+
+    while (!stack.empty())
+    {
+        Entity* entity = stack.back().first;
+        bool hidden = stack.back().second || !entity->flag_visible;
+        stack.pop_back();
+
+        // the store already has the bounds of the entities it imported
+        sEntityBounds bounds;
+        bool has_bounds = false;
+        sBoundsComponent* store_bounds = entity->store_id != ENTITY_NONE ? entity_store.bounds.get(entity->store_id) : nullptr;
+        if (!hidden && store_bounds) {
+            has_bounds = store_bounds->valid;
+            bounds.box = store_bounds->box;
+            bounds.sphere_center = store_bounds->sphere_center;
+            bounds.sphere_radius = store_bounds->sphere_radius;
+        }
+        else if (!hidden) {
+            has_bounds = entity->get_world_bounds(bounds.box, bounds.sphere_center, bounds.sphere_radius);
+        }
+        if (has_bounds) {
+            // only reinserted when it leaves its fat box
+            if (entity->tree_proxy < 0) {
+                entity->tree_proxy = scene_tree.insert(bounds.box, entity);
+            }
+            else {
+                scene_tree.update(entity->tree_proxy, bounds.box);
+            }
+            if (proxy_bounds.size() < scene_tree.nodes.size()) {
+                proxy_bounds.resize(scene_tree.nodes.size());
+            }
+            proxy_bounds[entity->tree_proxy] = bounds;
+        }
+        else if (entity->tree_proxy >= 0) {
+            scene_tree.remove(entity->tree_proxy);
+            entity->tree_proxy = -1;
+        }
+
+        for (size_t i = entity->children.size(); i > 0; --i) {
+            stack.push_back(std::make_pair(entity->children[i - 1], hidden));
+        }
+    }
+}
+
+void Application::remove_entity(Entity* entity)
+{
+    if (entity->tree_proxy >= 0) {
+        scene_tree.remove(entity->tree_proxy);
+        entity->tree_proxy = -1;
+    }
+    if (entity->store_id != ENTITY_NONE) {
+        entity_store.destroy(entity->store_id);
+    }
+    entity_list.erase(std::remove(entity_list.begin(), entity_list.end(), entity), entity_list.end());
+}
+
+void Application::set_culled(Entity* entity, bool culled)
+{
+    entity->flag_culled = culled;
+    if (entity->store_id != ENTITY_NONE) {
+        sBoundsComponent* bounds = entity_store.bounds.get(entity->store_id);
+        if (bounds) bounds->culled = culled;
+    }
+}
+
+void Application::cull_entities()
+{
+    // everything in the tree starts culled
+    for (size_t i = 0; i < scene_tree.nodes.size(); i++) {
+        const sAABBTreeNode& node = scene_tree.nodes[i];
+        if (node.height == 0) {
+            set_culled((Entity*)node.user_data, flag_culling);
+        }
+    }
+
+    num_visible_entities = scene_tree.get_num_proxies();
+    num_culled_entities = 0;
+    if (!flag_culling) return;
+
+    culling_inside.clear();
+    culling_intersect.clear();
+    Frustum frustum(camera->viewprojection_matrix);
+    scene_tree.query_frustum(frustum, culling_inside, culling_intersect);
+
+    for (size_t i = 0; i < culling_inside.size(); i++) {
+        set_culled((Entity*)scene_tree.get_user_data(culling_inside[i]), false);
+    }
+
+    // the leaves in the border of the frustum are tested with their tight bounds
+    culling_bounds.clear();
+    for (size_t i = 0; i < culling_intersect.size(); i++) {
+        const sEntityBounds& bounds = proxy_bounds[culling_intersect[i]];
+        culling_bounds.add(bounds.box, bounds.sphere_center, bounds.sphere_radius);
+    }
+    size_t num_visible = culling_bounds.cull(frustum, culling_visible);
+    for (size_t i = 0; i < culling_intersect.size(); i++) {
+        set_culled((Entity*)scene_tree.get_user_data(culling_intersect[i]), !culling_visible[i]);
+    }
+
+    num_visible_entities = (unsigned int)(culling_inside.size() + num_visible);
+    num_culled_entities = scene_tree.get_num_proxies() - num_visible_entities;
+}
+
+Entity* Application::pick_entity(const vec2& screen_position, vec3* hit_position)
+{
+    // ray from the near to the far plane under the cursor
+    float x = 2.f * screen_position.x / window_width - 1.f;
+    float y = 1.f - 2.f * screen_position.y / window_height;
+    mat4 inv_viewprojection = inverse(camera->viewprojection_matrix);
+    vec4 near_point = inv_viewprojection * vec4(x, y, -1.f, 1.f);
+    vec4 far_point = inv_viewprojection * vec4(x, y, 1.f, 1.f);
+    vec3 origin = vec3(near_point.x, near_point.y, near_point.z) / near_point.w;
+    vec3 direction = vec3(far_point.x, far_point.y, far_point.z) / far_point.w - origin;
+    float max_distance = sqrtf(dot(direction, direction));
+    direction = direction / max_distance;
+    vec3 inv_direction(1.f / direction.x, 1.f / direction.y, 1.f / direction.z);
+
+    Entity* closest = nullptr;
+    vec3 closest_hit;
+    scene_tree.query_ray(origin, direction, max_distance, [&](int proxy, float max_hit_distance) {
+        const BoundingBox& box = proxy_bounds[proxy].box;
+        float distance;
+        if (!ray_box_intersection(origin, inv_direction, box.center - box.halfsize, box.center + box.halfsize, max_hit_distance, distance)) {
+            return max_hit_distance;
+        }
+
+        // exact test against the triangles
+        Entity* entity = (Entity*)scene_tree.get_user_data(proxy);
+        mat4 model = entity->get_world_model();
+        vec3 hit, normal;
+        if (!entity->mesh->test_ray_collision(model, origin, direction, hit, normal, max_hit_distance)) {
+            return max_hit_distance;
+        }
+        closest = entity;
+        closest_hit = hit;
+        return sqrtf(dot(hit - origin, hit - origin));
+    });
+
+    if (closest && hit_position) {
+        *hit_position = closest_hit;
+    }
+    return closest;
+}
+
+void Application::query_entities(const BoundingBox& box, std::vector<Entity*>& result)
+{
+    std::vector<int> proxies;
+    scene_tree.query_overlap(box, proxies);
+
+    vec3 box_min = box.center - box.halfsize;
+    vec3 box_max = box.center + box.halfsize;
+    for (size_t i = 0; i < proxies.size(); i++) {
+        // the tree leaves are fat, check the real bounds
+        const BoundingBox& bounds = proxy_bounds[proxies[i]].box;
+        vec3 bounds_min = bounds.center - bounds.halfsize;
+        vec3 bounds_max = bounds.center + bounds.halfsize;
+        if (bounds_min.x <= box_max.x && bounds_max.x >= box_min.x &&
+            bounds_min.y <= box_max.y && bounds_max.y >= box_min.y &&
+            bounds_min.z <= box_max.z && bounds_max.z >= box_min.z) {
+            result.push_back((Entity*)scene_tree.get_user_data(proxies[i]));
+        }
+    }
+}
+
 void Application::render_gui()
 {
     if (ImGui::TreeNodeEx("Scene", ImGuiTreeNodeFlags_DefaultOpen))
@@ -151,6 +404,11 @@ void Application::render_gui()
             ImGui::TreePop();
         }
 
+        ImGui::Text("Scene tree: %d entities, height %d", scene_tree.get_num_proxies(), scene_tree.get_height());
+        ImGui::Text("Entity store: %d entities, %d visible", (int)entity_store.get_num_entities(), num_visible_store_entities);
+        Entity* selected = EntityRegistry::get()->resolve(selected_entity);
+        ImGui::Text("Selected: %s", selected ? selected->name.c_str() : "none");
+
         unsigned int count = 0;
         std::stringstream ss;
         for (auto& node : entity_list) {
@@ -206,6 +464,8 @@ void Application::on_left_mouse_down()
 {
     orbiting = true;
     last_mouse_position = mouse_position;
+    Entity* picked = pick_entity(mouse_position);
+    selected_entity = picked ? picked->handle : EntityHandle();
 }
 
 void Application::on_left_mouse_up()
@@ -6,6 +6,25 @@
 
 #include "camera.h"
 #include "framework/entity.h"
+#include "graphics/culling.h"
+#include "graphics/aabb_tree.h"
+#include "graphics/render_queue.h"
+
+// tight world bounds of an entity in the scene tree (the leaves of the tree are bigger)
+struct sEntityBounds
+{
+	BoundingBox box;
+	vec3 sphere_center;
+	float sphere_radius;
+};
+
+// the camera at one simulation step
+struct sCameraState
+{
+	vec3 eye;
+	vec3 center;
+	vec3 up;
+};
 
 class Application
 {
@@ -20,16 +39,57 @@ public:
 
 	bool flag_grid;
 	bool flag_wireframe;
+	bool flag_culling;
+
+	// fixed step simulation, main_loop calls update at simulation_hz and render interpolates the last two steps
+	bool flag_fixed_step = true;
+	float simulation_hz = 60.0f;
+	int max_simulation_steps = 5; // per frame, the rest of a hitch is dropped
+	float interpolation_alpha = 1.0f; // from the previous (0) to the last step (1)
+	double simulation_time = 0.0; // sum of the steps, used instead of the clock in update
+	unsigned int num_simulation_steps = 0; // in the last frame
+	sCameraState previous_camera; // before the last step moved it
+	sCameraState step_camera; // after the last step, render interpolates the orbit from previous_camera
+
+	// draw items of the frame, sorted by state
+	RenderQueue render_queue;
+
+	// dense components of the plain and skinned entities (imported from entity_list), updated and drawn by its systems
+	// their culling is done once, by the scene tree
+	EntityStore entity_store;
+	unsigned int num_visible_store_entities = 0;
+
+	// spatial structure of the scene, refit in update
+	AABBTree scene_tree;
+	std::vector<sEntityBounds> proxy_bounds; // indexed by the proxy of the entity
+
+	// frustum culling, the tree accepts or rejects whole branches and the rest is tested in a batch
+	std::vector<int> culling_inside;
+	std::vector<int> culling_intersect;
+	CullingBounds culling_bounds;
+	std::vector<uint8_t> culling_visible;
+	unsigned int num_visible_entities = 0;
+	unsigned int num_culled_entities = 0;
 
 	bool close = false;
 	bool orbiting;
 	bool moving_2D;
+	EntityHandle selected_entity; // picked with the mouse, null if it was destroyed
+	EntityHandle lerp_sphere; // animated in update
 	vec2 mouse_position;
 	vec2 last_mouse_position;
 
 	void init(GLFWwindow* window);
 	void update(float dt);
 	void render();
+	void update_scene_tree();
+	void cull_entities();
+	void set_culled(Entity* entity, bool culled); // and the bounds in the store of the imported ones
+	void remove_entity(Entity* entity); // the scene tree, the store and the list forget it, called by ~Entity
+
+	// scene queries
+	Entity* pick_entity(const vec2& screen_position, vec3* hit_position = nullptr);
+	void query_entities(const BoundingBox& box, std::vector<Entity*>& result);
 	void render_gui();
 	void shut_down();
 
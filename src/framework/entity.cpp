@@ -13,8 +13,9 @@ unsigned int Entity::name_id_counter = 0;
 
 Entity::Entity(const char* _name)
 {
-	if (_name && *_name) { name = _name; }
-	else { name = "Entity_" + std::to_string(++name_id_counter); }
+	handle = EntityRegistry::get()->add(this);
+	if (_name && *_name) { set_name(_name); }
+	else { set_name("Entity_" + std::to_string(++name_id_counter)); }
 
 	flag_visible = true;
 	flag_update = false;
@@ -25,20 +26,48 @@ Entity::Entity(const char* _name)
 	gui_rotation = vec3();
 
 	children.resize(0);
+	transform_node = TransformHierarchy::get()->create();
+}
+
+Entity::~Entity()
+{
+	//nothing keeps the raw pointer: the parent, the children, the scene tree and the store forget it
+	if (parent) {
+		std::vector<Entity*>& siblings = parent->children;
+		siblings.erase(std::remove(siblings.begin(), siblings.end(), this), siblings.end());
+	}
+	for (size_t i = 0; i < children.size(); i++) {
+		children[i]->set_parent(nullptr);
+	}
+	if (Application::instance) {
+		Application::instance->remove_entity(this);
+	}
+
+	TransformHierarchy::get()->destroy(transform_node);
+	EntityRegistry::get()->remove(handle);
 }
 
 void Entity::render(Camera* camera)
 {
 	if (flag_visible) {
-		if (material) {
+		if (material && !flag_culled && store_id == ENTITY_NONE) {
 			Uniforms uniforms;
 			uniforms.camera = camera;
-			uniforms.model = model;
+			uniforms.model = get_world_model();
 
-			if (parent) {
-				uniforms.model = model * parent->model;
-			} 
-			material->render(mesh, uniforms);			
+			// pick the level of detail from the size on screen
+			if (mesh) {
+				lod = mesh->select_lod(uniforms.model, camera, lod);
+				uniforms.lod = lod;
+			}
+
+			// sorted and drawn later with the rest of the scene
+			if (RenderQueue::current) {
+				RenderQueue::current->submit(mesh, material, uniforms.model, lod);
+			}
+			else {
+				material->render(mesh, uniforms);
+			}
 		}
 
 		if (children.size() > 0) {
@@ -49,6 +78,17 @@ void Entity::render(Camera* camera)
 	}
 }
 
+bool Entity::get_world_bounds(BoundingBox& box, vec3& sphere_center, float& sphere_radius)
+{
+	// not in the scene tree till its mesh is loaded
+	if (!mesh || !material || !mesh->is_ready())
+		return false;
+
+	// same model used in render
+	get_mesh_world_bounds(mesh, get_world_model(), box, sphere_center, sphere_radius);
+	return true;
+}
+
 void Entity::update(float dt)
 {
 	if (children.size() > 0) {
@@ -75,6 +115,7 @@ void Entity::render_gui()
 		if (changed) {
 			transform.rotation = euler_to_quat(gui_rotation.x * QUAT_DEG2RAD, gui_rotation.y * QUAT_DEG2RAD, gui_rotation.z * QUAT_DEG2RAD);
 			model = transform_to_mat4(transform);
+			TransformHierarchy::get()->set_local(transform_node, model);
 		}
 
 		ImGui::TreePop();
@@ -107,6 +148,14 @@ mat4 Entity::get_model()
 	return model;
 }
 
+const mat4& Entity::get_world_model()
+{
+	if (parent && !flag_apply_parent_transform)
+		return model;
+	// the roots too, their world is interpolated between simulation steps
+	return TransformHierarchy::get()->get_world(transform_node);
+}
+
 Transform Entity::get_transform()
 {
 	return transform;
@@ -116,6 +165,7 @@ void Entity::set_model(const mat4& m)
 {
 	model = m;
 	transform = mat4_to_transform(m);
+	TransformHierarchy::get()->set_local(transform_node, model);
 
 	// also update the gui information
 	gui_rotation = quat_to_euler(transform.rotation);
@@ -125,6 +175,7 @@ void Entity::set_transform(const Transform& t)
 {
 	transform = t;
 	model = transform_to_mat4(t);
+	TransformHierarchy::get()->set_local(transform_node, model);
 
 	// also update the gui information
 	gui_rotation = quat_to_euler(transform.rotation);
@@ -133,14 +184,26 @@ void Entity::set_transform(const Transform& t)
 void Entity::set_children(std::vector<Entity*> entities)
 {
 	for(unsigned int i = 0; i < entities.size(); i++) {
-		entities[i]->parent = this;
+		entities[i]->set_parent(this);
 	}
 	children = entities;
 }
 
+void Entity::set_parent(Entity* parent)
+{
+	this->parent = parent;
+	TransformHierarchy::get()->set_parent(transform_node, parent ? parent->transform_node : -1);
+}
+
+void Entity::set_name(const std::string& name)
+{
+	this->name = name;
+	EntityRegistry::get()->set_name(handle, name);
+}
+
 LineHelper::LineHelper(vec3 origin, vec3 end, const char* _name) : origin(origin), end(end), Entity(_name)
 {
-	if (!(_name && *_name)) { name = "LineHelper_" + std::to_string(name_id_counter); }
+	if (!(_name && *_name)) { set_name("LineHelper_" + std::to_string(name_id_counter)); }
 
 	color = vec4(1.f);
 
@@ -153,11 +216,18 @@ LineHelper::LineHelper(vec3 origin, vec3 end, const char* _name) : origin(origin
 	mesh->colors.push_back(vec4(color.x, color.y, color.z, color.w));
 	mesh->colors.push_back(vec4(color.x, color.y, color.z, color.w));
 
+	mesh->usage = MESH_USAGE_DYNAMIC; // edited from the gui
 	mesh->upload_to_vram();
 }
 
 void LineHelper::render(Camera* camera)
 {
+	// drawn on top, after the queued entities
+	if (RenderQueue::current) {
+		RenderQueue::current->defer([this, camera]() { render(camera); });
+		return;
+	}
+
 	WireframeMaterial mat = WireframeMaterial();
 	mat.color = vec4(color.x, color.y, color.z, color.w);
 	
@@ -167,7 +237,7 @@ void LineHelper::render(Camera* camera)
 		glDisable(GL_DEPTH_TEST);
 
 		//enable shader
-		mat.shader->enable();
+		mat.get_shader()->enable();
 
 		Uniforms uniforms;
 		uniforms.camera = camera;
@@ -193,7 +263,8 @@ void LineHelper::update(float dt)
 		mesh->vertices[1] = vec3(end.x + origin.x, end.y + origin.y, end.z + origin.z);
 		mesh->colors[0] = vec4(color.x, color.y, color.z, color.w);
 		mesh->colors[1] = vec4(color.x, color.y, color.z, color.w);
-		mesh->upload_to_vram();
+		mesh->update_stream(MESH_STREAM_VERTICES);
+		mesh->update_stream(MESH_STREAM_COLORS);
 		
 		flag_update = false;
 	}
@@ -216,7 +287,7 @@ void LineHelper::render_gui()
 
 SkeletonHelper::SkeletonHelper(Pose& current_pose, const char* _name) : Entity(_name)
 {
-	if (!(_name && *_name)) { name = "SkeletonHelper_" + std::to_string(name_id_counter); }
+	if (!(_name && *_name)) { set_name("SkeletonHelper_" + std::to_string(name_id_counter)); }
 	
 	pose = new Pose(current_pose);
 	color = vec4(1.f);
@@ -247,7 +318,7 @@ SkeletonHelper::SkeletonHelper(Pose& current_pose, const char* _name) : Entity(_
 
 SkeletonHelper::SkeletonHelper(Skeleton& skeleton, const char* _name) : Entity(_name)
 {
-	if (!(_name && *_name)) { name = "SkeletonHelper_" + std::to_string(name_id_counter); }
+	if (!(_name && *_name)) { set_name("SkeletonHelper_" + std::to_string(name_id_counter)); }
 
 	color = vec4(1.f);
 	flag_editable = true;
@@ -287,13 +358,28 @@ SkeletonHelper::~SkeletonHelper()
 
 void SkeletonHelper::render(Camera* camera)
 {
+	// drawn on top, after the queued entities
+	if (RenderQueue::current) {
+		RenderQueue::current->defer([this, camera]() { render(camera); });
+		return;
+	}
+
+	// between the last two steps, so the bones move as smooth as the entities
+	if (pose) {
+		float alpha = Application::instance ? Application::instance->interpolation_alpha : 1.0f;
+		if (alpha < 1.0f && last_pose.size() && previous_pose.size() == last_pose.size()) {
+			render_pose.blend(previous_pose, last_pose, alpha);
+			build_lines(render_pose);
+		}
+		else {
+			build_lines(*pose);
+		}
+	}
+
 	WireframeMaterial mat = WireframeMaterial();
 	mat.color = vec4(color.x, color.y, color.z, color.w);
 
-	mat4 model_mat = model;
-	if (parent && flag_apply_parent_transform) {
-		model_mat = model_mat * parent->get_model();
-	}
+	const mat4& model_mat = get_world_model();
 
 	if (flag_visible && mat.shader && mesh)	{
 		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
@@ -301,7 +387,7 @@ void SkeletonHelper::render(Camera* camera)
 		glDisable(GL_DEPTH_TEST);
 
 		//enable shader
-		mat.shader->enable();
+		mat.get_shader()->enable();
 
 		Uniforms uniforms;
 		uniforms.camera = camera;
@@ -322,12 +408,36 @@ void SkeletonHelper::render(Camera* camera)
 void SkeletonHelper::update(float dt) 
 {
 	if (pose) {
-		mesh->clear();
+		previous_pose = last_pose.size() ? last_pose : *pose;
+		last_pose = *pose;
+	}
+}
 
-		// ..
+void SkeletonHelper::build_lines(Pose& pose)
+{
+	// keep the GPU buffers, only the data changes
+	mesh->vertices.clear();
+	mesh->colors.clear();
+
+	std::vector<mat4> globals = pose.get_global_matrices();
+	for (unsigned int i = 0; i < globals.size(); i++) {
+		int parent_id = pose.get_parent(i);
+		if (parent_id < 0) continue;
+		mesh->vertices.push_back(vec3(globals[parent_id].data[12], globals[parent_id].data[13], globals[parent_id].data[14]));
+		mesh->vertices.push_back(vec3(globals[i].data[12], globals[i].data[13], globals[i].data[14]));
+		mesh->colors.push_back(color);
+		mesh->colors.push_back(color);
+	}
 
+	if (!mesh->vertices.size())
+		return;
+	if (!mesh->interleaved_vao_id) {
 		mesh->upload_to_vram();
 	}
+	else {
+		mesh->update_stream(MESH_STREAM_VERTICES);
+		mesh->update_stream(MESH_STREAM_COLORS);
+	}
 }
 
 void SkeletonHelper::set_pose(Pose* current_pose, bool editable)
@@ -336,8 +446,11 @@ void SkeletonHelper::set_pose(Pose* current_pose, bool editable)
 	pose = current_pose;
 	flag_editable = editable;
 	mesh = new Mesh();
-	
-	update(0.f);
+	mesh->usage = MESH_USAGE_STREAM; // rebuilt every frame
+
+	// no motion to blend from the previous pose
+	previous_pose = *pose;
+	last_pose = *pose;
 }
 
 
@@ -394,7 +507,7 @@ void SkeletonHelper::render_gui_bone(unsigned int id, Pose& pose, Bone bone)
 
 SkinnedEntity::SkinnedEntity(const char* _name) : Entity(_name)
 {
-	if (!(_name && *_name)) { name = "SkinnedEntity_" + std::to_string(name_id_counter); }
+	if (!(_name && *_name)) { set_name("SkinnedEntity_" + std::to_string(name_id_counter)); }
 	
 	flag_apply_bind_pose = false;
 }
@@ -402,16 +515,39 @@ SkinnedEntity::SkinnedEntity(const char* _name) : Entity(_name)
 void SkinnedEntity::render(Camera* camera)
 {
 	if (flag_visible) {
-		if (material) {
+		if (material && store_id == ENTITY_NONE) {
 			Uniforms uniforms;
 			uniforms.camera = camera;
-			uniforms.model = model;
-			
-			if (parent && flag_apply_parent_transform) {
-				uniforms.model = model * parent->get_model();
+			uniforms.model = get_world_model();
+
+			if (mesh) {
+				lod = mesh->select_lod(uniforms.model, camera, lod);
+				uniforms.lod = lod;
+			}
+
+			// skinned with the pose between the last two steps
+			if (skeleton && pose.size()) {
+				float alpha = Application::instance ? Application::instance->interpolation_alpha : 1.0f;
+				Pose* blended = &pose;
+				if (alpha < 1.0f && previous_pose.size() == pose.size()) {
+					render_pose.blend(previous_pose, pose, alpha);
+					blended = &render_pose;
+				}
+				std::vector<mat4>& inv_bind_pose = skeleton->get_inv_bind_pose();
+				skinning_matrices = blended->get_global_matrices();
+				for (unsigned int i = 0; i < skinning_matrices.size() && i < inv_bind_pose.size(); i++) {
+					skinning_matrices[i] = skinning_matrices[i] * inv_bind_pose[i];
+				}
+			}
+
+			// sorted and drawn later with the rest of the scene, the queue keeps a pointer to the matrices
+			if (RenderQueue::current) {
+				RenderQueue::current->submit(mesh, material, uniforms.model, lod, &skinning_matrices);
+			}
+			else {
+				uniforms.animated_matrices = skinning_matrices;
+				material->render(mesh, uniforms);
 			}
-			
-			material->render(mesh, uniforms);
 		}
 
 		if (children.size() > 0) {
@@ -434,11 +570,13 @@ void SkinnedEntity::update(float dt)
 		}
 	}
 
-	if (mesh && skeleton) {
-		Pose current_pose = skeleton->get_rest_pose();
-		if (parent && parent->as<SkinnedEntity>()->flag_apply_bind_pose) {
-			current_pose = skeleton->get_bind_pose();
-		}
+	// the imported ones are posed by the animator system of the store
+	if (mesh && skeleton && store_id == ENTITY_NONE) {
+		Pose& current_pose = uses_bind_pose() ? skeleton->get_bind_pose() : skeleton->get_rest_pose();
+
+		// the render blends from the pose of the previous step
+		previous_pose = pose.size() ? pose : current_pose;
+		pose = current_pose;
 
 		// CPU Skinning
 		// ..
@@ -451,6 +589,15 @@ void SkinnedEntity::update(float dt)
 	}
 }
 
+bool SkinnedEntity::uses_bind_pose()
+{
+	if (parent != cached_parent) {
+		cached_parent = parent;
+		skinned_parent = parent ? parent->as<SkinnedEntity>() : nullptr;
+	}
+	return skinned_parent && skinned_parent->flag_apply_bind_pose;
+}
+
 void SkinnedEntity::render_gui()
 {
 	Entity::render_gui();
@@ -483,7 +630,7 @@ void SkinnedEntity::set_skeleton(const Pose& rest, const Pose& bind, const std::
 {
 	skeleton = new Skeleton(rest, bind, names);
 	skeleton_helper = new SkeletonHelper(*skeleton, (name + "_helper").c_str());
-	skeleton_helper->parent = this;
+	skeleton_helper->set_parent(this);
 
 	for (unsigned int i = 0; i < children.size(); i++) {
 		children[i]->as<SkinnedEntity>()->skeleton = skeleton;
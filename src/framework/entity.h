@@ -5,6 +5,9 @@
 #include "graphics/shader.h"
 #include "graphics/mesh.h"
 #include "graphics/material.h"
+#include "transform_hierarchy.h"
+#include "entity_store.h"
+#include "entity_registry.h"
 
 #include "math/vec3.h"
 #include "math/vec4.h"
@@ -28,6 +31,8 @@ public:
 	bool flag_visible;
 	bool flag_update;
 	bool flag_apply_parent_transform;
+	bool flag_culled = false; //outside the camera frustum this frame, set by Application::cull_entities
+	int tree_proxy = -1; //leaf in Application::scene_tree, -1 if it is not in the tree
 
 	template <typename ChildEntity>
 	ChildEntity* as() {
@@ -36,22 +41,33 @@ public:
 
 	Mesh* mesh = nullptr;
 	Material* material = nullptr;
+	int lod = 0; //LOD used in the last frame
 
 	Entity* parent = nullptr;
 	std::vector<Entity*> children;
+	int transform_node = -1; //in TransformHierarchy::get(), keeps the model and the world matrix
+	EntityId store_id = ENTITY_NONE; //imported to an EntityStore, which draws it instead of render()
+	EntityHandle handle; //in EntityRegistry::get(), to keep references that survive the entity
 
 	Entity(const char* _name = nullptr);
+	virtual ~Entity();
 
 	virtual void render(Camera* camera);
 	virtual void update(float dt);
 	virtual void render_gui();
 
-	mat4 get_model();
+	//world AABB and bounding sphere of the mesh, false if the entity cannot be culled
+	virtual bool get_world_bounds(BoundingBox& box, vec3& sphere_center, float& sphere_radius);
+
+	mat4 get_model(); //local, relative to the parent
+	const mat4& get_world_model(); //parent world * model, cached till one of them changes (interpolated while rendering)
 	Transform get_transform();
 
 	void set_model(const mat4& m);
 	void set_transform(const Transform& t);
 	void set_children(std::vector<Entity*> children);
+	void set_parent(Entity* parent); //does not add it to the children
+	void set_name(const std::string& name); //also indexes it in the registry
 };
 
 class LineHelper : public Entity
@@ -70,6 +86,7 @@ public:
 	void render(Camera* camera);
 	void update(float dt);
 	void render_gui();
+	bool get_world_bounds(BoundingBox&, vec3&, float&) { return false; } //debug lines are always drawn
 };
 
 class SkeletonHelper : public Entity
@@ -87,6 +104,10 @@ public:
 
 	Pose* pose = nullptr;
 
+	//copies of the pose in the last two simulation steps, the render draws the blend (see Application::interpolation_alpha)
+	Pose previous_pose;
+	Pose last_pose;
+
 	SkeletonHelper(Pose& pose, const char* _name = nullptr);
 	SkeletonHelper(Skeleton& skeleton, const char* _name = nullptr);
 	~SkeletonHelper();
@@ -94,9 +115,14 @@ public:
 	void render(Camera* camera);
 	void update(float dt);
 	void render_gui();
+	bool get_world_bounds(BoundingBox&, vec3&, float&) { return false; }
 
 	void set_pose(Pose* pose, bool editable = true);
 	void render_gui_bone(unsigned int id, Pose& pose, Bone bone);
+
+private:
+	Pose render_pose; //blended this frame
+	void build_lines(Pose& pose); //one segment per bone, streamed every frame
 };
 
 class SkinnedEntity : public Entity
@@ -109,11 +135,24 @@ public:
 
 	std::vector<mat4> pose_mat_joint_space;
 
+	//the last two simulation steps, the render blends them (see Application::interpolation_alpha)
+	Pose pose;
+	Pose previous_pose;
+	std::vector<mat4> skinning_matrices; //of the blended pose (global * inverse bind pose), sent as u_animated
+
 	SkinnedEntity(const char* _name = nullptr);
 
 	void render(Camera* camera);
 	void update(float dt);
 	void render_gui();
+	bool get_world_bounds(BoundingBox&, vec3&, float&) { return false; } //the pose can move the vertices outside the bind box
 
 	void set_skeleton(const Pose& rest, const Pose& bind, const std::vector<std::string>& names);
+	bool uses_bind_pose(); //the skinned parent shows the bind pose
+
+private:
+	//the parent cast once, not every update
+	Entity* cached_parent = nullptr;
+	SkinnedEntity* skinned_parent = nullptr;
+	Pose render_pose; //blended this frame
 };
\ No newline at end of file
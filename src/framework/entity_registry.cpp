@@ -0,0 +1,115 @@
+#include "entity_registry.h"
+
+#include <cassert>
+#include <algorithm>
+
+EntityHandle EntityRegistry::add(Entity* entity)
+{
+	assert(entity);
+	uint32_t index;
+	if (free_indices.size())
+	{
+		index = free_indices.back();
+		free_indices.pop_back();
+	}
+	else
+	{
+		index = (uint32_t)entities.size();
+		entities.push_back(nullptr);
+		generations.push_back(0);
+		entity_names.push_back(NAME_NONE);
+	}
+	entities[index] = entity;
+	entity_names[index] = NAME_NONE;
+	num_entities++;
+
+	EntityHandle handle;
+	handle.index = index;
+	handle.generation = generations[index];
+	return handle;
+}
+
+void EntityRegistry::remove(EntityHandle handle)
+{
+	if (!resolve(handle))
+		return;
+
+	unlink_name(handle);
+
+	//a new generation makes the old handles stale
+	entities[handle.index] = nullptr;
+	entity_names[handle.index] = NAME_NONE;
+	generations[handle.index]++;
+	free_indices.push_back(handle.index);
+	num_entities--;
+}
+
+Entity* EntityRegistry::resolve(EntityHandle handle) const
+{
+	if (handle.index >= entities.size() || generations[handle.index] != handle.generation)
+		return nullptr;
+	return entities[handle.index];
+}
+
+NameId EntityRegistry::intern(const std::string& name)
+{
+	auto it = name_ids.find(name);
+	if (it != name_ids.end())
+		return it->second;
+
+	NameId id = (NameId)names.size();
+	names.push_back(name);
+	name_entities.push_back(std::vector<EntityHandle>());
+	name_ids[name] = id;
+	return id;
+}
+
+NameId EntityRegistry::find_name(const std::string& name) const
+{
+	auto it = name_ids.find(name);
+	return it != name_ids.end() ? it->second : NAME_NONE;
+}
+
+void EntityRegistry::set_name(EntityHandle handle, const std::string& name)
+{
+	if (!resolve(handle))
+		return;
+
+	unlink_name(handle);
+
+	NameId id = intern(name);
+	entity_names[handle.index] = id;
+	name_entities[id].push_back(handle);
+}
+
+void EntityRegistry::unlink_name(EntityHandle handle)
+{
+	NameId name = entity_names[handle.index];
+	if (name == NAME_NONE)
+		return;
+	std::vector<EntityHandle>& list = name_entities[name];
+	std::vector<EntityHandle>::iterator it = std::find(list.begin(), list.end(), handle);
+	if (it != list.end())
+		list.erase(it); //keeps the order, the last one named stays at the back
+	entity_names[handle.index] = NAME_NONE;
+}
+
+EntityHandle EntityRegistry::find(NameId name) const
+{
+	if (name >= name_entities.size() || name_entities[name].empty())
+		return EntityHandle();
+	return name_entities[name].back();
+}
+
+EntityHandle EntityRegistry::find(const std::string& name) const
+{
+	return find(find_name(name));
+}
+
+EntityRegistry* EntityRegistry::get()
+{
+	static EntityRegistry* registry = NULL;
+	if (!registry)
+		registry = new EntityRegistry();
+	return registry;
+}
@@ -0,0 +1,69 @@
+/*  Stable references to the entities: a handle is an index in the registry plus the generation of that slot,
+	so a handle to a destroyed entity resolves to nullptr instead of a dangling pointer, even if the slot is reused.
+	Names are interned once and indexed by a hash map, so the code that looks entities up by name (or keeps the
+	interned id) resolves them in O(1) instead of comparing the name of every entity.
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+
+class Entity;
+
+#define NAME_NONE 0xFFFFFFFFu
+
+typedef uint32_t NameId;
+
+struct EntityHandle
+{
+	uint32_t index = 0xFFFFFFFFu;
+	uint32_t generation = 0;
+
+	bool is_null() const { return index == 0xFFFFFFFFu; }
+	bool operator==(const EntityHandle& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const EntityHandle& other) const { return !(*this == other); }
+};
+
+class EntityRegistry
+{
+public:
+	EntityHandle add(Entity* entity);
+	void remove(EntityHandle handle); //the handles to it become stale
+
+	//nullptr if the handle is null or its entity was removed
+	Entity* resolve(EntityHandle handle) const;
+	bool is_valid(EntityHandle handle) const { return resolve(handle) != nullptr; }
+
+	//the same id for the same string, kept while the registry lives
+	NameId intern(const std::string& name);
+	NameId find_name(const std::string& name) const; //NAME_NONE if it was never interned
+	const std::string& get_name(NameId id) const { return names[id]; }
+
+	//with repeated names the last entity named wins, when it is removed or renamed the previous one is found again
+	void set_name(EntityHandle handle, const std::string& name);
+	EntityHandle find(NameId name) const;
+	EntityHandle find(const std::string& name) const;
+
+	size_t get_num_entities() const { return num_entities; }
+
+	//shared by the entities
+	static EntityRegistry* get();
+
+private:
+	//by index
+	std::vector<Entity*> entities;
+	std::vector<uint32_t> generations;
+	std::vector<NameId> entity_names;
+	std::vector<uint32_t> free_indices;
+	size_t num_entities = 0;
+
+	//by name id
+	std::vector<std::string> names;
+	std::vector<std::vector<EntityHandle>> name_entities; //every entity with the name, in the order they got it
+	std::unordered_map<std::string, NameId> name_ids;
+
+	void unlink_name(EntityHandle handle); //from the list of its current name
+};
@@ -0,0 +1,217 @@
+#include "entity_store.h"
+
+#include <typeinfo>
+
+#include "entity.h"
+#include "camera.h"
+#include "transform_hierarchy.h"
+#include "animations/skeleton.h"
+#include "graphics/material.h"
+#include "graphics/render_queue.h"
+
+EntityId EntityStore::create()
+{
+	EntityId id;
+	if (free_ids.size())
+	{
+		id = free_ids.back();
+		free_ids.pop_back();
+	}
+	else
+	{
+		id = (EntityId)alive.size();
+		alive.push_back(0);
+	}
+	alive[id] = 1;
+	num_alive++;
+	return id;
+}
+
+void EntityStore::destroy(EntityId id)
+{
+	if (!is_alive(id))
+		return;
+	transforms.remove(id);
+	renderers.remove(id);
+	bounds.remove(id);
+	animators.remove(id);
+
+	for (size_t i = 0; i < imported.size(); ++i)
+		if (imported[i].id == id)
+		{
+			Entity* entity = EntityRegistry::get()->resolve(imported[i].entity);
+			if (entity)
+				entity->store_id = ENTITY_NONE;
+			imported[i] = imported.back();
+			imported.pop_back();
+			break;
+		}
+
+	alive[id] = 0;
+	free_ids.push_back(id);
+	num_alive--;
+}
+
+void EntityStore::sync_imported()
+{
+	EntityRegistry* registry = EntityRegistry::get();
+	for (size_t i = 0; i < imported.size();)
+	{
+		Entity* entity = registry->resolve(imported[i].entity);
+		if (!entity)
+		{
+			destroy(imported[i].id); //moves the last one here
+			continue;
+		}
+
+		sMeshRendererComponent* renderer = renderers.get(imported[i].id);
+		renderer->mesh = entity->mesh;
+		renderer->material = entity->material;
+		//like Entity::render, the children of a hidden entity are not drawn either
+		renderer->visible = entity->flag_visible;
+		for (Entity* parent = entity->parent; parent && renderer->visible; parent = parent->parent)
+			renderer->visible = parent->flag_visible;
+
+		sSkinnedAnimatorComponent* animator = animators.get(imported[i].id);
+		if (animator)
+		{
+			SkinnedEntity* skinned = (SkinnedEntity*)entity; //only imported as an animator when it is one
+			animator->skeleton = skinned->skeleton;
+			animator->apply_bind_pose = skinned->uses_bind_pose();
+		}
+
+		//without the parent transform the world is the model, out of the hierarchy
+		sTransformComponent* transform = transforms.get(imported[i].id);
+		bool apply_parent = !entity->parent || entity->flag_apply_parent_transform;
+		transform->node = apply_parent ? entity->transform_node : -1;
+		if (!apply_parent)
+			transform->world = entity->get_world_model();
+		++i;
+	}
+}
+
+void EntityStore::update_animators()
+{
+	for (size_t i = 0; i < animators.size(); ++i)
+	{
+		sSkinnedAnimatorComponent& animator = animators.data[i];
+		if (!animator.skeleton)
+			continue;
+
+		//the render blends from the pose of the previous step
+		Pose& current = animator.apply_bind_pose ? animator.skeleton->get_bind_pose() : animator.skeleton->get_rest_pose();
+		animator.previous_pose = animator.pose.size() ? animator.pose : current;
+		animator.pose = current;
+	}
+}
+
+void EntityStore::update_transforms()
+{
+	TransformHierarchy* hierarchy = TransformHierarchy::get();
+	for (size_t i = 0; i < transforms.size(); ++i)
+	{
+		sTransformComponent& transform = transforms.data[i];
+		if (transform.node != -1)
+			transform.world = hierarchy->get_world(transform.node);
+	}
+}
+
+void EntityStore::update_bounds()
+{
+	for (size_t i = 0; i < bounds.size(); ++i)
+	{
+		EntityId id = bounds.owners[i];
+		sMeshRendererComponent* renderer = renderers.get(id);
+		sTransformComponent* transform = transforms.get(id);
+		sBoundsComponent& bound = bounds.data[i];
+		bound.valid = renderer && renderer->mesh && renderer->mesh->is_ready() && transform;
+		if (!bound.valid)
+			continue;
+
+		//same helper as Entity::get_world_bounds
+		get_mesh_world_bounds(renderer->mesh, transform->world, bound.box, bound.sphere_center, bound.sphere_radius);
+	}
+}
+
+void EntityStore::update_skinning(float alpha)
+{
+	for (size_t i = 0; i < animators.size(); ++i)
+	{
+		sSkinnedAnimatorComponent& animator = animators.data[i];
+		if (!animator.skeleton || !animator.pose.size())
+			continue;
+
+		Pose* blended = &animator.pose;
+		if (alpha < 1.0f && animator.previous_pose.size() == animator.pose.size())
+		{
+			animator.render_pose.blend(animator.previous_pose, animator.pose, alpha);
+			blended = &animator.render_pose;
+		}
+		std::vector<mat4>& inv_bind_pose = animator.skeleton->get_inv_bind_pose();
+		animator.matrices = blended->get_global_matrices();
+		for (size_t j = 0; j < animator.matrices.size() && j < inv_bind_pose.size(); ++j)
+			animator.matrices[j] = animator.matrices[j] * inv_bind_pose[j];
+	}
+}
+
+unsigned int EntityStore::submit(RenderQueue* queue, Camera* camera)
+{
+	unsigned int num_submitted = 0;
+	for (size_t i = 0; i < renderers.size(); ++i)
+	{
+		sMeshRendererComponent& renderer = renderers.data[i];
+		if (!renderer.visible || !renderer.mesh || !renderer.material)
+			continue;
+
+		EntityId id = renderers.owners[i];
+		sBoundsComponent* bound = bounds.get(id);
+		if (bound && bound->culled)
+			continue;
+		sTransformComponent* transform = transforms.get(id);
+		mat4 world = transform ? transform->world : mat4();
+
+		renderer.lod = renderer.mesh->select_lod(world, camera, renderer.lod);
+		sSkinnedAnimatorComponent* animator = animators.get(id);
+
+		if (queue)
+			queue->submit(renderer.mesh, renderer.material, world, renderer.lod, animator ? &animator->matrices : nullptr);
+		else
+		{
+			Uniforms uniforms;
+			uniforms.camera = camera;
+			uniforms.model = world;
+			uniforms.lod = renderer.lod;
+			if (animator)
+				uniforms.animated_matrices = animator->matrices;
+			renderer.material->render(renderer.mesh, uniforms);
+		}
+		num_submitted++;
+	}
+	return num_submitted;
+}
+
+void EntityStore::import(Entity* entity)
+{
+	bool plain = typeid(*entity) == typeid(Entity);
+	bool skinned = typeid(*entity) == typeid(SkinnedEntity) && ((SkinnedEntity*)entity)->skeleton;
+	if ((plain || skinned) && entity->store_id == ENTITY_NONE && entity->mesh && entity->material)
+	{
+		EntityId id = create();
+		sTransformComponent& transform = transforms.add(id);
+		transform.node = entity->transform_node;
+		transform.world = entity->get_world_model();
+		renderers.add(id);
+		//the pose can move the vertices outside the bind box, so the skinned ones are not culled (like SkinnedEntity)
+		if (plain)
+			bounds.add(id);
+		else
+			animators.add(id).skeleton = ((SkinnedEntity*)entity)->skeleton;
+
+		sImported entry = { id, entity->handle };
+		imported.push_back(entry);
+		entity->store_id = id;
+	}
+
+	for (size_t i = 0; i < entity->children.size(); ++i)
+		import(entity->children[i]);
+}
@@ -0,0 +1,146 @@
+/*  Data oriented storage for big scenes: the entities are only ids and their components live in dense arrays
+	(sparse sets), so the systems go through them linearly, without virtual calls or pointer chasing.
+	It lives next to the Entity tree: import() turns the plain Entity objects (mesh + material) and the skinned ones into
+	components that share their transform node, and the other subclasses (helpers...) keep their virtual update and render.
+	The imported entities are referenced by EntityHandle, the components of a destroyed one are removed in sync_imported.
+	The culling is done by the scene tree of the Application, which reads the bounds of the store and writes back culled.
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cassert>
+
+#include "math/mat4.h"
+#include "graphics/mesh.h"
+#include "animations/pose.h"
+#include "entity_registry.h"
+
+class Entity;
+class Skeleton;
+class Material;
+class Camera;
+class RenderQueue;
+
+typedef uint32_t EntityId;
+#define ENTITY_NONE 0xFFFFFFFFu
+
+//dense array of components with an index by entity, removing one moves the last to its place
+template <typename T>
+class ComponentArray
+{
+public:
+	std::vector<T> data;
+	std::vector<EntityId> owners; //entity of every element of data
+
+	T& add(EntityId id)
+	{
+		if (id >= sparse.size())
+			sparse.resize(id + 1, ENTITY_NONE);
+		if (sparse[id] != ENTITY_NONE)
+			return data[sparse[id]];
+		sparse[id] = (uint32_t)data.size();
+		data.push_back(T());
+		owners.push_back(id);
+		return data.back();
+	}
+
+	void remove(EntityId id)
+	{
+		if (!has(id))
+			return;
+		uint32_t index = sparse[id];
+		uint32_t last = (uint32_t)data.size() - 1;
+		if (index != last)
+		{
+			data[index] = std::move(data[last]);
+			owners[index] = owners[last];
+			sparse[owners[index]] = index;
+		}
+		data.pop_back();
+		owners.pop_back();
+		sparse[id] = ENTITY_NONE;
+	}
+
+	bool has(EntityId id) const { return id < sparse.size() && sparse[id] != ENTITY_NONE; }
+	T* get(EntityId id) { return has(id) ? &data[sparse[id]] : nullptr; }
+	size_t size() const { return data.size(); }
+
+private:
+	std::vector<uint32_t> sparse; //index in data by entity
+};
+
+struct sTransformComponent
+{
+	int node = -1; //in TransformHierarchy::get(), -1 to write world directly
+	mat4 world;
+};
+
+struct sMeshRendererComponent
+{
+	Mesh* mesh = nullptr;
+	Material* material = nullptr;
+	int lod = 0; //of the last frame
+	bool visible = true;
+};
+
+struct sBoundsComponent
+{
+	BoundingBox box;
+	vec3 sphere_center;
+	float sphere_radius = 0.0f;
+	bool valid = false; //false until the mesh is ready
+	bool culled = false; //written by the culling of the scene tree
+};
+
+struct sSkinnedAnimatorComponent
+{
+	Skeleton* skeleton = nullptr;
+	bool apply_bind_pose = false; //the bind pose instead of the rest one (see SkinnedEntity::uses_bind_pose)
+	//the last two simulation steps, blended by update_skinning
+	Pose pose;
+	Pose previous_pose;
+	Pose render_pose;
+	std::vector<mat4> matrices; //global * inverse bind pose of the blended pose, sent as u_animated
+};
+
+class EntityStore
+{
+public:
+	ComponentArray<sTransformComponent> transforms;
+	ComponentArray<sMeshRendererComponent> renderers;
+	ComponentArray<sBoundsComponent> bounds;
+	ComponentArray<sSkinnedAnimatorComponent> animators;
+
+	EntityId create();
+	void destroy(EntityId id); //with all its components
+	bool is_alive(EntityId id) const { return id < alive.size() && alive[id]; }
+	size_t get_num_entities() const { return num_alive; }
+
+	//systems of every simulation step, in this order
+	void sync_imported(); //copies what the imported entities can change from the gui, drops the destroyed ones
+	void update_animators(); //the pose of this step, the previous one is kept to blend
+	void update_transforms(); //world matrices from the TransformHierarchy, after its update
+	void update_bounds(); //world bounds of the meshes
+	//systems of every frame, after the culling of the scene tree
+	void update_skinning(float alpha); //skinning matrices of the poses blended between the last two steps
+	unsigned int submit(RenderQueue* queue, Camera* camera); //the visible renderers to the queue (drawn now if it is null), returns how many
+
+	//adapter: the plain and the skinned Entity objects of the tree (and their children) become components,
+	//the other subclasses are skipped
+	//the Entity keeps its data for the gui and the picking, but it does not render itself anymore
+	void import(Entity* entity);
+
+private:
+	std::vector<uint8_t> alive;
+	std::vector<EntityId> free_ids;
+	size_t num_alive = 0;
+
+	struct sImported
+	{
+		EntityId id;
+		EntityHandle entity; //resolves to nullptr once the entity is deleted
+	};
+	std::vector<sImported> imported;
+};
@@ -0,0 +1,108 @@
+#include "file_watcher.h"
+
+#include <iostream>
+#include <algorithm>
+
+#ifdef __linux__
+	#include <sys/inotify.h>
+	#include <unistd.h>
+#endif
+
+FileWatcher::FileWatcher(const std::string& folder)
+{
+	this->folder = normalize_path(folder);
+
+#ifdef __linux__
+	inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	//editors save by writing the file or by renaming a temporary one over it
+	if (inotify_fd != -1 && inotify_add_watch(inotify_fd, this->folder.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) == -1)
+	{
+		close(inotify_fd);
+		inotify_fd = -1;
+	}
+#endif
+
+	if (inotify_fd == -1)
+		scan(NULL);
+}
+
+FileWatcher::~FileWatcher()
+{
+#ifdef __linux__
+	if (inotify_fd != -1)
+		close(inotify_fd);
+#endif
+}
+
+std::string FileWatcher::normalize_path(const std::string& path)
+{
+	return std::filesystem::path(path).lexically_normal().generic_string();
+}
+
+void FileWatcher::poll(std::vector<std::string>& changed)
+{
+	size_t first = changed.size();
+
+#ifdef __linux__
+	if (inotify_fd != -1)
+	{
+		alignas(struct inotify_event) char buffer[4096];
+		while (true)
+		{
+			ssize_t length = read(inotify_fd, buffer, sizeof(buffer));
+			if (length <= 0)
+				break; //EAGAIN, nothing else pending
+
+			for (char* ptr = buffer; ptr < buffer + length;)
+			{
+				const struct inotify_event* event = (const struct inotify_event*)ptr;
+				if (event->len)
+					changed.push_back(normalize_path(folder + "/" + event->name));
+				ptr += sizeof(struct inotify_event) + event->len;
+			}
+		}
+	}
+	else
+#endif
+	{
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (now - last_scan < std::chrono::milliseconds(FILE_WATCHER_POLL_MS))
+			return;
+		scan(&changed);
+	}
+
+	//one save can generate several events
+	std::sort(changed.begin() + first, changed.end());
+	changed.erase(std::unique(changed.begin() + first, changed.end()), changed.end());
+}
+
+void FileWatcher::scan(std::vector<std::string>* changed)
+{
+	last_scan = std::chrono::steady_clock::now();
+
+	std::error_code error;
+	for (std::filesystem::directory_iterator it(folder, error), end; !error && it != end; it.increment(error))
+	{
+		//an entry that cannot be read (i.e. removed meanwhile) is skipped, the rest of the folder is still scanned
+		std::error_code entry_error;
+		if (!it->is_regular_file(entry_error))
+			continue;
+		std::filesystem::file_time_type time = it->last_write_time(entry_error);
+		if (entry_error)
+			continue;
+
+		std::string path = normalize_path(it->path().string());
+		std::map<std::string, std::filesystem::file_time_type>::iterator found = timestamps.find(path);
+		if (found == timestamps.end())
+			timestamps[path] = time;
+		else if (found->second != time)
+		{
+			found->second = time;
+			if (changed)
+				changed->push_back(path);
+		}
+	}
+
+	if (error && !changed) //reported once, when the watcher is created
+		std::cout << "[WARN] Cannot watch the folder " << folder << ": " << error.message() << std::endl;
+}
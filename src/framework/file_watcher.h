@@ -0,0 +1,40 @@
+/*  Watches the files of a folder (not recursive) and reports the ones modified since the last poll.
+	Uses inotify on Linux, so polling only reads the pending events, and compares the modification
+	times of the files every FILE_WATCHER_POLL_MS in the other platforms or if inotify is not available.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <filesystem>
+
+#define FILE_WATCHER_POLL_MS 250 //interval of the fallback, scanning the folder is not free
+
+class FileWatcher
+{
+public:
+	FileWatcher(const std::string& folder);
+	~FileWatcher();
+
+	//adds the files modified since the last call, with the folder in the path (i.e. "res/shaders/basic.vs")
+	void poll(std::vector<std::string>& changed);
+
+	const std::string& get_folder() const { return folder; }
+	bool is_using_events() const { return inotify_fd != -1; }
+
+	//same format as the reported files, to compare paths written in different ways
+	static std::string normalize_path(const std::string& path);
+
+private:
+	std::string folder;
+	int inotify_fd = -1;
+
+	//polling fallback
+	std::map<std::string, std::filesystem::file_time_type> timestamps;
+	std::chrono::steady_clock::time_point last_scan;
+
+	void scan(std::vector<std::string>* changed);
+};
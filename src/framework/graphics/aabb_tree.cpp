@@ -0,0 +1,399 @@
+#include "aabb_tree.h"
+
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+
+static inline vec3 min_vec3(const vec3& a, const vec3& b) { return vec3(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z)); }
+static inline vec3 max_vec3(const vec3& a, const vec3& b) { return vec3(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z)); }
+
+//half of the surface area, the cost of a node in the insertion heuristic
+static inline float box_cost(const vec3& min, const vec3& max)
+{
+	vec3 d = max - min;
+	return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+static inline bool boxes_overlap(const vec3& min_a, const vec3& max_a, const vec3& min_b, const vec3& max_b)
+{
+	return min_a.x <= max_b.x && max_a.x >= min_b.x && min_a.y <= max_b.y && max_a.y >= min_b.y && min_a.z <= max_b.z && max_a.z >= min_b.z;
+}
+
+AABBTree::AABBTree()
+{
+	clear();
+}
+
+void AABBTree::clear()
+{
+	nodes.clear();
+	root = AABB_TREE_NULL;
+	free_list = AABB_TREE_NULL;
+	num_proxies = 0;
+}
+
+int AABBTree::allocate_node()
+{
+	int id;
+	if (free_list != AABB_TREE_NULL)
+	{
+		id = free_list;
+		free_list = nodes[id].parent;
+	}
+	else
+	{
+		id = (int)nodes.size();
+		nodes.push_back(sAABBTreeNode());
+	}
+
+	sAABBTreeNode& node = nodes[id];
+	node.user_data = NULL;
+	node.parent = AABB_TREE_NULL;
+	node.left = AABB_TREE_NULL;
+	node.right = AABB_TREE_NULL;
+	node.height = 0;
+	return id;
+}
+
+void AABBTree::free_node(int id)
+{
+	nodes[id].parent = free_list;
+	nodes[id].height = -1;
+	free_list = id;
+}
+
+int AABBTree::insert(const BoundingBox& box, void* user_data)
+{
+	int proxy = allocate_node();
+	sAABBTreeNode& node = nodes[proxy];
+	vec3 margin(AABB_TREE_MARGIN, AABB_TREE_MARGIN, AABB_TREE_MARGIN);
+	node.min = box.center - box.halfsize - margin;
+	node.max = box.center + box.halfsize + margin;
+	node.user_data = user_data;
+
+	insert_leaf(proxy);
+	num_proxies++;
+	return proxy;
+}
+
+void AABBTree::remove(int proxy)
+{
+	assert(proxy >= 0 && proxy < (int)nodes.size() && nodes[proxy].is_leaf());
+	remove_leaf(proxy);
+	free_node(proxy);
+	num_proxies--;
+}
+
+bool AABBTree::update(int proxy, const BoundingBox& box)
+{
+	sAABBTreeNode& node = nodes[proxy];
+	vec3 box_min = box.center - box.halfsize;
+	vec3 box_max = box.center + box.halfsize;
+
+	//still inside the fat box, nothing to do
+	if (node.min.x <= box_min.x && node.min.y <= box_min.y && node.min.z <= box_min.z &&
+		node.max.x >= box_max.x && node.max.y >= box_max.y && node.max.z >= box_max.z)
+		return false;
+
+	remove_leaf(proxy);
+	vec3 margin(AABB_TREE_MARGIN, AABB_TREE_MARGIN, AABB_TREE_MARGIN);
+	nodes[proxy].min = box_min - margin;
+	nodes[proxy].max = box_max + margin;
+	insert_leaf(proxy);
+	return true;
+}
+
+BoundingBox AABBTree::get_fat_box(int proxy) const
+{
+	const sAABBTreeNode& node = nodes[proxy];
+	return BoundingBox((node.min + node.max) * 0.5f, (node.max - node.min) * 0.5f);
+}
+
+void AABBTree::insert_leaf(int leaf)
+{
+	if (root == AABB_TREE_NULL)
+	{
+		root = leaf;
+		nodes[root].parent = AABB_TREE_NULL;
+		return;
+	}
+
+	//find the best sibling, going down while it is cheaper than creating the parent here (surface area heuristic)
+	vec3 leaf_min = nodes[leaf].min;
+	vec3 leaf_max = nodes[leaf].max;
+	int index = root;
+	while (!nodes[index].is_leaf())
+	{
+		const sAABBTreeNode& node = nodes[index];
+		float area = box_cost(node.min, node.max);
+		float combined_area = box_cost(min_vec3(node.min, leaf_min), max_vec3(node.max, leaf_max));
+
+		//cost of creating a new parent for this node and the leaf
+		float cost = 2.0f * combined_area;
+		//minimum cost of pushing the leaf further down the tree
+		float inheritance_cost = 2.0f * (combined_area - area);
+
+		float child_cost[2];
+		int children[2] = { node.left, node.right };
+		for (int i = 0; i < 2; ++i)
+		{
+			const sAABBTreeNode& child = nodes[children[i]];
+			float new_area = box_cost(min_vec3(child.min, leaf_min), max_vec3(child.max, leaf_max));
+			child_cost[i] = (child.is_leaf() ? new_area : new_area - box_cost(child.min, child.max)) + inheritance_cost;
+		}
+
+		if (cost < child_cost[0] && cost < child_cost[1])
+			break;
+		index = child_cost[0] < child_cost[1] ? children[0] : children[1];
+	}
+
+	int sibling = index;
+	int old_parent = nodes[sibling].parent;
+	int new_parent = allocate_node();
+	sAABBTreeNode& parent = nodes[new_parent];
+	parent.parent = old_parent;
+	parent.min = min_vec3(leaf_min, nodes[sibling].min);
+	parent.max = max_vec3(leaf_max, nodes[sibling].max);
+	parent.height = nodes[sibling].height + 1;
+	parent.left = sibling;
+	parent.right = leaf;
+
+	if (old_parent != AABB_TREE_NULL)
+	{
+		if (nodes[old_parent].left == sibling)
+			nodes[old_parent].left = new_parent;
+		else
+			nodes[old_parent].right = new_parent;
+	}
+	else
+		root = new_parent;
+	nodes[sibling].parent = new_parent;
+	nodes[leaf].parent = new_parent;
+
+	fix_upwards(new_parent);
+}
+
+void AABBTree::remove_leaf(int leaf)
+{
+	if (leaf == root)
+	{
+		root = AABB_TREE_NULL;
+		return;
+	}
+
+	int parent = nodes[leaf].parent;
+	int grand_parent = nodes[parent].parent;
+	int sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+
+	//the sibling takes the place of the parent
+	if (grand_parent != AABB_TREE_NULL)
+	{
+		if (nodes[grand_parent].left == parent)
+			nodes[grand_parent].left = sibling;
+		else
+			nodes[grand_parent].right = sibling;
+		nodes[sibling].parent = grand_parent;
+		free_node(parent);
+		fix_upwards(grand_parent);
+	}
+	else
+	{
+		root = sibling;
+		nodes[sibling].parent = AABB_TREE_NULL;
+		free_node(parent);
+	}
+	nodes[leaf].parent = AABB_TREE_NULL;
+}
+
+//refits the boxes and heights from a node to the root, balancing on the way
+void AABBTree::fix_upwards(int index)
+{
+	while (index != AABB_TREE_NULL)
+	{
+		index = balance(index);
+
+		sAABBTreeNode& node = nodes[index];
+		const sAABBTreeNode& left = nodes[node.left];
+		const sAABBTreeNode& right = nodes[node.right];
+		node.height = 1 + std::max(left.height, right.height);
+		node.min = min_vec3(left.min, right.min);
+		node.max = max_vec3(left.max, right.max);
+
+		index = node.parent;
+	}
+}
+
+//if a child is two levels taller than the other, it is rotated up. Returns the node now in the place of id
+int AABBTree::balance(int id_a)
+{
+	sAABBTreeNode* a = &nodes[id_a];
+	if (a->is_leaf() || a->height < 2)
+		return id_a;
+
+	int id_b = a->left;
+	int id_c = a->right;
+	sAABBTreeNode* b = &nodes[id_b];
+	sAABBTreeNode* c = &nodes[id_c];
+	int difference = c->height - b->height;
+
+	if (difference > 1 || difference < -1)
+	{
+		//the tall child (up) replaces a, a keeps the short child and the shortest grandchild
+		bool right_is_tall = difference > 1;
+		int id_up = right_is_tall ? id_c : id_b;
+		sAABBTreeNode* up = right_is_tall ? c : b;
+		sAABBTreeNode* other = right_is_tall ? b : c;
+		int id_f = up->left;
+		int id_g = up->right;
+		sAABBTreeNode* f = &nodes[id_f];
+		sAABBTreeNode* g = &nodes[id_g];
+
+		up->left = id_a;
+		up->parent = a->parent;
+		a->parent = id_up;
+		if (up->parent != AABB_TREE_NULL)
+		{
+			if (nodes[up->parent].left == id_a)
+				nodes[up->parent].left = id_up;
+			else
+				nodes[up->parent].right = id_up;
+		}
+		else
+			root = id_up;
+
+		int id_keep = f->height > g->height ? id_f : id_g; //stays in up
+		int id_move = f->height > g->height ? id_g : id_f; //goes to a
+		sAABBTreeNode* keep = &nodes[id_keep];
+		sAABBTreeNode* move = &nodes[id_move];
+		up->right = id_keep;
+		if (right_is_tall)
+			a->right = id_move;
+		else
+			a->left = id_move;
+		move->parent = id_a;
+
+		a->min = min_vec3(other->min, move->min);
+		a->max = max_vec3(other->max, move->max);
+		a->height = 1 + std::max(other->height, move->height);
+		up->min = min_vec3(a->min, keep->min);
+		up->max = max_vec3(a->max, keep->max);
+		up->height = 1 + std::max(a->height, keep->height);
+		return id_up;
+	}
+
+	return id_a;
+}
+
+void AABBTree::query_frustum(const Frustum& frustum, std::vector<int>& inside, std::vector<int>& intersect) const
+{
+	if (root == AABB_TREE_NULL)
+		return;
+
+	stack.clear();
+	stack.push_back(std::make_pair(root, (unsigned int)FRUSTUM_ALL_PLANES));
+	while (!stack.empty())
+	{
+		int id = stack.back().first;
+		unsigned int plane_mask = stack.back().second;
+		stack.pop_back();
+
+		const sAABBTreeNode& node = nodes[id];
+		eFrustumTest result = FRUSTUM_INSIDE;
+		if (plane_mask)
+			result = frustum.classify_box((node.min + node.max) * 0.5f, (node.max - node.min) * 0.5f, plane_mask);
+		if (result == FRUSTUM_OUTSIDE)
+			continue;
+
+		if (node.is_leaf())
+			(result == FRUSTUM_INSIDE ? inside : intersect).push_back(id);
+		else
+		{
+			//when inside, the mask is 0 and the whole subtree is collected without more tests
+			stack.push_back(std::make_pair(node.right, plane_mask));
+			stack.push_back(std::make_pair(node.left, plane_mask));
+		}
+	}
+}
+
+void AABBTree::query_overlap(const BoundingBox& box, std::vector<int>& result) const
+{
+	if (root == AABB_TREE_NULL)
+		return;
+
+	vec3 box_min = box.center - box.halfsize;
+	vec3 box_max = box.center + box.halfsize;
+
+	stack.clear();
+	stack.push_back(std::make_pair(root, 0u));
+	while (!stack.empty())
+	{
+		const sAABBTreeNode& node = nodes[stack.back().first];
+		int id = stack.back().first;
+		stack.pop_back();
+
+		if (!boxes_overlap(node.min, node.max, box_min, box_max))
+			continue;
+		if (node.is_leaf())
+			result.push_back(id);
+		else
+		{
+			stack.push_back(std::make_pair(node.right, 0u));
+			stack.push_back(std::make_pair(node.left, 0u));
+		}
+	}
+}
+
+bool ray_box_intersection(const vec3& origin, const vec3& inv_direction, const vec3& min, const vec3& max, float max_distance, float& t_enter)
+{
+	float t_min = 0.0f;
+	float t_max = max_distance;
+	for (int i = 0; i < 3; ++i)
+	{
+		float t1 = (min.v[i] - origin.v[i]) * inv_direction.v[i];
+		float t2 = (max.v[i] - origin.v[i]) * inv_direction.v[i];
+		if (t1 > t2)
+			std::swap(t1, t2);
+		//NaN (origin on the slab with a parallel ray) keeps the previous limits
+		t_min = t1 > t_min ? t1 : t_min;
+		t_max = t2 < t_max ? t2 : t_max;
+		if (t_min > t_max)
+			return false;
+	}
+	t_enter = t_min;
+	return true;
+}
+
+void AABBTree::query_ray(const vec3& origin, const vec3& direction, float max_distance, const std::function<float(int proxy, float max_distance)>& callback) const
+{
+	if (root == AABB_TREE_NULL)
+		return;
+
+	//the division by zero gives infinities, which work in the slab test
+	vec3 inv_direction(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+	stack.clear();
+	stack.push_back(std::make_pair(root, 0u));
+	while (!stack.empty())
+	{
+		int id = stack.back().first;
+		stack.pop_back();
+		const sAABBTreeNode& node = nodes[id];
+
+		float t_enter;
+		if (!ray_box_intersection(origin, inv_direction, node.min, node.max, max_distance, t_enter))
+			continue;
+
+		if (node.is_leaf())
+		{
+			//the callback clips the ray with its hits, so farther nodes are discarded
+			max_distance = callback(id, max_distance);
+			if (max_distance <= 0.0f)
+				return;
+		}
+		else
+		{
+			stack.push_back(std::make_pair(node.right, 0u));
+			stack.push_back(std::make_pair(node.left, 0u));
+		}
+	}
+}
@@ -0,0 +1,76 @@
+/*  Dynamic AABB tree (as in Box2D / Bullet dbvt) over the world bounds of the scene.
+	Leaves store a fat box (the real box plus a margin) so small movements do not touch the tree,
+	internal nodes are the union of their children and the tree is kept balanced with rotations.
+	Used for hierarchical frustum culling, ray picking and overlap queries.
+*/
+
+#pragma once
+
+#include <vector>
+#include <functional>
+
+#include "../math/vec3.h"
+#include "mesh.h"
+#include "culling.h"
+
+#define AABB_TREE_NULL -1
+#define AABB_TREE_MARGIN 0.1f //added to every side of the leaves
+
+//slab test of a ray against a box, returns the entry distance (0 if the origin is inside) in t_enter
+//inv_direction is 1 / direction for every axis (infinite for the axis the ray is parallel to)
+bool ray_box_intersection(const vec3& origin, const vec3& inv_direction, const vec3& min, const vec3& max, float max_distance, float& t_enter);
+
+struct sAABBTreeNode
+{
+	vec3 min;
+	vec3 max;
+	void* user_data;
+	int parent; //next free node when the node is not used
+	int left;
+	int right;
+	int height; //0 for leaves, -1 for free nodes
+
+	bool is_leaf() const { return left == AABB_TREE_NULL; }
+};
+
+class AABBTree
+{
+public:
+	std::vector<sAABBTreeNode> nodes;
+	int root;
+
+	AABBTree();
+
+	void clear();
+
+	//returns the id of the proxy (a leaf), it does not change till it is removed
+	int insert(const BoundingBox& box, void* user_data);
+	void remove(int proxy);
+	//refits the leaf if the box left its fat box, returns true if it was reinserted
+	bool update(int proxy, const BoundingBox& box);
+
+	void* get_user_data(int proxy) const { return nodes[proxy].user_data; }
+	BoundingBox get_fat_box(int proxy) const;
+	int get_num_proxies() const { return num_proxies; }
+	int get_height() const { return root == AABB_TREE_NULL ? 0 : nodes[root].height; }
+
+	//proxies completely inside the frustum go to inside, the ones that touch its border to intersect (they need a finer test)
+	void query_frustum(const Frustum& frustum, std::vector<int>& inside, std::vector<int>& intersect) const;
+	//proxies whose fat box overlaps the box
+	void query_overlap(const BoundingBox& box, std::vector<int>& result) const;
+	//the callback receives every proxy hit by the ray and returns the new max distance (the distance of a real hit or the same max distance to keep going)
+	//direction does not need to be normalized, distances are in units of direction
+	void query_ray(const vec3& origin, const vec3& direction, float max_distance, const std::function<float(int proxy, float max_distance)>& callback) const;
+
+private:
+	int free_list;
+	int num_proxies;
+	mutable std::vector<std::pair<int, unsigned int>> stack; //traversal (node, frustum planes to test)
+
+	int allocate_node();
+	void free_node(int id);
+	void insert_leaf(int leaf);
+	void remove_leaf(int leaf);
+	int balance(int id);
+	void fix_upwards(int id);
+};
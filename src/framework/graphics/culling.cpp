@@ -0,0 +1,159 @@
+#include "culling.h"
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define CULLING_USE_SSE2
+#endif
+
+void Frustum::set(const mat4& m)
+{
+	//rows of the matrix (it is stored by columns)
+	vec4 row0(m.data[0], m.data[4], m.data[8], m.data[12]);
+	vec4 row1(m.data[1], m.data[5], m.data[9], m.data[13]);
+	vec4 row2(m.data[2], m.data[6], m.data[10], m.data[14]);
+	vec4 row3(m.data[3], m.data[7], m.data[11], m.data[15]);
+
+	planes[FRUSTUM_LEFT] = row3 + row0;
+	planes[FRUSTUM_RIGHT] = row3 - row0;
+	planes[FRUSTUM_BOTTOM] = row3 + row1;
+	planes[FRUSTUM_TOP] = row3 - row1;
+	planes[FRUSTUM_NEAR] = row3 + row2;
+	planes[FRUSTUM_FAR] = row3 - row2;
+
+	//normalized so the distances are in world units
+	for (int i = 0; i < 6; ++i)
+	{
+		vec4& p = planes[i];
+		float length = sqrtf(p.x * p.x + p.y * p.y + p.z * p.z);
+		if (length > 0.0f)
+			p = p * (1.0f / length);
+	}
+}
+
+bool Frustum::test_sphere(const vec3& center, float radius) const
+{
+	for (int i = 0; i < 6; ++i)
+	{
+		const vec4& p = planes[i];
+		if (p.x * center.x + p.y * center.y + p.z * center.z + p.w < -radius)
+			return false;
+	}
+	return true;
+}
+
+bool Frustum::test_box(const BoundingBox& box) const
+{
+	for (int i = 0; i < 6; ++i)
+	{
+		const vec4& p = planes[i];
+		float distance = p.x * box.center.x + p.y * box.center.y + p.z * box.center.z + p.w;
+		float radius = fabsf(p.x) * box.halfsize.x + fabsf(p.y) * box.halfsize.y + fabsf(p.z) * box.halfsize.z;
+		if (distance < -radius)
+			return false;
+	}
+	return true;
+}
+
+eFrustumTest Frustum::classify_box(const vec3& center, const vec3& halfsize, unsigned int& plane_mask) const
+{
+	for (int i = 0; i < 6; ++i)
+	{
+		if (!(plane_mask & (1 << i)))
+			continue;
+		const vec4& p = planes[i];
+		float distance = p.x * center.x + p.y * center.y + p.z * center.z + p.w;
+		float radius = fabsf(p.x) * halfsize.x + fabsf(p.y) * halfsize.y + fabsf(p.z) * halfsize.z;
+		if (distance < -radius)
+			return FRUSTUM_OUTSIDE;
+		if (distance >= radius)
+			plane_mask &= ~(1 << i);
+	}
+	return plane_mask ? FRUSTUM_INTERSECT : FRUSTUM_INSIDE;
+}
+
+void CullingBounds::clear()
+{
+	box_x.clear(); box_y.clear(); box_z.clear();
+	extent_x.clear(); extent_y.clear(); extent_z.clear();
+	sphere_x.clear(); sphere_y.clear(); sphere_z.clear(); sphere_radius.clear();
+}
+
+size_t CullingBounds::add(const BoundingBox& box, const vec3& sphere_center, float radius)
+{
+	box_x.push_back(box.center.x);
+	box_y.push_back(box.center.y);
+	box_z.push_back(box.center.z);
+	extent_x.push_back(fabsf(box.halfsize.x));
+	extent_y.push_back(fabsf(box.halfsize.y));
+	extent_z.push_back(fabsf(box.halfsize.z));
+	sphere_x.push_back(sphere_center.x);
+	sphere_y.push_back(sphere_center.y);
+	sphere_z.push_back(sphere_center.z);
+	sphere_radius.push_back(radius);
+	return box_x.size() - 1;
+}
+
+//scalar version, used for the objects that do not fill a group of four
+static bool cull_one(const Frustum& frustum, const CullingBounds& b, size_t i)
+{
+	for (int j = 0; j < 6; ++j)
+	{
+		const vec4& p = frustum.planes[j];
+		float box_distance = p.x * b.box_x[i] + p.y * b.box_y[i] + p.z * b.box_z[i] + p.w;
+		float box_radius = fabsf(p.x) * b.extent_x[i] + fabsf(p.y) * b.extent_y[i] + fabsf(p.z) * b.extent_z[i];
+		float sphere_distance = p.x * b.sphere_x[i] + p.y * b.sphere_y[i] + p.z * b.sphere_z[i] + p.w;
+		if (box_distance < -box_radius || sphere_distance < -b.sphere_radius[i])
+			return false;
+	}
+	return true;
+}
+
+size_t CullingBounds::cull(const Frustum& frustum, std::vector<uint8_t>& visible) const
+{
+	size_t count = size();
+	visible.resize(count);
+	size_t num_visible = 0;
+	size_t i = 0;
+
+#ifdef CULLING_USE_SSE2
+	const __m128 sign_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 bx = _mm_loadu_ps(&box_x[i]), by = _mm_loadu_ps(&box_y[i]), bz = _mm_loadu_ps(&box_z[i]);
+		__m128 ex = _mm_loadu_ps(&extent_x[i]), ey = _mm_loadu_ps(&extent_y[i]), ez = _mm_loadu_ps(&extent_z[i]);
+		__m128 sx = _mm_loadu_ps(&sphere_x[i]), sy = _mm_loadu_ps(&sphere_y[i]), sz = _mm_loadu_ps(&sphere_z[i]);
+		__m128 sr = _mm_loadu_ps(&sphere_radius[i]);
+		__m128 outside = _mm_setzero_ps();
+
+		for (int j = 0; j < 6; ++j)
+		{
+			const vec4& p = frustum.planes[j];
+			__m128 nx = _mm_set1_ps(p.x), ny = _mm_set1_ps(p.y), nz = _mm_set1_ps(p.z), d = _mm_set1_ps(p.w);
+
+			__m128 box_distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, bx), _mm_mul_ps(ny, by)), _mm_add_ps(_mm_mul_ps(nz, bz), d));
+			__m128 box_radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_and_ps(nx, sign_mask), ex), _mm_mul_ps(_mm_and_ps(ny, sign_mask), ey)), _mm_mul_ps(_mm_and_ps(nz, sign_mask), ez));
+			__m128 sphere_distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, sx), _mm_mul_ps(ny, sy)), _mm_add_ps(_mm_mul_ps(nz, sz), d));
+
+			//distance + radius < 0 means completely behind the plane
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(box_distance, box_radius), _mm_setzero_ps()));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(sphere_distance, sr), _mm_setzero_ps()));
+		}
+
+		int mask = _mm_movemask_ps(outside);
+		for (int k = 0; k < 4; ++k)
+		{
+			visible[i + k] = (mask & (1 << k)) ? 0 : 1;
+			num_visible += visible[i + k];
+		}
+	}
+#endif
+
+	for (; i < count; ++i)
+	{
+		visible[i] = cull_one(frustum, *this, i) ? 1 : 0;
+		num_visible += visible[i];
+	}
+	return num_visible;
+}
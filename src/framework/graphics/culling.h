@@ -0,0 +1,65 @@
+/*  View frustum culling. The planes are extracted from the viewprojection matrix (Gribb & Hartmann)
+	and the bounds of the scene are stored in a flat structure of arrays, so they are tested four at a time.
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "../math/vec3.h"
+#include "../math/vec4.h"
+#include "../math/mat4.h"
+#include "mesh.h"
+
+enum eFrustumPlane {
+	FRUSTUM_LEFT,
+	FRUSTUM_RIGHT,
+	FRUSTUM_BOTTOM,
+	FRUSTUM_TOP,
+	FRUSTUM_NEAR,
+	FRUSTUM_FAR
+};
+
+enum eFrustumTest {
+	FRUSTUM_OUTSIDE,
+	FRUSTUM_INTERSECT,
+	FRUSTUM_INSIDE
+};
+
+#define FRUSTUM_ALL_PLANES 0x3F
+
+class Frustum
+{
+public:
+	vec4 planes[6]; //normal (pointing inside) in xyz, distance in w
+
+	Frustum() {}
+	Frustum(const mat4& viewprojection) { set(viewprojection); }
+
+	void set(const mat4& viewprojection);
+
+	//false only if it is completely outside
+	bool test_sphere(const vec3& center, float radius) const;
+	bool test_box(const BoundingBox& box) const;
+	//plane_mask has a bit for every plane still to test, the planes the box is fully inside are removed from it
+	//(used in hierarchies, the children of a box do not need to test them again)
+	eFrustumTest classify_box(const vec3& center, const vec3& halfsize, unsigned int& plane_mask) const;
+};
+
+//world bounds of the objects to cull, every object has an AABB and a bounding sphere (it must touch both to be visible)
+class CullingBounds
+{
+public:
+	std::vector<float> box_x, box_y, box_z; //center of the AABB
+	std::vector<float> extent_x, extent_y, extent_z; //halfsize of the AABB
+	std::vector<float> sphere_x, sphere_y, sphere_z, sphere_radius;
+
+	size_t size() const { return box_x.size(); }
+	void clear();
+	//returns the index of the bounds
+	size_t add(const BoundingBox& box, const vec3& sphere_center, float sphere_radius);
+
+	//visible[i] is 1 if the object i touches the frustum, returns the number of visible objects
+	size_t cull(const Frustum& frustum, std::vector<uint8_t>& visible) const;
+};
@@ -0,0 +1,184 @@
+#include "frame_ring_buffer.h"
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+#include "../utils.h"
+
+FrameRingBuffer::FrameRingBuffer(size_t frame_size, int num_frames)
+{
+	assert(num_frames > 0 && num_frames <= FRAME_RING_BUFFER_FRAMES);
+	this->frame_size = frame_size;
+	this->num_frames = num_frames;
+	buffer_id = 0;
+	current_frame = 0;
+	frame_count = 0;
+	head = 0;
+	persistent = false;
+	mapped = false;
+	data = NULL;
+	for (int i = 0; i < FRAME_RING_BUFFER_FRAMES; ++i)
+		fences[i] = 0;
+	create();
+}
+
+FrameRingBuffer::~FrameRingBuffer()
+{
+	for (int i = 0; i < num_frames; ++i)
+		if (fences[i])
+			glDeleteSync(fences[i]);
+
+	if (buffer_id)
+	{
+		if (persistent || mapped)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, buffer_id);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+		glDeleteBuffers(1, &buffer_id);
+	}
+}
+
+bool FrameRingBuffer::create()
+{
+	glGenBuffers(1, &buffer_id);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer_id);
+
+	if (get_gl_version() >= 44 || has_gl_extension("GL_ARB_buffer_storage"))
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, frame_size * num_frames, NULL, flags);
+		data = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, frame_size * num_frames, flags);
+		persistent = data != NULL;
+		if (!persistent)
+		{
+			//storage is immutable, start again with a normal buffer
+			std::cout << "[WARN] FrameRingBuffer: persistent mapping failed, using orphaning" << std::endl;
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			glDeleteBuffers(1, &buffer_id);
+			glGenBuffers(1, &buffer_id);
+			glBindBuffer(GL_ARRAY_BUFFER, buffer_id);
+		}
+	}
+
+	//fallback: a single slice, orphaned every frame so the driver hands us fresh memory
+	if (!persistent)
+		glBufferData(GL_ARRAY_BUFFER, frame_size, NULL, GL_STREAM_DRAW);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return check_gl_errors();
+}
+
+void FrameRingBuffer::begin_frame()
+{
+	head = 0;
+	frame_count++;
+
+	if (!persistent)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, buffer_id);
+		glBufferData(GL_ARRAY_BUFFER, frame_size, NULL, GL_STREAM_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		return;
+	}
+
+	GLsync& fence = fences[current_frame];
+	if (!fence)
+		return;
+
+	//usually already signaled, we only wait if the CPU is num_frames ahead
+	GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	while (result == GL_TIMEOUT_EXPIRED)
+		result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); //1ms
+	if (result == GL_WAIT_FAILED)
+		std::cout << "[ERROR] FrameRingBuffer: waiting fence failed" << std::endl;
+
+	glDeleteSync(fence);
+	fence = 0;
+}
+
+void FrameRingBuffer::end_frame()
+{
+	if (!persistent)
+		return;
+
+	fences[current_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	current_frame = (current_frame + 1) % num_frames;
+}
+
+long long FrameRingBuffer::allocate(size_t size, size_t alignment)
+{
+	assert(!mapped && "unmap before allocating again");
+	size_t start = (head + alignment - 1) / alignment * alignment;
+	if (start + size > frame_size)
+	{
+		if (persistent || head == 0 || size > frame_size)
+			return -1;
+
+		//fallback: orphan and start again, the draws already issued keep the old storage
+		glBindBuffer(GL_ARRAY_BUFFER, buffer_id);
+		glBufferData(GL_ARRAY_BUFFER, frame_size, NULL, GL_STREAM_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		start = 0;
+	}
+
+	head = start + size;
+	if (persistent)
+		return (long long)(current_frame * frame_size + start);
+	return (long long)start;
+}
+
+void* FrameRingBuffer::map(size_t size, size_t alignment, long long& offset)
+{
+	offset = allocate(size, alignment);
+	if (offset < 0)
+		return NULL;
+
+	if (persistent)
+		return data + offset;
+
+	//nothing written in this range since the last orphaning, no need to synchronize
+	glBindBuffer(GL_ARRAY_BUFFER, buffer_id);
+	void* ptr = glMapBufferRange(GL_ARRAY_BUFFER, (GLintptr)offset, size, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	mapped = ptr != NULL;
+	return ptr;
+}
+
+void FrameRingBuffer::unmap()
+{
+	if (!mapped)
+		return; //persistent mappings are coherent, nothing to do
+
+	glBindBuffer(GL_ARRAY_BUFFER, buffer_id);
+	glUnmapBuffer(GL_ARRAY_BUFFER);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	mapped = false;
+}
+
+long long FrameRingBuffer::upload(const void* src, size_t size, size_t alignment)
+{
+	long long offset = allocate(size, alignment);
+	if (offset < 0)
+		return -1;
+
+	if (persistent)
+		memcpy(data + offset, src, size);
+	else
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, buffer_id);
+		glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)offset, size, src);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	return offset;
+}
+
+FrameRingBuffer* FrameRingBuffer::get()
+{
+	static FrameRingBuffer* ring = NULL;
+	if (!ring)
+		ring = new FrameRingBuffer();
+	return ring;
+}
@@ -0,0 +1,56 @@
+/*  One big GPU buffer split in N slices, one per frame in flight, for data that changes every frame
+	(instance matrices, skinned vertices, debug lines...). Data is sub-allocated linearly in the slice
+	of the current frame, and every slice is protected with a fence so the CPU never writes what the GPU is reading.
+	With ARB_buffer_storage the buffer is persistently mapped, otherwise it falls back to orphaning.
+*/
+
+#pragma once
+
+#include <cstddef>
+
+#include "../includes.h"
+
+#define FRAME_RING_BUFFER_FRAMES 3
+
+class FrameRingBuffer
+{
+public:
+	FrameRingBuffer(size_t frame_size = 4 * 1024 * 1024, int num_frames = FRAME_RING_BUFFER_FRAMES);
+	~FrameRingBuffer();
+
+	//call them once per frame, around the rendering
+	void begin_frame(); //waits till the GPU is done with the slice we are about to reuse
+	void end_frame(); //fences the slice of this frame
+
+	//reserves size bytes in the current frame, returns the offset in the buffer or -1 if the frame is full
+	//map() gives a pointer to write there, call unmap() before drawing
+	long long allocate(size_t size, size_t alignment = 16);
+	void* map(size_t size, size_t alignment, long long& offset);
+	void unmap();
+
+	//allocate + copy, returns the offset or -1
+	long long upload(const void* data, size_t size, size_t alignment = 16);
+
+	unsigned int get_buffer_id() const { return buffer_id; }
+	bool is_persistent() const { return persistent; }
+	size_t get_used() const { return head; }
+	size_t get_frame_size() const { return frame_size; }
+	unsigned long long get_frame_count() const { return frame_count; } //frames begun, the data of older frames is gone
+
+	//shared by the framework (created on first use, needs a GL context)
+	static FrameRingBuffer* get();
+
+private:
+	bool create();
+
+	unsigned int buffer_id;
+	size_t frame_size;
+	int num_frames;
+	int current_frame;
+	unsigned long long frame_count;
+	size_t head; //bytes used in the current frame
+	bool persistent;
+	bool mapped; //fallback only, between map and unmap
+	unsigned char* data; //persistent mapping of the whole buffer
+	GLsync fences[FRAME_RING_BUFFER_FRAMES];
+};
@@ -0,0 +1,346 @@
+#include "image_kernels.h"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define IMAGE_USE_SSE2
+#endif
+
+void image_flip_rows(uint8_t* data, int row_bytes, int height)
+{
+	for (int y = 0; y < height / 2; ++y)
+	{
+		uint8_t* top = data + (size_t)y * row_bytes;
+		uint8_t* bottom = data + (size_t)(height - y - 1) * row_bytes;
+		int i = 0;
+#ifdef IMAGE_USE_SSE2
+		for (; i + 16 <= row_bytes; i += 16)
+		{
+			__m128i a = _mm_loadu_si128((const __m128i*)(top + i));
+			__m128i b = _mm_loadu_si128((const __m128i*)(bottom + i));
+			_mm_storeu_si128((__m128i*)(top + i), b);
+			_mm_storeu_si128((__m128i*)(bottom + i), a);
+		}
+#endif
+		for (; i < row_bytes; ++i)
+			std::swap(top[i], bottom[i]);
+	}
+}
+
+// DOWNSAMPLING ************************************
+
+#ifdef IMAGE_USE_SSE2
+//4 RGBA pixels per iteration: the even and odd pixels of both rows are separated and added in 16 bits
+static int downsample_box_rgba_sse2(const uint8_t* row0, const uint8_t* row1, int dst_width, uint8_t* dst)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i two = _mm_set1_epi16(2);
+	int x = 0;
+	for (; x + 4 <= dst_width; x += 4)
+	{
+		__m128 a0 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(row0 + x * 8)));
+		__m128 a1 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(row0 + x * 8 + 16)));
+		__m128 b0 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(row1 + x * 8)));
+		__m128 b1 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(row1 + x * 8 + 16)));
+		__m128i a_even = _mm_castps_si128(_mm_shuffle_ps(a0, a1, _MM_SHUFFLE(2, 0, 2, 0)));
+		__m128i a_odd = _mm_castps_si128(_mm_shuffle_ps(a0, a1, _MM_SHUFFLE(3, 1, 3, 1)));
+		__m128i b_even = _mm_castps_si128(_mm_shuffle_ps(b0, b1, _MM_SHUFFLE(2, 0, 2, 0)));
+		__m128i b_odd = _mm_castps_si128(_mm_shuffle_ps(b0, b1, _MM_SHUFFLE(3, 1, 3, 1)));
+
+		__m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(a_even, zero), _mm_unpacklo_epi8(a_odd, zero)),
+			_mm_add_epi16(_mm_unpacklo_epi8(b_even, zero), _mm_unpacklo_epi8(b_odd, zero)));
+		__m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(a_even, zero), _mm_unpackhi_epi8(a_odd, zero)),
+			_mm_add_epi16(_mm_unpackhi_epi8(b_even, zero), _mm_unpackhi_epi8(b_odd, zero)));
+		lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+		hi = _mm_srli_epi16(_mm_add_epi16(hi, two), 2);
+		_mm_storeu_si128((__m128i*)(dst + x * 4), _mm_packus_epi16(lo, hi));
+	}
+	return x;
+}
+
+//8 values of one channel per iteration, the even and odd bytes are the low and high halves of the shorts
+static int downsample_box_r_sse2(const uint8_t* row0, const uint8_t* row1, int dst_width, uint8_t* dst)
+{
+	const __m128i low_mask = _mm_set1_epi16(0x00FF);
+	const __m128i two = _mm_set1_epi16(2);
+	int x = 0;
+	for (; x + 8 <= dst_width; x += 8)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)(row0 + x * 2));
+		__m128i b = _mm_loadu_si128((const __m128i*)(row1 + x * 2));
+		__m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a, low_mask), _mm_srli_epi16(a, 8)),
+			_mm_add_epi16(_mm_and_si128(b, low_mask), _mm_srli_epi16(b, 8)));
+		sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+		_mm_storel_epi64((__m128i*)(dst + x), _mm_packus_epi16(sum, sum));
+	}
+	return x;
+}
+#endif
+
+void image_downsample_box(const uint8_t* src, int width, int height, int channels, uint8_t* dst)
+{
+	int dst_width = std::max(width / 2, 1);
+	int dst_height = std::max(height / 2, 1);
+	size_t src_row = (size_t)width * channels;
+	size_t dst_row = (size_t)dst_width * channels;
+
+	for (int y = 0; y < dst_height; ++y)
+	{
+		//a single row or column is averaged with itself
+		const uint8_t* row0 = src + (size_t)std::min(y * 2, height - 1) * src_row;
+		const uint8_t* row1 = src + (size_t)std::min(y * 2 + 1, height - 1) * src_row;
+		uint8_t* out = dst + y * dst_row;
+
+		int x = 0;
+#ifdef IMAGE_USE_SSE2
+		if (width > 1 && channels == 4)
+			x = downsample_box_rgba_sse2(row0, row1, dst_width, out);
+		else if (width > 1 && channels == 1)
+			x = downsample_box_r_sse2(row0, row1, dst_width, out);
+#endif
+		for (; x < dst_width; ++x)
+		{
+			int x0 = std::min(x * 2, width - 1) * channels;
+			int x1 = std::min(x * 2 + 1, width - 1) * channels;
+			for (int c = 0; c < channels; ++c)
+				out[x * channels + c] = (uint8_t)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+		}
+	}
+}
+
+#define KAISER_TAPS 6 //source pixels per output pixel and axis
+#define KAISER_ALPHA 4.0f
+
+static float bessel_i0(float x)
+{
+	float sum = 1.0f, term = 1.0f;
+	for (int k = 1; k < 16; ++k)
+	{
+		term *= (x * 0.5f / k) * (x * 0.5f / k);
+		sum += term;
+	}
+	return sum;
+}
+
+//weights of the source pixels 2x-2 .. 2x+3, the same for every output pixel
+static std::vector<float> compute_kaiser_weights()
+{
+	const float pi = 3.14159265f;
+	std::vector<float> weights(KAISER_TAPS);
+	float total = 0.0f;
+	for (int i = 0; i < KAISER_TAPS; ++i)
+	{
+		float distance = i - (KAISER_TAPS - 1) * 0.5f; //from the center of the output pixel, in source pixels
+		float t = distance * 0.5f; //in output pixels
+		float sinc = fabsf(t) < 1e-6f ? 1.0f : sinf(pi * t) / (pi * t);
+		float window_x = distance / (KAISER_TAPS * 0.5f);
+		float window = bessel_i0(KAISER_ALPHA * sqrtf(std::max(1.0f - window_x * window_x, 0.0f))) / bessel_i0(KAISER_ALPHA);
+		weights[i] = sinc * window;
+		total += weights[i];
+	}
+	for (int i = 0; i < KAISER_TAPS; ++i)
+		weights[i] /= total;
+	return weights;
+}
+
+void image_downsample_kaiser(const uint8_t* src, int width, int height, int channels, uint8_t* dst)
+{
+	int dst_width = std::max(width / 2, 1);
+	int dst_height = std::max(height / 2, 1);
+	static const std::vector<float> weights = compute_kaiser_weights(); //thread safe, mips are cooked in the workers
+	const int first_tap = -(KAISER_TAPS / 2 - 1);
+
+	//separable: rows to half width in floats, then the columns
+	std::vector<float> horizontal((size_t)dst_width * height * channels);
+	for (int y = 0; y < height; ++y)
+	{
+		const uint8_t* row = src + (size_t)y * width * channels;
+		float* out = &horizontal[(size_t)y * dst_width * channels];
+		for (int x = 0; x < dst_width; ++x)
+			for (int c = 0; c < channels; ++c)
+			{
+				float sum = 0.0f;
+				for (int i = 0; i < KAISER_TAPS; ++i)
+				{
+					int sx = std::clamp(x * 2 + first_tap + i, 0, width - 1);
+					sum += row[sx * channels + c] * weights[i];
+				}
+				out[x * channels + c] = sum;
+			}
+	}
+
+	size_t row_values = (size_t)dst_width * channels;
+	std::vector<float> column(row_values);
+	for (int y = 0; y < dst_height; ++y)
+	{
+		//whole rows at a time, the loop over the values vectorizes
+		std::fill(column.begin(), column.end(), 0.0f);
+		for (int i = 0; i < KAISER_TAPS; ++i)
+		{
+			int sy = std::clamp(y * 2 + first_tap + i, 0, height - 1);
+			const float* row = &horizontal[(size_t)sy * row_values];
+			float weight = weights[i];
+			for (size_t j = 0; j < row_values; ++j)
+				column[j] += row[j] * weight;
+		}
+		uint8_t* out = dst + (size_t)y * row_values;
+		for (size_t j = 0; j < row_values; ++j)
+			out[j] = (uint8_t)std::clamp(column[j] + 0.5f, 0.0f, 255.0f); //the negative lobes can overshoot
+	}
+}
+
+// SAMPLING ************************************
+
+static inline float sample_bilinear(const uint8_t* data, int width, int height, int channels, float x, float y)
+{
+	x = std::clamp(x, 0.0f, (float)(width - 1));
+	y = std::clamp(y, 0.0f, (float)(height - 1));
+	int x0 = (int)x, y0 = (int)y;
+	int x1 = std::min(x0 + 1, width - 1), y1 = std::min(y0 + 1, height - 1);
+	float fx = x - x0, fy = y - y0;
+	const uint8_t* row0 = data + (size_t)y0 * width * channels;
+	const uint8_t* row1 = data + (size_t)y1 * width * channels;
+	float top = row0[x0 * channels] + (row0[x1 * channels] - row0[x0 * channels]) * fx;
+	float bottom = row1[x0 * channels] + (row1[x1 * channels] - row1[x0 * channels]) * fx;
+	return top + (bottom - top) * fy;
+}
+
+void image_sample_bilinear(const uint8_t* data, int width, int height, int channels, int channel, const float* uvs, int count, float* out)
+{
+	data += channel;
+	int i = 0;
+#ifdef IMAGE_USE_SSE2
+	//coordinates and weights for 4 samples at once, only the reads of the texels are scalar
+	const __m128 size_x = _mm_set1_ps((float)width);
+	const __m128 size_y = _mm_set1_ps((float)height);
+	const __m128 max_x = _mm_set1_ps((float)(width - 1));
+	const __m128 max_y = _mm_set1_ps((float)(height - 1));
+	const __m128 zero = _mm_setzero_ps();
+	alignas(16) int32_t ix[4], iy[4];
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 uv0 = _mm_loadu_ps(uvs + i * 2);
+		__m128 uv1 = _mm_loadu_ps(uvs + i * 2 + 4);
+		__m128 x = _mm_mul_ps(_mm_shuffle_ps(uv0, uv1, _MM_SHUFFLE(2, 0, 2, 0)), size_x);
+		__m128 y = _mm_mul_ps(_mm_shuffle_ps(uv0, uv1, _MM_SHUFFLE(3, 1, 3, 1)), size_y);
+		x = _mm_min_ps(_mm_max_ps(x, zero), max_x);
+		y = _mm_min_ps(_mm_max_ps(y, zero), max_y);
+		__m128i x0 = _mm_cvttps_epi32(x); //positive, so truncating is the floor
+		__m128i y0 = _mm_cvttps_epi32(y);
+		__m128 fx = _mm_sub_ps(x, _mm_cvtepi32_ps(x0));
+		__m128 fy = _mm_sub_ps(y, _mm_cvtepi32_ps(y0));
+		_mm_store_si128((__m128i*)ix, x0);
+		_mm_store_si128((__m128i*)iy, y0);
+
+		alignas(16) float t00[4], t10[4], t01[4], t11[4];
+		for (int j = 0; j < 4; ++j)
+		{
+			int x1 = std::min(ix[j] + 1, width - 1);
+			const uint8_t* row0 = data + (size_t)iy[j] * width * channels;
+			const uint8_t* row1 = data + (size_t)std::min(iy[j] + 1, height - 1) * width * channels;
+			t00[j] = row0[ix[j] * channels];
+			t10[j] = row0[x1 * channels];
+			t01[j] = row1[ix[j] * channels];
+			t11[j] = row1[x1 * channels];
+		}
+		__m128 a = _mm_load_ps(t00), b = _mm_load_ps(t10);
+		__m128 c = _mm_load_ps(t01), d = _mm_load_ps(t11);
+		__m128 top = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), fx));
+		__m128 bottom = _mm_add_ps(c, _mm_mul_ps(_mm_sub_ps(d, c), fx));
+		_mm_storeu_ps(out + i, _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), fy)));
+	}
+#endif
+	for (; i < count; ++i)
+		out[i] = sample_bilinear(data, width, height, channels, uvs[i * 2] * width, uvs[i * 2 + 1] * height);
+}
+
+// CONVERSIONS ************************************
+
+//4 pixels per iteration as 32 bits words (3 RGB words are 4 RGBA words), little endian
+void image_rgb_to_rgba(const uint8_t* src, uint8_t* dst, int count, uint8_t alpha)
+{
+	const uint32_t a = (uint32_t)alpha << 24;
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		uint32_t w[3], p[4];
+		memcpy(w, src + i * 3, 12);
+		p[0] = (w[0] & 0xFFFFFF) | a;
+		p[1] = ((w[0] >> 24) | (w[1] << 8)) & 0xFFFFFF;
+		p[2] = ((w[1] >> 16) | (w[2] << 16)) & 0xFFFFFF;
+		p[3] = w[2] >> 8;
+		p[1] |= a; p[2] |= a; p[3] |= a;
+		memcpy(dst + i * 4, p, 16);
+	}
+	for (; i < count; ++i)
+	{
+		dst[i * 4] = src[i * 3];
+		dst[i * 4 + 1] = src[i * 3 + 1];
+		dst[i * 4 + 2] = src[i * 3 + 2];
+		dst[i * 4 + 3] = alpha;
+	}
+}
+
+void image_rgba_to_rgb(const uint8_t* src, uint8_t* dst, int count)
+{
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		uint32_t p[4], w[3];
+		memcpy(p, src + i * 4, 16);
+		w[0] = (p[0] & 0xFFFFFF) | (p[1] << 24);
+		w[1] = ((p[1] >> 8) & 0xFFFF) | (p[2] << 16);
+		w[2] = ((p[2] >> 16) & 0xFF) | (p[3] << 8);
+		memcpy(dst + i * 3, w, 12);
+	}
+	for (; i < count; ++i)
+	{
+		dst[i * 3] = src[i * 4];
+		dst[i * 3 + 1] = src[i * 4 + 1];
+		dst[i * 3 + 2] = src[i * 4 + 2];
+	}
+}
+
+void image_unorm8_to_float(const uint8_t* src, float* dst, int count)
+{
+	int i = 0;
+#ifdef IMAGE_USE_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i lo = _mm_unpacklo_epi8(v, zero);
+		__m128i hi = _mm_unpackhi_epi8(v, zero);
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+		_mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+		_mm_storeu_ps(dst + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+		_mm_storeu_ps(dst + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+	}
+#endif
+	for (; i < count; ++i)
+		dst[i] = src[i] * (1.0f / 255.0f);
+}
+
+void image_float_to_unorm8(const float* src, uint8_t* dst, int count)
+{
+	int i = 0;
+#ifdef IMAGE_USE_SSE2
+	//the packs saturate, so there is no need to clamp
+	const __m128 scale = _mm_set1_ps(255.0f);
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i a = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i), scale));
+		__m128i b = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i + 4), scale));
+		__m128i c = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i + 8), scale));
+		__m128i d = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i + 12), scale));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+	}
+#endif
+	for (; i < count; ++i)
+		dst[i] = (uint8_t)std::clamp((int)lrintf(src[i] * 255.0f), 0, 255);
+}
@@ -0,0 +1,23 @@
+/*  Row based kernels for 8 bits images (1 to 4 channels, rows tightly packed), used by Image and the texture cooking.
+	They work on whole rows without per pixel checks, with SSE2 where it pays and plain loops elsewhere.
+*/
+
+#pragma once
+
+#include <cstdint>
+
+//swaps the rows in place (top to bottom)
+void image_flip_rows(uint8_t* data, int row_bytes, int height);
+
+//half size (floor, at least 1) for the next mip: 2x2 average, or a windowed sinc (Kaiser) that keeps more detail
+void image_downsample_box(const uint8_t* src, int width, int height, int channels, uint8_t* dst);
+void image_downsample_kaiser(const uint8_t* src, int width, int height, int channels, uint8_t* dst);
+
+//bilinear samples of one channel at count uvs (u, v interleaved, in [0,1] and clamped to the borders), 0..255
+void image_sample_bilinear(const uint8_t* data, int width, int height, int channels, int channel, const float* uvs, int count, float* out);
+
+//format conversions, count is in pixels or values
+void image_rgb_to_rgba(const uint8_t* src, uint8_t* dst, int count, uint8_t alpha = 255);
+void image_rgba_to_rgb(const uint8_t* src, uint8_t* dst, int count);
+void image_unorm8_to_float(const uint8_t* src, float* dst, int count); //0..255 to 0..1
+void image_float_to_unorm8(const float* src, uint8_t* dst, int count); //0..1 to 0..255, rounded and clamped
@@ -7,11 +7,54 @@
 #include <algorithm>
 
 #include "../math/vec3.h"
+#include "uniform_buffer.h"
+
+static const UniformHandle u_viewprojection = UNIFORM_HANDLE("u_viewprojection");
+static const UniformHandle u_camera_position = UNIFORM_HANDLE("u_camera_position");
+static const UniformHandle u_model = UNIFORM_HANDLE("u_model");
+static const UniformHandle u_animated = UNIFORM_HANDLE("u_animated");
+static const UniformHandle u_color = UNIFORM_HANDLE("u_color");
+static const UniformHandle u_texture = UNIFORM_HANDLE("u_texture");
+static const UniformHandle u_texture_layer = UNIFORM_HANDLE("u_texture_layer");
+static const UniformHandle u_texture_rect = UNIFORM_HANDLE("u_texture_rect");
+
+Shader* Material::get_shader() const
+{
+	if (shader && shader->compiled)
+		return shader;
+	//still compiling in the background (or failed)
+	static Shader* fallback = Shader::get_default_shader("flat");
+	return fallback;
+}
+
+void Material::set_frame_uniforms(Camera* camera)
+{
+	Shader* shader = Shader::current;
+	if (shader->has_frame_block)
+		return; //already bound for the whole frame
+	shader->set_uniform(u_viewprojection, camera->viewprojection_matrix);
+	shader->set_uniform(u_camera_position, camera->eye);
+}
+
+void Material::set_object_uniforms(Uniforms& uniforms)
+{
+	Shader* shader = Shader::current;
+	sObjectUniforms object;
+	object.model = uniforms.model;
+	if (shader->has_object_block)
+		UniformBuffer::bind_object_uniforms(object);
+	else
+		shader->set_uniform(u_model, uniforms.model);
+	if (uniforms.animated_matrices.size()) {
+		shader->set_uniform(u_animated, uniforms.animated_matrices);
+	}
+}
 
 FlatMaterial::FlatMaterial(vec4 color)
 {
 	this->color = color;
-	shader = Shader::get("res/shaders/basic.vs", "res/shaders/flat.fs");
+	shader = Shader::get_permutation("res/shaders/basic.vs", "res/shaders/flat.fs", 0);
+	instanced_shader = Shader::get_permutation("res/shaders/basic.vs", "res/shaders/flat.fs", SHADER_FEATURE_INSTANCING);
 }
 
 FlatMaterial::~FlatMaterial() { }
@@ -19,28 +62,31 @@ FlatMaterial::~FlatMaterial() { }
 void FlatMaterial::set_uniforms(Uniforms& uniforms)
 {
 	//upload node uniforms
-	shader->set_uniform("u_viewprojection", uniforms.camera->viewprojection_matrix);
-	shader->set_uniform("u_camera_position", uniforms.camera->eye);
-	shader->set_uniform("u_model", uniforms.model);
-	if (uniforms.animated_matrices.size()) {
-		shader->set_uniform("u_animated", uniforms.animated_matrices);
-	}
-	shader->set_uniform("u_color", color);
+	set_frame_uniforms(uniforms.camera);
+	set_object_uniforms(uniforms);
+	set_material_uniforms();
+	set_texture_slot_uniforms();
+}
+
+void FlatMaterial::set_material_uniforms()
+{
+	Shader* shader = Shader::current;
+	shader->set_uniform(u_color, color);
 }
 
 void FlatMaterial::render(Mesh* mesh, Uniforms& uniforms)
 {
 	if (mesh && shader) {
 		// enable shader
-		shader->enable();
+		get_shader()->enable();
 		
 		// upload uniforms
 		set_uniforms(uniforms);
 
 		// do the draw call
-		mesh->render(GL_TRIANGLES);
+		mesh->render(GL_TRIANGLES, -1, 0, uniforms.lod);
 
-		shader->disable();
+		// the shader stays bound, so the next material with it does not need to enable it again
 	}
 }
 
@@ -51,7 +97,8 @@ void FlatMaterial::render_gui()
 
 NormalMaterial::NormalMaterial()
 {
-	shader = Shader::get("res/shaders/basic.vs", "res/shaders/normal.fs");
+	shader = Shader::get_permutation("res/shaders/basic.vs", "res/shaders/normal.fs", 0);
+	instanced_shader = Shader::get_permutation("res/shaders/basic.vs", "res/shaders/normal.fs", SHADER_FEATURE_INSTANCING);
 }
 
 void NormalMaterial::render_gui() { }
@@ -61,32 +108,52 @@ PBRMaterial::PBRMaterial()
 	metallic = 1.f;
 	roughness = 1.f;
 
-	shader = Shader::get("res/shaders/basic.vs", "res/shaders/texture.fs");
+	shader = Shader::get_permutation("res/shaders/basic.vs", "res/shaders/texture.fs", 0);
+	instanced_shader = Shader::get_permutation("res/shaders/basic.vs", "res/shaders/texture.fs", SHADER_FEATURE_INSTANCING);
 }
 
-void PBRMaterial::set_uniforms(Uniforms& uniforms)
+void PBRMaterial::set_albedo(Texture* texture)
 {
-	//upload node uniforms
-	shader->set_uniform("u_viewprojection", uniforms.camera->viewprojection_matrix);
-	shader->set_uniform("u_camera_position", uniforms.camera->eye);
-	shader->set_uniform("u_model", uniforms.model);
+	sTextureSlot slot;
+	slot.texture = texture;
+	set_albedo(slot);
+}
 
-	if (uniforms.animated_matrices.size()) {
-		shader->set_uniform("u_animated", uniforms.animated_matrices);
-	}
+void PBRMaterial::set_albedo(const sTextureSlot& slot)
+{
+	albedo_tex = slot.texture;
+	albedo_layer = slot.layer;
+	albedo_rect = slot.rect;
 
-	if (albedo_tex) shader->set_uniform("u_texture", albedo_tex, 0);
+	uint32_t features = albedo_layer != -1 ? SHADER_FEATURE_TEXTURE_ARRAY : 0;
+	shader = Shader::get_permutation("res/shaders/basic.vs", "res/shaders/texture.fs", features);
+	instanced_shader = Shader::get_permutation("res/shaders/basic.vs", "res/shaders/texture.fs", features | SHADER_FEATURE_INSTANCING);
+}
+
+void PBRMaterial::set_material_uniforms()
+{
+	Shader* shader = Shader::current;
+	if (albedo_tex) shader->set_uniform(u_texture, albedo_tex, 0);
 	//if (normal_tex) shader->set_uniform("u_normal_tex", normal_tex, 1);
 	//if (met_rou_tex) shader->set_uniform("u_met_rou_tex", met_rou_tex, 2);
 }
 
+void PBRMaterial::set_texture_slot_uniforms()
+{
+	//not with the instanced shader, it reads them per instance
+	Shader* shader = Shader::current;
+	if (albedo_layer != -1) shader->set_uniform(u_texture_layer, (float)albedo_layer);
+	shader->set_uniform(u_texture_rect, albedo_rect);
+}
+
 void PBRMaterial::render_gui() { }
 
 WireframeMaterial::WireframeMaterial()
 {
 	color = vec4(1.f);
+	wireframe = true;
 
-	shader = Shader::get("res/shaders/basic.vs", "res/shaders/flat.fs");
+	shader = Shader::get_permutation("res/shaders/basic.vs", "res/shaders/flat.fs", 0);
 }
 
 WireframeMaterial::~WireframeMaterial() { }
@@ -99,13 +166,13 @@ void WireframeMaterial::render(Mesh* mesh, Uniforms& uniforms)
 		glDisable(GL_CULL_FACE);
 
 		//enable shader
-		shader->enable();
+		get_shader()->enable();
 
 		//upload material specific uniforms
 		set_uniforms(uniforms);
 
 		//do the draw call
-		mesh->render(GL_TRIANGLES);
+		mesh->render(GL_TRIANGLES, -1, 0, uniforms.lod);
 
 		glEnable(GL_CULL_FACE);
 		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
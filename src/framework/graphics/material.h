@@ -4,6 +4,7 @@
 #include "mesh.h"
 #include "texture.h"
 #include "shader.h"
+#include "texture_array.h"
 
 #include "../math/vec4.h"
 #include "../math/mat4.h"
@@ -12,18 +13,41 @@ struct Uniforms {
 	mat4 model;
 	Camera* camera = nullptr;
 	std::vector<mat4> animated_matrices;
+	int lod = 0; //level of detail of the mesh (see Mesh::select_lod)
 };
 
 class Material {
 public:
 	
 	Shader* shader = NULL;
+	Shader* instanced_shader = NULL; //same shader with USE_INSTANCING (u_model per instance), NULL if not supported
 	Texture* texture = NULL;
 	vec4 color;
+	bool wireframe = false; //render state, the RenderQueue groups the materials with the same state
+
+	//the shader to render with, a simple flat one while the shader of the material compiles in the background
+	Shader* get_shader() const;
 
 	virtual void set_uniforms(Uniforms& uniforms) = 0;
 	virtual void render(Mesh* mesh, Uniforms& uniforms) = 0;
 	virtual void render_gui() = 0;
+
+	//set_uniforms split by how often they change, so the RenderQueue only uploads them when needed
+	//they upload to the enabled shader, which can be the regular or the instanced one
+	virtual void set_frame_uniforms(Camera* camera);
+	virtual void set_material_uniforms() {}
+	virtual void set_object_uniforms(Uniforms& uniforms);
+
+	//materials with the same shared texture (see texture_array.h) only differ in its layer and uv rect,
+	//the RenderQueue binds the texture once for all of them and draws them in the same instanced runs
+	virtual Texture* get_shared_texture() const { return NULL; }
+	virtual float get_texture_layer() const { return 0.0f; }
+	virtual vec4 get_texture_rect() const { return vec4(0.0f, 0.0f, 1.0f, 1.0f); }
+	//the layer and the rect, when the shared texture is already bound by set_material_uniforms
+	virtual void set_texture_slot_uniforms() {}
+	//materials that only differ in their color are grouped by shader, the RenderQueue sends the color per instance
+	//(a_instance_color) and calls set_material_uniforms again for the regular draws of the group
+	virtual bool color_per_instance() const { return false; }
 };
 
 class FlatMaterial : public Material {
@@ -33,8 +57,11 @@ public:
 	~FlatMaterial();
 
 	void set_uniforms(Uniforms& uniforms);
+	void set_material_uniforms();
 	void render(Mesh* mesh, Uniforms& uniforms);
 	void render_gui();
+
+	bool color_per_instance() const { return true; }
 };
 
 class NormalMaterial : public FlatMaterial {
@@ -50,12 +77,24 @@ public:
 	Texture* normal_tex = NULL;
 	Texture* met_rou_tex = NULL;
 
+	//albedo stored in a shared TextureArray (layer) or TextureAtlas (rect), so the materials bind the same texture
+	int albedo_layer = -1;
+	vec4 albedo_rect = vec4(0.0f, 0.0f, 1.0f, 1.0f);
+
 	float metallic;
 	float roughness;
 
 	PBRMaterial();
-	void set_uniforms(Uniforms& uniforms);
+	void set_albedo(Texture* texture);
+	void set_albedo(const sTextureSlot& slot); //selects the shader for arrays or atlases
+	void set_material_uniforms();
 	void render_gui();
+
+	Texture* get_shared_texture() const { return albedo_tex; }
+	float get_texture_layer() const { return albedo_layer != -1 ? (float)albedo_layer : 0.0f; }
+	vec4 get_texture_rect() const { return albedo_rect; }
+	void set_texture_slot_uniforms();
+	bool color_per_instance() const { return false; } //grouped by the shared texture instead
 };
 
 class WireframeMaterial : public FlatMaterial {
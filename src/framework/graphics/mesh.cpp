@@ -3,63 +3,82 @@
 #include <cassert>
 #include <iostream>
 #include <limits>
+#include <cfloat>
+#include <cstddef>
 #include <sys/stat.h>
+#include <functional>
+#include <algorithm>
 
 #include "shader.h"
 #include "texture.h"
+#include "mesh_bin.h"
+#include "mesh_simplify.h"
+#include "mesh_bvh.h"
+#include "frame_ring_buffer.h"
 #include "../includes.h"
 #include "../utils.h"
+#include "../job_system.h"
 #include "../camera.h"
 #include "../animations/pose.h"
 #include "../animations/skeleton.h"
+#include "../loaders/gltf_loader.h"
 
 bool Mesh::use_binary = true;			//checks if there is .wbin, it there is one tries to read it instead of the other file
 bool Mesh::auto_upload_to_vram = true;	//uploads the mesh to the GPU VRAM to speed up rendering
 bool Mesh::interleave_meshes = true;	//places the geometry in an interleaved array
+bool Mesh::auto_generate_lods = true;	//builds the LOD chain when parsing a mesh
+float Mesh::lod_error_threshold = 0.002f; //around 2 pixels at 1080p
 
 std::map<std::string, Mesh*> Mesh::s_meshes_loaded;
+std::mutex Mesh::s_meshes_mutex;
 long Mesh::num_meshes_rendered = 0;
 long Mesh::num_triangles_rendered = 0;
 
+static const UniformHandle u_Ka = UNIFORM_HANDLE("u_Ka");
+static const UniformHandle u_Kd = UNIFORM_HANDLE("u_Kd");
+static const UniformHandle u_Ks = UNIFORM_HANDLE("u_Ks");
+
 #define FORMAT_ASE 1
 #define FORMAT_OBJ 2
 #define FORMAT_MBIN 3
 #define FORMAT_MESH 4
+#define FORMAT_GLTF 5
 
-const vec3 corners[] = { {1,1,1},  {1,1,-1},  {1,-1,1},  {1,-1,-1},  {-1,1,1},  {-1,1,-1},  {-1,-1,1},  {-1,-1,-1} };
-
+//Arvo's method: the new halfsize is the box halfsize projected on the absolute value of every axis of the matrix
+//(same result as transforming the 8 corners, without the loop)
 BoundingBox transform_bounding_box(const mat4 m, const BoundingBox& box)
 {
-	vec3 box_min(10000000.0f, 1000000.0f, 1000000.0f);
-	vec3 box_max(-10000000.0f, -1000000.0f, -1000000.0f);
-
-	for (int i = 0; i < 8; ++i)
-	{
-		vec3 corner = corners[i];
-		corner = box.halfsize * corner;
-		corner = corner + box.center;
-		vec4 corner_aux = m * vec4(corner, 1.f);
-		corner = vec3(corner_aux.x, corner_aux.y, corner_aux.z);
-
-		//box_min.setMin(corner);
-		if (corner.x < box_min.x) box_min.x = corner.x;
-		if (corner.y < box_min.y) box_min.y = corner.y;
-		if (corner.z < box_min.z) box_min.z = corner.z;
-
-		//box_max.setMax(corner);
-		if (corner.x > box_min.x) box_min.x = corner.x;
-		if (corner.y > box_min.y) box_min.y = corner.y;
-		if (corner.z > box_min.z) box_min.z = corner.z;
-	}
+	vec3 center = transform_point(m, box.center);
+	vec3 halfsize(
+		fabsf(m.data[0]) * box.halfsize.x + fabsf(m.data[4]) * box.halfsize.y + fabsf(m.data[8]) * box.halfsize.z,
+		fabsf(m.data[1]) * box.halfsize.x + fabsf(m.data[5]) * box.halfsize.y + fabsf(m.data[9]) * box.halfsize.z,
+		fabsf(m.data[2]) * box.halfsize.x + fabsf(m.data[6]) * box.halfsize.y + fabsf(m.data[10]) * box.halfsize.z);
+	return BoundingBox(center, halfsize);
+}
 
-	vec3 halfsize = (box_max - box_min) * 0.5f;
-	return BoundingBox(box_max - halfsize, halfsize);
+void get_mesh_world_bounds(const Mesh* mesh, const mat4& model, BoundingBox& box, vec3& sphere_center, float& sphere_radius)
+{
+	box = transform_bounding_box(model, mesh->box);
+
+	//the sphere is around the center of the box (see Mesh::radius), scaled by the biggest axis
+	float scale_x = sqrtf(model.data[0] * model.data[0] + model.data[1] * model.data[1] + model.data[2] * model.data[2]);
+	float scale_y = sqrtf(model.data[4] * model.data[4] + model.data[5] * model.data[5] + model.data[6] * model.data[6]);
+	float scale_z = sqrtf(model.data[8] * model.data[8] + model.data[9] * model.data[9] + model.data[10] * model.data[10]);
+	sphere_center = box.center;
+	sphere_radius = mesh->radius * std::max(scale_x, std::max(scale_y, scale_z));
+
+	//meshes without radius only use the box
+	if (sphere_radius <= 0.f)
+		sphere_radius = sqrtf(dot(box.halfsize, box.halfsize));
 }
 
 Mesh::Mesh()
 {
 	radius = 0;
+	load_state = MESH_READY;
 	vertices_vbo_id = uvs_vbo_id = uvs1_vbo_id = normals_vbo_id = colors_vbo_id = interleaved_vbo_id = indices_vbo_id = bones_vbo_id = weights_vbo_id = 0;
+	interleaved_vao_id = 0;
+	usage = MESH_USAGE_STATIC;
 	collision_model = NULL;
 	clear();
 }
@@ -90,8 +109,12 @@ void Mesh::clear()
 		glDeleteBuffers(1, &weights_vbo_id);
 	if (uvs1_vbo_id)
 		glDeleteBuffers(1, &uvs1_vbo_id);
+	if (interleaved_vao_id)
+		glDeleteVertexArrays(1, &interleaved_vao_id);
 
 	//VBOs ids
+	interleaved_vao_id = 0;
+	memset(vbo_capacity, 0, sizeof(vbo_capacity));
 	vertices_vbo_id = uvs_vbo_id = normals_vbo_id = colors_vbo_id = interleaved_vbo_id = indices_vbo_id = weights_vbo_id = bones_vbo_id = uvs1_vbo_id = 0;
 
 	//buffers
@@ -101,9 +124,14 @@ void Mesh::clear()
 	colors.clear();
 	interleaved.clear();
 	indices.clear();
+	lods.clear();
+	lod_submeshes.clear();
 	bones.clear();
 	weights.clear();
 	uvs1.clear();
+
+	delete (MeshBVH*)collision_model;
+	collision_model = NULL;
 }
 
 void Mesh::cpu_skinning(Skeleton* skeleton, Pose pose)
@@ -111,150 +139,149 @@ void Mesh::cpu_skinning(Skeleton* skeleton, Pose pose)
 	// ..
 }
 
-int vertex_location = -1;
-int normal_location = -1;
-int uv_location = -1;
-int color_location = -1;
-int bones_location = -1;
-int weights_location = -1;
-int uv1_location = -1;
-
 void Mesh::enable_buffers(Shader* sh)
 {
-	vertex_location = sh->get_attribute_location("a_vertex");
-	assert(vertex_location != -1 && "No a_vertex found in shader");
-
-	if (vertex_location == -1)
+	//uploaded meshes have all the attributes stored in the VAO, the locations are the same for every shader
+	if (interleaved_vao_id)
+	{
+		glBindVertexArray(interleaved_vao_id);
 		return;
+	}
+
+	//not in VRAM, use the client arrays (only works in compatibility profiles)
+	int spacing = interleaved.size() ? sizeof(tInterleaved) : 0;
+
+	glEnableVertexAttribArray(VERTEX_ATTRIB_VERTEX);
+	glVertexAttribPointer(VERTEX_ATTRIB_VERTEX, 3, GL_FLOAT, GL_FALSE, spacing, interleaved.size() ? &interleaved[0].vertex : &vertices[0]);
+
+	if (normals.size() || spacing)
+	{
+		glEnableVertexAttribArray(VERTEX_ATTRIB_NORMAL);
+		glVertexAttribPointer(VERTEX_ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, spacing, interleaved.size() ? &interleaved[0].normal : &normals[0]);
+	}
+
+	if (uvs.size() || spacing)
+	{
+		glEnableVertexAttribArray(VERTEX_ATTRIB_UV);
+		glVertexAttribPointer(VERTEX_ATTRIB_UV, 2, GL_FLOAT, GL_FALSE, spacing, interleaved.size() ? &interleaved[0].uv : &uvs[0]);
+	}
+
+	if (uvs1.size())
+	{
+		glEnableVertexAttribArray(VERTEX_ATTRIB_UV1);
+		glVertexAttribPointer(VERTEX_ATTRIB_UV1, 2, GL_FLOAT, GL_FALSE, 0, &uvs1[0]);
+	}
+
+	if (colors.size())
+	{
+		glEnableVertexAttribArray(VERTEX_ATTRIB_COLOR);
+		glVertexAttribPointer(VERTEX_ATTRIB_COLOR, 4, GL_FLOAT, GL_FALSE, 0, &colors[0]);
+	}
+
+	if (bones.size())
+	{
+		glEnableVertexAttribArray(VERTEX_ATTRIB_BONES);
+		glVertexAttribIPointer(VERTEX_ATTRIB_BONES, 4, GL_INT, 0, &bones[0]);
+	}
+
+	if (weights.size())
+	{
+		glEnableVertexAttribArray(VERTEX_ATTRIB_WEIGHTS);
+		glVertexAttribPointer(VERTEX_ATTRIB_WEIGHTS, 4, GL_FLOAT, GL_FALSE, 0, &weights[0]);
+	}
+}
+
+//configures the VAO once, the attribute locations are fixed when shaders are linked
+void Mesh::setup_vao()
+{
+	if (interleaved_vao_id == 0)
+		glGenVertexArrays(1, &interleaved_vao_id);
+	glBindVertexArray(interleaved_vao_id);
 
 	int spacing = 0;
 	int offset_normal = 0;
 	int offset_uv = 0;
 
-	if (interleaved.size())
+	if (interleaved_vbo_id)
 	{
 		spacing = sizeof(tInterleaved);
 		offset_normal = sizeof(vec3);
 		offset_uv = sizeof(vec3) + sizeof(vec3);
 	}
 
-	glBindVertexArray(interleaved_vao_id);
-
-	if (vertices_vbo_id || interleaved_vbo_id)
+	//streamed meshes have no vertex buffer, stream_to_ring sets their attributes
+	if (interleaved_vbo_id || vertices_vbo_id)
 	{
 		glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : vertices_vbo_id);
-		glVertexAttribPointer(vertex_location, 3, GL_FLOAT, GL_FALSE, spacing, 0);
+		glEnableVertexAttribArray(VERTEX_ATTRIB_VERTEX);
+		glVertexAttribPointer(VERTEX_ATTRIB_VERTEX, 3, GL_FLOAT, GL_FALSE, spacing, 0);
 	}
 	else
-		glVertexAttribPointer(vertex_location, 3, GL_FLOAT, GL_FALSE, spacing, interleaved.size() ? &interleaved[0].vertex : &vertices[0]);
+		glDisableVertexAttribArray(VERTEX_ATTRIB_VERTEX);
 
-	glEnableVertexAttribArray(vertex_location);
-
-	normal_location = -1;
-	if (normals.size() || spacing)
+	if (interleaved_vbo_id || normals_vbo_id)
 	{
-		normal_location = sh->get_attribute_location("a_normal");
-		if (normal_location != -1)
-		{
-			glEnableVertexAttribArray(normal_location);
-			if (normals_vbo_id || interleaved_vbo_id)
-			{
-				glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : normals_vbo_id);
-				glVertexAttribPointer(normal_location, 3, GL_FLOAT, GL_FALSE, spacing, (void*)offset_normal);
-			}
-			else
-				glVertexAttribPointer(normal_location, 3, GL_FLOAT, GL_FALSE, spacing, interleaved.size() ? &interleaved[0].normal : &normals[0]);
-		}
+		glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : normals_vbo_id);
+		glEnableVertexAttribArray(VERTEX_ATTRIB_NORMAL);
+		glVertexAttribPointer(VERTEX_ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, spacing, (void*)(size_t)offset_normal);
 	}
+	else
+		glDisableVertexAttribArray(VERTEX_ATTRIB_NORMAL);
 
-	uv_location = -1;
-	if (uvs.size() || spacing)
+	if (interleaved_vbo_id || uvs_vbo_id)
 	{
-		uv_location = sh->get_attribute_location("a_uv");
-		if (uv_location != -1)
-		{
-			glEnableVertexAttribArray(uv_location);
-			if (uvs_vbo_id || interleaved_vbo_id)
-			{
-				glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : uvs_vbo_id);
-				glVertexAttribPointer(uv_location, 2, GL_FLOAT, GL_FALSE, spacing, (void*)offset_uv);
-			}
-			else
-				glVertexAttribPointer(uv_location, 2, GL_FLOAT, GL_FALSE, spacing, interleaved.size() ? &interleaved[0].uv : &uvs[0]);
-		}
+		glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : uvs_vbo_id);
+		glEnableVertexAttribArray(VERTEX_ATTRIB_UV);
+		glVertexAttribPointer(VERTEX_ATTRIB_UV, 2, GL_FLOAT, GL_FALSE, spacing, (void*)(size_t)offset_uv);
 	}
+	else
+		glDisableVertexAttribArray(VERTEX_ATTRIB_UV);
 
-	uv1_location = -1;
-	if (uvs1.size())
+	if (uvs1_vbo_id)
 	{
-		uv1_location = sh->get_attribute_location("a_uv1");
-		if (uv1_location != -1)
-		{
-			glEnableVertexAttribArray(uv1_location);
-			if (uvs1_vbo_id)
-			{
-				glBindBuffer(GL_ARRAY_BUFFER, uvs1_vbo_id);
-				glVertexAttribPointer(uv1_location, 2, GL_FLOAT, GL_FALSE, spacing, (void*)NULL);
-			}
-			else
-				glVertexAttribPointer(uv1_location, 2, GL_FLOAT, GL_FALSE, spacing, &uvs1[0]);
-		}
+		glBindBuffer(GL_ARRAY_BUFFER, uvs1_vbo_id);
+		glEnableVertexAttribArray(VERTEX_ATTRIB_UV1);
+		glVertexAttribPointer(VERTEX_ATTRIB_UV1, 2, GL_FLOAT, GL_FALSE, 0, NULL);
 	}
+	else
+		glDisableVertexAttribArray(VERTEX_ATTRIB_UV1);
 
-	color_location = -1;
-	if (colors.size())
+	if (colors_vbo_id)
 	{
-		color_location = sh->get_attribute_location("a_color");
-		if (color_location != -1)
-		{
-			glEnableVertexAttribArray(color_location);
-			if (colors_vbo_id)
-			{
-				glBindBuffer(GL_ARRAY_BUFFER, colors_vbo_id);
-				glVertexAttribPointer(color_location, 4, GL_FLOAT, GL_FALSE, 0, NULL);
-			}
-			else
-				glVertexAttribPointer(color_location, 4, GL_FLOAT, GL_FALSE, 0, &colors[0]);
-		}
+		glBindBuffer(GL_ARRAY_BUFFER, colors_vbo_id);
+		glEnableVertexAttribArray(VERTEX_ATTRIB_COLOR);
+		glVertexAttribPointer(VERTEX_ATTRIB_COLOR, 4, GL_FLOAT, GL_FALSE, 0, NULL);
 	}
+	else
+		glDisableVertexAttribArray(VERTEX_ATTRIB_COLOR);
 
-	bones_location = -1;
-	if (bones.size())
+	if (bones_vbo_id)
 	{
-		bones_location = sh->get_attribute_location("a_bones");
-		if (bones_location != -1)
-		{
-			glEnableVertexAttribArray(bones_location);
-			if (bones_vbo_id)
-			{
-				glBindBuffer(GL_ARRAY_BUFFER, bones_vbo_id);
-				glVertexAttribIPointer(bones_location, 4, GL_INT, 0, NULL);
-			}
-			else
-				glVertexAttribIPointer(bones_location, 4, GL_INT, 0, &bones[0]);
-		}
+		glBindBuffer(GL_ARRAY_BUFFER, bones_vbo_id);
+		glEnableVertexAttribArray(VERTEX_ATTRIB_BONES);
+		glVertexAttribIPointer(VERTEX_ATTRIB_BONES, 4, GL_INT, 0, NULL);
 	}
-	weights_location = -1;
-	if (weights.size())
+	else
+		glDisableVertexAttribArray(VERTEX_ATTRIB_BONES);
+
+	if (weights_vbo_id)
 	{
-		weights_location = sh->get_attribute_location("a_weights");
-		if (weights_location != -1)
-		{
-			glEnableVertexAttribArray(weights_location);
-			if (weights_vbo_id)
-			{
-				glBindBuffer(GL_ARRAY_BUFFER, weights_vbo_id);
-				glVertexAttribPointer(weights_location, 4, GL_FLOAT, GL_FALSE, 0, NULL);
-			}
-			else
-				glVertexAttribPointer(weights_location, 4, GL_FLOAT, GL_FALSE, 0, &weights[0]);
-		}
+		glBindBuffer(GL_ARRAY_BUFFER, weights_vbo_id);
+		glEnableVertexAttribArray(VERTEX_ATTRIB_WEIGHTS);
+		glVertexAttribPointer(VERTEX_ATTRIB_WEIGHTS, 4, GL_FLOAT, GL_FALSE, 0, NULL);
 	}
+	else
+		glDisableVertexAttribArray(VERTEX_ATTRIB_WEIGHTS);
+
+	//the index buffer binding is stored in the VAO too
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
 
 	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
-void Mesh::render(unsigned int primitive, int submesh_id, int num_instances)
+void Mesh::render(unsigned int primitive, int submesh_id, int num_instances, int lod)
 {
 	Shader* shader = Shader::current;
 	if (!shader || !shader->compiled)
@@ -262,11 +289,34 @@ void Mesh::render(unsigned int primitive, int submesh_id, int num_instances)
 		assert(0 && "no shader or shader not compiled or enabled");
 		return;
 	}
+	//still loading in the background
+	if (load_state != MESH_READY)
+		return;
+
 	assert((interleaved.size() || vertices.size()) && "No vertices in this mesh");
 
+	//streamed meshes draw from this frame slice of the ring buffer, if it is full they use their own buffers
+	if (usage == MESH_USAGE_STREAM && !stream_to_ring())
+	{
+		for (int i = 0; i < MESH_STREAM_INDICES; ++i)
+			upload_stream_buffer((eMeshStream)i, NULL, 0, 0);
+		setup_vao();
+		streamed_frame = (unsigned long long)-1;
+	}
+
 	//bind buffers to attribute locations
 	enable_buffers(shader);
 
+	draw(primitive, submesh_id, num_instances, lod);
+
+	//unbind them
+	disable_buffers(shader);
+}
+
+void Mesh::draw(unsigned int primitive, int submesh_id, int num_instances, int lod)
+{
+	Shader* shader = Shader::current;
+
 	//draw call
 	if (submesh_id == -1 && materials.size() > 0) // if there's mesh mtl
 	{
@@ -274,24 +324,23 @@ void Mesh::render(unsigned int primitive, int submesh_id, int num_instances)
 			sSubmeshInfo& submesh = submeshes[i];
 			for (uint32_t j = 0; j < submesh.num_draw_calls; ++j) {
 				const sSubmeshDrawCallInfo& dc = submesh.draw_calls[j];
-				if (materials.count(dc.material) > 0) {
-					shader->set_uniform("u_Ka", materials[dc.material].Ka);
-					shader->set_uniform("u_Kd", materials[dc.material].Kd);
-					shader->set_uniform("u_Ks", materials[dc.material].Ks);
+				auto it = materials.find(dc.material);
+				if (it != materials.end()) {
+					shader->set_uniform(u_Ka, it->second.Ka);
+					shader->set_uniform(u_Kd, it->second.Kd);
+					shader->set_uniform(u_Ks, it->second.Ks);
 				}
-				draw_call(primitive, i, j, num_instances);
+				draw_call(primitive, i, j, num_instances, lod);
 			}
 		}
 	}
 	else {
-		draw_call(primitive, submesh_id, 0, num_instances);
+		draw_call(primitive, submesh_id, 0, num_instances, lod);
 		assert(check_gl_errors());
 	}
-	//unbind them
-	disable_buffers(shader);
 }
 
-void Mesh::draw_call(unsigned int primitive, int submesh_id, int draw_call_id, int num_instances)
+void Mesh::draw_call(unsigned int primitive, int submesh_id, int draw_call_id, int num_instances, int lod)
 {
 	size_t start = 0; //in primitives
 	size_t size = vertices.size();
@@ -300,41 +349,39 @@ void Mesh::draw_call(unsigned int primitive, int submesh_id, int draw_call_id, i
 	else if (interleaved.size())
 		size = interleaved.size();
 
+	//the index buffer holds every LOD
+	if (lods.size())
+	{
+		lod = std::min(std::max(lod, 0), (int)lods.size() - 1);
+		start = lods[lod].start;
+		size = lods[lod].length;
+	}
+	else
+		lod = 0;
+
 	if (submesh_id > -1)
 	{
 		assert(submesh_id < submeshes.size() && "this mesh doesnt have as many submeshes");
-		sSubmeshInfo& submesh = submeshes[submesh_id];
+		sSubmeshInfo& submesh = lod ? lod_submeshes[(lod - 1) * submeshes.size() + submesh_id] : submeshes[submesh_id];
 		sSubmeshDrawCallInfo& dc = submesh.draw_calls[draw_call_id];
 		start = dc.start;
 		size = dc.length;
 	}
 
-	//DRAW
-	glBindVertexArray(interleaved_vao_id);
-
+	//DRAW (the VAO is already bound by enable_buffers)
 	if (indices.size())
 	{
-		if (num_instances > 0)
+		if (indices_vbo_id)
 		{
-			assert(indices_vbo_id && "indices must be uploaded to the GPU");
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
-			glDrawElementsInstanced(primitive, size, GL_UNSIGNED_INT, (void*)(start * sizeof(unsigned int)), num_instances);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+			if (num_instances > 0)
+				glDrawElementsInstanced(primitive, size, GL_UNSIGNED_INT, (void*)(start * sizeof(unsigned int)), num_instances);
+			else
+				glDrawElements(primitive, size, GL_UNSIGNED_INT, (void*)(start * sizeof(unsigned int)));
 		}
 		else
 		{
-			if (indices_vbo_id)
-			{
-				assert(check_gl_errors());
-				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
-				assert(check_gl_errors());
-				glDrawElements(primitive, size, GL_UNSIGNED_INT, (void*)(start * sizeof(unsigned int)));
-				assert(check_gl_errors());
-				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-				assert(check_gl_errors());
-			}
-			else
-				glDrawElements(primitive, size, GL_UNSIGNED_INT, (void*)(&indices[0] + start)); //no multiply, its a vector3u pointer)
+			assert(num_instances == 0 && "indices must be uploaded to the GPU");
+			glDrawElements(primitive, size, GL_UNSIGNED_INT, (void*)(&indices[0] + start)); //no multiply, its a vector3u pointer)
 		}
 	}
 	else
@@ -343,8 +390,6 @@ void Mesh::draw_call(unsigned int primitive, int submesh_id, int draw_call_id, i
 			glDrawArraysInstanced(primitive, start, size, num_instances);
 		else
 			glDrawArrays(primitive, start, size);
-
-		glBindVertexArray(0);
 	}
 
 	num_triangles_rendered += static_cast<long>((size / 3) * (num_instances ? num_instances : 1));
@@ -353,22 +398,18 @@ void Mesh::draw_call(unsigned int primitive, int submesh_id, int draw_call_id, i
 
 void Mesh::disable_buffers(Shader* shader)
 {
-	glBindVertexArray(interleaved_vao_id);
-	glDisableVertexAttribArray(vertex_location);
-	if (normal_location != -1) glDisableVertexAttribArray(normal_location);
-	if (uv_location != -1) glDisableVertexAttribArray(uv_location);
-	if (uv1_location != -1) glDisableVertexAttribArray(uv1_location);
-	if (color_location != -1) glDisableVertexAttribArray(color_location);
-	if (bones_location != -1) glDisableVertexAttribArray(bones_location);
-	if (weights_location != -1) glDisableVertexAttribArray(weights_location);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);    //if crashes here, COMMENT THIS LINE ****************************
+	if (!interleaved_vao_id)
+	{
+		for (int i = VERTEX_ATTRIB_VERTEX; i <= VERTEX_ATTRIB_UV1; ++i)
+			glDisableVertexAttribArray(i);
+	}
 	glBindVertexArray(0);
 }
 
 GLuint instances_buffer_id = 0;
 
 //should be faster but in some system it is slower
-void Mesh::render_instanced(unsigned int primitive, const mat4* instanced_models, int num_instances)
+void Mesh::render_instanced(unsigned int primitive, const mat4* instanced_models, int num_instances, int lod, const sInstanceTextureSlot* instanced_slots, const vec4* instanced_colors)
 {
 	if (!num_instances)
 		return;
@@ -376,35 +417,98 @@ void Mesh::render_instanced(unsigned int primitive, const mat4* instanced_models
 	Shader* shader = Shader::current;
 	assert(shader && "shader must be enabled");
 
-	if (instances_buffer_id == 0)
-		glGenBuffers(1, &instances_buffer_id);
-	glBindBuffer(GL_ARRAY_BUFFER, instances_buffer_id);
-	glBufferData(GL_ARRAY_BUFFER, num_instances * sizeof(mat4), instanced_models, GL_STREAM_DRAW);
-
-	int attribLocation = shader->get_attribute_location("u_model");
-	assert(attribLocation != -1 && "shader must have attribute mat4 u_model (not a uniform)");
-	if (attribLocation == -1)
+	assert(shader->is_attribute("u_model") && "shader must have attribute mat4 u_model (not a uniform)");
+	if (!shader->is_attribute("u_model"))
 		return; //this shader doesnt support instanced model
 
+	//instance data goes to this frame slice of the ring buffer, if it doesnt fit use our own buffer
+	size_t models_size = num_instances * sizeof(mat4);
+	size_t slots_size = instanced_slots ? num_instances * sizeof(sInstanceTextureSlot) : 0;
+	size_t colors_size = instanced_colors ? num_instances * sizeof(vec4) : 0;
+	FrameRingBuffer* ring = FrameRingBuffer::get();
+	long long models_offset = ring->upload(instanced_models, models_size, sizeof(mat4));
+	long long slots_offset = instanced_slots && models_offset >= 0 ? ring->upload(instanced_slots, slots_size, sizeof(vec4)) : -1;
+	long long colors_offset = instanced_colors && models_offset >= 0 ? ring->upload(instanced_colors, colors_size, sizeof(vec4)) : -1;
+	bool use_ring = models_offset >= 0 && (!instanced_slots || slots_offset >= 0) && (!instanced_colors || colors_offset >= 0);
+	size_t models_base = use_ring ? (size_t)models_offset : 0;
+	size_t slots_base = use_ring ? (size_t)slots_offset : models_size;
+	size_t colors_base = use_ring ? (size_t)colors_offset : models_size + slots_size;
+
+	//instanced attributes are set in the mesh VAO
+	enable_buffers(shader);
+	if (use_ring)
+		glBindBuffer(GL_ARRAY_BUFFER, ring->get_buffer_id());
+	else
+	{
+		if (instances_buffer_id == 0)
+			glGenBuffers(1, &instances_buffer_id);
+		glBindBuffer(GL_ARRAY_BUFFER, instances_buffer_id);
+		glBufferData(GL_ARRAY_BUFFER, models_size + slots_size + colors_size, NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, models_size, instanced_models);
+		if (instanced_slots)
+			glBufferSubData(GL_ARRAY_BUFFER, models_size, slots_size, instanced_slots);
+		if (instanced_colors)
+			glBufferSubData(GL_ARRAY_BUFFER, models_size + slots_size, colors_size, instanced_colors);
+	}
+
 	//mat4 count as 4 different attributes of vec4... (thanks opengl...)
 	for (int k = 0; k < 4; ++k)
 	{
-		glEnableVertexAttribArray(attribLocation + k);
-		int offset = sizeof(float) * 4 * k;
+		glEnableVertexAttribArray(VERTEX_ATTRIB_MODEL + k);
+		size_t offset = models_base + sizeof(float) * 4 * k;
 		const uint8_t* addr = (uint8_t*)offset;
-		glVertexAttribPointer(attribLocation + k, 4, GL_FLOAT, false, sizeof(mat4), addr);
-		glVertexAttribDivisor(attribLocation + k, 1); // This makes it instanced!
+		glVertexAttribPointer(VERTEX_ATTRIB_MODEL + k, 4, GL_FLOAT, false, sizeof(mat4), addr);
+		glVertexAttribDivisor(VERTEX_ATTRIB_MODEL + k, 1); // This makes it instanced!
+	}
+	if (instanced_slots)
+	{
+		const uint8_t* addr = (uint8_t*)slots_base;
+		glEnableVertexAttribArray(VERTEX_ATTRIB_TEXTURE_RECT);
+		glVertexAttribPointer(VERTEX_ATTRIB_TEXTURE_RECT, 4, GL_FLOAT, false, sizeof(sInstanceTextureSlot), addr + offsetof(sInstanceTextureSlot, rect));
+		glVertexAttribDivisor(VERTEX_ATTRIB_TEXTURE_RECT, 1);
+		glEnableVertexAttribArray(VERTEX_ATTRIB_TEXTURE_LAYER);
+		glVertexAttribPointer(VERTEX_ATTRIB_TEXTURE_LAYER, 1, GL_FLOAT, false, sizeof(sInstanceTextureSlot), addr + offsetof(sInstanceTextureSlot, layer));
+		glVertexAttribDivisor(VERTEX_ATTRIB_TEXTURE_LAYER, 1);
+	}
+	else
+	{
+		//disabled attributes read these values, the whole texture
+		glVertexAttrib4f(VERTEX_ATTRIB_TEXTURE_RECT, 0.0f, 0.0f, 1.0f, 1.0f);
+		glVertexAttrib1f(VERTEX_ATTRIB_TEXTURE_LAYER, 0.0f);
+	}
+	if (instanced_colors)
+	{
+		glEnableVertexAttribArray(VERTEX_ATTRIB_INSTANCE_COLOR);
+		glVertexAttribPointer(VERTEX_ATTRIB_INSTANCE_COLOR, 4, GL_FLOAT, false, sizeof(vec4), (uint8_t*)colors_base);
+		glVertexAttribDivisor(VERTEX_ATTRIB_INSTANCE_COLOR, 1);
 	}
+	else
+		glVertexAttrib4f(VERTEX_ATTRIB_INSTANCE_COLOR, 1.0f, 1.0f, 1.0f, 1.0f);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 	//regular render
-	render(primitive, -1, num_instances);
+	render(primitive, -1, num_instances, lod);
 
-	//disable instanced attribs
+	//disable instanced attribs so regular renders of this mesh dont use them
+	enable_buffers(shader);
 	for (int k = 0; k < 4; ++k)
 	{
-		glDisableVertexAttribArray(attribLocation + k);
-		glVertexAttribDivisor(attribLocation + k, 0);
+		glDisableVertexAttribArray(VERTEX_ATTRIB_MODEL + k);
+		glVertexAttribDivisor(VERTEX_ATTRIB_MODEL + k, 0);
+	}
+	if (instanced_slots)
+	{
+		glDisableVertexAttribArray(VERTEX_ATTRIB_TEXTURE_RECT);
+		glVertexAttribDivisor(VERTEX_ATTRIB_TEXTURE_RECT, 0);
+		glDisableVertexAttribArray(VERTEX_ATTRIB_TEXTURE_LAYER);
+		glVertexAttribDivisor(VERTEX_ATTRIB_TEXTURE_LAYER, 0);
+	}
+	if (instanced_colors)
+	{
+		glDisableVertexAttribArray(VERTEX_ATTRIB_INSTANCE_COLOR);
+		glVertexAttribDivisor(VERTEX_ATTRIB_INSTANCE_COLOR, 0);
 	}
+	disable_buffers(shader);
 }
 
 void Mesh::render_instanced(unsigned int primitive, const std::vector<vec3> positions, const char* uniform_name)
@@ -416,26 +520,39 @@ void Mesh::render_instanced(unsigned int primitive, const std::vector<vec3> posi
 	Shader* shader = Shader::current;
 	assert(shader && "shader must be enabled");
 
-	if (instances_buffer_id == 0)
-		glGenBuffers(1, &instances_buffer_id);
-	glBindBuffer(GL_ARRAY_BUFFER, instances_buffer_id);
-	glBufferData(GL_ARRAY_BUFFER, num_instances * sizeof(vec3), &positions[0], GL_STREAM_DRAW);
-
 	int attribLocation = shader->get_attribute_location(uniform_name);
 	assert(attribLocation != -1 && "shader uniform not found");
 	if (attribLocation == -1)
 		return; //this shader doesnt have instanced uniform
 
+	size_t size = num_instances * sizeof(vec3);
+	FrameRingBuffer* ring = FrameRingBuffer::get();
+	long long ring_offset = ring->upload(&positions[0], size, sizeof(vec3));
+
+	enable_buffers(shader);
+	if (ring_offset >= 0)
+		glBindBuffer(GL_ARRAY_BUFFER, ring->get_buffer_id());
+	else
+	{
+		if (instances_buffer_id == 0)
+			glGenBuffers(1, &instances_buffer_id);
+		glBindBuffer(GL_ARRAY_BUFFER, instances_buffer_id);
+		glBufferData(GL_ARRAY_BUFFER, size, &positions[0], GL_STREAM_DRAW);
+	}
+
 	glEnableVertexAttribArray(attribLocation);
-	glVertexAttribPointer(attribLocation, 3, GL_FLOAT, false, sizeof(vec3), 0);
+	glVertexAttribPointer(attribLocation, 3, GL_FLOAT, false, sizeof(vec3), (void*)(size_t)(ring_offset >= 0 ? ring_offset : 0));
 	glVertexAttribDivisor(attribLocation, 1); // This makes it instanced!
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 	//regular render
 	render(primitive, -1, num_instances);
 
 	//disable instanced attribs
+	enable_buffers(shader);
 	glDisableVertexAttribArray(attribLocation);
 	glVertexAttribDivisor(attribLocation, 0);
+	disable_buffers(shader);
 }
 
 
@@ -538,72 +655,189 @@ void Mesh::upload_to_vram()
 		exit(0);
 	}
 
-	glGenVertexArrays(1, &interleaved_vao_id);
-	if (interleaved.size())
+	//streamed meshes are copied to the ring buffer when drawn, only the indices need a buffer
+	if (usage == MESH_USAGE_STREAM)
 	{
-		// Vertex,Normal,UV
-		upload_attributes_to_vram(interleaved, interleaved_vbo_id);
+		if (indices.size())
+			update_stream(MESH_STREAM_INDICES);
+		if (!interleaved_vao_id)
+			setup_vao();
+		streamed_frame = (unsigned long long)-1;
+		return;
 	}
-	else
-	{
-		// Vertices
-		upload_attributes_to_vram(vertices, vertices_vbo_id);
 
-		// UVs
-		if (uvs.size())
-		{
-			upload_attributes_to_vram(uvs, uvs_vbo_id);
-		}
-
-		// Normals
-		if (normals.size())
+	//existing buffers are reused, streams that are gone get their buffer released
+	for (int i = 0; i < MESH_STREAM_COUNT; ++i)
+	{
+		sStreamInfo stream = get_stream_info((eMeshStream)i);
+		if (stream.count)
+			update_stream((eMeshStream)i);
+		else if (*stream.vbo)
 		{
-			upload_attributes_to_vram(normals, normals_vbo_id);
+			glDeleteBuffers(1, stream.vbo);
+			*stream.vbo = 0;
+			vbo_capacity[i] = 0;
 		}
 	}
 
-	// UVs
-	if (uvs1.size())
+	setup_vao();
+
+	check_gl_errors();
+
+	//clear buffers to save memory
+}
+
+Mesh::sStreamInfo Mesh::get_stream_info(eMeshStream stream)
+{
+	sStreamInfo info;
+	bool separated = interleaved.size() == 0; //interleaved meshes dont use the separated streams
+	switch (stream)
+	{
+	case MESH_STREAM_VERTICES: info = { &vertices_vbo_id, vertices.data(), separated ? vertices.size() : 0, sizeof(vec3) }; break;
+	case MESH_STREAM_NORMALS: info = { &normals_vbo_id, normals.data(), separated ? normals.size() : 0, sizeof(vec3) }; break;
+	case MESH_STREAM_UVS: info = { &uvs_vbo_id, uvs.data(), separated ? uvs.size() : 0, sizeof(vec2) }; break;
+	case MESH_STREAM_UVS1: info = { &uvs1_vbo_id, uvs1.data(), uvs1.size(), sizeof(vec2) }; break;
+	case MESH_STREAM_COLORS: info = { &colors_vbo_id, colors.data(), colors.size(), sizeof(vec4) }; break;
+	case MESH_STREAM_BONES: info = { &bones_vbo_id, bones.data(), bones.size(), sizeof(ivec4) }; break;
+	case MESH_STREAM_WEIGHTS: info = { &weights_vbo_id, weights.data(), weights.size(), sizeof(vec4) }; break;
+	case MESH_STREAM_INTERLEAVED: info = { &interleaved_vbo_id, interleaved.data(), interleaved.size(), sizeof(tInterleaved) }; break;
+	case MESH_STREAM_INDICES: info = { &indices_vbo_id, indices.data(), indices.size(), sizeof(unsigned int) }; break;
+	default: assert(0 && "unknown mesh stream"); info = { &vertices_vbo_id, NULL, 0, 0 };
+	}
+	return info;
+}
+
+bool Mesh::update_stream(eMeshStream stream, const void* data, size_t first, size_t count)
+{
+	//the RAM copy of a streamed mesh is sent in the next draw
+	if (usage == MESH_USAGE_STREAM && !data && stream != MESH_STREAM_INDICES && interleaved_vao_id)
 	{
-		upload_attributes_to_vram(uvs1, uvs1_vbo_id);
+		streamed_frame = (unsigned long long)-1;
+		return first < get_stream_info(stream).count;
 	}
+	return upload_stream_buffer(stream, data, first, count);
+}
 
-	// Colors
-	if (colors.size())
+bool Mesh::upload_stream_buffer(eMeshStream stream, const void* data, size_t first, size_t count)
+{
+	sStreamInfo info = get_stream_info(stream);
+	if (!data)
 	{
-		upload_attributes_to_vram(colors, colors_vbo_id);
+		//from the copy in RAM
+		if (first >= info.count)
+			return false;
+		data = (const uint8_t*)info.data + first * info.element_size;
 	}
+	if (!count)
+		count = info.count > first ? info.count - first : 0;
+	if (!count)
+		return false;
 
-	if (bones.size())
+	static const GLenum gl_usage[] = { GL_STATIC_DRAW, GL_DYNAMIC_DRAW, GL_STREAM_DRAW };
+	size_t total_bytes = std::max(info.count, first + count) * info.element_size;
+	size_t offset = first * info.element_size;
+	size_t bytes = count * info.element_size;
+	size_t& capacity = vbo_capacity[stream];
+
+	bool new_buffer = *info.vbo == 0;
+	if (new_buffer)
+		glGenBuffers(1, info.vbo);
+
+	//GL_ARRAY_BUFFER also for indices, binding the element buffer would change the current VAO
+	glBindBuffer(GL_ARRAY_BUFFER, *info.vbo);
+	if (new_buffer || total_bytes > capacity)
 	{
-		upload_attributes_to_vram(bones, bones_vbo_id);
+		//(re)allocate, the whole buffer in one call when possible
+		bool full = offset == 0 && bytes == total_bytes;
+		glBufferData(GL_ARRAY_BUFFER, total_bytes, full ? data : NULL, gl_usage[usage]);
+		if (!full)
+			glBufferSubData(GL_ARRAY_BUFFER, offset, bytes, data);
+		capacity = total_bytes;
 	}
-	if (weights.size())
+	else if (offset == 0 && bytes >= total_bytes && usage != MESH_USAGE_STATIC)
 	{
-		upload_attributes_to_vram(weights, weights_vbo_id);
+		//full update: orphan the old storage so we dont wait for draws still using it
+		glBufferData(GL_ARRAY_BUFFER, capacity, NULL, gl_usage[usage]);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, data);
 	}
-
+	else
+		glBufferSubData(GL_ARRAY_BUFFER, offset, bytes, data);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-	// Indices
-	if (indices.size())
+	//a new stream needs to be added to the VAO
+	if (new_buffer && interleaved_vao_id)
+		setup_vao();
+
+	return true;
+}
+
+bool Mesh::stream_to_ring()
+{
+	FrameRingBuffer* ring = FrameRingBuffer::get();
+	if (streamed_frame == ring->get_frame_count())
+		return true;
+
+	//every stream in RAM to this frame, the indices keep their buffer
+	long long offsets[MESH_STREAM_INDICES];
+	for (int i = 0; i < MESH_STREAM_INDICES; ++i)
 	{
-		upload_attributes_to_vram(indices, indices_vbo_id);
+		sStreamInfo info = get_stream_info((eMeshStream)i);
+		offsets[i] = info.count ? ring->upload(info.data, info.count * info.element_size, 16) : -1;
+		if (info.count && offsets[i] < 0)
+			return false;
 	}
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-	check_gl_errors();
+	if (!interleaved_vao_id)
+		setup_vao();
+	glBindVertexArray(interleaved_vao_id);
+	glBindBuffer(GL_ARRAY_BUFFER, ring->get_buffer_id());
 
-	//clear buffers to save memory
+	auto set_attribute = [](int location, int components, GLenum type, long long offset, int stride = 0, size_t member = 0) {
+		if (offset < 0)
+		{
+			glDisableVertexAttribArray(location);
+			return;
+		}
+		glEnableVertexAttribArray(location);
+		void* pointer = (void*)(size_t)(offset + member);
+		if (type == GL_INT)
+			glVertexAttribIPointer(location, components, type, stride, pointer);
+		else
+			glVertexAttribPointer(location, components, type, GL_FALSE, stride, pointer);
+	};
+
+	long long interleaved_offset = offsets[MESH_STREAM_INTERLEAVED];
+	if (interleaved_offset >= 0)
+	{
+		set_attribute(VERTEX_ATTRIB_VERTEX, 3, GL_FLOAT, interleaved_offset, sizeof(tInterleaved), 0);
+		set_attribute(VERTEX_ATTRIB_NORMAL, 3, GL_FLOAT, interleaved_offset, sizeof(tInterleaved), sizeof(vec3));
+		set_attribute(VERTEX_ATTRIB_UV, 2, GL_FLOAT, interleaved_offset, sizeof(tInterleaved), sizeof(vec3) * 2);
+	}
+	else
+	{
+		set_attribute(VERTEX_ATTRIB_VERTEX, 3, GL_FLOAT, offsets[MESH_STREAM_VERTICES]);
+		set_attribute(VERTEX_ATTRIB_NORMAL, 3, GL_FLOAT, offsets[MESH_STREAM_NORMALS]);
+		set_attribute(VERTEX_ATTRIB_UV, 2, GL_FLOAT, offsets[MESH_STREAM_UVS]);
+	}
+	set_attribute(VERTEX_ATTRIB_UV1, 2, GL_FLOAT, offsets[MESH_STREAM_UVS1]);
+	set_attribute(VERTEX_ATTRIB_COLOR, 4, GL_FLOAT, offsets[MESH_STREAM_COLORS]);
+	set_attribute(VERTEX_ATTRIB_BONES, 4, GL_INT, offsets[MESH_STREAM_BONES]);
+	set_attribute(VERTEX_ATTRIB_WEIGHTS, 4, GL_FLOAT, offsets[MESH_STREAM_WEIGHTS]);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	streamed_frame = ring->get_frame_count();
+	return true;
 }
 
 template<typename T>
-void Mesh::upload_attributes_to_vram(const std::vector<T> values, unsigned int& id)
+void Mesh::upload_attributes_to_vram(const std::vector<T>& values, unsigned int& id)
 {
+	static const GLenum gl_usage[] = { GL_STATIC_DRAW, GL_DYNAMIC_DRAW, GL_STREAM_DRAW };
 	if (id == 0)
 		glGenBuffers(1, &id);
 	glBindBuffer(GL_ARRAY_BUFFER, id);
-	glBufferData(GL_ARRAY_BUFFER, values.size() * sizeof(T), &values[0], GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, values.size() * sizeof(T), values.data(), gl_usage[usage]);
 }
 
 bool Mesh::interleave_buffers()
@@ -629,6 +863,7 @@ bool Mesh::interleave_buffers()
 	return true;
 }
 
+//header of the old single block format (version 12), kept to read old bins
 struct sMeshInfo
 {
 	int version = 0;
@@ -647,40 +882,199 @@ struct sMeshInfo
 	char extra[32]; //unused
 };
 
+bool Mesh::quantize_bin = false;
+bool Mesh::compress_bin = true;
+
 bool Mesh::read_bin(const char* filename)
 {
-	FILE* f;
 	assert(filename);
 
-	struct stat stbuffer;
-
-	stat(filename, &stbuffer);
-	f = fopen(filename, "rb");
-	if (f == NULL)
+	MeshBinReader reader;
+	if (!reader.load(filename))
+	{
+		//not a chunked file, check if it is an old one
+		if (reader.data.size() < 4 + sizeof(int) || memcmp(&reader.data[0], "MBIN", 4) != 0)
+		{
+			if (reader.data.size())
+				std::cout << "[ERROR] loading BIN: invalid content: " << filename << std::endl;
+			return false;
+		}
+		int version = 0;
+		memcpy(&version, &reader.data[4], sizeof(int));
+		if (version != MESH_BIN_LEGACY_VERSION || !read_bin_legacy(reader.data))
+		{
+			std::cout << "[WARN] loading BIN: old version: " << filename << std::endl;
+			return false;
+		}
+	}
+	else if (reader.header.version != MESH_BIN_VERSION || !read_bin_chunks(reader))
+	{
+		std::cout << "[WARN] loading BIN: old version: " << filename << std::endl;
 		return false;
+	}
 
-	unsigned int size = (unsigned int)stbuffer.st_size;
-	char* data = new char[size];
-	fread(data, size, 1, f);
-	fclose(f);
+	// if the mtl is not specified in the obj but it's needed
+	if (!materials.size()) {
+		std::string mesh_name = filename;
+		mesh_name = mesh_name.substr(0, mesh_name.size() - 5);
 
-	//watermark
-	if (memcmp(data, "MBIN", 4) != 0)
-	{
-		std::cout << "[ERROR] loading BIN: invalid content: " << filename << std::endl;
+		std::string ext = mesh_name.substr(mesh_name.find_last_of(".") + 1);
+		if (ext == "obj" || ext == "OBJ") {
+			replace(mesh_name, ".obj", ".mtl");
+			if (!parse_mtl(mesh_name.c_str()))
+				std::cerr << "MTL file not found: " << mesh_name.c_str() << std::endl;
+		}
+	}
+
+	//createCollisionModel();
+	return true;
+}
+
+bool Mesh::read_bin_chunks(const MeshBinReader& reader)
+{
+	sMeshBinInfo info;
+	if (reader.get_raw_size(MBIN_CHUNK_INFO) != sizeof(sMeshBinInfo) || !reader.decode(MBIN_CHUNK_INFO, &info))
+		return false;
+
+	size_t size = (size_t)info.num_vertices;
+
+	//every stream goes to its own container, so chunks can be decompressed in parallel
+	std::vector<std::function<bool()>> tasks;
+
+	if (reader.has(MBIN_CHUNK_INTERLEAVED))
+		tasks.push_back([&]() { return reader.decode(MBIN_CHUNK_INTERLEAVED, interleaved); });
+	else if (reader.has(MBIN_CHUNK_VERTICES_Q16))
+		tasks.push_back([&]() {
+			std::vector<uint16_t> quantized;
+			if (!reader.decode(MBIN_CHUNK_VERTICES_Q16, quantized) || quantized.size() != size * 3)
+				return false;
+			vertices.resize(size);
+			dequantize_positions(quantized.data(), size, info.aabb_min, info.aabb_max, vertices.data());
+			return true;
+		});
+	else
+		tasks.push_back([&]() { return reader.decode(MBIN_CHUNK_VERTICES, vertices); });
+
+	if (reader.has(MBIN_CHUNK_NORMALS_OCT))
+		tasks.push_back([&]() {
+			std::vector<int16_t> encoded;
+			if (!reader.decode(MBIN_CHUNK_NORMALS_OCT, encoded) || encoded.size() != size * 2)
+				return false;
+			normals.resize(size);
+			decode_octahedral(encoded.data(), size, normals.data());
+			return true;
+		});
+	else if (reader.has(MBIN_CHUNK_NORMALS))
+		tasks.push_back([&]() { return reader.decode(MBIN_CHUNK_NORMALS, normals); });
+
+	if (reader.has(MBIN_CHUNK_UVS_HALF))
+		tasks.push_back([&]() {
+			std::vector<uint16_t> encoded;
+			if (!reader.decode(MBIN_CHUNK_UVS_HALF, encoded) || encoded.size() != size * 2)
+				return false;
+			uvs.resize(size);
+			decode_half2(encoded.data(), size, uvs.data());
+			return true;
+		});
+	else if (reader.has(MBIN_CHUNK_UVS))
+		tasks.push_back([&]() { return reader.decode(MBIN_CHUNK_UVS, uvs); });
+
+	if (reader.has(MBIN_CHUNK_UVS1_HALF))
+		tasks.push_back([&]() {
+			std::vector<uint16_t> encoded;
+			if (!reader.decode(MBIN_CHUNK_UVS1_HALF, encoded) || encoded.size() != size * 2)
+				return false;
+			uvs1.resize(size);
+			decode_half2(encoded.data(), size, uvs1.data());
+			return true;
+		});
+	else if (reader.has(MBIN_CHUNK_UVS1))
+		tasks.push_back([&]() { return reader.decode(MBIN_CHUNK_UVS1, uvs1); });
+
+	if (reader.has(MBIN_CHUNK_COLORS))
+		tasks.push_back([&]() { return reader.decode(MBIN_CHUNK_COLORS, colors); });
+
+	if (reader.has(MBIN_CHUNK_INDICES16))
+		tasks.push_back([&]() {
+			std::vector<uint16_t> indices16;
+			if (!reader.decode(MBIN_CHUNK_INDICES16, indices16))
+				return false;
+			indices.assign(indices16.begin(), indices16.end());
+			return true;
+		});
+	else if (reader.has(MBIN_CHUNK_INDICES))
+		tasks.push_back([&]() { return reader.decode(MBIN_CHUNK_INDICES, indices); });
+
+	if (reader.has(MBIN_CHUNK_BONES8))
+		tasks.push_back([&]() {
+			std::vector<uint8_t> bones8;
+			if (!reader.decode(MBIN_CHUNK_BONES8, bones8) || bones8.size() != size * 4)
+				return false;
+			bones.resize(size);
+			for (size_t i = 0; i < size; ++i)
+				bones[i] = ivec4(bones8[i * 4 + 0], bones8[i * 4 + 1], bones8[i * 4 + 2], bones8[i * 4 + 3]);
+			return true;
+		});
+	else if (reader.has(MBIN_CHUNK_BONES))
+		tasks.push_back([&]() { return reader.decode(MBIN_CHUNK_BONES, bones); });
+
+	if (reader.has(MBIN_CHUNK_WEIGHTS8))
+		tasks.push_back([&]() {
+			std::vector<uint8_t> weights8;
+			if (!reader.decode(MBIN_CHUNK_WEIGHTS8, weights8) || weights8.size() != size * 4)
+				return false;
+			weights.resize(size);
+			decode_weights8(weights8.data(), size, weights.data());
+			return true;
+		});
+	else if (reader.has(MBIN_CHUNK_WEIGHTS))
+		tasks.push_back([&]() { return reader.decode(MBIN_CHUNK_WEIGHTS, weights); });
+
+	if (reader.has(MBIN_CHUNK_BONES_INFO))
+		tasks.push_back([&]() { return reader.decode(MBIN_CHUNK_BONES_INFO, bones_info); });
+
+	if (reader.has(MBIN_CHUNK_SUBMESHES))
+		tasks.push_back([&]() { return reader.decode(MBIN_CHUNK_SUBMESHES, submeshes); });
+
+	if (reader.has(MBIN_CHUNK_LODS))
+		tasks.push_back([&]() { return reader.decode(MBIN_CHUNK_LODS, lods) && reader.decode(MBIN_CHUNK_LOD_SUBMESHES, lod_submeshes); });
+
+	//decoded by the job system, this thread helps so it also works from a job (get_async)
+	std::vector<uint8_t> results(tasks.size(), 0);
+	JobSystem::parallel_for((int)tasks.size(), [&](int i) { results[i] = tasks[i]() ? 1 : 0; });
+	bool ok = std::find(results.begin(), results.end(), 0) == results.end();
+
+	if (ok && lods.size() && (lod_submeshes.size() != (lods.size() - 1) * submeshes.size() || lods.back().start + lods.back().length > indices.size()))
+		ok = false;
+
+	if (!ok || (interleaved.size() ? interleaved.size() : vertices.size()) != size)
+	{
+		clear();
 		return false;
 	}
 
-	char* pos = data + 4;
+	aabb_max = info.aabb_max;
+	aabb_min = info.aabb_min;
+	box.center = info.center;
+	box.halfsize = info.halfsize;
+	radius = info.radius;
+	memcpy(&bind_matrix, info.bind_matrix, sizeof(float) * 16);
+
+	return true;
+}
+
+bool Mesh::read_bin_legacy(const std::vector<uint8_t>& data)
+{
+	if (data.size() < 4 + sizeof(sMeshInfo))
+		return false;
+
+	const uint8_t* pos = &data[0] + 4;
 	sMeshInfo info;
 	memcpy(&info, pos, sizeof(sMeshInfo));
 	pos += sizeof(sMeshInfo);
 
-	if (info.version != MESH_BIN_VERSION || info.header_bytes != sizeof(sMeshInfo))
-	{
-		std::cout << "[WARN] loading BIN: old version: " << filename << std::endl;
+	if (info.header_bytes != sizeof(sMeshInfo))
 		return false;
-	}
 
 	if (info.streams[0] == 'I')
 	{
@@ -720,7 +1114,7 @@ bool Mesh::read_bin(const char* filename)
 	{
 		indices.resize(info.num_indices);
 		memcpy((void*)&indices[0], pos, sizeof(unsigned int) * info.num_indices);
-		pos += sizeof(uivec3) * info.num_indices;
+		pos += sizeof(unsigned int) * info.num_indices;
 	}
 
 	if (info.streams[5] == 'B')
@@ -737,13 +1131,7 @@ bool Mesh::read_bin(const char* filename)
 		pos += sizeof(vec4) * info.size;
 	}
 
-	if (info.streams[7] == 'u')
-	{
-		uvs1.resize(info.size);
-		memcpy((void*)&uvs1[0], pos, sizeof(vec2) * info.size);
-		pos += sizeof(vec2) * info.size;
-	}
-
+	//the writer stored the bones info before the secondary uvs
 	if (info.num_bones)
 	{
 		bones_info.resize(info.num_bones);
@@ -751,6 +1139,13 @@ bool Mesh::read_bin(const char* filename)
 		pos += sizeof(BoneInfo) * info.num_bones;
 	}
 
+	if (info.streams[7] == 'u')
+	{
+		uvs1.resize(info.size);
+		memcpy((void*)&uvs1[0], pos, sizeof(vec2) * info.size);
+		pos += sizeof(vec2) * info.size;
+	}
+
 	aabb_max = info.aabb_max;
 	aabb_min = info.aabb_min;
 	box.center = info.center;
@@ -765,98 +1160,156 @@ bool Mesh::read_bin(const char* filename)
 		pos += sizeof(sSubmeshInfo) * info.num_submeshes;
 	}
 
-	// if the mtl is not specified in the obj but it's needed
-	if (!materials.size()) {
-		std::string mesh_name = filename;
-		mesh_name = mesh_name.substr(0, mesh_name.size() - 5);
-
-		std::string ext = mesh_name.substr(mesh_name.find_last_of(".") + 1);
-		if (ext == "obj" || ext == "OBJ") {
-			replace(mesh_name, ".obj", ".mtl");
-			if (!parse_mtl(mesh_name.c_str()))
-				std::cerr << "MTL file not found: " << mesh_name.c_str() << std::endl;
-		}
-	}
-
-	//createCollisionModel();
 	return true;
 }
 
 bool Mesh::write_bin(const char* filename)
 {
-	assert(vertices.size() || interleaved.size());
 	std::string s_filename = filename;
 	s_filename += ".mbin";
 
-	FILE* f = fopen(s_filename.c_str(), "wb");
-	if (f == NULL)
+	MeshBinWriter writer;
+	write_bin_chunks(writer);
+	if (!writer.save(s_filename.c_str(), MESH_BIN_VERSION))
 	{
 		std::cout << "[ERROR] cannot write mesh BIN: " << s_filename.c_str() << std::endl;
 		return false;
 	}
+	return true;
+}
 
-	//watermark
-	fwrite("MBIN", sizeof(char), 4, f);
+void Mesh::write_bin_chunks(MeshBinWriter& writer)
+{
+	size_t size = interleaved.size() ? interleaved.size() : vertices.size();
 
-	sMeshInfo info;
-	memset(&info, 0, sizeof(info));
-	info.version = MESH_BIN_VERSION;
-	info.header_bytes = sizeof(sMeshInfo);
-	info.size = interleaved.size() ? interleaved.size() : vertices.size();
+	sMeshBinInfo info;
+	info.num_vertices = size;
 	info.num_indices = indices.size();
 	info.aabb_max = aabb_max;
 	info.aabb_min = aabb_min;
 	info.center = box.center;
 	info.halfsize = box.halfsize;
 	info.radius = radius;
-	info.num_bones = bones_info.size();
-	info.bind_matrix = bind_matrix;
-	info.num_submeshes = submeshes.size();
-
-	info.streams[0] = interleaved.size() ? 'I' : 'V';
-	info.streams[1] = normals.size() ? 'N' : ' ';
-	info.streams[2] = uvs.size() ? 'U' : ' ';
-	info.streams[3] = colors.size() ? 'C' : ' ';
-	info.streams[4] = indices.size() ? 'I' : ' ';
-	info.streams[5] = bones.size() ? 'B' : ' ';
-	info.streams[6] = weights.size() ? 'W' : ' ';
-	info.streams[7] = uvs1.size() ? 'u' : ' ';
-
-	//write info
-	fwrite((void*)&info, sizeof(sMeshInfo), 1, f);
-
-	//write streams
-	if (interleaved.size())
-		fwrite((void*)&interleaved[0], interleaved.size() * sizeof(tInterleaved), 1, f);
-	else
+	info.num_bones = (uint32_t)bones_info.size();
+	info.num_submeshes = (uint32_t)submeshes.size();
+	info.num_lods = (uint32_t)lods.size();
+	memcpy(info.bind_matrix, &bind_matrix, sizeof(float) * 16);
+
+	bool compress = compress_bin;
+
+	//lossy, only when asked for (and there are positions to quantize against)
+	if (!quantize_bin || size == 0)
 	{
-		fwrite((void*)&vertices[0], vertices.size() * sizeof(vec3), 1, f);
-		if (normals.size())
-			fwrite((void*)&normals[0], normals.size() * sizeof(vec3), 1, f);
-		if (uvs.size())
-			fwrite((void*)&uvs[0], uvs.size() * sizeof(vec2), 1, f);
+		writer.add_chunk(MBIN_CHUNK_INFO, &info, sizeof(info));
+		if (interleaved.size())
+			writer.add_chunk(MBIN_CHUNK_INTERLEAVED, interleaved, compress);
+		else
+		{
+			writer.add_chunk(MBIN_CHUNK_VERTICES, vertices, compress);
+			writer.add_chunk(MBIN_CHUNK_NORMALS, normals, compress);
+			writer.add_chunk(MBIN_CHUNK_UVS, uvs, compress);
+		}
+		writer.add_chunk(MBIN_CHUNK_UVS1, uvs1, compress);
+		writer.add_chunk(MBIN_CHUNK_INDICES, indices, compress);
+		writer.add_chunk(MBIN_CHUNK_BONES, bones, compress);
+		writer.add_chunk(MBIN_CHUNK_WEIGHTS, weights, compress);
 	}
+	else
+	{
+		//quantized streams are stored separated, the reader interleaves them again if needed
+		const vec3* positions = vertices.data();
+		const vec3* normals_src = normals.size() ? normals.data() : NULL;
+		const vec2* uvs_src = uvs.size() ? uvs.data() : NULL;
+		std::vector<vec3> tmp_vertices, tmp_normals;
+		std::vector<vec2> tmp_uvs;
+		if (interleaved.size())
+		{
+			tmp_vertices.resize(size);
+			tmp_normals.resize(size);
+			tmp_uvs.resize(size);
+			for (size_t i = 0; i < size; ++i)
+			{
+				tmp_vertices[i] = interleaved[i].vertex;
+				tmp_normals[i] = interleaved[i].normal;
+				tmp_uvs[i] = interleaved[i].uv;
+			}
+			positions = tmp_vertices.data();
+			normals_src = tmp_normals.data();
+			uvs_src = tmp_uvs.data();
+		}
 
-	if (colors.size())
-		fwrite((void*)&colors[0], colors.size() * sizeof(vec4), 1, f);
+		//quantize against the real bounds of the data, the stored aabb could be outdated
+		vec3 qmin = positions[0];
+		vec3 qmax = positions[0];
+		for (size_t i = 1; i < size; ++i)
+		{
+			qmin = vec3(std::min(qmin.x, positions[i].x), std::min(qmin.y, positions[i].y), std::min(qmin.z, positions[i].z));
+			qmax = vec3(std::max(qmax.x, positions[i].x), std::max(qmax.y, positions[i].y), std::max(qmax.z, positions[i].z));
+		}
+		info.aabb_min = qmin;
+		info.aabb_max = qmax;
+		writer.add_chunk(MBIN_CHUNK_INFO, &info, sizeof(info));
 
-	if (indices.size())
-		fwrite((void*)&indices[0], indices.size() * sizeof(unsigned int), 1, f);
+		std::vector<uint16_t> quantized(size * 3);
+		quantize_positions(positions, size, qmin, qmax, quantized.data());
+		writer.add_chunk(MBIN_CHUNK_VERTICES_Q16, quantized, compress);
 
-	if (bones.size())
-		fwrite((void*)&bones[0], bones.size() * sizeof(vec4), 1, f);
-	if (weights.size())
-		fwrite((void*)&weights[0], weights.size() * sizeof(vec4), 1, f);
-	if (bones_info.size())
-		fwrite((void*)&bones_info[0], bones_info.size() * sizeof(BoneInfo), 1, f);
-	if (uvs1.size())
-		fwrite((void*)&uvs1[0], uvs1.size() * sizeof(vec2), 1, f);
+		if (normals_src)
+		{
+			std::vector<int16_t> encoded(size * 2);
+			encode_octahedral(normals_src, size, encoded.data());
+			writer.add_chunk(MBIN_CHUNK_NORMALS_OCT, encoded, compress);
+		}
 
-	if (submeshes.size())
-		fwrite((void*)&submeshes[0], submeshes.size() * sizeof(sSubmeshInfo), 1, f);
+		std::vector<uint16_t> halfs(size * 2);
+		if (uvs_src)
+		{
+			encode_half2(uvs_src, size, halfs.data());
+			writer.add_chunk(MBIN_CHUNK_UVS_HALF, halfs, compress);
+		}
+		if (uvs1.size())
+		{
+			encode_half2(uvs1.data(), size, halfs.data());
+			writer.add_chunk(MBIN_CHUNK_UVS1_HALF, halfs, compress);
+		}
 
-	fclose(f);
-	return true;
+		if (indices.size() && size <= 65536)
+		{
+			std::vector<uint16_t> indices16(indices.begin(), indices.end());
+			writer.add_chunk(MBIN_CHUNK_INDICES16, indices16, compress);
+		}
+		else
+			writer.add_chunk(MBIN_CHUNK_INDICES, indices, compress);
+
+		bool small_bones = bones_info.size() <= 256;
+		for (size_t i = 0; i < bones.size() && small_bones; ++i)
+			for (int j = 0; j < 4; ++j)
+				if (bones[i].v[j] < 0 || bones[i].v[j] > 255)
+					small_bones = false;
+		if (bones.size() && small_bones)
+		{
+			std::vector<uint8_t> bones8(bones.size() * 4);
+			for (size_t i = 0; i < bones.size(); ++i)
+				for (int j = 0; j < 4; ++j)
+					bones8[i * 4 + j] = (uint8_t)bones[i].v[j];
+			writer.add_chunk(MBIN_CHUNK_BONES8, bones8, compress);
+		}
+		else
+			writer.add_chunk(MBIN_CHUNK_BONES, bones, compress);
+
+		if (weights.size())
+		{
+			std::vector<uint8_t> weights8(weights.size() * 4);
+			encode_weights8(weights.data(), weights.size(), weights8.data());
+			writer.add_chunk(MBIN_CHUNK_WEIGHTS8, weights8, compress);
+		}
+	}
+
+	writer.add_chunk(MBIN_CHUNK_COLORS, colors, compress);
+	writer.add_chunk(MBIN_CHUNK_BONES_INFO, bones_info, compress);
+	writer.add_chunk(MBIN_CHUNK_SUBMESHES, submeshes);
+	writer.add_chunk(MBIN_CHUNK_LODS, lods);
+	writer.add_chunk(MBIN_CHUNK_LOD_SUBMESHES, lod_submeshes, compress);
 }
 
 bool Mesh::parse_mtl(const char* filename)
@@ -1163,8 +1616,7 @@ bool Mesh::load_obj(const char* filename)
 
 	box.center = (aabb_max + aabb_min) * 0.5f;
 	box.halfsize = (aabb_max - box.center);
-	//radius = (float)fmax(aabb_max.length(), aabb_min.length());
-	radius = (float)fmax(len(aabb_max), len(aabb_min));
+	update_radius();
 
 	submesh_dc_info.length = vertices.size() - last_submesh_vertex;
 	submesh_info.draw_calls[submesh_draw_calls] = submesh_dc_info;
@@ -1404,19 +1856,25 @@ void Mesh::displace(Image* heightmap, float altitude)
 	int num = is_interleaved ? interleaved.size() : vertices.size();
 	assert(num && "no vertices found");
 
-	for (int i = 0; i < num; ++i)
-	{
-		vec2& uv = uvs[i];
-		vec4 c = heightmap->get_pixel_interpolated(uv.x * heightmap->width, uv.y * heightmap->height);
-		if (is_interleaved)
-			interleaved[i].vertex.y = (c.x / 255.0f) * altitude;
-		else
-			vertices[i].y = (c.x / 255.0f) * altitude;
-	}
+	//all the heights in one pass over the uvs
+	std::vector<float> heights(num);
+	heightmap->sample_bilinear(uvs.data(), num, heights.data());
+
+	float scale = altitude / 255.0f;
+	if (is_interleaved)
+		for (int i = 0; i < num; ++i)
+			interleaved[i].vertex.y = heights[i] * scale;
+	else
+		for (int i = 0; i < num; ++i)
+			vertices[i].y = heights[i] * scale;
 	box.center.y += altitude * 0.5f;
 	box.halfsize.y += altitude * 0.5f;
 	//radius = static_cast<float>(box.halfsize.length());
 	radius = len(box.halfsize);
+
+	//the triangles moved
+	if (collision_model)
+		create_collision_model();
 }
 
 
@@ -1476,6 +1934,209 @@ void Mesh::update_bounding_box()
 	}
 	box.center = (aabb_max + aabb_min) * 0.5f;
 	box.halfsize = aabb_max - box.center;
+	update_radius();
+}
+
+void Mesh::update_radius()
+{
+	//farthest vertex from the center of the box, never bigger than the half diagonal
+	float max_distance2 = 0.0f;
+	size_t size = interleaved.size() ? interleaved.size() : vertices.size();
+	for (size_t i = 0; i < size; ++i)
+	{
+		vec3 d = (interleaved.size() ? interleaved[i].vertex : vertices[i]) - box.center;
+		max_distance2 = std::max(max_distance2, dot(d, d));
+	}
+	radius = sqrtf(max_distance2);
+}
+
+bool Mesh::build_indices()
+{
+	if (indices.size())
+		return true;
+
+	size_t size = interleaved.size() ? interleaved.size() : vertices.size();
+	if (size == 0 || size % 3)
+		return false;
+
+	//every vertex as the bytes of all its attributes
+	std::vector<std::pair<const uint8_t*, size_t>> streams;
+	auto add_stream = [&](const auto& stream) {
+		if (stream.size() == size)
+			streams.push_back(std::make_pair((const uint8_t*)stream.data(), sizeof(stream[0])));
+	};
+	add_stream(interleaved);
+	add_stream(vertices);
+	add_stream(normals);
+	add_stream(uvs);
+	add_stream(uvs1);
+	add_stream(colors);
+	add_stream(bones);
+	add_stream(weights);
+
+	size_t vertex_size = 0;
+	for (size_t i = 0; i < streams.size(); ++i)
+		vertex_size += streams[i].second;
+	std::vector<uint8_t> keys(size * vertex_size);
+	for (size_t i = 0; i < size; ++i)
+	{
+		uint8_t* key = &keys[i * vertex_size];
+		for (size_t j = 0; j < streams.size(); ++j)
+		{
+			memcpy(key, streams[j].first + i * streams[j].second, streams[j].second);
+			key += streams[j].second;
+		}
+	}
+
+	//sort to find the equal vertices, new ids follow the order of the triangles
+	std::vector<unsigned int> order(size);
+	for (size_t i = 0; i < size; ++i)
+		order[i] = (unsigned int)i;
+	std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+		return memcmp(&keys[a * vertex_size], &keys[b * vertex_size], vertex_size) < 0;
+	});
+	std::vector<unsigned int> first(size);
+	for (size_t i = 0; i < size; ++i)
+		first[order[i]] = (i > 0 && memcmp(&keys[order[i] * vertex_size], &keys[order[i - 1] * vertex_size], vertex_size) == 0) ? first[order[i - 1]] : order[i];
+
+	std::vector<unsigned int> remap(size, ~0u);
+	unsigned int num_unique = 0;
+	indices.resize(size);
+	for (size_t i = 0; i < size; ++i)
+	{
+		if (remap[first[i]] == ~0u)
+			remap[first[i]] = num_unique++;
+		indices[i] = remap[first[i]];
+	}
+
+	auto compact_stream = [&](auto& stream) {
+		if (stream.size() != size)
+			return;
+		typename std::remove_reference<decltype(stream)>::type compacted(num_unique);
+		for (size_t i = 0; i < size; ++i)
+			compacted[indices[i]] = stream[i];
+		stream.swap(compacted);
+	};
+	compact_stream(interleaved);
+	compact_stream(vertices);
+	compact_stream(normals);
+	compact_stream(uvs);
+	compact_stream(uvs1);
+	compact_stream(colors);
+	compact_stream(bones);
+	compact_stream(weights);
+	return true;
+}
+
+bool Mesh::generate_lods(int max_lods)
+{
+	lods.clear();
+	lod_submeshes.clear();
+	if (max_lods < 2 || !build_indices())
+		return false;
+
+	size_t num_indices = indices.size();
+	if (num_indices / 3 < MESH_LOD_MIN_TRIANGLES * 2)
+		return false;
+
+	size_t num_vertices = get_num_vertices();
+	std::vector<vec3> interleaved_positions;
+	const vec3* positions = vertices.data();
+	if (interleaved.size())
+	{
+		interleaved_positions.resize(num_vertices);
+		for (size_t i = 0; i < num_vertices; ++i)
+			interleaved_positions[i] = interleaved[i].vertex;
+		positions = interleaved_positions.data();
+	}
+
+	//draw call of every triangle, to rebuild the submeshes of every LOD
+	std::vector<int> groups(num_indices / 3, -1);
+	int num_groups = 0;
+	for (size_t i = 0; i < submeshes.size(); ++i)
+		for (unsigned int j = 0; j < submeshes[i].num_draw_calls; ++j, ++num_groups)
+		{
+			const sSubmeshDrawCallInfo& dc = submeshes[i].draw_calls[j];
+			for (size_t t = dc.start / 3; t < (dc.start + dc.length) / 3 && t < groups.size(); ++t)
+				groups[t] = num_groups;
+		}
+
+	sMeshLOD original = { 0.0f, 0, (uint32_t)num_indices };
+	lods.push_back(original);
+
+	std::vector<unsigned int> current(indices.begin(), indices.end());
+	std::vector<size_t> group_start(num_groups), group_count(num_groups);
+	float error = 0.0f;
+	for (int level = 1; level < max_lods; ++level)
+	{
+		size_t previous = current.size();
+		size_t target = (size_t)(previous / 3 * MESH_LOD_REDUCTION) * 3;
+		if (target / 3 < MESH_LOD_MIN_TRIANGLES)
+			break;
+
+		//every LOD starts from the previous one, so the errors add up
+		error += simplify_mesh(current, positions, num_vertices, target, &groups);
+		if (current.size() > previous * 0.9f)
+			break; //most of the vertices are in seams or borders
+
+		sMeshLOD lod = { error, (uint32_t)indices.size(), (uint32_t)current.size() };
+		indices.insert(indices.end(), current.begin(), current.end());
+		lods.push_back(lod);
+
+		//triangles keep their order, so every draw call is still a contiguous range
+		std::fill(group_count.begin(), group_count.end(), 0);
+		for (size_t t = 0; t < groups.size(); ++t)
+			if (groups[t] >= 0 && group_count[groups[t]]++ == 0)
+				group_start[groups[t]] = t;
+
+		int group = 0;
+		for (size_t i = 0; i < submeshes.size(); ++i)
+		{
+			sSubmeshInfo submesh = submeshes[i];
+			for (unsigned int j = 0; j < submesh.num_draw_calls; ++j, ++group)
+			{
+				submesh.draw_calls[j].start = lod.start + (group_count[group] ? group_start[group] * 3 : 0);
+				submesh.draw_calls[j].length = group_count[group] * 3;
+			}
+			lod_submeshes.push_back(submesh);
+		}
+	}
+
+	if (lods.size() < 2)
+	{
+		lods.clear();
+		return false;
+	}
+	return true;
+}
+
+int Mesh::select_lod(const mat4& model, Camera* camera, int current_lod)
+{
+	//the lods of a mesh still loading in a worker cannot be read yet
+	if (load_state != MESH_READY || lods.size() < 2 || !camera)
+		return 0;
+
+	float scale = std::max(len(vec3(model.xx, model.xy, model.xz)), std::max(len(vec3(model.yx, model.yy, model.yz)), len(vec3(model.zx, model.zy, model.zz))));
+
+	//fraction of the screen height covered by one unit at the distance of the bounding sphere
+	float units_to_screen = camera->projection_matrix.yy * 0.5f * scale;
+	if (camera->type == Camera::PERSPECTIVE)
+	{
+		vec3 center = transform_point(model, box.center);
+		float sphere_radius = (radius > 0.0f ? radius : len(box.halfsize)) * scale;
+		float distance = len(center - camera->eye) - sphere_radius; //closest point of the sphere
+		if (distance <= camera->near_plane)
+			return 0;
+		units_to_screen /= distance;
+	}
+
+	//refine while the error is visible, coarsen only when it is clearly below the threshold (avoids popping)
+	int lod = std::min(std::max(current_lod, 0), (int)lods.size() - 1);
+	while (lod > 0 && lods[lod].error * units_to_screen > lod_error_threshold)
+		lod--;
+	while (lod + 1 < (int)lods.size() && lods[lod + 1].error * units_to_screen < lod_error_threshold * (1.0f - MESH_LOD_HYSTERESIS))
+		lod++;
+	return lod;
 }
 
 Mesh* wire_box = NULL;
@@ -1515,6 +2176,112 @@ void Mesh::render_bounding(const mat4& model, bool world_bounding)
 	sh->disable();
 }
 
+bool Mesh::create_collision_model()
+{
+	MeshBVH* bvh = (MeshBVH*)collision_model;
+	if (!bvh)
+		bvh = new MeshBVH();
+	collision_model = bvh;
+
+	size_t num_vertices = get_num_vertices();
+	std::vector<vec3> interleaved_positions;
+	const vec3* positions = vertices.data();
+	if (interleaved.size())
+	{
+		interleaved_positions.resize(num_vertices);
+		for (size_t i = 0; i < num_vertices; ++i)
+			interleaved_positions[i] = interleaved[i].vertex;
+		positions = interleaved_positions.data();
+	}
+
+	//only the full detail triangles, the LODs are stored after them
+	if (indices.size())
+	{
+		size_t start = lods.size() ? lods[0].start : 0;
+		size_t length = lods.size() ? lods[0].length : indices.size();
+		bvh->build(positions, num_vertices, &indices[start], length);
+	}
+	else
+		bvh->build(positions, num_vertices, NULL, 0);
+
+	return !bvh->empty();
+}
+
+bool Mesh::test_ray_collision(const mat4& model, const vec3& ray_origin, const vec3& ray_direction, vec3& collision, vec3& normal, float max_ray_dist, bool in_object_space)
+{
+	if (!collision_model && !create_collision_model())
+		return false;
+
+	//the distance is the same in both spaces if the direction is only transformed (not normalized) to object space
+	vec3 direction = ray_direction;
+	float length = sqrtf(dot(direction, direction));
+	if (length == 0.0f)
+		return false;
+	direction = direction * (1.0f / length);
+
+	mat4 inv_model = inverse(model);
+	vec3 local_origin = transform_point(inv_model, ray_origin);
+	vec4 local_direction = inv_model * vec4(direction, 0.0f);
+
+	float distance;
+	vec3 local_normal;
+	if (!((MeshBVH*)collision_model)->test_ray(local_origin, vec3(local_direction.x, local_direction.y, local_direction.z), max_ray_dist, distance, local_normal))
+		return false;
+
+	if (in_object_space)
+	{
+		collision = local_origin + vec3(local_direction.x, local_direction.y, local_direction.z) * distance;
+		normal = local_normal;
+		return true;
+	}
+
+	collision = ray_origin + direction * distance;
+	//normals use the inverse transpose
+	vec4 world_normal = transposed(inv_model) * vec4(local_normal, 0.0f);
+	normal = vec3(world_normal.x, world_normal.y, world_normal.z);
+	float normal_length = sqrtf(dot(normal, normal));
+	if (normal_length > 0.0f)
+		normal = normal * (1.0f / normal_length);
+	return true;
+}
+
+bool Mesh::test_sphere_collision(const mat4& model, const vec3& center, float radius, vec3& collision, vec3& normal)
+{
+	if (!collision_model && !create_collision_model())
+		return false;
+
+	//the sphere in object space is scaled by the smallest axis, so it covers the world sphere with non uniform scales
+	float min_scale = FLT_MAX;
+	for (int i = 0; i < 3; ++i)
+		min_scale = std::min(min_scale, sqrtf(model.data[i * 4] * model.data[i * 4] + model.data[i * 4 + 1] * model.data[i * 4 + 1] + model.data[i * 4 + 2] * model.data[i * 4 + 2]));
+	if (min_scale <= 0.0f)
+		return false;
+
+	mat4 inv_model = inverse(model);
+	vec3 local_center = transform_point(inv_model, center);
+	vec3 local_collision, local_normal;
+	if (!((MeshBVH*)collision_model)->test_sphere(local_center, radius / min_scale, local_collision, local_normal))
+		return false;
+
+	collision = transform_point(model, local_collision);
+	vec3 delta = center - collision;
+	float distance = sqrtf(dot(delta, delta));
+	if (distance > radius)
+		return false;
+
+	if (distance > 1e-6f)
+		normal = delta * (1.0f / distance);
+	else
+	{
+		vec4 world_normal = transposed(inv_model) * vec4(local_normal, 0.0f);
+		normal = vec3(world_normal.x, world_normal.y, world_normal.z);
+		float normal_length = sqrtf(dot(normal, normal));
+		if (normal_length > 0.0f)
+			normal = normal * (1.0f / normal_length);
+	}
+	return true;
+}
+
 Mesh* Mesh::get_quad()
 {
 	static Mesh* quad = NULL;
@@ -1527,14 +2294,9 @@ Mesh* Mesh::get_quad()
 	return quad;
 }
 
-Mesh* Mesh::get(const char* filename)
+bool Mesh::load(const char* filename)
 {
 	assert(filename);
-	std::map<std::string, Mesh*>::iterator it = s_meshes_loaded.find(filename);
-	if (it != s_meshes_loaded.end())
-		return it->second;
-
-	Mesh* m = new Mesh();
 	std::string name = filename;
 
 	//detect format
@@ -1548,61 +2310,93 @@ Mesh* Mesh::get(const char* filename)
 		file_format = FORMAT_MBIN;
 	else if (ext == "mesh" || ext == "MESH")
 		file_format = FORMAT_MESH;
+	else if (ext == "gltf" || ext == "GLTF" || ext == "glb" || ext == "GLB")
+		file_format = FORMAT_GLTF;
 	else
 	{
 		std::cerr << "Unknown mesh format: " << filename << std::endl;
-		return NULL;
+		return false;
+	}
+
+	//the glTF loader keeps its own cache (with the skeleton and the clips)
+	if (file_format == FORMAT_GLTF)
+	{
+		sGLTFAsset asset;
+		asset.mesh = this;
+		return load_gltf(filename, asset, use_binary);
 	}
 
-	//stats
-	long time = get_time();
-	std::cout << " + Mesh loading: " << filename << " ... ";
 	std::string binfilename = filename;
 
 	if (file_format != FORMAT_MBIN)
 		binfilename = binfilename + ".mbin";
 
 	//try loading the binary version
-	if (use_binary && m->read_bin(binfilename.c_str()))
+	if (use_binary && read_bin(binfilename.c_str()))
 	{
-		if (interleave_meshes && m->interleaved.size() == 0)
-		{
-			std::cout << "[INTERL] ";
-			m->interleave_buffers();
-		}
-
-		if (auto_upload_to_vram)
-		{
-			std::cout << "[VRAM] ";
-			m->upload_to_vram();
-		}
-
-		std::cout << "[OK BIN]  Faces: " << (m->interleaved.size() ? m->interleaved.size() : m->vertices.size()) / 3 << " Time: " << (get_time() - time) * 0.001 << "sec" << std::endl;
-		m->register_mesh(filename);
-		return m;
+		if (interleave_meshes && interleaved.size() == 0)
+			interleave_buffers();
+		return true;
 	}
 
 	//load the ascii version
 	bool loaded = false;
 	if (file_format == FORMAT_OBJ)
-		loaded = m->load_obj(filename);
+		loaded = load_obj(filename);
 	/*else if (file_format == FORMAT_ASE)
-		loaded = m->loadASE(filename);*/
+		loaded = loadASE(filename);*/
 	else if (file_format == FORMAT_MESH)
-		loaded = m->load_mesh(filename);
+		loaded = load_mesh(filename);
 
 	if (!loaded)
-	{
-		delete m;
-		std::cout << "[ERROR]: Mesh not found" << std::endl;
-		return NULL;
-	}
+		return false;
+
+	//simplified versions, before interleaving (they need the separated streams to weld the vertices)
+	if (auto_generate_lods)
+		generate_lods();
 
 	//to optimize, interleave the meshes
 	if (interleave_meshes)
+		interleave_buffers();
+
+	if (use_binary)
+		write_bin(filename);
+
+	return true;
+}
+
+Mesh* Mesh::get(const char* filename)
+{
+	assert(filename);
+	Mesh* m = NULL;
 	{
-		std::cout << "[INTERL] ";
-		m->interleave_buffers();
+		std::lock_guard<std::mutex> lock(s_meshes_mutex);
+		std::map<std::string, Mesh*>::iterator it = s_meshes_loaded.find(filename);
+		if (it != s_meshes_loaded.end())
+			m = it->second;
+	}
+
+	if (m)
+	{
+		//requested before with get_async, wait for it (uploads run in this thread)
+		while (m->load_state == MESH_LOADING)
+		{
+			JobSystem::process_main_thread_jobs(-1.0);
+			std::this_thread::yield();
+		}
+		return m->load_state == MESH_READY ? m : NULL;
+	}
+
+	//stats
+	long time = get_time();
+	std::cout << " + Mesh loading: " << filename << " ... ";
+
+	m = new Mesh();
+	if (!m->load(filename))
+	{
+		delete m;
+		std::cout << "[ERROR]: Mesh not found" << std::endl;
+		return NULL;
 	}
 
 	//and upload them to VRAM
@@ -1612,20 +2406,64 @@ Mesh* Mesh::get(const char* filename)
 		m->upload_to_vram();
 	}
 
-	std::cout << "[OK]  Faces: " << m->vertices.size() / 3 << " Time: " << (get_time() - time) * 0.001 << "sec" << std::endl;
-	if (use_binary)
+	std::cout << "[OK]  Faces: " << m->get_num_vertices() / 3 << " Time: " << (get_time() - time) * 0.001 << "sec" << std::endl;
+	m->register_mesh(filename);
+	return m;
+}
+
+MeshHandle Mesh::get_async(const char* filename)
+{
+	assert(filename);
+	Mesh* m = NULL;
 	{
-		std::cout << "\t\t Writing .BIN ... ";
-		m->write_bin(filename);
-		std::cout << "[OK]" << std::endl;
+		//registered before loading so concurrent requests of the same file share it
+		std::lock_guard<std::mutex> lock(s_meshes_mutex);
+		std::map<std::string, Mesh*>::iterator it = s_meshes_loaded.find(filename);
+		if (it != s_meshes_loaded.end())
+			return MeshHandle(it->second);
+
+		m = new Mesh();
+		m->load_state = MESH_LOADING;
+		m->name = filename;
+		s_meshes_loaded[filename] = m;
 	}
 
-	m->register_mesh(name);
-	return m;
+	std::string name = filename;
+	JobSystem::enqueue([m, name]() {
+		long time = get_time();
+		if (!m->load(name.c_str()))
+		{
+			std::cout << " + Mesh loading: " << name << " ... [ERROR]: Mesh not found" << std::endl;
+			m->load_state = MESH_FAILED;
+
+			//unregistered so it can be requested again, the handles keep the failed mesh
+			std::lock_guard<std::mutex> lock(s_meshes_mutex);
+			std::map<std::string, Mesh*>::iterator it = s_meshes_loaded.find(name);
+			if (it != s_meshes_loaded.end() && it->second == m)
+				s_meshes_loaded.erase(it);
+			return;
+		}
+
+		if (!auto_upload_to_vram)
+		{
+			m->load_state = MESH_READY;
+			return;
+		}
+
+		//GL calls must be done in the main thread
+		JobSystem::enqueue_main_thread([m, name, time]() {
+			m->upload_to_vram();
+			m->load_state = MESH_READY;
+			std::cout << " + Mesh loaded async: " << name << " [OK]  Faces: " << m->get_num_vertices() / 3 << " Time: " << (get_time() - time) * 0.001 << "sec" << std::endl;
+		});
+	});
+
+	return MeshHandle(m);
 }
 
 void Mesh::register_mesh(std::string name)
 {
+	std::lock_guard<std::mutex> lock(s_meshes_mutex);
 	this->name = name;
 	s_meshes_loaded[name] = this;
 }
\ No newline at end of file
@@ -3,6 +3,9 @@
 #include <vector>
 #include <map>
 #include <string>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
 
 #include "../math/vec2.h"
 #include "../math/vec3.h"
@@ -13,12 +16,50 @@ class Shader; //for binding
 class Image; //for displace
 class Skeleton; //for skinned meshes
 class Pose;
+class Camera; //for the LOD selection
+class MeshBinReader; //chunked bin files
+class MeshBinWriter;
 
-//version from 21/01/2024
-#define MESH_BIN_VERSION 12 //this is used to regenerate bins if the format changes
+//version from 18/10/2026, chunked file (see mesh_bin.h) with LODs
+#define MESH_BIN_VERSION 15 //this is used to regenerate bins if the format changes
+#define MESH_BIN_LEGACY_VERSION 12 //single block format, still readable
 
 #define MAX_SUBMESH_DRAW_CALLS 16
 
+#define MESH_MAX_LODS 4 //including the original
+#define MESH_LOD_REDUCTION 0.5f //triangles kept from one LOD to the next
+#define MESH_LOD_MIN_TRIANGLES 64 //smaller meshes do not get more LODs
+#define MESH_LOD_HYSTERESIS 0.25f //a coarser LOD needs an error this much below the threshold
+
+enum eMeshLoadState {
+	MESH_READY,		//can be rendered
+	MESH_LOADING,	//requested with get_async, still being parsed or waiting for the upload
+	MESH_FAILED
+};
+
+class MeshHandle; //returned by Mesh::get_async
+
+//GPU buffers of a mesh, used to update them
+enum eMeshStream {
+	MESH_STREAM_VERTICES,
+	MESH_STREAM_NORMALS,
+	MESH_STREAM_UVS,
+	MESH_STREAM_UVS1,
+	MESH_STREAM_COLORS,
+	MESH_STREAM_BONES,
+	MESH_STREAM_WEIGHTS,
+	MESH_STREAM_INTERLEAVED,
+	MESH_STREAM_INDICES,
+	MESH_STREAM_COUNT
+};
+
+//how often the buffers are going to change (GL_STATIC_DRAW, GL_DYNAMIC_DRAW, GL_STREAM_DRAW)
+enum eMeshUsage {
+	MESH_USAGE_STATIC,	//uploaded once
+	MESH_USAGE_DYNAMIC,	//changes from time to time
+	MESH_USAGE_STREAM	//changes every frame
+};
+
 class BoundingBox
 {
 public:
@@ -31,6 +72,17 @@ public:
 //applies a transform to a AABB so it is 
 BoundingBox transform_bounding_box(const mat4 m, const BoundingBox& box);
 
+class Mesh;
+//world AABB and bounding sphere of a mesh drawn with the model (used for culling)
+void get_mesh_world_bounds(const Mesh* mesh, const mat4& model, BoundingBox& box, vec3& sphere_center, float& sphere_radius);
+
+//per instance slot of a shared texture (see RenderQueue), read as a_texture_rect and a_texture_layer
+struct sInstanceTextureSlot
+{
+	vec4 rect;
+	float layer;
+};
+
 struct BoneInfo
 {
 	char name[32]; //max 32 chars per bone name
@@ -51,6 +103,14 @@ struct sSubmeshInfo
 	sSubmeshDrawCallInfo draw_calls[MAX_SUBMESH_DRAW_CALLS];
 };
 
+//range of the index buffer used by every LOD (the vertices are shared)
+struct sMeshLOD
+{
+	float error; //object space distance to the original surface
+	uint32_t start; //first index
+	uint32_t length; //number of indices
+};
+
 struct sMaterialInfo
 {
 	vec3 Ka;
@@ -62,13 +122,19 @@ class Mesh
 {
 public:
 	static std::map<std::string, Mesh*> s_meshes_loaded;
+	static std::mutex s_meshes_mutex; //get_async registers meshes from other threads
 	static bool use_binary; //always load the binary version of a mesh when possible
 	static bool interleave_meshes; //loaded meshes will me automatically interleaved
 	static bool auto_upload_to_vram; //loaded meshes will be stored in the VRAM
+	static bool quantize_bin; //written bins store quantized streams (16 bit positions, octahedral normals, half uvs...), lossy so off by default
+	static bool compress_bin; //written bins compress every stream with LZ4
+	static bool auto_generate_lods; //loaded meshes get a LOD chain (stored in the bin)
+	static float lod_error_threshold; //max error allowed on screen, as a fraction of the screen height
 	static long num_meshes_rendered;
 	static long num_triangles_rendered;
 
 	std::string name;
+	std::atomic<int> load_state; //eMeshLoadState
 
 	std::vector<sSubmeshInfo> submeshes; //contains info about every submesh
 	std::map<std::string, sMaterialInfo> materials; //contains info about every material
@@ -90,6 +156,10 @@ public:
 
 	std::vector<unsigned int> indices; //for indexed meshes
 
+	//LOD chain, empty if not generated. lods[0] is the original, the rest are stored after it in indices
+	std::vector<sMeshLOD> lods;
+	std::vector<sSubmeshInfo> lod_submeshes; //submeshes of LODs 1..n, (lod - 1) * submeshes.size() + submesh
+
 	//for animated meshes
 	std::vector<ivec4> bones; //tells which bones afect the vertex (4 max)
 	std::vector<vec4> weights; //tells how much affect every bone
@@ -100,7 +170,7 @@ public:
 	vec3 aabb_max;
 	BoundingBox box;
 
-	float radius;
+	float radius; //of the bounding sphere centered in box.center (every loader uses this convention)
 
 	unsigned int vertices_vbo_id;
 	unsigned int uvs_vbo_id;
@@ -113,6 +183,8 @@ public:
 	unsigned int bones_vbo_id;
 	unsigned int weights_vbo_id;
 	unsigned int uvs1_vbo_id;
+	size_t vbo_capacity[MESH_STREAM_COUNT]; //bytes allocated in every buffer
+	eMeshUsage usage; //hint for the buffers, set it before upload_to_vram (MESH_USAGE_STREAM meshes draw from the FrameRingBuffer)
 
 	Mesh();
 	~Mesh();
@@ -121,31 +193,39 @@ public:
 
 	void cpu_skinning(Skeleton* skeleton, Pose pose);
 
-	void render(unsigned int primitive, int submesh_id = -1, int num_instances = 0);
-	void render_instanced(unsigned int primitive, const mat4* instanced_models, int number);
+	void render(unsigned int primitive, int submesh_id = -1, int num_instances = 0, int lod = 0);
+	void draw(unsigned int primitive, int submesh_id = -1, int num_instances = 0, int lod = 0); //like render, but the buffers must be enabled already (see RenderQueue)
+	void render_instanced(unsigned int primitive, const mat4* instanced_models, int number, int lod = 0, const sInstanceTextureSlot* instanced_slots = NULL, const vec4* instanced_colors = NULL);
 	void render_instanced(unsigned int primitive, const std::vector<vec3> positions, const char* uniform_name);
 	void render_bounding(const mat4& model, bool world_bounding = true);
 	void render_fixed_pipeline(int primitive); //sloooooooow
 
 	void enable_buffers(Shader* shader);
-	void draw_call(unsigned int primitive, int submesh_id, int draw_call_id, int num_instances);
+	void draw_call(unsigned int primitive, int submesh_id, int draw_call_id, int num_instances, int lod = 0);
 	void disable_buffers(Shader* shader);
+	void setup_vao(); //called by upload_to_vram
 
 	bool read_bin(const char* filename);
 	bool write_bin(const char* filename);
+	//to store the mesh inside other chunked files (i.e. with skeletons and animations)
+	bool read_bin_chunks(const MeshBinReader& reader);
+	void write_bin_chunks(MeshBinWriter& writer);
 
 	unsigned int get_num_submeshes() { return (unsigned int)submeshes.size(); }
 	unsigned int get_num_vertices() { return (unsigned int)interleaved.size() ? (unsigned int)interleaved.size() : (unsigned int)vertices.size(); }
 
 	//collision testing
-	void* collision_model;
-	//bool createCollisionModel(bool is_static = false); //is_static sets if the inv matrix should be computed after setTransform (true) or before rayCollision (false)
-	////help: model is the transform of the mesh, ray origin and direction, a Vector3 where to store the collision if found, a Vector3 where to store the normal if there was a collision, max ray distance in case the ray should go to infintiy, and in_object_space to get the collision point in object space or world space
-	//bool testRayCollision(Matrix44 model, Vector3 ray_origin, Vector3 ray_direction, Vector3& collision, Vector3& normal, float max_ray_dist = 3.4e+38F, bool in_object_space = false);
-	//bool testSphereCollision(Matrix44 model, Vector3 center, float radius, Vector3& collision, Vector3& normal);
+	void* collision_model; //MeshBVH of the triangles, built on demand
+	bool create_collision_model(); //call it again if the vertices change (displace already does it)
+	//help: model is the transform of the mesh, ray origin and direction, a vec3 where to store the collision if found, a vec3 where to store the normal if there was a collision, max ray distance in case the ray should go to infintiy, and in_object_space to get the collision point in object space or world space
+	bool test_ray_collision(const mat4& model, const vec3& ray_origin, const vec3& ray_direction, vec3& collision, vec3& normal, float max_ray_dist = 3.4e+38F, bool in_object_space = false);
+	bool test_sphere_collision(const mat4& model, const vec3& center, float radius, vec3& collision, vec3& normal);
 
 	//loader
 	static Mesh* get(const char* filename);
+	static MeshHandle get_async(const char* filename); //parses in a worker thread, uploads in the main thread
+	bool load(const char* filename); //cpu side only (bin or parsing), can run in any thread
+	bool is_ready() const { return load_state == MESH_READY; }
 	void register_mesh(std::string name);
 
 	//create help meshes
@@ -158,18 +238,61 @@ public:
 	void displace(Image* heightmap, float altitude);
 	static Mesh* get_quad(); //get global quad
 
-	void update_bounding_box();
+	void update_bounding_box(); //also the radius
+	void update_radius(); //from box.center, call it if the box is set by hand
+
+	//level of detail
+	bool build_indices(); //turns a triangle soup into an indexed mesh merging equal vertices
+	bool generate_lods(int max_lods = MESH_MAX_LODS); //simplified versions of the mesh (see mesh_simplify.h)
+	unsigned int get_num_lods() { return lods.size() ? (unsigned int)lods.size() : 1; }
+	//picks the LOD from the projected bounding sphere, current_lod is the one used last frame (for the hysteresis)
+	int select_lod(const mat4& model, Camera* camera, int current_lod = 0);
 
 	//optimize meshes
-	void upload_to_vram();
+	void upload_to_vram(); //reuses the buffers already created
+	//uploads a range of a stream (in elements), data NULL uses the stream in RAM, count 0 until the end
+	bool update_stream(eMeshStream stream, const void* data = NULL, size_t first = 0, size_t count = 0);
 	template <typename T>
-	void upload_attributes_to_vram(const std::vector<T> values, unsigned int& id);
+	void upload_attributes_to_vram(const std::vector<T>& values, unsigned int& id);
 
 	bool interleave_buffers();
 
 private:
+	struct sStreamInfo
+	{
+		unsigned int* vbo;
+		const void* data;
+		size_t count;
+		size_t element_size;
+	};
+	sStreamInfo get_stream_info(eMeshStream stream);
+
+	//MESH_USAGE_STREAM: the streams in RAM are copied once per frame to the ring buffer and the VAO points there
+	unsigned long long streamed_frame = (unsigned long long)-1;
+	bool stream_to_ring(); //false if they do not fit in this frame
+	bool upload_stream_buffer(eMeshStream stream, const void* data, size_t first, size_t count);
+
 	//bool loadASE(const char* filename);
 	bool load_obj(const char* filename);
 	bool parse_mtl(const char* filename);
 	bool load_mesh(const char* filename); //personal format used for animations
+	bool read_bin_legacy(const std::vector<uint8_t>& data);
+};
+
+class MeshHandle
+{
+public:
+	MeshHandle(Mesh* mesh = NULL) : mesh(mesh) {}
+
+	bool is_valid() const { return mesh != NULL; }
+	bool is_ready() const { return mesh && mesh->load_state == MESH_READY; }
+	bool has_failed() const { return !mesh || mesh->load_state == MESH_FAILED; }
+
+	//NULL until the mesh is loaded and uploaded
+	Mesh* get() const { return is_ready() ? mesh : NULL; }
+	//the mesh even if it is not ready (rendering it does nothing till then)
+	Mesh* get_mesh() const { return mesh; }
+
+private:
+	Mesh* mesh;
 };
\ No newline at end of file
@@ -0,0 +1,552 @@
+#include "mesh_bin.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+
+void MeshBinWriter::add_chunk(uint32_t tag, const void* data, size_t size, bool compress)
+{
+	sMeshBinChunk chunk;
+	chunk.tag = tag;
+	chunk.raw_size = size;
+
+	std::vector<uint8_t> payload;
+	if (compress && size > 64)
+	{
+		//[num_blocks][block sizes][blocks...], high bit of the size means the block is stored raw
+		uint32_t num_blocks = (uint32_t)((size + MBIN_LZ4_BLOCK_SIZE - 1) / MBIN_LZ4_BLOCK_SIZE);
+		std::vector<uint32_t> sizes(num_blocks);
+		std::vector<uint8_t> blocks;
+		std::vector<uint8_t> tmp(lz4_compress_bound(MBIN_LZ4_BLOCK_SIZE));
+		const uint8_t* src = (const uint8_t*)data;
+
+		for (uint32_t i = 0; i < num_blocks; ++i)
+		{
+			int block_size = (int)std::min<size_t>(MBIN_LZ4_BLOCK_SIZE, size - (size_t)i * MBIN_LZ4_BLOCK_SIZE);
+			const uint8_t* block = src + (size_t)i * MBIN_LZ4_BLOCK_SIZE;
+			int compressed = lz4_compress_block(block, block_size, &tmp[0], (int)tmp.size());
+			if (compressed > 0 && compressed < block_size)
+			{
+				sizes[i] = (uint32_t)compressed;
+				blocks.insert(blocks.end(), tmp.begin(), tmp.begin() + compressed);
+			}
+			else
+			{
+				sizes[i] = (uint32_t)block_size | 0x80000000u;
+				blocks.insert(blocks.end(), block, block + block_size);
+			}
+		}
+
+		//only worth it if it saves something
+		if (blocks.size() + sizeof(uint32_t) * (num_blocks + 1) < size)
+		{
+			payload.resize(sizeof(uint32_t) * (num_blocks + 1) + blocks.size());
+			memcpy(&payload[0], &num_blocks, sizeof(uint32_t));
+			memcpy(&payload[sizeof(uint32_t)], &sizes[0], sizeof(uint32_t) * num_blocks);
+			memcpy(&payload[sizeof(uint32_t) * (num_blocks + 1)], &blocks[0], blocks.size());
+			chunk.flags |= MBIN_CHUNK_FLAG_LZ4;
+		}
+	}
+
+	if (!(chunk.flags & MBIN_CHUNK_FLAG_LZ4))
+		payload.assign((const uint8_t*)data, (const uint8_t*)data + size);
+
+	chunk.size = payload.size();
+	chunks.push_back(chunk);
+	payloads.push_back(std::move(payload));
+}
+
+bool MeshBinWriter::save(const char* filename, int version)
+{
+	FILE* f = fopen(filename, "wb");
+	if (f == NULL)
+		return false;
+
+	sMeshBinHeader header;
+	header.version = version;
+	header.header_bytes = sizeof(sMeshBinHeader);
+	header.num_chunks = (int)chunks.size();
+
+	//payloads start after the table of contents, aligned to 16 bytes
+	uint64_t offset = 4 + sizeof(sMeshBinHeader) + sizeof(sMeshBinChunk) * chunks.size();
+	for (size_t i = 0; i < chunks.size(); ++i)
+	{
+		offset = (offset + 15) & ~(uint64_t)15;
+		chunks[i].offset = offset;
+		offset += chunks[i].size;
+	}
+
+	//watermark
+	fwrite("MBIN", sizeof(char), 4, f);
+	fwrite(&header, sizeof(sMeshBinHeader), 1, f);
+	if (chunks.size())
+		fwrite(&chunks[0], sizeof(sMeshBinChunk), chunks.size(), f);
+
+	static const uint8_t padding[16] = { 0 };
+	long pos = (long)(4 + sizeof(sMeshBinHeader) + sizeof(sMeshBinChunk) * chunks.size());
+	for (size_t i = 0; i < chunks.size(); ++i)
+	{
+		if (chunks[i].offset > (uint64_t)pos)
+			fwrite(padding, 1, (size_t)(chunks[i].offset - pos), f);
+		if (payloads[i].size())
+			fwrite(&payloads[i][0], 1, payloads[i].size(), f);
+		pos = (long)(chunks[i].offset + chunks[i].size);
+	}
+
+	fclose(f);
+	return true;
+}
+
+bool MeshBinReader::load(const char* filename)
+{
+	FILE* f = fopen(filename, "rb");
+	if (f == NULL)
+		return false;
+
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	rewind(f);
+
+	std::vector<uint8_t> file_data(size > 0 ? size : 0);
+	if (size > 0 && fread(&file_data[0], 1, size, f) != (size_t)size)
+		file_data.clear();
+	fclose(f);
+
+	return load_from_memory(file_data);
+}
+
+bool MeshBinReader::load_from_memory(std::vector<uint8_t>& file_data)
+{
+	data.swap(file_data);
+	chunks.clear();
+
+	if (data.size() < 4 + sizeof(sMeshBinHeader) || memcmp(&data[0], "MBIN", 4) != 0)
+		return false;
+
+	memcpy(&header, &data[4], sizeof(sMeshBinHeader));
+	if (header.header_bytes != sizeof(sMeshBinHeader) || header.num_chunks < 0)
+		return false;
+
+	size_t table_end = 4 + sizeof(sMeshBinHeader) + sizeof(sMeshBinChunk) * header.num_chunks;
+	if (table_end > data.size())
+		return false;
+
+	chunks.resize(header.num_chunks);
+	if (header.num_chunks)
+		memcpy(&chunks[0], &data[4 + sizeof(sMeshBinHeader)], sizeof(sMeshBinChunk) * header.num_chunks);
+
+	//written so a huge offset or size cannot wrap around and pass the check
+	uint64_t file_size = data.size();
+	for (size_t i = 0; i < chunks.size(); ++i)
+		if (chunks[i].size > file_size || chunks[i].offset > file_size - chunks[i].size)
+		{
+			std::cout << "[ERROR] loading BIN: truncated chunk" << std::endl;
+			return false;
+		}
+
+	return true;
+}
+
+const sMeshBinChunk* MeshBinReader::find(uint32_t tag) const
+{
+	for (size_t i = 0; i < chunks.size(); ++i)
+		if (chunks[i].tag == tag)
+			return &chunks[i];
+	return nullptr;
+}
+
+bool MeshBinReader::decode(const sMeshBinChunk& chunk, void* dst) const
+{
+	const uint8_t* src = &data[0] + chunk.offset;
+
+	if (!(chunk.flags & MBIN_CHUNK_FLAG_LZ4))
+	{
+		if (chunk.size != chunk.raw_size)
+			return false;
+		memcpy(dst, src, (size_t)chunk.size);
+		return true;
+	}
+
+	uint32_t num_blocks = 0;
+	if (chunk.size < sizeof(uint32_t))
+		return false;
+	memcpy(&num_blocks, src, sizeof(uint32_t));
+	//the table of sizes has to fit in the chunk before it is read
+	if ((uint64_t)num_blocks > (chunk.size - sizeof(uint32_t)) / sizeof(uint32_t))
+		return false;
+	const uint8_t* sizes = src + sizeof(uint32_t);
+	const uint8_t* block = sizes + sizeof(uint32_t) * num_blocks;
+	const uint8_t* end = src + chunk.size;
+	uint8_t* out = (uint8_t*)dst;
+	uint64_t remaining = chunk.raw_size;
+
+	for (uint32_t i = 0; i < num_blocks; ++i)
+	{
+		uint32_t block_size;
+		memcpy(&block_size, sizes + i * sizeof(uint32_t), sizeof(uint32_t));
+		int raw_size = (int)std::min<uint64_t>(MBIN_LZ4_BLOCK_SIZE, remaining);
+		bool stored = (block_size & 0x80000000u) != 0;
+		block_size &= 0x7FFFFFFFu;
+		if (block_size > (size_t)(end - block))
+			return false;
+
+		if (stored)
+		{
+			if ((int)block_size != raw_size)
+				return false;
+			memcpy(out, block, block_size);
+		}
+		else if (lz4_decompress_block(block, (int)block_size, out, raw_size) != raw_size)
+			return false;
+
+		block += block_size;
+		out += raw_size;
+		remaining -= raw_size;
+	}
+
+	return remaining == 0;
+}
+
+// LZ4 ***********************************************
+
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5 //last bytes of a block are always literals
+#define LZ4_MF_LIMIT 12 //a match cannot start closer than this to the end
+#define LZ4_HASH_BITS 12
+
+int lz4_compress_bound(int size)
+{
+	return size + size / 255 + 16;
+}
+
+static inline uint32_t lz4_read32(const uint8_t* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static inline uint32_t lz4_hash(uint32_t v) { return (v * 2654435761u) >> (32 - LZ4_HASH_BITS); }
+
+static inline uint8_t* lz4_write_length(uint8_t* op, int length)
+{
+	while (length >= 255) { *op++ = 255; length -= 255; }
+	*op++ = (uint8_t)length;
+	return op;
+}
+
+int lz4_compress_block(const uint8_t* src, int src_size, uint8_t* dst, int dst_capacity)
+{
+	if (dst_capacity < lz4_compress_bound(src_size))
+		return 0;
+
+	int table[1 << LZ4_HASH_BITS];
+	for (int i = 0; i < (1 << LZ4_HASH_BITS); ++i)
+		table[i] = -1;
+
+	const uint8_t* ip = src;
+	const uint8_t* anchor = src;
+	const uint8_t* end = src + src_size;
+	const uint8_t* match_limit = end - LZ4_LAST_LITERALS;
+	uint8_t* op = dst;
+
+	if (src_size >= LZ4_MF_LIMIT + 1)
+	{
+		const uint8_t* search_limit = end - LZ4_MF_LIMIT;
+		while (ip < search_limit)
+		{
+			uint32_t seq = lz4_read32(ip);
+			uint32_t h = lz4_hash(seq);
+			int candidate = table[h];
+			table[h] = (int)(ip - src);
+
+			if (candidate < 0 || (ip - src) - candidate > 65535 || lz4_read32(src + candidate) != seq)
+			{
+				ip++;
+				continue;
+			}
+
+			//extend the match forward
+			const uint8_t* ref = src + candidate;
+			const uint8_t* mp = ip + LZ4_MIN_MATCH;
+			const uint8_t* mr = ref + LZ4_MIN_MATCH;
+			while (mp < match_limit && *mp == *mr) { mp++; mr++; }
+
+			//and backwards over pending literals
+			while (ip > anchor && ref > src && ip[-1] == ref[-1]) { ip--; ref--; }
+
+			int literals = (int)(ip - anchor);
+			int match_length = (int)(mp - ip) - LZ4_MIN_MATCH;
+			uint8_t* token = op++;
+			*token = (uint8_t)((literals >= 15 ? 15 : literals) << 4);
+			if (literals >= 15)
+				op = lz4_write_length(op, literals - 15);
+			memcpy(op, anchor, literals);
+			op += literals;
+
+			uint16_t offset = (uint16_t)(ip - ref);
+			*op++ = (uint8_t)(offset & 0xFF);
+			*op++ = (uint8_t)(offset >> 8);
+
+			*token |= (uint8_t)(match_length >= 15 ? 15 : match_length);
+			if (match_length >= 15)
+				op = lz4_write_length(op, match_length - 15);
+
+			ip = mp;
+			anchor = ip;
+		}
+	}
+
+	//last literals
+	int literals = (int)(end - anchor);
+	uint8_t* token = op++;
+	*token = (uint8_t)((literals >= 15 ? 15 : literals) << 4);
+	if (literals >= 15)
+		op = lz4_write_length(op, literals - 15);
+	memcpy(op, anchor, literals);
+	op += literals;
+
+	return (int)(op - dst);
+}
+
+int lz4_decompress_block(const uint8_t* src, int src_size, uint8_t* dst, int dst_size)
+{
+	const uint8_t* ip = src;
+	const uint8_t* iend = src + src_size;
+	uint8_t* op = dst;
+	uint8_t* oend = dst + dst_size;
+
+	while (ip < iend)
+	{
+		uint8_t token = *ip++;
+
+		//literals
+		size_t length = token >> 4;
+		if (length == 15)
+		{
+			uint8_t s;
+			do {
+				if (ip >= iend) return -1;
+				s = *ip++;
+				length += s;
+			} while (s == 255);
+		}
+		if (ip + length > iend || op + length > oend)
+			return -1;
+		memcpy(op, ip, length);
+		ip += length;
+		op += length;
+
+		if (ip >= iend) //last sequence has no match
+			break;
+
+		//match
+		if (ip + 2 > iend)
+			return -1;
+		size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (size_t)(op - dst))
+			return -1;
+
+		length = (token & 15);
+		if (length == 15)
+		{
+			uint8_t s;
+			do {
+				if (ip >= iend) return -1;
+				s = *ip++;
+				length += s;
+			} while (s == 255);
+		}
+		length += LZ4_MIN_MATCH;
+		if (op + length > oend)
+			return -1;
+
+		//overlapping copies are allowed (offset < length), so copy byte by byte in that case
+		const uint8_t* ref = op - offset;
+		if (offset >= length)
+			memcpy(op, ref, length);
+		else
+			for (size_t i = 0; i < length; ++i)
+				op[i] = ref[i];
+		op += length;
+	}
+
+	return (int)(op - dst);
+}
+
+// Quantization ***************************************
+
+uint16_t float_to_half(float f)
+{
+	uint32_t x;
+	memcpy(&x, &f, 4);
+	uint32_t sign = (x >> 16) & 0x8000;
+	int32_t exponent = (int32_t)((x >> 23) & 0xFF) - 127 + 15;
+	uint32_t mantissa = x & 0x7FFFFF;
+
+	if (((x >> 23) & 0xFF) == 0xFF) //inf or nan
+		return (uint16_t)(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+	if (exponent >= 31) //overflow, clamp to inf
+		return (uint16_t)(sign | 0x7C00);
+	if (exponent <= 0) //subnormal or zero
+	{
+		if (exponent < -10)
+			return (uint16_t)sign;
+		mantissa |= 0x800000;
+		uint32_t shift = (uint32_t)(14 - exponent);
+		uint32_t half = mantissa >> shift;
+		if ((mantissa >> (shift - 1)) & 1) //round
+			half++;
+		return (uint16_t)(sign | half);
+	}
+
+	uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+	if (mantissa & 0x1000) //round to nearest, may carry into the exponent which is fine
+		half++;
+	return (uint16_t)half;
+}
+
+float half_to_float(uint16_t h)
+{
+	uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+	uint32_t exponent = (h >> 10) & 0x1F;
+	uint32_t mantissa = h & 0x3FF;
+	uint32_t x;
+
+	if (exponent == 0)
+	{
+		if (mantissa == 0)
+			x = sign;
+		else //subnormal, normalize it
+		{
+			exponent = 127 - 15 + 1;
+			while (!(mantissa & 0x400)) { mantissa <<= 1; exponent--; }
+			mantissa &= 0x3FF;
+			x = sign | (exponent << 23) | (mantissa << 13);
+		}
+	}
+	else if (exponent == 31)
+		x = sign | 0x7F800000 | (mantissa << 13);
+	else
+		x = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+
+	float f;
+	memcpy(&f, &x, 4);
+	return f;
+}
+
+void quantize_positions(const vec3* positions, size_t count, const vec3& aabb_min, const vec3& aabb_max, uint16_t* out)
+{
+	vec3 extent = aabb_max - aabb_min;
+	float sx = extent.x > 0.0f ? 65535.0f / extent.x : 0.0f;
+	float sy = extent.y > 0.0f ? 65535.0f / extent.y : 0.0f;
+	float sz = extent.z > 0.0f ? 65535.0f / extent.z : 0.0f;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		const vec3& p = positions[i];
+		out[i * 3 + 0] = (uint16_t)std::clamp((p.x - aabb_min.x) * sx + 0.5f, 0.0f, 65535.0f);
+		out[i * 3 + 1] = (uint16_t)std::clamp((p.y - aabb_min.y) * sy + 0.5f, 0.0f, 65535.0f);
+		out[i * 3 + 2] = (uint16_t)std::clamp((p.z - aabb_min.z) * sz + 0.5f, 0.0f, 65535.0f);
+	}
+}
+
+void dequantize_positions(const uint16_t* in, size_t count, const vec3& aabb_min, const vec3& aabb_max, vec3* positions)
+{
+	vec3 step = (aabb_max - aabb_min) / 65535.0f;
+	for (size_t i = 0; i < count; ++i)
+	{
+		positions[i].x = aabb_min.x + in[i * 3 + 0] * step.x;
+		positions[i].y = aabb_min.y + in[i * 3 + 1] * step.y;
+		positions[i].z = aabb_min.z + in[i * 3 + 2] * step.z;
+	}
+}
+
+static inline float sign_not_zero(float v) { return v >= 0.0f ? 1.0f : -1.0f; }
+
+void encode_octahedral(const vec3* normals, size_t count, int16_t* out)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		const vec3& n = normals[i];
+		float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+		float x = 0.0f, y = 0.0f;
+		if (l1 > 0.0f)
+		{
+			x = n.x / l1;
+			y = n.y / l1;
+			if (n.z < 0.0f) //fold the lower hemisphere
+			{
+				float ox = x;
+				x = (1.0f - fabsf(y)) * sign_not_zero(ox);
+				y = (1.0f - fabsf(ox)) * sign_not_zero(y);
+			}
+		}
+		out[i * 2 + 0] = (int16_t)roundf(std::clamp(x, -1.0f, 1.0f) * 32767.0f);
+		out[i * 2 + 1] = (int16_t)roundf(std::clamp(y, -1.0f, 1.0f) * 32767.0f);
+	}
+}
+
+void decode_octahedral(const int16_t* in, size_t count, vec3* normals)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		float x = std::max(in[i * 2 + 0] / 32767.0f, -1.0f);
+		float y = std::max(in[i * 2 + 1] / 32767.0f, -1.0f);
+		float z = 1.0f - fabsf(x) - fabsf(y);
+		if (z < 0.0f)
+		{
+			float ox = x;
+			x = (1.0f - fabsf(y)) * sign_not_zero(ox);
+			y = (1.0f - fabsf(ox)) * sign_not_zero(y);
+		}
+		float l = sqrtf(x * x + y * y + z * z);
+		normals[i] = l > 0.0f ? vec3(x / l, y / l, z / l) : vec3(0.0f, 0.0f, 1.0f);
+	}
+}
+
+void encode_half2(const vec2* values, size_t count, uint16_t* out)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		out[i * 2 + 0] = float_to_half(values[i].x);
+		out[i * 2 + 1] = float_to_half(values[i].y);
+	}
+}
+
+void decode_half2(const uint16_t* in, size_t count, vec2* values)
+{
+	for (size_t i = 0; i < count; ++i)
+		values[i] = vec2(half_to_float(in[i * 2 + 0]), half_to_float(in[i * 2 + 1]));
+}
+
+void encode_weights8(const vec4* weights, size_t count, uint8_t* out)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		const vec4& w = weights[i];
+		float total = w.x + w.y + w.z + w.w;
+		float s = total > 0.0f ? 255.0f / total : 0.0f;
+		int q[4];
+		int sum = 0;
+		for (int j = 0; j < 4; ++j)
+		{
+			q[j] = (int)(w.v[j] * s + 0.5f);
+			sum += q[j];
+		}
+		//keep the sum exactly 255 by fixing the largest weight
+		if (total > 0.0f && sum != 255)
+		{
+			int largest = 0;
+			for (int j = 1; j < 4; ++j)
+				if (q[j] > q[largest]) largest = j;
+			q[largest] = std::clamp(q[largest] + 255 - sum, 0, 255);
+		}
+		for (int j = 0; j < 4; ++j)
+			out[i * 4 + j] = (uint8_t)q[j];
+	}
+}
+
+void decode_weights8(const uint8_t* in, size_t count, vec4* weights)
+{
+	const float s = 1.0f / 255.0f;
+	for (size_t i = 0; i < count; ++i)
+		weights[i] = vec4(in[i * 4 + 0] * s, in[i * 4 + 1] * s, in[i * 4 + 2] * s, in[i * 4 + 3] * s);
+}
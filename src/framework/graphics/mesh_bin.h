@@ -0,0 +1,139 @@
+/*  Chunked binary container used by Mesh::read_bin / Mesh::write_bin.
+	Every stream is stored in a tagged chunk (with its offset and size in the file), so new
+	streams (LODs, skeletons, animations...) can be added without breaking older readers.
+	Chunks can be LZ4 block compressed and are independent, so they can be decoded in parallel.
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "../math/vec2.h"
+#include "../math/vec3.h"
+#include "../math/vec4.h"
+
+#define MBIN_TAG(a,b,c,d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+//mesh streams
+#define MBIN_CHUNK_INFO MBIN_TAG('I','N','F','O') //sMeshBinInfo
+#define MBIN_CHUNK_INTERLEAVED MBIN_TAG('I','N','T','R') //Mesh::tInterleaved
+#define MBIN_CHUNK_VERTICES MBIN_TAG('V','E','R','T') //vec3
+#define MBIN_CHUNK_VERTICES_Q16 MBIN_TAG('V','E','Q','6') //uint16 x3, quantized against the AABB
+#define MBIN_CHUNK_NORMALS MBIN_TAG('N','O','R','M') //vec3
+#define MBIN_CHUNK_NORMALS_OCT MBIN_TAG('N','O','C','T') //int16 x2, octahedral encoded
+#define MBIN_CHUNK_UVS MBIN_TAG('U','V','S','0') //vec2
+#define MBIN_CHUNK_UVS_HALF MBIN_TAG('U','V','H','0') //half x2
+#define MBIN_CHUNK_UVS1 MBIN_TAG('U','V','S','1') //vec2
+#define MBIN_CHUNK_UVS1_HALF MBIN_TAG('U','V','H','1') //half x2
+#define MBIN_CHUNK_COLORS MBIN_TAG('C','O','L','R') //vec4
+#define MBIN_CHUNK_INDICES MBIN_TAG('I','N','D','X') //uint32
+#define MBIN_CHUNK_INDICES16 MBIN_TAG('I','D','X','6') //uint16, when vertices < 65536
+#define MBIN_CHUNK_BONES MBIN_TAG('B','O','N','E') //ivec4
+#define MBIN_CHUNK_BONES8 MBIN_TAG('B','O','N','8') //uint8 x4, when bones < 256
+#define MBIN_CHUNK_WEIGHTS MBIN_TAG('W','G','H','T') //vec4
+#define MBIN_CHUNK_WEIGHTS8 MBIN_TAG('W','G','T','8') //uint8 x4, normalized to 255
+#define MBIN_CHUNK_BONES_INFO MBIN_TAG('B','I','N','F') //BoneInfo
+#define MBIN_CHUNK_SUBMESHES MBIN_TAG('S','U','B','M') //sSubmeshInfo
+//used by the glTF cache (see gltf_loader.cpp)
+#define MBIN_CHUNK_SKELETON MBIN_TAG('S','K','E','L')
+#define MBIN_CHUNK_ANIMATIONS MBIN_TAG('A','N','I','M')
+#define MBIN_CHUNK_LODS MBIN_TAG('L','O','D','S') //sMeshLOD
+#define MBIN_CHUNK_LOD_SUBMESHES MBIN_TAG('L','S','U','B') //sSubmeshInfo, LODs 1..n
+
+//chunk flags
+#define MBIN_CHUNK_FLAG_LZ4 1 //payload is a sequence of LZ4 blocks
+
+#define MBIN_LZ4_BLOCK_SIZE (64 * 1024) //raw bytes per compressed block
+
+struct sMeshBinHeader
+{
+	int version = 0;
+	int header_bytes = 0; //sizeof(sMeshBinHeader), to detect layout changes
+	int num_chunks = 0;
+	int flags = 0;
+};
+
+struct sMeshBinChunk
+{
+	uint32_t tag = 0;
+	uint32_t flags = 0;
+	uint64_t offset = 0; //from the start of the file
+	uint64_t size = 0; //bytes stored in the file
+	uint64_t raw_size = 0; //bytes once decompressed
+};
+
+struct sMeshBinInfo
+{
+	uint64_t num_vertices = 0;
+	uint64_t num_indices = 0;
+	vec3 aabb_min;
+	vec3 aabb_max;
+	vec3 center;
+	vec3 halfsize;
+	float radius = 0.0f;
+	uint32_t num_bones = 0;
+	uint32_t num_submeshes = 0;
+	uint32_t num_lods = 0;
+	float bind_matrix[16];
+};
+
+//collects chunks in memory and writes them with the table of contents in front
+class MeshBinWriter
+{
+public:
+	void add_chunk(uint32_t tag, const void* data, size_t size, bool compress = false);
+	template <typename T>
+	void add_chunk(uint32_t tag, const std::vector<T>& values, bool compress = false) { if (values.size()) add_chunk(tag, values.data(), values.size() * sizeof(T), compress); }
+
+	bool save(const char* filename, int version);
+
+private:
+	std::vector<sMeshBinChunk> chunks;
+	std::vector<std::vector<uint8_t>> payloads;
+};
+
+//keeps the whole file in memory, chunks are decoded on demand (decode is thread safe)
+class MeshBinReader
+{
+public:
+	sMeshBinHeader header;
+	std::vector<sMeshBinChunk> chunks;
+	std::vector<uint8_t> data;
+
+	//returns false if the file is missing or it is not a chunked MBIN
+	bool load(const char* filename);
+	bool load_from_memory(std::vector<uint8_t>& file_data);
+
+	const sMeshBinChunk* find(uint32_t tag) const;
+	bool has(uint32_t tag) const { return find(tag) != nullptr; }
+	size_t get_raw_size(uint32_t tag) const { const sMeshBinChunk* c = find(tag); return c ? (size_t)c->raw_size : 0; }
+
+	bool decode(const sMeshBinChunk& chunk, void* dst) const;
+	bool decode(uint32_t tag, void* dst) const { const sMeshBinChunk* c = find(tag); return c && decode(*c, dst); }
+	template <typename T>
+	bool decode(uint32_t tag, std::vector<T>& values) const {
+		const sMeshBinChunk* c = find(tag);
+		if (!c || c->raw_size % sizeof(T)) return false;
+		values.resize((size_t)c->raw_size / sizeof(T));
+		return values.empty() || decode(*c, values.data());
+	}
+};
+
+//LZ4 block format (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md)
+int lz4_compress_bound(int size);
+int lz4_compress_block(const uint8_t* src, int src_size, uint8_t* dst, int dst_capacity); //returns 0 if it does not fit
+int lz4_decompress_block(const uint8_t* src, int src_size, uint8_t* dst, int dst_size); //returns bytes written or -1
+
+//quantization helpers
+uint16_t float_to_half(float f);
+float half_to_float(uint16_t h);
+void quantize_positions(const vec3* positions, size_t count, const vec3& aabb_min, const vec3& aabb_max, uint16_t* out);
+void dequantize_positions(const uint16_t* in, size_t count, const vec3& aabb_min, const vec3& aabb_max, vec3* positions);
+void encode_octahedral(const vec3* normals, size_t count, int16_t* out);
+void decode_octahedral(const int16_t* in, size_t count, vec3* normals);
+void encode_half2(const vec2* values, size_t count, uint16_t* out);
+void decode_half2(const uint16_t* in, size_t count, vec2* values);
+void encode_weights8(const vec4* weights, size_t count, uint8_t* out);
+void decode_weights8(const uint8_t* in, size_t count, vec4* weights);
@@ -0,0 +1,482 @@
+#include "mesh_bvh.h"
+
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define BVH_USE_SSE2
+#endif
+
+struct sBuildTriangle
+{
+	vec3 min;
+	vec3 max;
+	vec3 centroid;
+};
+
+struct sBuildBounds
+{
+	vec3 min = vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+	vec3 max = vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+	void grow(const vec3& p_min, const vec3& p_max)
+	{
+		min = vec3(std::min(min.x, p_min.x), std::min(min.y, p_min.y), std::min(min.z, p_min.z));
+		max = vec3(std::max(max.x, p_max.x), std::max(max.y, p_max.y), std::max(max.z, p_max.z));
+	}
+	//half of the surface
+	float area() const
+	{
+		if (min.x > max.x)
+			return 0.0f;
+		vec3 d = max - min;
+		return d.x * d.y + d.y * d.z + d.z * d.x;
+	}
+};
+
+struct sBuildTask
+{
+	uint32_t node;
+	uint32_t first;
+	uint32_t count;
+	uint32_t depth;
+};
+
+void MeshBVH::build(const vec3* positions, size_t num_vertices, const unsigned int* indices, size_t num_indices)
+{
+	nodes.clear();
+	packets.clear();
+
+	size_t num_triangles = (indices ? num_indices : num_vertices) / 3;
+	if (num_triangles == 0)
+		return;
+
+	std::vector<sBuildTriangle> triangles(num_triangles);
+	std::vector<uint32_t> order(num_triangles);
+	for (size_t i = 0; i < num_triangles; ++i)
+	{
+		const vec3& a = positions[indices ? indices[i * 3] : i * 3];
+		const vec3& b = positions[indices ? indices[i * 3 + 1] : i * 3 + 1];
+		const vec3& c = positions[indices ? indices[i * 3 + 2] : i * 3 + 2];
+		sBuildTriangle& t = triangles[i];
+		t.min = vec3(std::min(a.x, std::min(b.x, c.x)), std::min(a.y, std::min(b.y, c.y)), std::min(a.z, std::min(b.z, c.z)));
+		t.max = vec3(std::max(a.x, std::max(b.x, c.x)), std::max(a.y, std::max(b.y, c.y)), std::max(a.z, std::max(b.z, c.z)));
+		t.centroid = (t.min + t.max) * 0.5f;
+		order[i] = (uint32_t)i;
+	}
+
+	nodes.reserve(num_triangles * 2 / 3 + 1);
+	nodes.push_back(sBVHNode());
+	std::vector<sBuildTask> tasks;
+	tasks.push_back({ 0, 0, (uint32_t)num_triangles, 0 });
+
+	while (!tasks.empty())
+	{
+		sBuildTask task = tasks.back();
+		tasks.pop_back();
+
+		sBuildBounds bounds, centroid_bounds;
+		for (uint32_t i = task.first; i < task.first + task.count; ++i)
+		{
+			const sBuildTriangle& t = triangles[order[i]];
+			bounds.grow(t.min, t.max);
+			centroid_bounds.grow(t.centroid, t.centroid);
+		}
+		sBVHNode& node = nodes[task.node];
+		for (int k = 0; k < 3; ++k)
+		{
+			node.min[k] = bounds.min.v[k];
+			node.max[k] = bounds.max.v[k];
+		}
+
+		//best split with binned SAH
+		int best_axis = -1;
+		int best_split = 0;
+		float best_cost = FLT_MAX;
+		if (task.count > 4)
+		{
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				float extent = centroid_bounds.max.v[axis] - centroid_bounds.min.v[axis];
+				if (extent <= 0.0f)
+					continue;
+
+				sBuildBounds bins[BVH_NUM_BINS];
+				uint32_t bin_count[BVH_NUM_BINS] = {};
+				float scale = BVH_NUM_BINS / extent;
+				for (uint32_t i = task.first; i < task.first + task.count; ++i)
+				{
+					const sBuildTriangle& t = triangles[order[i]];
+					int bin = std::min(BVH_NUM_BINS - 1, (int)((t.centroid.v[axis] - centroid_bounds.min.v[axis]) * scale));
+					bins[bin].grow(t.min, t.max);
+					bin_count[bin]++;
+				}
+
+				//sweep from both sides
+				float left_area[BVH_NUM_BINS - 1];
+				uint32_t left_count[BVH_NUM_BINS - 1];
+				sBuildBounds left_bounds, right_bounds;
+				uint32_t left_sum = 0, right_sum = 0;
+				for (int i = 0; i < BVH_NUM_BINS - 1; ++i)
+				{
+					left_sum += bin_count[i];
+					left_bounds.grow(bins[i].min, bins[i].max);
+					left_count[i] = left_sum;
+					left_area[i] = left_bounds.area();
+				}
+				for (int i = BVH_NUM_BINS - 1; i > 0; --i)
+				{
+					right_sum += bin_count[i];
+					right_bounds.grow(bins[i].min, bins[i].max);
+					if (left_count[i - 1] == 0 || right_sum == 0)
+						continue;
+					float cost = left_area[i - 1] * left_count[i - 1] + right_bounds.area() * right_sum;
+					if (cost < best_cost)
+					{
+						best_cost = cost;
+						best_axis = axis;
+						best_split = i;
+					}
+				}
+			}
+		}
+
+		//a leaf is cheaper than the split, unless it has too many triangles or the tree is too deep to traverse
+		float leaf_cost = bounds.area() * task.count;
+		bool make_leaf = task.count <= 4 || task.depth + 1 >= BVH_STACK_SIZE;
+		if (!make_leaf && best_cost >= leaf_cost && task.count <= BVH_MAX_LEAF_TRIANGLES)
+			make_leaf = true;
+
+		uint32_t middle = 0;
+		if (!make_leaf)
+		{
+			if (best_axis >= 0)
+			{
+				float extent = centroid_bounds.max.v[best_axis] - centroid_bounds.min.v[best_axis];
+				float scale = BVH_NUM_BINS / extent;
+				float min = centroid_bounds.min.v[best_axis];
+				uint32_t* split = std::partition(&order[task.first], &order[task.first] + task.count, [&](uint32_t id) {
+					return std::min(BVH_NUM_BINS - 1, (int)((triangles[id].centroid.v[best_axis] - min) * scale)) < best_split;
+				});
+				middle = (uint32_t)(split - &order[0]);
+			}
+			else
+				middle = task.first + task.count / 2; //all the centroids in the same point, split them by count
+		}
+
+		if (make_leaf)
+		{
+			node.left_first = (uint32_t)packets.size();
+			node.num_packets = (task.count + 3) / 4;
+			for (uint32_t p = 0; p < node.num_packets; ++p)
+			{
+				sBVHPacket packet = {};
+				for (int lane = 0; lane < 4; ++lane)
+				{
+					uint32_t i = task.first + p * 4 + lane;
+					packet.triangle[lane] = -1;
+					if (i >= task.first + task.count)
+						continue;
+					uint32_t id = order[i];
+					const vec3& a = positions[indices ? indices[id * 3] : id * 3];
+					const vec3& b = positions[indices ? indices[id * 3 + 1] : id * 3 + 1];
+					const vec3& c = positions[indices ? indices[id * 3 + 2] : id * 3 + 2];
+					for (int k = 0; k < 3; ++k)
+					{
+						packet.v0[k][lane] = a.v[k];
+						packet.edge1[k][lane] = b.v[k] - a.v[k];
+						packet.edge2[k][lane] = c.v[k] - a.v[k];
+					}
+					packet.triangle[lane] = (int)id;
+				}
+				packets.push_back(packet);
+			}
+			continue;
+		}
+
+		uint32_t left = (uint32_t)nodes.size();
+		node.left_first = left;
+		node.num_packets = 0;
+		nodes.push_back(sBVHNode()); //node is not valid anymore
+		nodes.push_back(sBVHNode());
+		tasks.push_back({ left, task.first, middle - task.first, task.depth + 1 });
+		tasks.push_back({ left + 1, middle, task.first + task.count - middle, task.depth + 1 });
+	}
+}
+
+//entry distance of the ray in the node, FLT_MAX if it does not hit it before max_distance
+static inline float ray_node(const sBVHNode& node, const vec3& origin, const vec3& inv_direction, float max_distance)
+{
+	float t_min = 0.0f;
+	float t_max = max_distance;
+	for (int i = 0; i < 3; ++i)
+	{
+		float t1 = (node.min[i] - origin.v[i]) * inv_direction.v[i];
+		float t2 = (node.max[i] - origin.v[i]) * inv_direction.v[i];
+		if (t1 > t2)
+			std::swap(t1, t2);
+		t_min = t1 > t_min ? t1 : t_min;
+		t_max = t2 < t_max ? t2 : t_max;
+	}
+	return t_min <= t_max ? t_min : FLT_MAX;
+}
+
+//Moller-Trumbore against the 4 triangles of a packet, updates distance and lane with the closest hit
+static inline bool ray_packet(const sBVHPacket& packet, const vec3& origin, const vec3& direction, float& distance, int& hit_lane)
+{
+#ifdef BVH_USE_SSE2
+	__m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y), oz = _mm_set1_ps(origin.z);
+	__m128 dx = _mm_set1_ps(direction.x), dy = _mm_set1_ps(direction.y), dz = _mm_set1_ps(direction.z);
+	__m128 e1x = _mm_loadu_ps(packet.edge1[0]), e1y = _mm_loadu_ps(packet.edge1[1]), e1z = _mm_loadu_ps(packet.edge1[2]);
+	__m128 e2x = _mm_loadu_ps(packet.edge2[0]), e2y = _mm_loadu_ps(packet.edge2[1]), e2z = _mm_loadu_ps(packet.edge2[2]);
+
+	//p = direction x edge2
+	__m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+	__m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+	__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+	__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+	__m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+	__m128 sx = _mm_sub_ps(ox, _mm_loadu_ps(packet.v0[0]));
+	__m128 sy = _mm_sub_ps(oy, _mm_loadu_ps(packet.v0[1]));
+	__m128 sz = _mm_sub_ps(oz, _mm_loadu_ps(packet.v0[2]));
+	__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inv_det);
+
+	//q = s x edge1
+	__m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+	__m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+	__m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+	__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv_det);
+	__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv_det);
+
+	//degenerated triangles give NaN or infinite values, which fail the comparisons
+	__m128 zero = _mm_setzero_ps();
+	__m128 abs_det = _mm_and_ps(det, _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF)));
+	__m128 mask = _mm_cmpgt_ps(abs_det, _mm_set1_ps(1e-12f));
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+	mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(t, zero));
+	mask = _mm_and_ps(mask, _mm_cmplt_ps(t, _mm_set1_ps(distance)));
+
+	int hits = _mm_movemask_ps(mask);
+	if (!hits)
+		return false;
+	float ts[4];
+	_mm_storeu_ps(ts, t);
+	for (int lane = 0; lane < 4; ++lane)
+		if ((hits & (1 << lane)) && ts[lane] < distance)
+		{
+			distance = ts[lane];
+			hit_lane = lane;
+		}
+	return true;
+#else
+	bool hit = false;
+	for (int lane = 0; lane < 4; ++lane)
+	{
+		vec3 e1(packet.edge1[0][lane], packet.edge1[1][lane], packet.edge1[2][lane]);
+		vec3 e2(packet.edge2[0][lane], packet.edge2[1][lane], packet.edge2[2][lane]);
+		vec3 p = cross(direction, e2);
+		float det = dot(e1, p);
+		if (fabsf(det) <= 1e-12f)
+			continue;
+		float inv_det = 1.0f / det;
+		vec3 s = origin - vec3(packet.v0[0][lane], packet.v0[1][lane], packet.v0[2][lane]);
+		float u = dot(s, p) * inv_det;
+		vec3 q = cross(s, e1);
+		float v = dot(direction, q) * inv_det;
+		float t = dot(e2, q) * inv_det;
+		if (u < 0.0f || v < 0.0f || u + v > 1.0f || t < 0.0f || t >= distance)
+			continue;
+		distance = t;
+		hit_lane = lane;
+		hit = true;
+	}
+	return hit;
+#endif
+}
+
+static inline vec3 packet_normal(const sBVHPacket& packet, int lane)
+{
+	vec3 e1(packet.edge1[0][lane], packet.edge1[1][lane], packet.edge1[2][lane]);
+	vec3 e2(packet.edge2[0][lane], packet.edge2[1][lane], packet.edge2[2][lane]);
+	vec3 n = cross(e1, e2);
+	float length = sqrtf(dot(n, n));
+	return length > 0.0f ? n * (1.0f / length) : vec3(0.0f, 1.0f, 0.0f);
+}
+
+bool MeshBVH::test_ray(const vec3& origin, const vec3& direction, float max_distance, float& distance, vec3& normal, int* triangle) const
+{
+	if (nodes.empty())
+		return false;
+
+	vec3 inv_direction(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	float closest = max_distance;
+	const sBVHPacket* hit_packet = NULL;
+	int hit_lane = 0;
+
+	if (ray_node(nodes[0], origin, inv_direction, closest) == FLT_MAX)
+		return false;
+
+	uint32_t stack[BVH_STACK_SIZE];
+	int stack_size = 0;
+	uint32_t current = 0;
+	while (true)
+	{
+		const sBVHNode& node = nodes[current];
+		if (node.num_packets)
+		{
+			for (uint32_t p = 0; p < node.num_packets; ++p)
+			{
+				const sBVHPacket& packet = packets[node.left_first + p];
+				if (ray_packet(packet, origin, direction, closest, hit_lane))
+					hit_packet = &packet;
+			}
+		}
+		else
+		{
+			//visit the closest child first, the other one waits in the stack
+			uint32_t near_child = node.left_first;
+			uint32_t far_child = node.left_first + 1;
+			float near_t = ray_node(nodes[near_child], origin, inv_direction, closest);
+			float far_t = ray_node(nodes[far_child], origin, inv_direction, closest);
+			if (far_t < near_t)
+			{
+				std::swap(near_t, far_t);
+				std::swap(near_child, far_child);
+			}
+			if (near_t != FLT_MAX)
+			{
+				if (far_t != FLT_MAX)
+					stack[stack_size++] = far_child;
+				current = near_child;
+				continue;
+			}
+		}
+
+		if (stack_size == 0)
+			break;
+		current = stack[--stack_size];
+	}
+
+	if (!hit_packet)
+		return false;
+	distance = closest;
+	normal = packet_normal(*hit_packet, hit_lane);
+	if (dot(normal, direction) > 0.0f)
+		normal = normal * -1.0f; //facing the ray
+	if (triangle)
+		*triangle = hit_packet->triangle[hit_lane];
+	return true;
+}
+
+//Real-Time Collision Detection (Ericson), 5.1.5
+static vec3 closest_point_triangle(const vec3& p, const vec3& a, const vec3& b, const vec3& c)
+{
+	vec3 ab = b - a, ac = c - a, ap = p - a;
+	float d1 = dot(ab, ap), d2 = dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f)
+		return a;
+
+	vec3 bp = p - b;
+	float d3 = dot(ab, bp), d4 = dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3)
+		return b;
+
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+		return a + ab * (d1 / (d1 - d3));
+
+	vec3 cp = p - c;
+	float d5 = dot(ab, cp), d6 = dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6)
+		return c;
+
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+		return a + ac * (d2 / (d2 - d6));
+
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+		return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+	float denom = 1.0f / (va + vb + vc);
+	return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+static inline float sq_distance_node(const sBVHNode& node, const vec3& p)
+{
+	float result = 0.0f;
+	for (int i = 0; i < 3; ++i)
+	{
+		float v = p.v[i];
+		if (v < node.min[i]) result += (node.min[i] - v) * (node.min[i] - v);
+		if (v > node.max[i]) result += (v - node.max[i]) * (v - node.max[i]);
+	}
+	return result;
+}
+
+bool MeshBVH::test_sphere(const vec3& center, float radius, vec3& collision, vec3& normal) const
+{
+	if (nodes.empty())
+		return false;
+
+	//the radius shrinks to the closest point found, so the rest of the nodes are discarded sooner
+	float closest_sq = radius * radius;
+	bool found = false;
+	const sBVHPacket* hit_packet = NULL;
+	int hit_lane = 0;
+
+	uint32_t stack[BVH_STACK_SIZE];
+	int stack_size = 0;
+	stack[stack_size++] = 0;
+	while (stack_size)
+	{
+		const sBVHNode& node = nodes[stack[--stack_size]];
+		if (sq_distance_node(node, center) > closest_sq)
+			continue;
+
+		if (!node.num_packets)
+		{
+			stack[stack_size++] = node.left_first + 1;
+			stack[stack_size++] = node.left_first;
+			continue;
+		}
+
+		for (uint32_t p = 0; p < node.num_packets; ++p)
+		{
+			const sBVHPacket& packet = packets[node.left_first + p];
+			for (int lane = 0; lane < 4; ++lane)
+			{
+				if (packet.triangle[lane] < 0)
+					continue;
+				vec3 a(packet.v0[0][lane], packet.v0[1][lane], packet.v0[2][lane]);
+				vec3 b = a + vec3(packet.edge1[0][lane], packet.edge1[1][lane], packet.edge1[2][lane]);
+				vec3 c = a + vec3(packet.edge2[0][lane], packet.edge2[1][lane], packet.edge2[2][lane]);
+				vec3 point = closest_point_triangle(center, a, b, c);
+				vec3 delta = center - point;
+				float sq = dot(delta, delta);
+				if (sq <= closest_sq)
+				{
+					closest_sq = sq;
+					collision = point;
+					hit_packet = &packet;
+					hit_lane = lane;
+					found = true;
+				}
+			}
+		}
+	}
+
+	if (!found)
+		return false;
+
+	//the center can be on the surface, then the triangle normal is used
+	vec3 delta = center - collision;
+	float distance = sqrtf(dot(delta, delta));
+	normal = distance > 1e-6f ? delta * (1.0f / distance) : packet_normal(*hit_packet, hit_lane);
+	return true;
+}
@@ -0,0 +1,50 @@
+/*  Bounding volume hierarchy over the triangles of a mesh, used as Mesh::collision_model.
+	Built with the surface area heuristic (binned), nodes are 32 bytes and the triangles of every leaf
+	are stored in packets of 4 (structure of arrays) to test the ray against 4 triangles at once.
+	All the queries are in object space, Mesh::test_ray_collision / test_sphere_collision handle the model.
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "../math/vec3.h"
+
+#define BVH_MAX_LEAF_TRIANGLES 8 //leaves with more triangles are always split
+#define BVH_NUM_BINS 16 //SAH candidates per axis
+#define BVH_STACK_SIZE 64
+
+struct sBVHNode
+{
+	float min[3];
+	uint32_t left_first; //first child (the second is next to it) or first packet for leaves
+	float max[3];
+	uint32_t num_packets; //0 for internal nodes
+};
+static_assert(sizeof(sBVHNode) == 32, "sBVHNode must be 32 bytes");
+
+//4 triangles stored as vertex 0 and the two edges, unused slots are degenerated (they never hit)
+struct sBVHPacket
+{
+	float v0[3][4];
+	float edge1[3][4];
+	float edge2[3][4];
+	int triangle[4]; //index of the triangle in the mesh, -1 if unused
+};
+
+class MeshBVH
+{
+public:
+	std::vector<sBVHNode> nodes;
+	std::vector<sBVHPacket> packets;
+
+	//positions of the vertices and 3 indices per triangle (indices can be NULL for triangle lists)
+	void build(const vec3* positions, size_t num_vertices, const unsigned int* indices, size_t num_indices);
+	bool empty() const { return nodes.empty(); }
+
+	//closest hit in [0, max_distance], distance in units of direction
+	bool test_ray(const vec3& origin, const vec3& direction, float max_distance, float& distance, vec3& normal, int* triangle = NULL) const;
+	//closest point of the mesh to the center if it is inside the sphere, normal points from the mesh to the center
+	bool test_sphere(const vec3& center, float radius, vec3& collision, vec3& normal) const;
+};
@@ -0,0 +1,294 @@
+#include "mesh_simplify.h"
+
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+//symmetric 4x4 matrix of the sum of squared distances to a set of planes
+struct sQuadric
+{
+	double a2 = 0, ab = 0, ac = 0, ad = 0;
+	double b2 = 0, bc = 0, bd = 0;
+	double c2 = 0, cd = 0;
+	double d2 = 0;
+
+	void add_plane(double a, double b, double c, double d)
+	{
+		a2 += a * a; ab += a * b; ac += a * c; ad += a * d;
+		b2 += b * b; bc += b * c; bd += b * d;
+		c2 += c * c; cd += c * d;
+		d2 += d * d;
+	}
+
+	void add(const sQuadric& q)
+	{
+		a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+		b2 += q.b2; bc += q.bc; bd += q.bd;
+		c2 += q.c2; cd += q.cd;
+		d2 += q.d2;
+	}
+
+	double evaluate(const vec3& p) const
+	{
+		double x = p.x, y = p.y, z = p.z;
+		double result = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+			+ b2 * y * y + 2 * bc * y * z + 2 * bd * y
+			+ c2 * z * z + 2 * cd * z
+			+ d2;
+		return result > 0.0 ? result : 0.0;
+	}
+};
+
+struct sCollapse
+{
+	unsigned int from;
+	unsigned int to;
+	float cost;
+};
+
+//first vertex with the same position of every vertex (vertices are split in uv or normal seams)
+static void build_position_remap(const vec3* positions, size_t num_vertices, std::vector<unsigned int>& remap)
+{
+	std::vector<unsigned int> order(num_vertices);
+	for (size_t i = 0; i < num_vertices; ++i)
+		order[i] = (unsigned int)i;
+
+	std::sort(order.begin(), order.end(), [positions](unsigned int a, unsigned int b) {
+		return memcmp(&positions[a], &positions[b], sizeof(float) * 3) < 0;
+	});
+
+	remap.resize(num_vertices);
+	for (size_t i = 0; i < num_vertices; ++i)
+	{
+		bool same = i > 0 && memcmp(&positions[order[i]], &positions[order[i - 1]], sizeof(float) * 3) == 0;
+		remap[order[i]] = same ? remap[order[i - 1]] : order[i];
+	}
+}
+
+//vertices that cannot move: seams (same position, different attributes) and open borders
+static void build_locked_vertices(const std::vector<unsigned int>& indices, const std::vector<unsigned int>& remap, std::vector<char>& locked)
+{
+	size_t num_vertices = remap.size();
+	locked.assign(num_vertices, 0);
+
+	std::vector<unsigned int> first_variant(num_vertices, ~0u);
+	std::vector<char> is_seam(num_vertices, 0);
+	for (size_t i = 0; i < indices.size(); ++i)
+	{
+		unsigned int v = indices[i];
+		unsigned int& first = first_variant[remap[v]];
+		if (first == ~0u)
+			first = v;
+		else if (first != v)
+			is_seam[remap[v]] = 1;
+	}
+
+	//edges used by a single triangle
+	std::vector<uint64_t> edges;
+	edges.reserve(indices.size());
+	for (size_t i = 0; i < indices.size(); i += 3)
+		for (int e = 0; e < 3; ++e)
+		{
+			uint64_t a = remap[indices[i + e]];
+			uint64_t b = remap[indices[i + (e + 1) % 3]];
+			edges.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+		}
+	std::sort(edges.begin(), edges.end());
+
+	std::vector<char> is_border(num_vertices, 0);
+	for (size_t i = 0; i < edges.size();)
+	{
+		size_t j = i + 1;
+		while (j < edges.size() && edges[j] == edges[i])
+			++j;
+		if (j - i == 1)
+		{
+			is_border[(unsigned int)(edges[i] >> 32)] = 1;
+			is_border[(unsigned int)(edges[i] & 0xFFFFFFFF)] = 1;
+		}
+		i = j;
+	}
+
+	for (size_t i = 0; i < num_vertices; ++i)
+		locked[i] = is_seam[remap[i]] || is_border[remap[i]];
+}
+
+static vec3 triangle_normal(const vec3& a, const vec3& b, const vec3& c)
+{
+	return cross(b - a, c - a);
+}
+
+//len() clamps to zero small vectors, and small triangles are common here
+static float exact_length(const vec3& v)
+{
+	return sqrtf(dot(v, v));
+}
+
+float simplify_mesh(std::vector<unsigned int>& indices, const vec3* positions, size_t num_vertices, size_t target_indices, std::vector<int>* triangle_ids)
+{
+	if (indices.size() <= target_indices || num_vertices == 0)
+		return 0.0f;
+
+	std::vector<unsigned int> remap;
+	std::vector<char> locked;
+	build_position_remap(positions, num_vertices, remap);
+	build_locked_vertices(indices, remap, locked);
+
+	//every vertex starts with the planes of its triangles
+	std::vector<sQuadric> quadrics(num_vertices);
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		const vec3& p0 = positions[indices[i]];
+		vec3 normal = triangle_normal(p0, positions[indices[i + 1]], positions[indices[i + 2]]);
+		float length = exact_length(normal);
+		if (length == 0.0f)
+			continue;
+		normal = normal * (1.0f / length);
+		double d = -dot(normal, p0);
+		for (int k = 0; k < 3; ++k)
+			quadrics[indices[i + k]].add_plane(normal.x, normal.y, normal.z, d);
+	}
+
+	double max_error = 0.0;
+	std::vector<unsigned int> offsets;
+	std::vector<unsigned int> adjacency;
+	std::vector<unsigned int> collapse(num_vertices);
+	std::vector<char> touched;
+	std::vector<sCollapse> candidates;
+	std::vector<unsigned int> neighbours;
+
+	//every pass collapses the cheapest independent edges, till the target is reached
+	while (indices.size() > target_indices)
+	{
+		size_t num_triangles = indices.size() / 3;
+
+		//triangles around every vertex
+		offsets.assign(num_vertices + 1, 0);
+		for (size_t i = 0; i < indices.size(); ++i)
+			offsets[indices[i] + 1]++;
+		for (size_t i = 0; i < num_vertices; ++i)
+			offsets[i + 1] += offsets[i];
+		adjacency.resize(indices.size());
+		std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < indices.size(); ++i)
+			adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+
+		candidates.clear();
+		for (size_t i = 0; i < indices.size(); i += 3)
+			for (int e = 0; e < 3; ++e)
+			{
+				unsigned int a = indices[i + e];
+				unsigned int b = indices[i + (e + 1) % 3];
+				if (!locked[a] || !locked[b])
+				{
+					sQuadric q = quadrics[a];
+					q.add(quadrics[b]);
+					if (!locked[a])
+						candidates.push_back({ a, b, (float)q.evaluate(positions[b]) });
+					if (!locked[b])
+						candidates.push_back({ b, a, (float)q.evaluate(positions[a]) });
+				}
+			}
+		if (candidates.empty())
+			break;
+
+		std::sort(candidates.begin(), candidates.end(), [](const sCollapse& a, const sCollapse& b) { return a.cost < b.cost; });
+
+		for (size_t i = 0; i < num_vertices; ++i)
+			collapse[i] = (unsigned int)i;
+		touched.assign(num_vertices, 0);
+
+		size_t triangles_to_remove = (indices.size() - target_indices) / 3;
+		size_t removed = 0;
+		for (size_t c = 0; c < candidates.size() && removed < std::max<size_t>(triangles_to_remove, 1); ++c)
+		{
+			const sCollapse& candidate = candidates[c];
+			if (touched[candidate.from] || touched[candidate.to])
+				continue;
+
+			//reject collapses that flip triangles
+			bool valid = true;
+			size_t shared = 0;
+			const vec3& target = positions[candidate.to];
+			for (unsigned int k = offsets[candidate.from]; k < offsets[candidate.from + 1] && valid; ++k)
+			{
+				const unsigned int* tri = &indices[adjacency[k] * 3];
+				if (tri[0] == candidate.to || tri[1] == candidate.to || tri[2] == candidate.to)
+				{
+					shared++;
+					continue;
+				}
+				vec3 p[3] = { positions[tri[0]], positions[tri[1]], positions[tri[2]] };
+				vec3 before = triangle_normal(p[0], p[1], p[2]);
+				for (int v = 0; v < 3; ++v)
+					if (tri[v] == candidate.from)
+						p[v] = target;
+				vec3 after = triangle_normal(p[0], p[1], p[2]);
+				float length = exact_length(before) * exact_length(after);
+				valid = length > 0.0f && dot(before, after) > 0.25f * length;
+			}
+			if (!valid || shared == 0)
+				continue;
+
+			//link condition: the only neighbours in common are the ones of the shared triangles, otherwise the surface folds
+			neighbours.clear();
+			for (unsigned int k = offsets[candidate.from]; k < offsets[candidate.from + 1]; ++k)
+				for (int v = 0; v < 3; ++v)
+				{
+					unsigned int n = remap[indices[adjacency[k] * 3 + v]];
+					if (n != remap[candidate.from] && n != remap[candidate.to] && std::find(neighbours.begin(), neighbours.end(), n) == neighbours.end())
+						neighbours.push_back(n);
+				}
+			size_t common = 0;
+			for (unsigned int k = offsets[candidate.to]; k < offsets[candidate.to + 1]; ++k)
+				for (int v = 0; v < 3; ++v)
+				{
+					unsigned int n = remap[indices[adjacency[k] * 3 + v]];
+					std::vector<unsigned int>::iterator it = std::find(neighbours.begin(), neighbours.end(), n);
+					if (it != neighbours.end())
+					{
+						common++;
+						neighbours.erase(it); //count every vertex once
+					}
+				}
+			if (common != shared)
+				continue;
+
+			collapse[candidate.from] = candidate.to;
+			quadrics[candidate.to].add(quadrics[candidate.from]);
+			max_error = std::max(max_error, (double)candidate.cost);
+			removed += shared;
+
+			//the neighbourhood has changed, wait till the next pass
+			for (unsigned int k = offsets[candidate.from]; k < offsets[candidate.from + 1]; ++k)
+				for (int v = 0; v < 3; ++v)
+					touched[indices[adjacency[k] * 3 + v]] = 1;
+		}
+
+		if (removed == 0)
+			break;
+
+		//apply the collapses and remove the degenerated triangles
+		size_t write = 0;
+		for (size_t t = 0; t < num_triangles; ++t)
+		{
+			unsigned int a = collapse[indices[t * 3]];
+			unsigned int b = collapse[indices[t * 3 + 1]];
+			unsigned int c = collapse[indices[t * 3 + 2]];
+			if (a == b || b == c || a == c)
+				continue;
+			indices[write * 3] = a;
+			indices[write * 3 + 1] = b;
+			indices[write * 3 + 2] = c;
+			if (triangle_ids)
+				(*triangle_ids)[write] = (*triangle_ids)[t];
+			write++;
+		}
+		indices.resize(write * 3);
+		if (triangle_ids)
+			triangle_ids->resize(write);
+	}
+
+	return (float)sqrt(max_error);
+}
@@ -0,0 +1,16 @@
+/*  Mesh simplification with quadric error metrics (Garland & Heckbert), used to build the LOD chain of a Mesh.
+	Edges collapse into one of their existing vertices (half edge collapse), so the vertex buffer is shared
+	by every LOD and only the index buffer changes. Attribute seams and open borders are kept.
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include "../math/vec3.h"
+
+//simplifies an indexed triangle list in place till it has target_indices or no more edges can collapse
+//triangle_ids (optional) holds a value per triangle that is compacted together with the triangles
+//returns the object space error of the result (distance to the planes of the source triangles)
+float simplify_mesh(std::vector<unsigned int>& indices, const vec3* positions, size_t num_vertices, size_t target_indices, std::vector<int>* triangle_ids = NULL);
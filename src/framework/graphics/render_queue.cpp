@@ -0,0 +1,313 @@
+#include "render_queue.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include "mesh.h"
+#include "material.h"
+#include "shader.h"
+#include "uniform_buffer.h"
+#include "frame_ring_buffer.h"
+#include "../camera.h"
+#include "../includes.h"
+
+RenderQueue* RenderQueue::current = nullptr;
+
+static const UniformHandle u_animated = UNIFORM_HANDLE("u_animated");
+
+void RenderQueue::begin(Camera* camera)
+{
+	this->camera = camera;
+	items.clear();
+	deferred.clear();
+	shader_ids.clear();
+	material_ids.clear();
+	mesh_ids.clear();
+	current = this;
+}
+
+uint32_t RenderQueue::get_id(std::unordered_map<const void*, uint32_t>& ids, const void* pointer, int bits)
+{
+	std::unordered_map<const void*, uint32_t>::iterator it = ids.find(pointer);
+	if (it != ids.end())
+		return it->second;
+	//wraps when there are too many, the items are still grouped by pointer when they run
+	uint32_t id = (uint32_t)ids.size() & ((1u << bits) - 1);
+	ids[pointer] = id;
+	return id;
+}
+
+const void* RenderQueue::get_batch(const Material* material)
+{
+	Texture* texture = material->get_shared_texture();
+	if (texture)
+		return texture;
+	return material->color_per_instance() ? (const void*)material->shader : (const void*)material;
+}
+
+void RenderQueue::submit(Mesh* mesh, Material* material, const mat4& model, int lod, std::vector<mat4>* animated_matrices)
+{
+	if (!mesh || !material || !material->shader || !mesh->is_ready())
+		return;
+
+	sDrawItem item;
+	item.mesh = mesh;
+	item.material = material;
+	item.model = model;
+	item.lod = lod;
+	item.animated_matrices = animated_matrices && animated_matrices->size() ? animated_matrices : nullptr;
+	items.push_back(item);
+}
+
+void RenderQueue::defer(std::function<void()> callback)
+{
+	deferred.push_back(callback);
+}
+
+void RenderQueue::flush()
+{
+	current = nullptr;
+
+	sort();
+	execute();
+
+	for (size_t i = 0; i < deferred.size(); ++i)
+		deferred[i]();
+	deferred.clear();
+}
+
+void RenderQueue::sort()
+{
+	keys.resize(items.size());
+
+	const uint64_t depth_max = (1ull << RENDER_KEY_DEPTH_BITS) - 1;
+	float far_plane = camera && camera->far_plane > 0.0f ? camera->far_plane : 1.0f;
+	for (size_t i = 0; i < items.size(); ++i)
+	{
+		const sDrawItem& item = items[i];
+
+		//opaque, so front to back inside the same state
+		float depth = 0.0f;
+		if (camera)
+		{
+			vec3 delta = vec3(item.model.data[12], item.model.data[13], item.model.data[14]) - camera->eye;
+			depth = sqrtf(dot(delta, delta)) / far_plane;
+		}
+		uint64_t depth_key = (uint64_t)(std::min(std::max(depth, 0.0f), 1.0f) * depth_max);
+
+		uint64_t key = item.material->wireframe ? 1 : 0;
+		key = (key << RENDER_KEY_SHADER_BITS) | get_id(shader_ids, item.material->get_shader(), RENDER_KEY_SHADER_BITS);
+		key = (key << RENDER_KEY_MATERIAL_BITS) | get_id(material_ids, get_batch(item.material), RENDER_KEY_MATERIAL_BITS);
+		key = (key << RENDER_KEY_MESH_BITS) | get_id(mesh_ids, item.mesh, RENDER_KEY_MESH_BITS);
+		key = (key << RENDER_KEY_DEPTH_BITS) | depth_key;
+		keys[i].key = key;
+		keys[i].index = (uint32_t)i;
+	}
+
+	//LSD radix sort, 8 bits per pass, the passes where every key has the same byte are skipped
+	keys_tmp.resize(keys.size());
+	for (int shift = 0; shift < 64; shift += 8)
+	{
+		uint32_t histogram[256] = {};
+		for (size_t i = 0; i < keys.size(); ++i)
+			histogram[(keys[i].key >> shift) & 0xFF]++;
+		if (keys.empty() || histogram[(keys[0].key >> shift) & 0xFF] == keys.size())
+			continue;
+
+		uint32_t offset = 0;
+		for (int i = 0; i < 256; ++i)
+		{
+			uint32_t count = histogram[i];
+			histogram[i] = offset;
+			offset += count;
+		}
+		for (size_t i = 0; i < keys.size(); ++i)
+			keys_tmp[histogram[(keys[i].key >> shift) & 0xFF]++] = keys[i];
+		keys.swap(keys_tmp);
+	}
+}
+
+void RenderQueue::execute()
+{
+	stats = sRenderQueueStats();
+
+	Shader* shader = nullptr;
+	Material* material = nullptr;
+	const void* batch = nullptr;
+	Mesh* mesh = nullptr;
+	bool wireframe = false;
+
+	//the sort leaves together the items with the same mesh and material (or shared texture, or shader),
+	//the runs are found first so only the regular draws get an ObjectBlock
+	run_ends.clear();
+	object_keys.clear();
+	for (size_t i = 0; i < keys.size();)
+	{
+		const sDrawItem& item = items[keys[i].index];
+		const void* item_batch = get_batch(item.material);
+		size_t run_end = i + 1;
+		if (item.material->instanced_shader && item.material->instanced_shader->compiled && !item.animated_matrices)
+		{
+			while (run_end < keys.size())
+			{
+				const sDrawItem& next = items[keys[run_end].index];
+				if (next.animated_matrices || next.mesh != item.mesh || next.lod != item.lod || next.material->instanced_shader != item.material->instanced_shader
+					|| next.material->wireframe != item.material->wireframe || get_batch(next.material) != item_batch)
+					break;
+				run_end++;
+			}
+		}
+		//smaller groups are drawn one item at a time
+		if (run_end - i < RENDER_QUEUE_MIN_INSTANCES)
+		{
+			run_end = i + 1;
+			object_keys.push_back((uint32_t)i);
+		}
+		run_ends.push_back((uint32_t)run_end);
+		i = run_end;
+	}
+
+	//the ObjectBlocks of the regular draws are written in chunks, so each draw only binds its range
+	FrameRingBuffer* ring = FrameRingBuffer::get();
+	size_t alignment = UniformBuffer::get_offset_alignment();
+	size_t object_stride = (sizeof(sObjectUniforms) + alignment - 1) / alignment * alignment;
+	size_t next_object = 0; //in object_keys
+	size_t chunk_start = 0;
+	size_t chunk_end = 0;
+	long long chunk_offset = -1;
+
+	for (size_t r = 0, i = 0; r < run_ends.size(); ++r)
+	{
+		sDrawItem& item = items[keys[i].index];
+		const void* item_batch = get_batch(item.material);
+		size_t run_end = run_ends[r];
+		size_t num_instances = run_end - i;
+		bool instanced = num_instances >= RENDER_QUEUE_MIN_INSTANCES;
+		Shader* item_shader = instanced ? item.material->instanced_shader : item.material->get_shader();
+
+		if (item.material->wireframe != wireframe)
+		{
+			wireframe = item.material->wireframe;
+			glPolygonMode(GL_FRONT_AND_BACK, wireframe ? GL_LINE : GL_FILL);
+			if (wireframe) glDisable(GL_CULL_FACE); else glEnable(GL_CULL_FACE);
+		}
+
+		if (item_shader != shader)
+		{
+			shader = item_shader;
+			shader->enable();
+			item.material->set_frame_uniforms(camera);
+			material = nullptr; //the uniforms of the material are stored in the program
+			batch = nullptr;
+			stats.num_program_binds++;
+		}
+
+		//the materials of a batch share everything but the slot of the texture or the color
+		if (item_batch != batch)
+		{
+			batch = item_batch;
+			item.material->set_material_uniforms();
+			material = nullptr;
+			stats.num_material_binds++;
+		}
+
+		//meshes without VAO leave their attributes enabled
+		if (item.mesh != mesh && mesh && !mesh->interleaved_vao_id)
+			mesh->disable_buffers(shader);
+
+		if (instanced)
+		{
+			instance_models.resize(num_instances);
+			for (size_t j = 0; j < num_instances; ++j)
+				instance_models[j] = items[keys[i + j].index].model;
+
+			bool shared_texture = item.material->get_shared_texture() != NULL;
+			if (shared_texture)
+			{
+				instance_slots.resize(num_instances);
+				for (size_t j = 0; j < num_instances; ++j)
+				{
+					const Material* instance = items[keys[i + j].index].material;
+					instance_slots[j].rect = instance->get_texture_rect();
+					instance_slots[j].layer = instance->get_texture_layer();
+				}
+			}
+
+			bool instance_colors_used = item.material->color_per_instance();
+			if (instance_colors_used)
+			{
+				instance_colors.resize(num_instances);
+				for (size_t j = 0; j < num_instances; ++j)
+					instance_colors[j] = items[keys[i + j].index].material->color;
+			}
+
+			//binds and unbinds the VAO itself
+			item.mesh->render_instanced(GL_TRIANGLES, instance_models.data(), (int)num_instances, item.lod,
+				shared_texture ? instance_slots.data() : NULL, instance_colors_used ? instance_colors.data() : NULL);
+			mesh = nullptr;
+			stats.num_vao_binds++;
+			stats.num_instanced_draws++;
+			stats.num_instances += (unsigned int)num_instances;
+		}
+		else
+		{
+			if (item.material != material)
+			{
+				material = item.material;
+				if (material->color_per_instance() && item_batch != material)
+					material->set_material_uniforms(); //its color, the group only shares the shader
+				material->set_texture_slot_uniforms();
+			}
+
+			if (item.mesh != mesh)
+			{
+				mesh = item.mesh;
+				mesh->enable_buffers(shader);
+				stats.num_vao_binds++;
+			}
+
+			if (next_object == chunk_end)
+			{
+				chunk_start = next_object;
+				chunk_end = std::min(next_object + RENDER_QUEUE_OBJECT_CHUNK, object_keys.size());
+				uint8_t* data = (uint8_t*)ring->map((chunk_end - chunk_start) * object_stride, alignment, chunk_offset);
+				if (data)
+				{
+					for (size_t j = chunk_start; j < chunk_end; ++j)
+						memcpy(data + (j - chunk_start) * object_stride, items[keys[object_keys[j]].index].model.data, sizeof(mat4));
+					ring->unmap();
+				}
+				else
+					chunk_offset = -1;
+			}
+			size_t object = next_object++;
+
+			if (shader->has_object_block && chunk_offset >= 0)
+				UniformBuffer::bind_range(ring->get_buffer_id(), UBO_BINDING_OBJECT, (size_t)chunk_offset + (object - chunk_start) * object_stride, sizeof(sObjectUniforms));
+			else
+			{
+				//no block, or the ring is full: set_object_uniforms falls back to a buffer of its own
+				Uniforms uniforms;
+				uniforms.camera = camera;
+				uniforms.model = item.model;
+				uniforms.lod = item.lod;
+				material->set_object_uniforms(uniforms);
+			}
+			if (item.animated_matrices)
+				shader->set_uniform(u_animated, *item.animated_matrices);
+
+			mesh->draw(GL_TRIANGLES, -1, 0, item.lod);
+		}
+		stats.num_draws++;
+		i = run_end;
+	}
+
+	if (mesh)
+		mesh->disable_buffers(shader);
+	if (wireframe)
+	{
+		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		glEnable(GL_CULL_FACE);
+	}
+}
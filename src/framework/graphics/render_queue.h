@@ -0,0 +1,97 @@
+/*  Render queue: the entities submit draw items while the scene is traversed and the queue draws them later,
+	sorted by a 64 bits key (state | shader | material | mesh | depth) with a radix sort.
+	Running the sorted items only changes the program, the material uniforms and the VAO when they differ
+	from the previous item, so most of the draws only upload the model.
+	Consecutive items with the same mesh, material and LOD are collapsed in one instanced draw.
+	Materials with the same shared texture (see Material::get_shared_texture) are grouped as one, the texture
+	is bound once for all of them and their layer and uv rect go per instance.
+	Materials that only differ in their color (see Material::color_per_instance) are grouped by shader and
+	their color goes per instance.
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+#include "../math/vec4.h"
+#include "../math/mat4.h"
+#include "mesh.h" //sInstanceTextureSlot
+
+class Material;
+class Camera;
+
+//bits of the sort key, from the most significant
+#define RENDER_KEY_STATE_BITS 1
+#define RENDER_KEY_SHADER_BITS 12
+#define RENDER_KEY_MATERIAL_BITS 16 //the material, or its shared texture
+#define RENDER_KEY_MESH_BITS 15
+#define RENDER_KEY_DEPTH_BITS 20
+
+#define RENDER_QUEUE_MIN_INSTANCES 2 //smaller groups use regular draws
+#define RENDER_QUEUE_OBJECT_CHUNK 256 //ObjectBlocks mapped at once in the FrameRingBuffer
+
+struct sDrawItem
+{
+	Mesh* mesh;
+	Material* material;
+	mat4 model;
+	int lod;
+	std::vector<mat4>* animated_matrices; //skinning (u_animated), owned by the submitter until the flush, never instanced
+};
+
+struct sRenderQueueStats
+{
+	unsigned int num_draws = 0; //draw calls, an instanced draw counts once
+	unsigned int num_instanced_draws = 0;
+	unsigned int num_instances = 0; //items drawn with instancing
+	unsigned int num_program_binds = 0;
+	unsigned int num_material_binds = 0;
+	unsigned int num_vao_binds = 0;
+};
+
+class RenderQueue
+{
+public:
+	static RenderQueue* current; //the queue between begin and flush, entities submit to it if it is set
+
+	std::vector<sDrawItem> items;
+	sRenderQueueStats stats; //of the last flush
+
+	void begin(Camera* camera);
+	void submit(Mesh* mesh, Material* material, const mat4& model, int lod = 0, std::vector<mat4>* animated_matrices = nullptr);
+	//to render after the sorted items (i.e. helpers drawn on top of the scene)
+	void defer(std::function<void()> callback);
+	//sorts and runs the items, then the deferred callbacks
+	void flush();
+
+private:
+	struct sSortItem
+	{
+		uint64_t key;
+		uint32_t index;
+	};
+
+	Camera* camera = nullptr;
+	std::vector<sSortItem> keys;
+	std::vector<sSortItem> keys_tmp;
+	std::vector<std::function<void()>> deferred;
+	std::vector<mat4> instance_models;
+	std::vector<sInstanceTextureSlot> instance_slots;
+	std::vector<vec4> instance_colors;
+	std::vector<uint32_t> run_ends; //in keys, one per draw
+	std::vector<uint32_t> object_keys; //in keys, the items drawn without instancing
+
+	//small ids for the key, assigned in submission order and cleared every frame so freed pointers do not pile up
+	std::unordered_map<const void*, uint32_t> shader_ids;
+	std::unordered_map<const void*, uint32_t> material_ids;
+	std::unordered_map<const void*, uint32_t> mesh_ids;
+
+	uint32_t get_id(std::unordered_map<const void*, uint32_t>& ids, const void* pointer, int bits);
+	//what groups the materials: the shared texture, the shader when only the color differs, or the material itself
+	static const void* get_batch(const Material* material);
+	void sort();
+	void execute();
+};
@@ -7,11 +7,21 @@
 #include <functional> 
 #include <cctype>
 #include <locale>
+#include <chrono>
+#include <fstream>
+#include <filesystem>
 
 #include "texture.h"
+#include "uniform_buffer.h"
+#include "../file_watcher.h"
 
 std::string Shader::s_shader_atlas_filename;
 std::map<std::string, std::string> Shader::s_shaders_atlas;
+bool Shader::s_use_binary_cache = true;
+bool Shader::s_parallel_compile = false;
+std::vector<Shader*> Shader::s_pending;
+std::map<std::string, std::vector<Shader*>> Shader::s_file_users;
+static std::vector<FileWatcher*> s_watchers;
 
 
 //typedef unsigned int GLhandle;
@@ -77,7 +87,18 @@ void Shader::set_filenames(const std::string& vsf, const std::string& psf)
 	ps_filename = psf;
 }
 
-bool Shader::load(const std::string& vsf, const std::string& psf, const char* macros)
+//the macros go after the #version line, it must be the first one in GLSL
+static std::string insert_macros(const std::string& code, const std::string& macros)
+{
+	if (code.compare(0, 8, "#version") != 0)
+		return macros + "\n" + code;
+	size_t end = code.find('\n');
+	if (end == std::string::npos)
+		return code + "\n" + macros + "\n";
+	return code.substr(0, end + 1) + macros + "\n" + code.substr(end + 1);
+}
+
+bool Shader::load(const std::string& vsf, const std::string& psf, const char* macros, bool async)
 {
 	assert(compiled == false);
 	assert(glGetError() == GL_NO_ERROR);
@@ -97,11 +118,29 @@ bool Shader::load(const std::string& vsf, const std::string& psf, const char* ma
 	//printf("Fragment shader from memory:\n%s\n", psm.c_str());
 	if (macros)
 	{
-		vsm = macros + vsm;
-		psm = macros + psm;
+		vsm = insert_macros(vsm, macros);
+		psm = insert_macros(psm, macros);
 		this->macros = macros;
 	}
 
+	if (async)
+	{
+		//without parallel compile the driver blocks, so it is done later in update_pending
+		if (s_parallel_compile && !begin_compile(vsm, psm))
+			return false;
+		if (!compiled)
+		{
+			if (!program)
+			{
+				pending_vs = vsm;
+				pending_ps = psm;
+			}
+			pending = true;
+			s_pending.push_back(this);
+		}
+		return true;
+	}
+
 	if (!compile_from_memory(vsm, psm))
 		return false;
 
@@ -110,7 +149,7 @@ bool Shader::load(const std::string& vsf, const std::string& psf, const char* ma
 	return true;
 }
 
-Shader* Shader::get(const char* vsf, const char* psf, const char* macros)
+Shader* Shader::get(const char* vsf, const char* psf, const char* macros, bool async)
 {
 	std::string name;
 
@@ -120,27 +159,192 @@ Shader* Shader::get(const char* vsf, const char* psf, const char* macros)
 		name = vsf;
 	std::map<std::string, Shader*>::iterator it = s_Shaders.find(name);
 	if (it != s_Shaders.end())
+	{
+		//sync callers expect a usable shader, so a background compile is finished here
+		if (!async && it->second->pending)
+			it->second->finish_pending();
 		return it->second;
+	}
 
 	if (!psf)
 		return NULL;
 
 	Shader* sh = new Shader();
-	if (!sh->load(vsf, psf, macros))
+	if (!sh->load(vsf, psf, macros, async))
 		return NULL;
 	s_Shaders[name] = sh;
+	s_file_users[FileWatcher::normalize_path(vsf)].push_back(sh);
+	s_file_users[FileWatcher::normalize_path(psf)].push_back(sh);
 	return sh;
 }
 
+std::string Shader::get_feature_macros(uint32_t features)
+{
+	static const char* feature_macros[SHADER_NUM_FEATURES] = {
+		"#define USE_INSTANCING",
+		"#define USE_TEXTURE_ARRAY"
+	};
+
+	std::string macros;
+	for (int i = 0; i < SHADER_NUM_FEATURES; ++i)
+	{
+		if (!(features & (1u << i)))
+			continue;
+		if (macros.size())
+			macros += "\n";
+		macros += feature_macros[i];
+	}
+	return macros;
+}
+
+Shader* Shader::get_permutation(const char* vsf, const char* psf, uint32_t features, bool async)
+{
+	std::string macros = get_feature_macros(features);
+	return get(vsf, psf, macros.size() ? macros.c_str() : NULL, async);
+}
+
+void Shader::precompile(const char* vsf, const char* psf, uint32_t feature_mask)
+{
+	//every subset of the mask, including no features
+	for (uint32_t features = feature_mask;; features = (features - 1) & feature_mask)
+	{
+		get_permutation(vsf, psf, features, true);
+		if (!features)
+			break;
+	}
+}
+
+void Shader::update_pending(float budget_ms)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	for (size_t i = 0; i < s_pending.size();)
+	{
+		Shader* sh = s_pending[i];
+		if (sh->program && !sh->is_compile_complete())
+		{
+			++i;
+			continue;
+		}
+		if (!sh->program && std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count() > budget_ms)
+			break;
+
+		sh->finish_pending();
+	}
+}
+
+bool Shader::finish_pending()
+{
+	if (!pending)
+		return compiled;
+
+	s_pending.erase(std::find(s_pending.begin(), s_pending.end(), this));
+	pending = false;
+
+	//blocks until the driver is done if it is still compiling in parallel
+	bool done;
+	if (program)
+		done = finish_compile();
+	else
+	{
+		std::string vsm, psm;
+		vsm.swap(pending_vs);
+		psm.swap(pending_ps);
+		done = compile_from_memory(vsm, psm);
+	}
+	if (!done)
+		std::cout << "[ERROR] Shader compilation failed: " << vs_filename << " " << ps_filename << std::endl;
+	return done;
+}
+
 void Shader::reload_all()
 {
 	for (std::map<std::string, Shader*>::iterator it = s_Shaders.begin(); it != s_Shaders.end(); it++)
-		it->second->recompile();
+		it->second->reload();
 	if (!s_shader_atlas_filename.empty())
 		load_atlas(s_shader_atlas_filename.c_str());
 	std::cout << "Shaders recompiled" << std::endl;
 }
 
+bool Shader::reload()
+{
+	if (from_atlas || !vs_filename.size() || !ps_filename.size()) //shaders compiled from memory cannot be recompiled
+		return false;
+
+	//nothing working to keep, compile it again in the background
+	if (!compiled)
+	{
+		release();
+		return load(vs_filename, ps_filename, macros.size() ? macros.c_str() : NULL, true);
+	}
+
+	Shader* fresh = new Shader();
+	bool linked = fresh->load(vs_filename, ps_filename, macros.size() ? macros.c_str() : NULL);
+	if (linked)
+		take_program(fresh);
+	else
+	{
+		info_log = fresh->info_log;
+		std::cout << "[ERROR] Shader reload failed, the previous version is kept: " << vs_filename << " " << ps_filename << std::endl;
+	}
+	delete fresh; //releases the old program, or the one that failed
+	return linked;
+}
+
+void Shader::take_program(Shader* other)
+{
+	std::swap(vs, other->vs);
+	std::swap(fs, other->fs);
+	std::swap(program, other->program);
+	uniforms_info.swap(other->uniforms_info);
+	attributes_info.swap(other->attributes_info);
+	handle_locations.clear(); //the locations can change between versions
+	reported_misses.clear();
+	has_frame_block = other->has_frame_block;
+	has_object_block = other->has_object_block;
+	from_binary_cache = other->from_binary_cache;
+	compile_time = other->compile_time;
+	link_time = other->link_time;
+	info_log = other->info_log;
+
+	//so the next enable binds the new program
+	if (current == this)
+		current = NULL;
+}
+
+void Shader::watch_folder(const char* folder)
+{
+	s_watchers.push_back(new FileWatcher(folder));
+}
+
+void Shader::update_hot_reload()
+{
+	std::vector<std::string> changed;
+	for (size_t i = 0; i < s_watchers.size(); ++i)
+		s_watchers[i]->poll(changed);
+	if (changed.empty())
+		return;
+
+	std::vector<Shader*> reloaded; //a shader can use several of the changed files
+	for (size_t i = 0; i < changed.size(); ++i)
+	{
+		if (!s_shader_atlas_filename.empty() && FileWatcher::normalize_path(s_shader_atlas_filename) == changed[i])
+			load_atlas(s_shader_atlas_filename.c_str());
+
+		std::map<std::string, std::vector<Shader*>>::iterator it = s_file_users.find(changed[i]);
+		if (it == s_file_users.end())
+			continue;
+
+		std::cout << " * Shader file changed: " << changed[i] << std::endl;
+		for (Shader* sh : it->second)
+		{
+			if (std::find(reloaded.begin(), reloaded.end(), sh) != reloaded.end())
+				continue;
+			reloaded.push_back(sh);
+			sh->reload();
+		}
+	}
+}
+
 //functions to trim strings
 static inline std::string trim(std::string str) {
 	size_t startpos = str.find_first_not_of(" \t\r\n");
@@ -239,8 +443,8 @@ bool Shader::load_atlas(const char* filename)
 			continue;
 		}
 
-		vs_code = macros + "\n" + vs_code;
-		fs_code = macros + "\n" + fs_code;
+		vs_code = insert_macros(vs_code, macros);
+		fs_code = insert_macros(fs_code, macros);
 
 		Shader* shader = NULL;
 		auto it = s_Shaders.find(name);
@@ -295,7 +499,19 @@ bool Shader::has_info_log() const
 
 // ******************************************
 
+static float elapsed_ms(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
 bool Shader::compile_from_memory(const std::string& vsm, const std::string& psm)
+{
+	if (!begin_compile(vsm, psm))
+		return false;
+	return compiled || finish_compile();
+}
+
+bool Shader::begin_compile(const std::string& vsm, const std::string& psm)
 {
 	if (glCreateProgram == 0)
 	{
@@ -306,25 +522,72 @@ bool Shader::compile_from_memory(const std::string& vsm, const std::string& psm)
 	program = glCreateProgram();
 	assert(glGetError() == GL_NO_ERROR);
 
-	if (!create_vertex_shader_object(vsm))
+	compile_start = std::chrono::high_resolution_clock::now();
+	cache_key = get_cache_key(vsm, psm);
+	from_binary_cache = load_program_binary(cache_key);
+	if (from_binary_cache)
 	{
-		printf("Vertex shader compilation failed\n");
-		return false;
+		compile_time = elapsed_ms(compile_start);
+		link_time = 0.0f;
+		std::cout << "   from binary cache: " << compile_time << " ms" << std::endl;
+		setup_program();
+		return true;
 	}
 
-	if (!create_fragment_shader_object(psm))
+	//the status is not checked until finish_compile, so with parallel compile this does not block
+	if (!create_vertex_shader_object(vsm) || !create_fragment_shader_object(psm))
 	{
-		printf("Fragment shader compilation failed\n");
+		release();
 		return false;
 	}
+	pending_vs = vsm;
+	pending_ps = psm;
 
+	bind_attribute_locations();
+
+	if (s_use_binary_cache)
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(program);
 	assert(glGetError() == GL_NO_ERROR);
+	return true;
+}
+
+bool Shader::is_compile_complete()
+{
+	if (!s_parallel_compile)
+		return true;
+	GLint done = GL_FALSE;
+	glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &done);
+	return done == GL_TRUE;
+}
+
+bool Shader::finish_compile()
+{
+	std::string vsm, psm;
+	vsm.swap(pending_vs);
+	psm.swap(pending_ps);
+
+	//the objects and the program are released on failure, so a failed shader does not keep them alive
+	if (!check_shader_object(vs, vsm))
+	{
+		printf("Vertex shader compilation failed\n");
+		release();
+		return false;
+	}
+
+	if (!check_shader_object(fs, psm))
+	{
+		printf("Fragment shader compilation failed\n");
+		release();
+		return false;
+	}
+	compile_time = elapsed_ms(compile_start);
 
 	GLint linked = 0;
 
 	glGetProgramiv(program, GL_LINK_STATUS, &linked);
 	assert(glGetError() == GL_NO_ERROR);
+	link_time = elapsed_ms(compile_start) - compile_time;
 
 	if (!linked)
 	{
@@ -333,15 +596,215 @@ bool Shader::compile_from_memory(const std::string& vsm, const std::string& psm)
 		return false;
 	}
 
+	//in the background it is the time until the compile was polled
+	std::cout << "   compile: " << compile_time << " ms  link: " << link_time << " ms" << std::endl;
+	save_program_binary(cache_key);
+	setup_program();
+	return true;
+}
+
+void Shader::setup_program()
+{
+	reflect();
+	bind_uniform_blocks();
+
 #ifdef _DEBUG
 	validate();
 #endif
 
 	compiled = true;
+}
+
+// ******************************************
 
+struct sShaderCacheHeader
+{
+	uint32_t version;
+	uint64_t key;
+	uint32_t format;
+	uint32_t size;
+};
+
+static bool supports_program_binary()
+{
+	static int supported = -1;
+	if (supported == -1)
+	{
+		GLint num_formats = 0;
+		if (glGetProgramBinary != 0 && glProgramBinary != 0)
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+		supported = num_formats > 0 ? 1 : 0;
+	}
+	return supported == 1;
+}
+
+static std::string get_cache_filename(uint64_t key)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+	return std::string(SHADER_CACHE_FOLDER) + "/" + name;
+}
+
+static uint64_t hash_bytes(const char* data, size_t size, uint64_t hash)
+{
+	//FNV-1a 64
+	for (size_t i = 0; i < size; ++i)
+		hash = (hash ^ (uint8_t)data[i]) * 1099511628211ull;
+	return hash;
+}
+
+struct sShaderBinding
+{
+	const char* name;
+	GLuint index;
+};
+
+//fixed attribute locations, the meshes set up their VAOs with them
+static const sShaderBinding s_attribute_locations[] = {
+	{ "a_vertex", VERTEX_ATTRIB_VERTEX },
+	{ "a_normal", VERTEX_ATTRIB_NORMAL },
+	{ "a_uv", VERTEX_ATTRIB_UV },
+	{ "a_color", VERTEX_ATTRIB_COLOR },
+	{ "a_bones", VERTEX_ATTRIB_BONES },
+	{ "a_weights", VERTEX_ATTRIB_WEIGHTS },
+	{ "a_uv1", VERTEX_ATTRIB_UV1 },
+	{ "u_model", VERTEX_ATTRIB_MODEL },
+	{ "a_texture_rect", VERTEX_ATTRIB_TEXTURE_RECT },
+	{ "a_texture_layer", VERTEX_ATTRIB_TEXTURE_LAYER },
+	{ "a_instance_color", VERTEX_ATTRIB_INSTANCE_COLOR },
+};
+
+//fixed binding points of the uniform blocks
+static const sShaderBinding s_uniform_block_bindings[] = {
+	{ UBO_FRAME_BLOCK_NAME, UBO_BINDING_FRAME },
+	{ UBO_OBJECT_BLOCK_NAME, UBO_BINDING_OBJECT },
+};
+
+static uint64_t hash_bindings(const sShaderBinding* bindings, size_t count, uint64_t hash)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		hash = hash_bytes(bindings[i].name, strlen(bindings[i].name) + 1, hash);
+		hash = hash_bytes((const char*)&bindings[i].index, sizeof(GLuint), hash);
+	}
+	return hash;
+}
+
+uint64_t Shader::get_cache_key(const std::string& vsm, const std::string& psm) const
+{
+	//the macros are already in the sources, the driver strings invalidate the cache when the driver changes
+	//the binary keeps the locations and bindings set before the link, so changing the tables invalidates it too
+	uint64_t hash = 14695981039346656037ull;
+	hash = hash_bytes(vsm.c_str(), vsm.size() + 1, hash);
+	hash = hash_bytes(psm.c_str(), psm.size() + 1, hash);
+	hash = hash_bindings(s_attribute_locations, sizeof(s_attribute_locations) / sizeof(sShaderBinding), hash);
+	hash = hash_bindings(s_uniform_block_bindings, sizeof(s_uniform_block_bindings) / sizeof(sShaderBinding), hash);
+	const GLenum driver_strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+	for (GLenum name : driver_strings)
+	{
+		const char* str = (const char*)glGetString(name);
+		if (str)
+			hash = hash_bytes(str, strlen(str) + 1, hash);
+	}
+	return hash;
+}
+
+bool Shader::load_program_binary(uint64_t key)
+{
+	if (!s_use_binary_cache || !supports_program_binary())
+		return false;
+
+	std::string filename = get_cache_filename(key);
+	std::ifstream file(filename, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	sShaderCacheHeader header;
+	std::vector<char> data;
+	bool valid = file.read((char*)&header, sizeof(header)) && header.version == SHADER_CACHE_VERSION && header.key == key;
+	if (valid)
+	{
+		data.resize(header.size);
+		valid = header.size > 0 && file.read(data.data(), header.size);
+	}
+	file.close();
+
+	GLint linked = 0;
+	if (valid)
+	{
+		glProgramBinary(program, header.format, data.data(), (GLsizei)data.size());
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		glGetError(); //an unknown format only fails the link
+	}
+
+	if (!linked)
+	{
+		//stale (driver update or corrupted file), it will be compiled and stored again
+		std::cout << "[WARN] Shader binary cache entry rejected: " << filename << std::endl;
+		std::error_code error;
+		std::filesystem::remove(filename, error);
+		return false;
+	}
 	return true;
 }
 
+void Shader::save_program_binary(uint64_t key)
+{
+	if (!s_use_binary_cache || !supports_program_binary())
+		return;
+
+	GLint size = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+	if (size <= 0)
+		return;
+
+	sShaderCacheHeader header;
+	header.version = SHADER_CACHE_VERSION;
+	header.key = key;
+	header.size = (uint32_t)size;
+	std::vector<char> data(size);
+	GLenum format = 0;
+	glGetProgramBinary(program, size, NULL, &format, data.data());
+	header.format = format;
+	if (glGetError() != GL_NO_ERROR)
+		return;
+
+	std::error_code error;
+	std::filesystem::create_directories(SHADER_CACHE_FOLDER, error);
+	std::ofstream file(get_cache_filename(key), std::ios::binary);
+	if (!file.is_open())
+	{
+		std::cout << "[WARN] Cannot write the shader binary cache in " << SHADER_CACHE_FOLDER << std::endl;
+		return;
+	}
+	file.write((const char*)&header, sizeof(header));
+	file.write(data.data(), data.size());
+}
+
+void Shader::bind_attribute_locations()
+{
+	//names not used by the shader are ignored
+	for (const sShaderBinding& binding : s_attribute_locations)
+		glBindAttribLocation(program, binding.index, binding.name);
+}
+
+void Shader::bind_uniform_blocks()
+{
+	//the blocks always use the same binding points, so the buffers are bound once and not per program
+	has_frame_block = has_object_block = false;
+	for (const sShaderBinding& binding : s_uniform_block_bindings)
+	{
+		GLuint index = glGetUniformBlockIndex(program, binding.name);
+		if (index == GL_INVALID_INDEX)
+			continue;
+		glUniformBlockBinding(program, index, binding.index);
+		if (binding.index == UBO_BINDING_FRAME)
+			has_frame_block = true;
+		else if (binding.index == UBO_BINDING_OBJECT)
+			has_object_block = true;
+	}
+}
+
 bool Shader::validate()
 {
 	glValidateProgram(program);
@@ -386,6 +849,15 @@ bool Shader::create_shader_object(unsigned int type, GLuint& handle, const std::
 	glCompileShader(handle);
 	assert(glGetError() == GL_NO_ERROR);
 
+	//the compile status is checked after linking (see check_shader_object)
+	glAttachShader(program, handle);
+	assert(glGetError() == GL_NO_ERROR);
+
+	return true;
+}
+
+bool Shader::check_shader_object(GLuint handle, const std::string& code)
+{
 	GLint compile = 0;
 	glGetShaderiv(handle, GL_COMPILE_STATUS, &compile);
 	assert(glGetError() == GL_NO_ERROR);
@@ -395,22 +867,26 @@ bool Shader::create_shader_object(unsigned int type, GLuint& handle, const std::
 	{
 		save_shader_info_log(handle);
 		std::cout << "Shader code:\n " << std::endl;
-		std::vector<std::string> lines = split(fullcode, '\n');
+		std::vector<std::string> lines = split(code, '\n');
 		for (size_t i = 0; i < lines.size(); ++i)
 			std::cout << i << "  " << lines[i] << std::endl;
 
 		return false;
 	}
-
-	glAttachShader(program, handle);
-	assert(glGetError() == GL_NO_ERROR);
-
 	return true;
 }
 
 
 void Shader::release()
 {
+	if (pending)
+	{
+		s_pending.erase(std::find(s_pending.begin(), s_pending.end(), this));
+		pending = false;
+	}
+	pending_vs.clear();
+	pending_ps.clear();
+
 	if (vs)
 	{
 		glDeleteShader(vs);
@@ -432,7 +908,10 @@ void Shader::release()
 		program = 0;
 	}
 
-	locations.clear();
+	uniforms_info.clear();
+	attributes_info.clear();
+	handle_locations.clear();
+	reported_misses.clear();
 
 	compiled = false;
 }
@@ -464,6 +943,7 @@ void Shader::disable()
 
 void Shader::disable_shaders()
 {
+	current = NULL;
 	glUseProgram(0);
 	assert(glGetError() == GL_NO_ERROR);
 }
@@ -511,55 +991,146 @@ void Shader::save_program_info_log(GLuint obj)
 	}
 }
 
-GLint Shader::get_location(const char* varname, loctable* table)
+void Shader::reflect()
 {
-	if (varname == 0 || table == 0)
-		return 0;
-
-	GLint loc = 0;
-	loctable* locs = table;
-
-	loctable::iterator cur = locs->find(varname);
-
-	if (cur == locs->end()) //not found in the locations table
+	uniforms_info.clear();
+	attributes_info.clear();
+	handle_locations.clear();
+	reported_misses.clear();
+
+	GLint count = 0;
+	GLint max_length = 0;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+	std::vector<char> name(max_length + 1);
+	for (GLint i = 0; i < count; ++i)
 	{
-		loc = glGetUniformLocation(program, varname);
-		if (loc == -1)
-		{
-			return -1;
-		}
-
-		//insert the new value
-		locs->insert(loctable::value_type(varname, loc));
+		sVariableInfo info;
+		GLsizei length = 0;
+		glGetActiveUniform(program, i, (GLsizei)name.size(), &length, &info.size, &info.type, name.data());
+		info.location = glGetUniformLocation(program, name.data());
+		if (info.location == -1)
+			continue; //members of the uniform blocks
+		//arrays are listed as "name[0]" but they are set with the plain name
+		if (length > 3 && strcmp(&name[length - 3], "[0]") == 0)
+			name[length - 3] = 0;
+		info.hash = hash_uniform_name(name.data());
+		uniforms_info.push_back(info);
 	}
-	else //found in the table
+
+	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &max_length);
+	name.resize(max_length + 1);
+	for (GLint i = 0; i < count; ++i)
 	{
-		loc = (*cur).second;
+		sVariableInfo info;
+		GLsizei length = 0;
+		glGetActiveAttrib(program, i, (GLsizei)name.size(), &length, &info.size, &info.type, name.data());
+		info.location = glGetAttribLocation(program, name.data());
+		if (info.location == -1)
+			continue; //built-ins like gl_VertexID
+		info.hash = hash_uniform_name(name.data());
+		attributes_info.push_back(info);
 	}
-	return loc;
+
+	auto by_hash = [](const sVariableInfo& a, const sVariableInfo& b) { return a.hash < b.hash; };
+	std::sort(uniforms_info.begin(), uniforms_info.end(), by_hash);
+	std::sort(attributes_info.begin(), attributes_info.end(), by_hash);
+	assert(glGetError() == GL_NO_ERROR);
 }
 
-int Shader::get_attribute_location(const char* varname)
+const Shader::sVariableInfo* Shader::find_variable(const std::vector<sVariableInfo>& table, uint32_t hash)
+{
+	std::vector<sVariableInfo>::const_iterator it = std::lower_bound(table.begin(), table.end(), hash,
+		[](const sVariableInfo& info, uint32_t hash) { return info.hash < hash; });
+	if (it == table.end() || it->hash != hash)
+		return NULL;
+	return &(*it);
+}
+
+void Shader::report_miss(const char* varname, uint32_t hash)
+{
+	if (std::find(reported_misses.begin(), reported_misses.end(), hash) != reported_misses.end())
+		return;
+	reported_misses.push_back(hash);
+	std::cout << "[WARN] Shader " << vs_filename << " " << ps_filename << " has no active uniform " << varname << std::endl;
+}
+
+GLint Shader::get_location(const char* varname)
 {
-	int loc = glGetAttribLocation(program, varname);
-	if (loc == -1)
+	if (varname == 0)
+		return -1;
+
+	uint32_t hash = hash_uniform_name(varname);
+	const sVariableInfo* info = find_variable(uniforms_info, hash);
+	if (!info)
 	{
-		return loc;
+		report_miss(varname, hash);
+		return -1;
 	}
-	assert(glGetError() == GL_NO_ERROR);
+	return info->location;
+}
 
+GLint Shader::resolve_handle(const UniformHandle& handle)
+{
+	if (handle.index >= handle_locations.size())
+		handle_locations.resize(handle.index + 1, UNIFORM_UNRESOLVED);
+
+	const sVariableInfo* info = find_variable(uniforms_info, handle.hash);
+	if (!info)
+		report_miss(handle.name, handle.hash);
+	//misses are stored too, so they are not looked up again
+	GLint loc = info ? info->location : -1;
+	handle_locations[handle.index] = loc;
 	return loc;
 }
 
+int Shader::get_attribute_location(const char* varname)
+{
+	const sVariableInfo* info = find_variable(attributes_info, hash_uniform_name(varname));
+	return info ? info->location : -1;
+}
+
 int Shader::get_uniform_location(const char* varname)
 {
-	int loc = get_location(varname, &locations);
-	if (loc == -1)
-	{
-		return loc;
-	}
-	assert(glGetError() == GL_NO_ERROR);
-	return loc;
+	//not reported, this is used to check if the uniform exists
+	const sVariableInfo* info = find_variable(uniforms_info, hash_uniform_name(varname));
+	return info ? info->location : -1;
+}
+
+//names of all the handles, the position is the UniformHandle::index
+struct sHandleName
+{
+	uint32_t hash;
+	const char* name;
+};
+static std::vector<sHandleName>& get_handle_names()
+{
+	static std::vector<sHandleName> names;
+	return names;
+}
+
+UniformHandle::UniformHandle(const char* name, uint32_t hash) : name(name), hash(hash)
+{
+	std::vector<sHandleName>& names = get_handle_names();
+	for (index = 0; index < names.size(); ++index)
+		if (names[index].hash == hash)
+		{
+			assert(strcmp(names[index].name, name) == 0 && "uniform names with the same hash");
+			return;
+		}
+	sHandleName entry = { hash, name };
+	names.push_back(entry);
+}
+
+void Shader::set_uniform(const UniformHandle& handle, Texture* texture, int slot)
+{
+	assert(current == this);
+	glActiveTexture(GL_TEXTURE0 + slot);
+	glBindTexture(texture->texture_type, texture->texture_id);
+	GLint loc = get_location(handle);
+	if (loc != -1)
+		glUniform1i(loc, slot);
 }
 
 void Shader::set_texture(const char* varname, Texture* tex, int slot)
@@ -582,7 +1153,7 @@ void Shader::set_texture(const char* varname, unsigned int tex)
 
 void Shader::set_uniform1(const char* varname, bool input1)
 {
-	GLint loc = get_location(varname, &locations);
+	GLint loc = get_location(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform1i(loc, input1);
 	assert(glGetError() == GL_NO_ERROR);
@@ -590,7 +1161,7 @@ void Shader::set_uniform1(const char* varname, bool input1)
 
 void Shader::set_uniform1(const char* varname, int input1)
 {
-	GLint loc = get_location(varname, &locations);
+	GLint loc = get_location(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform1i(loc, input1);
 	assert(glGetError() == GL_NO_ERROR);
@@ -598,7 +1169,7 @@ void Shader::set_uniform1(const char* varname, int input1)
 
 void Shader::set_uniform2(const char* varname, int input1, int input2)
 {
-	GLint loc = get_location(varname, &locations);
+	GLint loc = get_location(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform2i(loc, input1, input2);
 	assert(glGetError() == GL_NO_ERROR);
@@ -606,7 +1177,7 @@ void Shader::set_uniform2(const char* varname, int input1, int input2)
 
 void Shader::set_uniform3(const char* varname, int input1, int input2, int input3)
 {
-	GLint loc = get_location(varname, &locations);
+	GLint loc = get_location(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform3i(loc, input1, input2, input3);
 	assert(glGetError() == GL_NO_ERROR);
@@ -614,7 +1185,7 @@ void Shader::set_uniform3(const char* varname, int input1, int input2, int input
 
 void Shader::set_uniform4(const char* varname, const int input1, const int input2, const int input3, const int input4)
 {
-	GLint loc = get_location(varname, &locations);
+	GLint loc = get_location(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform4i(loc, input1, input2, input3, input4);
 	assert(glGetError() == GL_NO_ERROR);
@@ -622,7 +1193,7 @@ void Shader::set_uniform4(const char* varname, const int input1, const int input
 
 void Shader::set_uniform1_array(const char* varname, const int* input, const int count)
 {
-	GLint loc = get_location(varname, &locations);
+	GLint loc = get_location(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform1iv(loc, count, input);
 	assert(glGetError() == GL_NO_ERROR);
@@ -630,7 +1201,7 @@ void Shader::set_uniform1_array(const char* varname, const int* input, const int
 
 void Shader::set_uniform2_array(const char* varname, const int* input, const int count)
 {
-	GLint loc = get_location(varname, &locations);
+	GLint loc = get_location(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform2iv(loc, count, input);
 	assert(glGetError() == GL_NO_ERROR);
@@ -638,7 +1209,7 @@ void Shader::set_uniform2_array(const char* varname, const int* input, const int
 
 void Shader::set_uniform3_array(const char* varname, const int* input, const int count)
 {
-	GLint loc = get_location(varname, &locations);
+	GLint loc = get_location(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform3iv(loc, count, input);
 	assert(glGetError() == GL_NO_ERROR);
@@ -646,7 +1217,7 @@ void Shader::set_uniform3_array(const char* varname, const int* input, const int
 
 void Shader::set_uniform4_array(const char* varname, const int* input, const int count)
 {
-	GLint loc = get_location(varname, &locations);
+	GLint loc = get_location(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform4iv(loc, count, input);
 	assert(glGetError() == GL_NO_ERROR);
@@ -654,7 +1225,7 @@ void Shader::set_uniform4_array(const char* varname, const int* input, const int
 
 void Shader::set_uniform1(const char* varname, const float input1)
 {
-	GLint loc = get_location(varname, &locations);
+	GLint loc = get_location(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform1f(loc, input1);
 	assert(glGetError() == GL_NO_ERROR);
@@ -662,7 +1233,7 @@ void Shader::set_uniform1(const char* varname, const float input1)
 
 void Shader::set_uniform2(const char* varname, const float input1, const float input2)
 {
-	GLint loc = get_location(varname, &locations);
+	GLint loc = get_location(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform2f(loc, input1, input2);
 	assert(glGetError() == GL_NO_ERROR);
@@ -670,7 +1241,7 @@ void Shader::set_uniform2(const char* varname, const float input1, const float i
 
 void Shader::set_uniform3(const char* varname, const float input1, const float input2, const float input3)
 {
-	GLint loc = get_location(varname, &locations);
+	GLint loc = get_location(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform3f(loc, input1, input2, input3);
 	assert(glGetError() == GL_NO_ERROR);
@@ -678,7 +1249,7 @@ void Shader::set_uniform3(const char* varname, const float input1, const float i
 
 void Shader::set_uniform4(const char* varname, const float input1, const float input2, const float input3, const float input4)
 {
-	GLint loc = get_location(varname, &locations);
+	GLint loc = get_location(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform4f(loc, input1, input2, input3, input4);
 	check_gl_errors();
@@ -686,7 +1257,7 @@ void Shader::set_uniform4(const char* varname, const float input1, const float i
 
 void Shader::set_uniform1_array(const char* varname, const float* input, const int count)
 {
-	GLint loc = get_location(varname, &locations);
+	GLint loc = get_location(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform1fv(loc, count, input);
 	assert(glGetError() == GL_NO_ERROR);
@@ -694,7 +1265,7 @@ void Shader::set_uniform1_array(const char* varname, const float* input, const i
 
 void Shader::set_uniform2_array(const char* varname, const float* input, const int count)
 {
-	GLint loc = get_location(varname, &locations);
+	GLint loc = get_location(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform2fv(loc, count, input);
 	assert(glGetError() == GL_NO_ERROR);
@@ -702,7 +1273,7 @@ void Shader::set_uniform2_array(const char* varname, const float* input, const i
 
 void Shader::set_uniform3_array(const char* varname, const float* input, const int count)
 {
-	GLint loc = get_location(varname, &locations);
+	GLint loc = get_location(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform3fv(loc, count, input);
 	assert(glGetError() == GL_NO_ERROR);
@@ -710,7 +1281,7 @@ void Shader::set_uniform3_array(const char* varname, const float* input, const i
 
 void Shader::set_uniform4_array(const char* varname, const float* input, const int count)
 {
-	GLint loc = get_location(varname, &locations);
+	GLint loc = get_location(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform4fv(loc, count, input);
 	assert(glGetError() == GL_NO_ERROR);
@@ -718,7 +1289,7 @@ void Shader::set_uniform4_array(const char* varname, const float* input, const i
 
 void Shader::set_matrix4(const char* varname, const float* m)
 {
-	GLint loc = get_location(varname, &locations);
+	GLint loc = get_location(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniformMatrix4fv(loc, 1, GL_FALSE, m);
 	assert(glGetError() == GL_NO_ERROR);
@@ -726,7 +1297,7 @@ void Shader::set_matrix4(const char* varname, const float* m)
 
 void Shader::set_matrix4(const char* varname, const mat4& m)
 {
-	GLint loc = get_location(varname, &locations);
+	GLint loc = get_location(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniformMatrix4fv(loc, 1, GL_FALSE, m.data);
 	assert(glGetError() == GL_NO_ERROR);
@@ -734,7 +1305,7 @@ void Shader::set_matrix4(const char* varname, const mat4& m)
 
 void Shader::set_matrix4_array(const char* varname, mat4* m_array, int num)
 {
-	GLint loc = get_location(varname, &locations);
+	GLint loc = get_location(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniformMatrix4fv(loc, num, GL_FALSE, (GLfloat*)m_array);
 	assert(glGetError() == GL_NO_ERROR);
@@ -780,6 +1351,19 @@ void Shader::init()
 		IMPORT_GLEXT(glUniform4fv);
 		IMPORT_GLEXT(glUniformMatrix4fv);
 #endif
+
+		//let the driver compile in its own threads, the shaders are polled in update_pending
+		GLint num_extensions = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+		for (GLint i = 0; i < num_extensions && !s_parallel_compile; ++i)
+		{
+			const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+			s_parallel_compile = extension && strcmp(extension, "GL_KHR_parallel_shader_compile") == 0;
+		}
+		if (s_parallel_compile && glMaxShaderCompilerThreadsKHR != 0)
+			glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+		else
+			s_parallel_compile = false;
 	}
 
 	firsttime = false;
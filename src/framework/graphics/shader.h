@@ -15,6 +15,9 @@
 #include <vector>
 #include <map>
 #include <cassert>
+#include <cstdint>
+#include <type_traits>
+#include <chrono>
 
 #ifdef _DEBUG
 #define CHECK_SHADER_VAR(a,b) if (a == -1) return
@@ -23,8 +26,52 @@
 #define CHECK_SHADER_VAR(a,b) if (a == -1) return
 #endif
 
+//attribute locations are fixed before linking, so a mesh VAO works with every shader
+#define VERTEX_ATTRIB_VERTEX 0
+#define VERTEX_ATTRIB_NORMAL 1
+#define VERTEX_ATTRIB_UV 2
+#define VERTEX_ATTRIB_COLOR 3
+#define VERTEX_ATTRIB_BONES 4
+#define VERTEX_ATTRIB_WEIGHTS 5
+#define VERTEX_ATTRIB_UV1 6
+#define VERTEX_ATTRIB_MODEL 7 //instanced mat4, uses 7 to 10
+#define VERTEX_ATTRIB_TEXTURE_RECT 11 //instanced vec4, uv rect in a shared texture
+#define VERTEX_ATTRIB_TEXTURE_LAYER 12 //instanced float, layer in a shared texture
+#define VERTEX_ATTRIB_INSTANCE_COLOR 13 //instanced vec4, color of the material
+
+#define SHADER_CACHE_FOLDER "cache/shaders" //linked program binaries, safe to delete
+#define SHADER_CACHE_VERSION 1
+
+//feature bits of the shader permutations, each one adds its macro to the sources (see Shader::get_feature_macros)
+enum eShaderFeature
+{
+	SHADER_FEATURE_INSTANCING = 1 << 0, //USE_INSTANCING: u_model and the color per instance
+	SHADER_FEATURE_TEXTURE_ARRAY = 1 << 1, //USE_TEXTURE_ARRAY: u_texture is a layer of a sampler2DArray (see TextureArray)
+	SHADER_NUM_FEATURES = 2
+};
+
+#define UNIFORM_UNRESOLVED -2 //handle_locations entry not looked up yet
+
 class Texture;
 
+//FNV-1a, constexpr so the hash of a literal name is folded by the compiler
+constexpr uint32_t hash_uniform_name(const char* name, uint32_t hash = 2166136261u)
+{
+	return *name ? hash_uniform_name(name + 1, (hash ^ (uint8_t)*name) * 16777619u) : hash;
+}
+
+//a uniform name interned once, declare it static: set_uniform with a handle is an array index in the shader
+//i.e. static const UniformHandle u_color = UNIFORM_HANDLE("u_color"); shader->set_uniform(u_color, color);
+struct UniformHandle
+{
+	const char* name;
+	uint32_t hash;
+	uint32_t index; //the same for every handle with this name, slot in Shader::handle_locations
+
+	UniformHandle(const char* name, uint32_t hash);
+};
+#define UNIFORM_HANDLE(name) UniformHandle(name, std::integral_constant<uint32_t, hash_uniform_name(name)>::value)
+
 class Shader
 {
 	int last_slot;
@@ -41,7 +88,8 @@ public:
 	virtual bool compile();
 	virtual bool recompile();
 
-	virtual bool load(const std::string& vsf, const std::string& psf, const char* macros);
+	//async: the shader is compiled in the background (see update_pending), compiled is false until it finishes
+	virtual bool load(const std::string& vsf, const std::string& psf, const char* macros, bool async = false);
 
 	//internal functions
 	virtual bool compile_from_memory(const std::string& vsm, const std::string& psm);
@@ -69,6 +117,17 @@ public:
 	//for textures you must specify an slot (a number from 0 to 16) where this texture is stored in the shader
 	void set_uniform(const char* varname, Texture* texture, int slot) { assert(current == this); set_texture(varname, texture, slot); }
 
+	//upload with a handle, no string lookup
+	void set_uniform(const UniformHandle& handle, bool input) { set_uniform(handle, (int)input); }
+	void set_uniform(const UniformHandle& handle, int input) { assert(current == this); GLint loc = get_location(handle); if (loc != -1) glUniform1i(loc, input); }
+	void set_uniform(const UniformHandle& handle, float input) { assert(current == this); GLint loc = get_location(handle); if (loc != -1) glUniform1f(loc, input); }
+	void set_uniform(const UniformHandle& handle, const vec2& input) { assert(current == this); GLint loc = get_location(handle); if (loc != -1) glUniform2f(loc, input.x, input.y); }
+	void set_uniform(const UniformHandle& handle, const vec3& input) { assert(current == this); GLint loc = get_location(handle); if (loc != -1) glUniform3f(loc, input.x, input.y, input.z); }
+	void set_uniform(const UniformHandle& handle, const vec4& input) { assert(current == this); GLint loc = get_location(handle); if (loc != -1) glUniform4f(loc, input.x, input.y, input.z, input.w); }
+	void set_uniform(const UniformHandle& handle, const mat4& input) { assert(current == this); GLint loc = get_location(handle); if (loc != -1) glUniformMatrix4fv(loc, 1, GL_FALSE, input.data); }
+	void set_uniform(const UniformHandle& handle, std::vector<mat4>& m_vector) { assert(current == this && m_vector.size()); GLint loc = get_location(handle); if (loc != -1) glUniformMatrix4fv(loc, (GLsizei)m_vector.size(), GL_FALSE, m_vector[0].data); }
+	void set_uniform(const UniformHandle& handle, Texture* texture, int slot);
+
 
 	virtual void setInt(const char* varname, const int& input) { set_uniform1(varname, input); }
 	virtual void setFloat(const char* varname, const float& input) { set_uniform1(varname, input); }
@@ -110,11 +169,24 @@ public:
 	std::string get_info_log() const;
 	bool has_info_log() const;
 	bool compiled;
+	bool pending = false; //compiling in the background
+	bool from_binary_cache = false; //the program was loaded from SHADER_CACHE_FOLDER
+	float compile_time = 0.0f; //ms, compiling both stages (or loading the binary)
+	float link_time = 0.0f; //ms
+	bool has_frame_block = false; //uses the FrameBlock/ObjectBlock uniform buffers (see uniform_buffer.h)
+	bool has_object_block = false;
 
 	void set_macros(const char* macros);
 
-	static Shader* get(const char* vsf, const char* psf = NULL, const char* macros = NULL);
+	static Shader* get(const char* vsf, const char* psf = NULL, const char* macros = NULL, bool async = false);
 	static void reload_all();
+	//recompiles and replaces the program only if the new one links, so a broken edit keeps the old one working
+	bool reload();
+
+	//hot reload: when a file of the folder changes only the shaders that use it are reloaded
+	static void watch_folder(const char* folder);
+	static void update_hot_reload();
+	static std::map<std::string, std::vector<Shader*>> s_file_users; //normalized filename to the shaders (and permutations) using it
 	static std::map<std::string, Shader*> s_Shaders;
 
 	//this is a way to load a single file that contains all the shaders 
@@ -125,6 +197,22 @@ public:
 
 	static Shader* get_default_shader(std::string name);
 
+	//permutations of the same sources, by feature bits (eShaderFeature), compiled in the background by default
+	static Shader* get_permutation(const char* vsf, const char* psf, uint32_t features, bool async = true);
+	static std::string get_feature_macros(uint32_t features);
+	//starts compiling every combination of the features in the mask, to call at startup
+	static void precompile(const char* vsf, const char* psf, uint32_t feature_mask);
+	//finishes the background compiles, once per frame. With GL_KHR_parallel_shader_compile it only polls,
+	//without it the shaders are compiled here one after another until the budget is spent
+	static void update_pending(float budget_ms);
+	static size_t get_num_pending() { return s_pending.size(); }
+	//finishes the background compile of this shader now (waiting for the driver), false if it failed
+	bool finish_pending();
+	static bool s_parallel_compile; //GL_KHR_parallel_shader_compile is supported
+
+	//linked programs are stored with glGetProgramBinary and reused while the sources and the driver are the same
+	static bool s_use_binary_cache;
+
 protected:
 
 	std::string info_log;
@@ -136,29 +224,60 @@ protected:
 	bool create_vertex_shader_object(const std::string& shader);
 	bool create_fragment_shader_object(const std::string& shader);
 	bool create_shader_object(unsigned int type, GLuint& handle, const std::string& shader);
+	void bind_attribute_locations();
+	void bind_uniform_blocks();
 	void save_shader_info_log(GLuint obj);
 	void save_program_info_log(GLuint obj);
 
+	//compile_from_memory split in two, so the driver can compile between both
+	bool begin_compile(const std::string& vsm, const std::string& psm);
+	bool finish_compile();
+	bool is_compile_complete();
+	bool check_shader_object(GLuint handle, const std::string& code);
+	void setup_program();
+	void take_program(Shader* other);
+	std::string pending_vs; //sources kept until the compile finishes
+	std::string pending_ps;
+	std::chrono::high_resolution_clock::time_point compile_start;
+	uint64_t cache_key = 0;
+	static std::vector<Shader*> s_pending;
+
+	uint64_t get_cache_key(const std::string& vsm, const std::string& psm) const;
+	bool load_program_binary(uint64_t key);
+	void save_program_binary(uint64_t key);
+
 	bool validate();
 
-	GLuint vs;
-	GLuint fs;
-	GLuint program;
+	GLuint vs = 0;
+	GLuint fs = 0;
+	GLuint program = 0;
 	std::string log;
 
-	//this is a hack to speed up shader usage (save info locally)
-private:
-
-	struct ltstr
+	//active uniforms and attributes from glGetActiveUniform/glGetActiveAttrib, sorted by hash
+	struct sVariableInfo
 	{
-		bool operator()(const char* s1, const char* s2) const
-		{
-			return strcmp(s1, s2) < 0;
-		}
+		uint32_t hash;
+		GLint location;
+		GLenum type;
+		GLint size;
 	};
-	typedef std::map<const char*, int, ltstr> loctable;
+	std::vector<sVariableInfo> uniforms_info;
+	std::vector<sVariableInfo> attributes_info;
+	std::vector<GLint> handle_locations; //indexed by UniformHandle::index
+	std::vector<uint32_t> reported_misses; //hashes of the names already reported as missing
+
+	void reflect();
+	GLint resolve_handle(const UniformHandle& handle);
+	void report_miss(const char* varname, uint32_t hash);
+	static const sVariableInfo* find_variable(const std::vector<sVariableInfo>& table, uint32_t hash);
 
 public:
-	GLint get_location(const char* varname, loctable* table);
-	loctable locations;
-};
\ No newline at end of file
+	//the location of a uniform, -1 if it is not active (reported once)
+	GLint get_location(const char* varname);
+	GLint get_location(const UniformHandle& handle)
+	{
+		if (handle.index < handle_locations.size() && handle_locations[handle.index] != UNIFORM_UNRESOLVED)
+			return handle_locations[handle.index];
+		return resolve_handle(handle);
+	}
+};
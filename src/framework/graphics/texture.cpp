@@ -8,7 +8,14 @@
 
 #include "mesh.h"
 #include "shader.h"
+#include "../job_system.h"
+#include "texture_cook.h"
+#include "image_kernels.h"
 #include <cassert>
+#include <filesystem>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
 
 //bilinear interpolation
 vec4 Image::get_pixel_interpolated(float x, float y, bool repeat) {
@@ -43,6 +50,7 @@ std::map<std::string, Texture*> Texture::s_textures_loaded;
 int Texture::default_mag_filter = GL_LINEAR;
 int Texture::default_min_filter = GL_LINEAR_MIPMAP_LINEAR;
 FBO* Texture::global_fbo = NULL;
+bool Texture::use_cooked = false;
 
 Texture::Texture()
 {
@@ -73,12 +81,18 @@ Texture::Texture(Image* img)
 
 Texture::~Texture()
 {
+	//so the async jobs and the manager do not use it anymore
+	auto it = s_textures_loaded.find(filename);
+	if (it != s_textures_loaded.end() && it->second == this)
+		s_textures_loaded.erase(it);
 	clear();
 }
 
 void Texture::clear()
 {
-	glDeleteTextures(1, &texture_id);
+	//while it is not ready the id is the one of the white texture
+	if (load_state == TEXTURE_READY)
+		glDeleteTextures(1, &texture_id);
 	glBindTexture(this->texture_type, 0);
 	texture_id = 0;
 }
@@ -224,31 +238,225 @@ Texture* Texture::get(const char* filename, bool mipmaps, bool wrap)
 	return texture;
 }
 
+//does not use GL, so it can run in the worker threads
+static bool decode_image(const std::string& filename, Image* image, bool& supported)
+{
+	supported = Image::is_supported(filename.c_str());
+	return supported && image->load(filename.c_str());
+}
+
+//the .ctex next to the file, only if it is not older than the source (or the source is not shipped)
+static bool read_fresh_cooked(const std::string& filename, sCookedTexture& cooked)
+{
+	std::string cooked_filename = filename + CTEX_EXTENSION;
+	std::error_code error;
+	std::filesystem::file_time_type cooked_time = std::filesystem::last_write_time(cooked_filename, error);
+	if (error)
+		return false;
+	std::filesystem::file_time_type source_time = std::filesystem::last_write_time(filename, error);
+	if (!error && source_time > cooked_time)
+		return false;
+	return read_cooked_texture(cooked_filename.c_str(), cooked);
+}
+
+//the texture of a get_async request, NULL if it was deleted or unregistered while the jobs ran
+//(a registered texture is alive, ~Texture unregisters it, and the request id rules out a new one at the same address)
+static Texture* find_async_texture(const std::string& name, Texture* texture, unsigned int request)
+{
+	auto it = Texture::s_textures_loaded.find(name);
+	if (it == Texture::s_textures_loaded.end() || it->second != texture || texture->load_request != request)
+		return NULL;
+	return texture;
+}
+
+Texture* Texture::get_async(const char* filename, bool mipmaps, bool wrap)
+{
+	assert(filename);
+
+	//registered before loading so the requests of the same file share it
+	auto it = s_textures_loaded.find(filename);
+	if (it != s_textures_loaded.end())
+		return it->second;
+
+	Texture* white = get_white_texture();
+	Texture* texture = new Texture();
+	texture->filename = filename;
+	texture->load_state = TEXTURE_LOADING;
+	texture->texture_id = white->texture_id;
+	texture->width = white->width;
+	texture->height = white->height;
+	texture->format = white->format;
+	texture->type = white->type;
+	texture->set_name(filename);
+
+	//the jobs only keep the pointer, it is checked with find_async_texture in the main thread before using it
+	static unsigned int last_request = 0;
+	unsigned int request = texture->load_request = ++last_request;
+	std::string name = filename;
+	long time = get_time();
+	bool cook = use_cooked && supports_cooked();
+	JobSystem::enqueue([texture, name, request, mipmaps, wrap, time, cook]() {
+		sCookedTexture* cooked = new sCookedTexture();
+		if (cook && read_fresh_cooked(name, *cooked))
+		{
+			JobSystem::enqueue_main_thread([texture, name, request, cooked, mipmaps, wrap, time]() {
+				if (find_async_texture(name, texture, request))
+					texture->finish_cooked_upload(cooked, mipmaps, wrap, time);
+				else
+					delete cooked;
+			});
+			return;
+		}
+
+		Image* image = new Image();
+		bool supported = false;
+		if (!decode_image(name, image, supported))
+		{
+			delete image;
+			delete cooked;
+			JobSystem::enqueue_main_thread([texture, name, request, supported]() {
+				std::cout << " + Texture loading: " << name << " ... [ERROR]: " << (supported ? "Texture not found" : "unsupported format") << std::endl;
+				if (!find_async_texture(name, texture, request))
+					return;
+				//the users keep the pointer (and the white texture), the next request tries again
+				texture->load_state = TEXTURE_FAILED;
+				s_textures_loaded.erase(name);
+			});
+			return;
+		}
+
+		delete cooked;
+
+		//GL calls must be done in the main thread
+		JobSystem::enqueue_main_thread([texture, name, request, image, mipmaps, wrap, time]() {
+			if (find_async_texture(name, texture, request))
+				texture->begin_async_upload(image, mipmaps, wrap, time);
+			else
+				delete image;
+		});
+	});
+
+	return texture;
+}
+
+void Texture::begin_async_upload(Image* image, bool mipmaps, bool wrap, long start_time)
+{
+	int w = image->width;
+	int h = image->height;
+	int bpp = image->bytes_per_pixel;
+	size_t size = (size_t)w * h * bpp;
+
+	//the pixels are copied to the mapped PBO in a worker, so the main thread only maps and unmaps
+	GLuint pbo = 0;
+	glGenBuffers(1, &pbo);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+	void* ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (!ptr)
+	{
+		//no mapping, upload from the image
+		glDeleteBuffers(1, &pbo);
+		texture_id = 0;
+		load_state = TEXTURE_READY;
+		create(w, h, bpp == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, mipmaps, image->data);
+		glTexParameteri(texture_type, GL_TEXTURE_WRAP_S, this->mipmaps && wrap ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+		glTexParameteri(texture_type, GL_TEXTURE_WRAP_T, this->mipmaps && wrap ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+		delete image;
+		return;
+	}
+
+	//the copy only touches the mapped PBO, the texture is checked again when it comes back
+	Texture* texture = this;
+	std::string name = filename;
+	unsigned int request = load_request;
+	JobSystem::enqueue([texture, name, request, image, ptr, size, pbo, w, h, bpp, mipmaps, wrap, start_time]() {
+		memcpy(ptr, image->data, size);
+		delete image;
+		JobSystem::enqueue_main_thread([texture, name, request, pbo, w, h, bpp, mipmaps, wrap, start_time]() {
+			if (find_async_texture(name, texture, request))
+			{
+				texture->finish_async_upload(pbo, w, h, bpp, mipmaps, wrap, start_time);
+				return;
+			}
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			glDeleteBuffers(1, &pbo);
+		});
+	});
+}
+
+void Texture::finish_async_upload(GLuint pbo, int w, int h, int bpp, bool mipmaps, bool wrap, long start_time)
+{
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+	//stops using the white texture, with the PBO bound the NULL data is the offset in it so glTexImage2D does not wait
+	texture_id = 0;
+	load_state = TEXTURE_READY;
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1); //RGB rows are not aligned to 4 bytes
+	create(w, h, bpp == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, mipmaps, NULL);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glDeleteBuffers(1, &pbo); //the driver keeps it until the copy is done
+
+	glBindTexture(texture_type, texture_id);
+	glTexParameteri(texture_type, GL_TEXTURE_WRAP_S, this->mipmaps && wrap ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+	glTexParameteri(texture_type, GL_TEXTURE_WRAP_T, this->mipmaps && wrap ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+	if (this->mipmaps)
+		generate_mipmaps();
+	glBindTexture(texture_type, 0);
+
+	std::cout << " + Texture loaded async: " << filename << " [OK] Size: " << width << "x" << height << " Time: " << (get_time() - start_time) * 0.001 << "sec" << std::endl;
+}
+
+void Texture::finish_cooked_upload(sCookedTexture* cooked, bool mipmaps, bool wrap, long start_time)
+{
+	//stops using the white texture
+	texture_id = 0;
+	load_state = TEXTURE_READY;
+	upload_cooked(*cooked, mipmaps, wrap);
+	delete cooked;
+
+	std::cout << " + Texture loaded async: " << filename << " [OK] Cooked Size: " << width << "x" << height << " Time: " << (get_time() - start_time) * 0.001 << "sec" << std::endl;
+}
+
 bool Texture::load(const char* filename, bool mipmaps, bool wrap, unsigned int type)
 {
-	std::string str = filename;
-	std::string ext = str.substr(str.size() - 4, 4);
 	Image* image = NULL;
 	long time = get_time();
 
 	std::cout << " + Texture loading: " << filename << " ... ";
 
+	//float textures keep the precision, they are never compressed
+	bool cook = use_cooked && type == GL_UNSIGNED_BYTE && supports_cooked();
+	sCookedTexture cooked;
+	if (cook && read_fresh_cooked(filename, cooked))
+	{
+		this->filename = filename;
+		upload_cooked(cooked, mipmaps, wrap);
+		std::cout << "[OK] Cooked Size: " << width << "x" << height << " Time: " << (get_time() - time) * 0.001 << "sec" << std::endl;
+		set_name(filename);
+		return true;
+	}
+
 	image = new Image();
-	bool found = false;
+	bool supported = false;
+	bool found = decode_image(filename, image, supported);
 
-	if (ext == ".tga" || ext == ".TGA")
-		found = image->loadTGA(filename);
-	else if (ext == ".png" || ext == ".PNG")
-		found = image->loadPNG(filename);
-	else
+	if (!supported)
 	{
 		std::cout << "[ERROR]: unsupported format" << std::endl;
+		delete image;
 		return false; //unsupported file type
 	}
 
 	if (!found) //file not found
 	{
 		std::cout << " [ERROR]: Texture not found " << std::endl;
+		delete image;
 		return false;
 	}
 
@@ -268,6 +476,7 @@ bool Texture::load(const char* filename, bool mipmaps, bool wrap, unsigned int t
 		generate_mipmaps();
 
 	this->image.clear();
+	delete image;
 	std::cout << "[OK] Size: " << width << "x" << height << " Time: " << (get_time() - time) * 0.001 << "sec" << std::endl;
 	set_name(filename);
 	return true;
@@ -301,6 +510,51 @@ void Texture::upload(unsigned int format, unsigned int type, bool mipmaps, uint8
 	assert(check_gl_errors() && "Error uploading texture");
 }
 
+void Texture::upload_cooked(const sCookedTexture& cooked, bool mipmaps, bool wrap)
+{
+	unsigned int compressed_format = get_compressed_gl_format(cooked.compression);
+	assert(compressed_format && cooked.levels.size() && "Cooked texture is empty");
+
+	if (texture_id != 0)
+		clear();
+
+	this->width = (float)cooked.width;
+	this->height = (float)cooked.height;
+	this->depth = 0;
+	this->type = GL_UNSIGNED_BYTE;
+	this->internal_format = compressed_format;
+	this->texture_type = GL_TEXTURE_2D;
+	this->mipmaps = mipmaps && cooked.levels.size() > 1;
+	switch (cooked.compression)
+	{
+	case TEXTURE_COMPRESSION_BC1: format = GL_RGB; break;
+	case TEXTURE_COMPRESSION_BC4: format = GL_RED; break;
+	case TEXTURE_COMPRESSION_BC5: format = GL_RG; break;
+	default: format = GL_RGBA; break;
+	}
+
+	glGenTextures(1, &texture_id);
+	glBindTexture(texture_type, texture_id);
+
+	//the mips are already in the file, generate_mipmaps cannot be used with compressed formats
+	int num_levels = this->mipmaps ? (int)cooked.levels.size() : 1;
+	for (int i = 0; i < num_levels; ++i)
+	{
+		int level_width = std::max(cooked.width >> i, 1);
+		int level_height = std::max(cooked.height >> i, 1);
+		glCompressedTexImage2D(texture_type, i, compressed_format, level_width, level_height, 0, (GLsizei)cooked.levels[i].size(), cooked.levels[i].data());
+	}
+	glTexParameteri(texture_type, GL_TEXTURE_MAX_LEVEL, num_levels - 1);
+
+	glTexParameteri(texture_type, GL_TEXTURE_MAG_FILTER, Texture::default_mag_filter);
+	glTexParameteri(texture_type, GL_TEXTURE_MIN_FILTER, this->mipmaps ? Texture::default_min_filter : GL_LINEAR);
+	glTexParameteri(texture_type, GL_TEXTURE_WRAP_S, this->mipmaps && wrap ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+	glTexParameteri(texture_type, GL_TEXTURE_WRAP_T, this->mipmaps && wrap ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+
+	glBindTexture(texture_type, 0);
+	assert(check_gl_errors() && "Error uploading cooked texture");
+}
+
 void Texture::upload3D(unsigned int format, unsigned int type, bool mipmaps, uint8_t* data, unsigned int internal_format) {
 	assert(texture_id && "Must create texture before uploading data.");
 	assert(texture_type == GL_TEXTURE_3D && "Texture type does not match.");
@@ -469,6 +723,15 @@ Texture* Texture::get_black_texture()
 	return black;
 }
 
+bool Texture::supports_cooked()
+{
+	//RGTC (BC4, BC5) is core since GL 3.0, S3TC (BC1, BC3) is an extension every desktop driver exposes
+	static int supported = -1;
+	if (supported == -1)
+		supported = has_gl_extension("GL_EXT_texture_compression_s3tc") ? 1 : 0;
+	return supported == 1;
+}
+
 Texture* Texture::get_white_texture()
 {
 	static Texture* white = NULL;
@@ -513,6 +776,24 @@ void Image::from_texture(Texture* texture)
 
 //TGA format from: http://www.paulbourke.net/dataformats/tga/
 //also on https://gshaw.ca/closecombat/formats/tga.html
+bool Image::is_supported(const char* filename)
+{
+	std::string name = filename;
+	std::string ext = name.size() >= 4 ? name.substr(name.size() - 4, 4) : "";
+	return ext == ".tga" || ext == ".TGA" || ext == ".png" || ext == ".PNG";
+}
+
+bool Image::load(const char* filename)
+{
+	std::string name = filename;
+	std::string ext = name.size() >= 4 ? name.substr(name.size() - 4, 4) : "";
+	if (ext == ".tga" || ext == ".TGA")
+		return loadTGA(filename);
+	if (ext == ".png" || ext == ".PNG")
+		return loadPNG(filename);
+	return false;
+}
+
 bool Image::loadTGA(const char* filename)
 {
 	GLubyte TGAheader[12] = { 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
@@ -591,35 +872,24 @@ bool Image::loadTGA(const char* filename)
 
 bool Image::loadPNG(const char* filename, bool flip_y)
 {
-	std::ifstream file(filename, std::ios::in | std::ios::binary | std::ios::ate);
-
-	//get filesize
-	std::streamsize size = 0;
-	if (file.seekg(0, std::ios::end).good()) size = file.tellg();
-	if (file.seekg(0, std::ios::beg).good()) size -= file.tellg();
-
-	if (!size)
+	int w = 0, h = 0, channels = 0;
+	if (!stbi_info(filename, &w, &h, &channels))
 		return false;
 
-	std::vector<unsigned char> buffer;
-
-	//read contents of the file into the vector
-	if (size > 0)
-	{
-		buffer.resize((size_t)size);
-		file.read((char*)(&buffer[0]), size);
-	}
-	else
-		buffer.clear();
-
-	std::vector<unsigned char> out_image;
-
-	//if (decodePNG(out_image, width, height, buffer.empty() ? 0 : &buffer[0], (unsigned long)buffer.size(), true) != 0)
-	//	return false;
+	//RGB stays RGB, the rest (gray, gray + alpha) is expanded to RGBA
+	int bpp = channels == 3 ? 3 : 4;
+	stbi_uc* pixels = stbi_load(filename, &w, &h, &channels, bpp);
+	if (!pixels)
+		return false;
 
-	data = new uint8_t[out_image.size()];
-	memcpy(data, &out_image[0], out_image.size());
-	bytes_per_pixel = 4;
+	clear();
+	width = w;
+	height = h;
+	bytes_per_pixel = bpp;
+	origin_topleft = true;
+	data = new uint8_t[(size_t)w * h * bpp];
+	memcpy(data, pixels, (size_t)w * h * bpp);
+	stbi_image_free(pixels);
 
 	//flip pixels in Y
 	if (flip_y)
@@ -672,17 +942,40 @@ bool Image::saveTGA(const char* filename, bool flip_y)
 void Image::flipY()
 {
 	assert(data);
-	int row_size = 4 * width;
-	uint8_t* temp_row = new uint8_t[row_size];
-	for (int y = 0; y < height * 0.5; y += 1)
-	{
-		uint8_t* pos = data + y * row_size;
-		memcpy(temp_row, pos, row_size);
-		uint8_t* pos2 = data + (height - y - 1) * row_size;
-		memcpy(pos, pos2, row_size);
-		memcpy(pos2, temp_row, row_size);
-	}
-	delete[] temp_row;
+	image_flip_rows(data, width * bytes_per_pixel, height);
+}
+
+void Image::sample_bilinear(const vec2* uvs, int count, float* result, int channel) const
+{
+	assert(data && channel < bytes_per_pixel);
+	image_sample_bilinear(data, width, height, bytes_per_pixel, channel, (const float*)uvs, count, result);
+}
+
+void Image::downsample(Image& result, bool kaiser) const
+{
+	assert(data);
+	result.resize(std::max(width / 2, 1), std::max(height / 2, 1), bytes_per_pixel);
+	result.origin_topleft = origin_topleft;
+	if (kaiser)
+		image_downsample_kaiser(data, width, height, bytes_per_pixel, result.data);
+	else
+		image_downsample_box(data, width, height, bytes_per_pixel, result.data);
+}
+
+void Image::convert(int bytes_per_pixel)
+{
+	assert(data && (bytes_per_pixel == 3 || bytes_per_pixel == 4));
+	if (bytes_per_pixel == this->bytes_per_pixel)
+		return;
+
+	uint8_t* converted = new uint8_t[(size_t)width * height * bytes_per_pixel];
+	if (bytes_per_pixel == 4)
+		image_rgb_to_rgba(data, converted, width * height);
+	else
+		image_rgba_to_rgb(data, converted, width * height);
+	delete[] data;
+	data = converted;
+	this->bytes_per_pixel = bytes_per_pixel;
 }
 
 bool is_power_of_two(int n)
@@ -14,6 +14,13 @@
 class Shader;
 class FBO;
 class Texture;
+struct sCookedTexture;
+
+enum eTextureLoadState {
+	TEXTURE_READY,		//has its own data
+	TEXTURE_LOADING,	//requested with get_async, shows the white texture until it is decoded and uploaded
+	TEXTURE_FAILED		//keeps showing the white texture
+};
 
 //Simple class to handle images (stores RGBA always)
 class Image
@@ -36,7 +43,7 @@ public:
 	vec4 get_pixel(int x, int y) {
 		assert(x >= 0 && x < (int)width && y >= 0 && y < (int)height && "reading of memory");
 		int pos = y * width * bytes_per_pixel + x * bytes_per_pixel;
-		return vec4(data[pos], data[pos + 1], data[pos + 2], bytes_per_pixel == 4 ? 255 : data[pos + 3]);
+		return vec4(data[pos], data[pos + 1], data[pos + 2], bytes_per_pixel == 4 ? data[pos + 3] : 255);
 	};
 	void set_pixel(int x, int y, vec4 v) {
 		assert(x >= 0 && x < (int)width && y >= 0 && y < (int)height && "writing of memory");
@@ -47,9 +54,17 @@ public:
 	vec4 get_pixel_interpolated(float x, float y, bool repeat = false);
 	vec4 get_pixel_interpolated_high(float x, float y, bool repeat = false); //returns a Vector4 (floats)
 
+	//whole image operations (see image_kernels.h), much faster than going pixel by pixel
+	void sample_bilinear(const vec2* uvs, int count, float* result, int channel = 0) const; //0..255, uvs clamped to [0,1]
+	void downsample(Image& result, bool kaiser = false) const; //half size, for the mips
+	void convert(int bytes_per_pixel); //RGB <-> RGBA, the added alpha is opaque
+
 	void from_texture(Texture* texture);
 	void from_screen(int width, int height);
 
+	//TGA or PNG, by the extension
+	bool load(const char* filename);
+	static bool is_supported(const char* filename);
 	bool loadTGA(const char* filename);
 	bool loadPNG(const char* filename, bool flip_y = false);
 	bool saveTGA(const char* filename, bool flip_y = true);
@@ -63,6 +78,7 @@ public:
 	static int default_mag_filter;
 	static int default_min_filter;
 	static FBO* global_fbo;
+	static bool use_cooked; //load 8 bits textures from their .ctex when there is a fresh one (lossy, cooked offline, see texture_cook.h)
 
 	//a general struct to store all the information about a TGA file
 
@@ -80,6 +96,8 @@ public:
 	unsigned int internal_format;
 	unsigned int texture_type; //GL_TEXTURE_2D, GL_TEXTURE_CUBE, GL_TEXTURE_2D_ARRAY
 	bool mipmaps;
+	eTextureLoadState load_state = TEXTURE_READY;
+	unsigned int load_request = 0; //id of the get_async request, the jobs check it before touching the texture
 
 	unsigned int wrap_s = GL_CLAMP_TO_EDGE;
 	unsigned int wrap_t = GL_CLAMP_TO_EDGE;
@@ -105,6 +123,8 @@ public:
 	void upload3D(float* data = NULL, unsigned int mag_filter = GL_LINEAR, unsigned int min_filter = GL_LINEAR, unsigned int wrap = GL_CLAMP_TO_EDGE);
 	void upload_cubemap(unsigned int format = GL_RGB, unsigned int type = GL_UNSIGNED_BYTE, bool mipmaps = true, uint8_t** data = NULL, unsigned int internal_format = 0);
 	void upload_as_array(unsigned int texture_size, bool mipmaps = true);
+	//compressed blocks of every level, only the first one if mipmaps is false
+	void upload_cooked(const sCookedTexture& cooked, bool mipmaps = true, bool wrap = true);
 
 	void bind();
 	void unbind();
@@ -118,6 +138,11 @@ public:
 
 	//load using the manager (caching loaded ones to avoid reloading them)
 	static Texture* get(const char* filename, bool mipmaps = true, bool wrap = true);
+	//decodes in a worker thread and uploads through a PBO in the main thread jobs, call it from the main thread
+	//the texture is registered at once (so it is only loaded once) and uses the white texture till it is ready
+	//if the load fails it is unregistered, so it can be requested again
+	static Texture* get_async(const char* filename, bool mipmaps = true, bool wrap = true);
+	bool is_ready() const { return load_state == TEXTURE_READY; }
 	void set_name(const char* name) { s_textures_loaded[name] = this; }
 
 	void generate_mipmaps();
@@ -127,6 +152,13 @@ public:
 
 	static Texture* get_black_texture();
 	static Texture* get_white_texture();
+
+	static bool supports_cooked(); //the formats written by cook_texture can be uploaded
+
+private:
+	void begin_async_upload(Image* image, bool mipmaps, bool wrap, long start_time);
+	void finish_async_upload(GLuint pbo, int width, int height, int bytes_per_pixel, bool mipmaps, bool wrap, long start_time);
+	void finish_cooked_upload(sCookedTexture* cooked, bool mipmaps, bool wrap, long start_time);
 };
 
 bool is_power_of_two(int n);
\ No newline at end of file
@@ -0,0 +1,247 @@
+#include "texture_array.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cassert>
+
+#include "texture.h"
+#include "../includes.h"
+#include "../utils.h"
+
+std::map<std::pair<int, int>, std::vector<TextureArray*>> TextureArray::s_arrays;
+std::map<std::string, sTextureSlot> TextureArray::s_slots;
+std::vector<TextureAtlas*> TextureAtlas::s_atlases;
+std::map<std::string, sTextureSlot> TextureAtlas::s_slots;
+
+TextureArray::TextureArray(int width, int height, int max_layers, bool mipmaps)
+{
+	assert(width > 0 && height > 0 && max_layers > 0);
+
+	GLint gpu_max_layers = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &gpu_max_layers);
+	if (gpu_max_layers > 0)
+		max_layers = std::min(max_layers, (int)gpu_max_layers);
+
+	this->width = width;
+	this->height = height;
+	this->max_layers = max_layers;
+	this->mipmaps = mipmaps;
+
+	texture = new Texture();
+	texture->texture_type = GL_TEXTURE_2D_ARRAY;
+	texture->width = (float)width;
+	texture->height = (float)height;
+	texture->depth = (float)max_layers;
+	texture->format = GL_RGBA;
+	texture->internal_format = GL_RGBA8;
+	texture->type = GL_UNSIGNED_BYTE;
+	texture->mipmaps = mipmaps;
+
+	//every layer is allocated now, adding an image only copies it
+	glGenTextures(1, &texture->texture_id);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture->texture_id);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, max_layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, Texture::default_mag_filter);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, mipmaps ? Texture::default_min_filter : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	assert(check_gl_errors() && "Error creating texture array");
+}
+
+TextureArray::~TextureArray()
+{
+	delete texture;
+}
+
+int TextureArray::add(const Image& image)
+{
+	if (is_full() || image.width != width || image.height != height || !image.data)
+		return -1;
+
+	int layer = num_layers++;
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture->texture_id);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1); //RGB rows are not aligned to 4 bytes
+	glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1, image.bytes_per_pixel == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, image.data);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	dirty = true;
+	return layer;
+}
+
+void TextureArray::finalize()
+{
+	if (!dirty)
+		return;
+	dirty = false;
+	if (!mipmaps)
+		return;
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture->texture_id);
+	texture->generate_mipmaps();
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void TextureArray::finalize_all()
+{
+	for (std::map<std::pair<int, int>, std::vector<TextureArray*>>::iterator it = s_arrays.begin(); it != s_arrays.end(); ++it)
+		for (size_t i = 0; i < it->second.size(); ++i)
+			it->second[i]->finalize();
+}
+
+bool TextureArray::get(const char* filename, sTextureSlot& slot)
+{
+	assert(filename);
+
+	std::map<std::string, sTextureSlot>::iterator it = s_slots.find(filename);
+	if (it != s_slots.end())
+	{
+		slot = it->second;
+		return true;
+	}
+
+	Image image;
+	if (!image.load(filename))
+	{
+		std::cout << " + Texture array loading: " << filename << " ... [ERROR]: Texture not found" << std::endl;
+		return false;
+	}
+
+	std::vector<TextureArray*>& arrays = s_arrays[std::make_pair(image.width, image.height)];
+	if (arrays.empty() || arrays.back()->is_full())
+		arrays.push_back(new TextureArray(image.width, image.height));
+
+	TextureArray* array = arrays.back();
+	slot = sTextureSlot();
+	slot.texture = array->texture;
+	slot.layer = array->add(image);
+	if (slot.layer == -1)
+		return false;
+	s_slots[filename] = slot;
+	return true;
+}
+
+// ******************************************
+
+TextureAtlas::TextureAtlas(int size, bool mipmaps)
+{
+	this->size = size;
+	this->mipmaps = mipmaps;
+
+	texture = new Texture();
+	texture->create(size, size, GL_RGBA, GL_UNSIGNED_BYTE, mipmaps, NULL, GL_RGBA8);
+
+	//the images do not repeat, the padding is what the filter reads outside of them
+	glBindTexture(GL_TEXTURE_2D, texture->texture_id);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+TextureAtlas::~TextureAtlas()
+{
+	delete texture;
+}
+
+bool TextureAtlas::add(const Image& image, vec4& rect)
+{
+	if (!image.data)
+		return false;
+
+	int padded_width = image.width + TEXTURE_ATLAS_PADDING * 2;
+	int padded_height = image.height + TEXTURE_ATLAS_PADDING * 2;
+	if (padded_width > size || padded_height > size)
+		return false;
+
+	if (shelf_x + padded_width > size)
+	{
+		shelf_y += shelf_height;
+		shelf_x = 0;
+		shelf_height = 0;
+	}
+	if (shelf_y + padded_height > size)
+		return false;
+
+	//the border pixels are repeated in the padding so the mips do not mix the neighbours
+	std::vector<uint8_t> pixels((size_t)padded_width * padded_height * 4);
+	for (int y = 0; y < padded_height; ++y)
+	{
+		int source_y = std::clamp(y - TEXTURE_ATLAS_PADDING, 0, image.height - 1);
+		for (int x = 0; x < padded_width; ++x)
+		{
+			int source_x = std::clamp(x - TEXTURE_ATLAS_PADDING, 0, image.width - 1);
+			const uint8_t* source = image.data + ((size_t)source_y * image.width + source_x) * image.bytes_per_pixel;
+			uint8_t* pixel = &pixels[((size_t)y * padded_width + x) * 4];
+			pixel[0] = source[0];
+			pixel[1] = source[1];
+			pixel[2] = source[2];
+			pixel[3] = image.bytes_per_pixel == 4 ? source[3] : 255;
+		}
+	}
+
+	glBindTexture(GL_TEXTURE_2D, texture->texture_id);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, shelf_x, shelf_y, padded_width, padded_height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	glBindTexture(GL_TEXTURE_2D, 0);
+	dirty = true;
+
+	rect.x = (shelf_x + TEXTURE_ATLAS_PADDING) / (float)size;
+	rect.y = (shelf_y + TEXTURE_ATLAS_PADDING) / (float)size;
+	rect.z = image.width / (float)size;
+	rect.w = image.height / (float)size;
+
+	shelf_x += padded_width;
+	shelf_height = std::max(shelf_height, padded_height);
+	return true;
+}
+
+void TextureAtlas::finalize()
+{
+	if (!dirty)
+		return;
+	dirty = false;
+	if (!texture->mipmaps)
+		return;
+	glBindTexture(GL_TEXTURE_2D, texture->texture_id);
+	texture->generate_mipmaps();
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void TextureAtlas::finalize_all()
+{
+	for (size_t i = 0; i < s_atlases.size(); ++i)
+		s_atlases[i]->finalize();
+}
+
+bool TextureAtlas::get(const char* filename, sTextureSlot& slot)
+{
+	assert(filename);
+
+	std::map<std::string, sTextureSlot>::iterator it = s_slots.find(filename);
+	if (it != s_slots.end())
+	{
+		slot = it->second;
+		return true;
+	}
+
+	Image image;
+	if (!image.load(filename))
+	{
+		std::cout << " + Texture atlas loading: " << filename << " ... [ERROR]: Texture not found" << std::endl;
+		return false;
+	}
+
+	if (image.width + TEXTURE_ATLAS_PADDING * 2 > TEXTURE_ATLAS_SIZE || image.height + TEXTURE_ATLAS_PADDING * 2 > TEXTURE_ATLAS_SIZE)
+	{
+		std::cout << " + Texture atlas loading: " << filename << " ... [ERROR]: bigger than the atlas" << std::endl;
+		return false;
+	}
+
+	slot = sTextureSlot();
+	if (s_atlases.empty() || !s_atlases.back()->add(image, slot.rect))
+	{
+		s_atlases.push_back(new TextureAtlas());
+		s_atlases.back()->add(image, slot.rect);
+	}
+	slot.texture = s_atlases.back()->texture;
+	s_slots[filename] = slot;
+	return true;
+}
@@ -0,0 +1,91 @@
+/*  Shared textures, so the materials that only differ in their image use the same GL texture:
+	TextureArray stores images of the same size in the layers of a GL_TEXTURE_2D_ARRAY and
+	TextureAtlas packs images of any size in one 2D texture (shelf packer, borders extruded for the mips).
+	A material keeps the layer or the uv rect of its image instead of its own texture (see PBRMaterial::set_albedo).
+	Adding an image only copies it, the mips are built once by finalize after the last add (finalize_all every frame).
+*/
+
+#pragma once
+
+#include <map>
+#include <vector>
+#include <string>
+
+#include "../math/vec4.h"
+
+class Texture;
+class Image;
+
+#define TEXTURE_ARRAY_LAYERS 64 //per array, another one is created when it is full
+#define TEXTURE_ATLAS_SIZE 2048
+#define TEXTURE_ATLAS_PADDING 4 //pixels around every image, enough for the first mips
+
+//where an image is stored
+struct sTextureSlot
+{
+	Texture* texture = NULL; //the array or the atlas
+	int layer = -1; //in a TextureArray, -1 in a TextureAtlas
+	vec4 rect = vec4(0.0f, 0.0f, 1.0f, 1.0f); //in a TextureAtlas: offset (xy) and scale (zw) of the uvs
+};
+
+class TextureArray
+{
+public:
+	Texture* texture;
+	int width;
+	int height;
+	int num_layers = 0;
+	int max_layers;
+	bool mipmaps;
+	bool dirty = false; //images added since the last finalize
+
+	TextureArray(int width, int height, int max_layers = TEXTURE_ARRAY_LAYERS, bool mipmaps = true);
+	~TextureArray();
+
+	//copies the image (RGB or RGBA) to the next layer, returns it or -1 if the array is full or the size differs
+	int add(const Image& image);
+	bool is_full() const { return num_layers >= max_layers; }
+	//builds the mips of every layer if images were added, call it before rendering with the array
+	void finalize();
+
+	//loads the file to an array of its size (the arrays are shared, one is created when needed)
+	static bool get(const char* filename, sTextureSlot& slot);
+	//finalizes the shared arrays, once per frame
+	static void finalize_all();
+
+private:
+	static std::map<std::pair<int, int>, std::vector<TextureArray*>> s_arrays; //by size
+	static std::map<std::string, sTextureSlot> s_slots; //by filename
+};
+
+class TextureAtlas
+{
+public:
+	Texture* texture;
+	int size;
+	bool mipmaps;
+	bool dirty = false; //images added since the last finalize
+
+	TextureAtlas(int size = TEXTURE_ATLAS_SIZE, bool mipmaps = true);
+	~TextureAtlas();
+
+	//packs the image (RGB or RGBA) and returns its uv rect, false if it does not fit
+	//the uvs of the meshes must be inside [0,1], repeating would read the neighbours
+	bool add(const Image& image, vec4& rect);
+	//builds the mips if images were added, call it before rendering with the atlas
+	void finalize();
+
+	//loads the file to the current atlas, starting a new one when it is full
+	static bool get(const char* filename, sTextureSlot& slot);
+	//finalizes the shared atlases, once per frame
+	static void finalize_all();
+
+private:
+	//shelves: rows filled from left to right, a new one starts over the tallest image of the last
+	int shelf_x = 0;
+	int shelf_y = 0;
+	int shelf_height = 0;
+
+	static std::vector<TextureAtlas*> s_atlases;
+	static std::map<std::string, sTextureSlot> s_slots;
+};
@@ -0,0 +1,387 @@
+#include "texture_cook.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <iostream>
+#include <filesystem>
+
+#include "texture.h"
+#include "image_kernels.h"
+
+unsigned int get_compressed_gl_format(eTextureCompression compression)
+{
+	switch (compression)
+	{
+	case TEXTURE_COMPRESSION_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case TEXTURE_COMPRESSION_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case TEXTURE_COMPRESSION_BC4: return GL_COMPRESSED_RED_RGTC1;
+	case TEXTURE_COMPRESSION_BC5: return GL_COMPRESSED_RG_RGTC2;
+	default: return 0;
+	}
+}
+
+int get_block_bytes(eTextureCompression compression)
+{
+	return compression == TEXTURE_COMPRESSION_BC1 || compression == TEXTURE_COMPRESSION_BC4 ? 8 : 16;
+}
+
+// ******************************************
+
+static inline uint16_t to_565(const float* color)
+{
+	int r = std::clamp((int)(color[0] * 31.0f / 255.0f + 0.5f), 0, 31);
+	int g = std::clamp((int)(color[1] * 63.0f / 255.0f + 0.5f), 0, 63);
+	int b = std::clamp((int)(color[2] * 31.0f / 255.0f + 0.5f), 0, 31);
+	return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+//the color the GPU will decode, with the bits replicated
+static inline void from_565(uint16_t c, int* color)
+{
+	int r = (c >> 11) & 31;
+	int g = (c >> 5) & 63;
+	int b = c & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+void encode_bc1_block(const uint8_t* rgba, uint8_t* output)
+{
+	//principal axis of the colors (power iteration on the covariance)
+	float mean[3] = { 0, 0, 0 };
+	for (int i = 0; i < 16; ++i)
+		for (int c = 0; c < 3; ++c)
+			mean[c] += rgba[i * 4 + c];
+	for (int c = 0; c < 3; ++c)
+		mean[c] /= 16.0f;
+
+	float cov[6] = { 0, 0, 0, 0, 0, 0 }; //rr rg rb gg gb bb
+	for (int i = 0; i < 16; ++i)
+	{
+		float r = rgba[i * 4] - mean[0];
+		float g = rgba[i * 4 + 1] - mean[1];
+		float b = rgba[i * 4 + 2] - mean[2];
+		cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+		cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+	}
+
+	float axis[3] = { 1, 1, 1 };
+	for (int iteration = 0; iteration < 8; ++iteration)
+	{
+		float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+		float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+		float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+		float length = std::max(std::max(fabsf(x), fabsf(y)), fabsf(z));
+		if (length < 1e-6f)
+			break; //a single color, any axis works
+		axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+	}
+
+	//the extremes along the axis, moved a bit inside: the error of the end colors is spread to the rest
+	float min_t = 1e30f, max_t = -1e30f;
+	for (int i = 0; i < 16; ++i)
+	{
+		float t = (rgba[i * 4] - mean[0]) * axis[0] + (rgba[i * 4 + 1] - mean[1]) * axis[1] + (rgba[i * 4 + 2] - mean[2]) * axis[2];
+		min_t = std::min(min_t, t);
+		max_t = std::max(max_t, t);
+	}
+	float axis_length2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+	float inset = (max_t - min_t) / 16.0f;
+	float max_color[3], min_color[3];
+	for (int c = 0; c < 3; ++c)
+	{
+		max_color[c] = std::clamp(mean[c] + axis[c] * (max_t - inset) / axis_length2, 0.0f, 255.0f);
+		min_color[c] = std::clamp(mean[c] + axis[c] * (min_t + inset) / axis_length2, 0.0f, 255.0f);
+	}
+
+	uint16_t c0 = to_565(max_color);
+	uint16_t c1 = to_565(min_color);
+	if (c0 < c1)
+		std::swap(c0, c1);
+
+	uint32_t indices = 0;
+	if (c0 != c1)
+	{
+		//c0 > c1 selects the four colors mode
+		int palette[4][3];
+		from_565(c0, palette[0]);
+		from_565(c1, palette[1]);
+		for (int c = 0; c < 3; ++c)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		for (int i = 0; i < 16; ++i)
+		{
+			int best = 0;
+			int best_distance = 0x7FFFFFFF;
+			for (int j = 0; j < 4; ++j)
+			{
+				int dr = rgba[i * 4] - palette[j][0];
+				int dg = rgba[i * 4 + 1] - palette[j][1];
+				int db = rgba[i * 4 + 2] - palette[j][2];
+				int distance = dr * dr + dg * dg + db * db;
+				if (distance < best_distance)
+				{
+					best_distance = distance;
+					best = j;
+				}
+			}
+			indices |= (uint32_t)best << (i * 2);
+		}
+	}
+
+	output[0] = c0 & 0xFF; output[1] = c0 >> 8;
+	output[2] = c1 & 0xFF; output[3] = c1 >> 8;
+	memcpy(output + 4, &indices, 4); //little endian
+}
+
+void encode_bc4_block(const uint8_t* values, int stride, uint8_t* output)
+{
+	int min_value = 255, max_value = 0;
+	for (int i = 0; i < 16; ++i)
+	{
+		min_value = std::min(min_value, (int)values[i * stride]);
+		max_value = std::max(max_value, (int)values[i * stride]);
+	}
+
+	//a0 > a1 selects the eight values mode
+	output[0] = (uint8_t)max_value;
+	output[1] = (uint8_t)min_value;
+
+	uint64_t indices = 0;
+	if (max_value != min_value)
+	{
+		int palette[8];
+		palette[0] = max_value;
+		palette[1] = min_value;
+		for (int i = 2; i < 8; ++i)
+			palette[i] = ((8 - i) * max_value + (i - 1) * min_value) / 7;
+
+		for (int i = 0; i < 16; ++i)
+		{
+			int value = values[i * stride];
+			int best = 0;
+			for (int j = 1; j < 8; ++j)
+				if (abs(value - palette[j]) < abs(value - palette[best]))
+					best = j;
+			indices |= (uint64_t)best << (i * 3);
+		}
+	}
+
+	for (int i = 0; i < 6; ++i)
+		output[2 + i] = (uint8_t)(indices >> (i * 8));
+}
+
+void encode_bc3_block(const uint8_t* rgba, uint8_t* output)
+{
+	encode_bc4_block(rgba + 3, 4, output);
+	encode_bc1_block(rgba, output + 8);
+}
+
+// ******************************************
+
+static void encode_level(const std::vector<uint8_t>& rgba, int width, int height, eTextureCompression compression, std::vector<uint8_t>& blocks)
+{
+	int blocks_x = (width + 3) / 4;
+	int blocks_y = (height + 3) / 4;
+	int block_bytes = get_block_bytes(compression);
+	blocks.resize((size_t)blocks_x * blocks_y * block_bytes);
+
+	uint8_t block[64];
+	uint8_t* output = blocks.data();
+	for (int by = 0; by < blocks_y; ++by)
+		for (int bx = 0; bx < blocks_x; ++bx)
+		{
+			//the borders of sizes that are not a multiple of 4 repeat the last pixel
+			for (int y = 0; y < 4; ++y)
+				for (int x = 0; x < 4; ++x)
+				{
+					int px = std::min(bx * 4 + x, width - 1);
+					int py = std::min(by * 4 + y, height - 1);
+					memcpy(block + (y * 4 + x) * 4, &rgba[((size_t)py * width + px) * 4], 4);
+				}
+
+			switch (compression)
+			{
+			case TEXTURE_COMPRESSION_BC1: encode_bc1_block(block, output); break;
+			case TEXTURE_COMPRESSION_BC3: encode_bc3_block(block, output); break;
+			case TEXTURE_COMPRESSION_BC4: encode_bc4_block(block, 4, output); break;
+			case TEXTURE_COMPRESSION_BC5: encode_bc4_block(block, 4, output); encode_bc4_block(block + 1, 4, output + 8); break;
+			default: break;
+			}
+			output += block_bytes;
+		}
+}
+
+bool cook_texture(const Image& image, eTextureCompression compression, bool mipmaps, sCookedTexture& cooked)
+{
+	if (!image.data || image.width <= 0 || image.height <= 0 || (image.bytes_per_pixel != 3 && image.bytes_per_pixel != 4))
+		return false;
+
+	int width = image.width;
+	int height = image.height;
+	std::vector<uint8_t> rgba((size_t)width * height * 4);
+	bool transparent = false;
+	if (image.bytes_per_pixel == 4)
+	{
+		memcpy(rgba.data(), image.data, rgba.size());
+		for (size_t i = 3; i < rgba.size() && !transparent; i += 4)
+			transparent = rgba[i] != 255;
+	}
+	else
+		image_rgb_to_rgba(image.data, rgba.data(), width * height);
+
+	if (compression == TEXTURE_COMPRESSION_AUTO)
+		compression = transparent ? TEXTURE_COMPRESSION_BC3 : TEXTURE_COMPRESSION_BC1;
+	if (compression == TEXTURE_COMPRESSION_NONE)
+		return false;
+
+	cooked.compression = compression;
+	cooked.width = width;
+	cooked.height = height;
+	cooked.levels.clear();
+
+	std::vector<uint8_t> next;
+	while (true)
+	{
+		cooked.levels.push_back(std::vector<uint8_t>());
+		encode_level(rgba, width, height, compression, cooked.levels.back());
+		if (!mipmaps || (width == 1 && height == 1))
+			break;
+
+		int next_width = std::max(width / 2, 1);
+		int next_height = std::max(height / 2, 1);
+		next.resize((size_t)next_width * next_height * 4);
+		image_downsample_box(rgba.data(), width, height, 4, next.data());
+		rgba.swap(next);
+		width = next_width;
+		height = next_height;
+	}
+	return true;
+}
+
+bool write_cooked_texture(const char* filename, const sCookedTexture& cooked)
+{
+	FILE* file = fopen(filename, "wb");
+	if (!file)
+		return false;
+
+	sCookedTextureHeader header;
+	header.compression = cooked.compression;
+	header.width = cooked.width;
+	header.height = cooked.height;
+	header.num_levels = (uint32_t)cooked.levels.size();
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	for (size_t i = 0; ok && i < cooked.levels.size(); ++i)
+	{
+		uint32_t size = (uint32_t)cooked.levels[i].size();
+		ok = fwrite(&size, sizeof(size), 1, file) == 1;
+	}
+	for (size_t i = 0; ok && i < cooked.levels.size(); ++i)
+		ok = fwrite(cooked.levels[i].data(), 1, cooked.levels[i].size(), file) == cooked.levels[i].size();
+	fclose(file);
+	return ok;
+}
+
+bool read_cooked_texture(const char* filename, sCookedTexture& cooked)
+{
+	FILE* file = fopen(filename, "rb");
+	if (!file)
+		return false;
+
+	sCookedTextureHeader header;
+	bool ok = fread(&header, sizeof(header), 1, file) == 1 && header.magic == CTEX_MAGIC && header.version == CTEX_VERSION
+		&& get_compressed_gl_format((eTextureCompression)header.compression) && header.num_levels > 0 && header.num_levels <= 32;
+
+	std::vector<uint32_t> sizes;
+	if (ok)
+	{
+		sizes.resize(header.num_levels);
+		ok = fread(sizes.data(), sizeof(uint32_t), sizes.size(), file) == sizes.size();
+	}
+
+	//the blocks of every level must cover its mip exactly, and there cannot be levels past 1x1
+	ok = ok && header.width > 0 && header.height > 0 && header.width <= 16384 && header.height <= 16384;
+	int block_bytes = get_block_bytes((eTextureCompression)header.compression);
+	for (uint32_t i = 0; ok && i < header.num_levels; ++i)
+	{
+		uint32_t level_width = header.width >> i;
+		uint32_t level_height = header.height >> i;
+		if (!level_width && !level_height)
+			ok = false;
+		level_width = std::max(level_width, 1u);
+		level_height = std::max(level_height, 1u);
+		ok = ok && sizes[i] == ((level_width + 3) / 4) * ((level_height + 3) / 4) * (uint32_t)block_bytes;
+	}
+
+	if (ok)
+	{
+		cooked.compression = (eTextureCompression)header.compression;
+		cooked.width = header.width;
+		cooked.height = header.height;
+		cooked.levels.resize(header.num_levels);
+		for (size_t i = 0; ok && i < sizes.size(); ++i)
+		{
+			cooked.levels[i].resize(sizes[i]);
+			ok = fread(cooked.levels[i].data(), 1, sizes[i], file) == sizes[i];
+		}
+	}
+	fclose(file);
+	return ok;
+}
+
+bool cook_texture_file(const char* filename, eTextureCompression compression, bool mipmaps)
+{
+	Image image;
+	if (!Image::is_supported(filename) || !image.load(filename))
+	{
+		std::cout << "[ERROR] Cannot decode the texture to cook " << filename << std::endl;
+		return false;
+	}
+
+	sCookedTexture cooked;
+	std::string cooked_filename = std::string(filename) + CTEX_EXTENSION;
+	if (!cook_texture(image, compression, mipmaps, cooked))
+		return false;
+	if (!write_cooked_texture(cooked_filename.c_str(), cooked))
+	{
+		std::cout << "[ERROR] Cannot write the cooked texture " << cooked_filename << std::endl;
+		return false;
+	}
+	return true;
+}
+
+int cook_textures_in_folder(const char* folder, eTextureCompression compression)
+{
+	std::error_code error;
+	std::filesystem::recursive_directory_iterator it(folder, error);
+	if (error)
+	{
+		std::cout << "[ERROR] Cannot open the folder to cook " << folder << std::endl;
+		return 0;
+	}
+
+	int num_cooked = 0;
+	for (const std::filesystem::directory_entry& entry : it)
+	{
+		std::string filename = entry.path().string();
+		if (!entry.is_regular_file() || !Image::is_supported(filename.c_str()))
+			continue;
+
+		//the same freshness test the loader uses
+		std::filesystem::file_time_type cooked_time = std::filesystem::last_write_time(filename + CTEX_EXTENSION, error);
+		if (!error && cooked_time >= std::filesystem::last_write_time(filename, error))
+			continue;
+
+		std::cout << " + Cooking: " << filename << std::endl;
+		if (cook_texture_file(filename.c_str(), compression))
+			num_cooked++;
+	}
+	return num_cooked;
+}
@@ -0,0 +1,66 @@
+/*  Cooked textures: block compressed (BC1, BC3, BC4, BC5) with the whole mip chain precomputed,
+	stored in a small container next to the source file (texture.png -> texture.png.ctex).
+	The encoder is lossy and slow, so it runs offline (cook_texture_file / cook_textures_in_folder, or the
+	--cook argument of the app), the loads only read the blocks and upload them with glCompressedTexImage2D.
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+class Image;
+
+#define CTEX_MAGIC 0x58455443 //"CTEX"
+#define CTEX_VERSION 1
+#define CTEX_EXTENSION ".ctex"
+
+enum eTextureCompression {
+	TEXTURE_COMPRESSION_NONE,
+	TEXTURE_COMPRESSION_BC1, //RGB, 4 bits per pixel
+	TEXTURE_COMPRESSION_BC3, //RGBA, 8 bits per pixel
+	TEXTURE_COMPRESSION_BC4, //R, 4 bits per pixel
+	TEXTURE_COMPRESSION_BC5, //RG (i.e. normal maps with z rebuilt in the shader), 8 bits per pixel
+	TEXTURE_COMPRESSION_AUTO //BC3 if the image has transparent pixels, BC1 otherwise
+};
+
+struct sCookedTextureHeader
+{
+	uint32_t magic = CTEX_MAGIC;
+	uint32_t version = CTEX_VERSION;
+	uint32_t compression = TEXTURE_COMPRESSION_NONE; //eTextureCompression
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t num_levels = 0; //followed by the size of every level (uint32) and then the blocks
+};
+
+struct sCookedTexture
+{
+	eTextureCompression compression = TEXTURE_COMPRESSION_NONE;
+	int width = 0;
+	int height = 0;
+	std::vector<std::vector<uint8_t>> levels; //blocks of every mip, from the biggest
+};
+
+//compresses the image and its mips (box filtered), RGB images are read as opaque RGBA
+bool cook_texture(const Image& image, eTextureCompression compression, bool mipmaps, sCookedTexture& cooked);
+
+bool write_cooked_texture(const char* filename, const sCookedTexture& cooked);
+//checks that every level has the size of its mip, a damaged file is rejected instead of uploaded
+bool read_cooked_texture(const char* filename, sCookedTexture& cooked);
+
+//offline step: decodes the file and writes its .ctex next to it, no GL needed
+bool cook_texture_file(const char* filename, eTextureCompression compression = TEXTURE_COMPRESSION_AUTO, bool mipmaps = true);
+//cooks the supported images of the folder and its subfolders that have no .ctex or an older one, returns how many
+int cook_textures_in_folder(const char* folder, eTextureCompression compression = TEXTURE_COMPRESSION_AUTO);
+
+//GL_COMPRESSED_* internal format of a compression, 0 for none
+unsigned int get_compressed_gl_format(eTextureCompression compression);
+int get_block_bytes(eTextureCompression compression);
+
+//4x4 RGBA8 block (64 bytes, row by row) to its compressed bytes
+void encode_bc1_block(const uint8_t* rgba, uint8_t* output); //8 bytes
+void encode_bc3_block(const uint8_t* rgba, uint8_t* output); //16 bytes
+//16 values of one channel, stride is the distance between them in bytes
+void encode_bc4_block(const uint8_t* values, int stride, uint8_t* output); //8 bytes
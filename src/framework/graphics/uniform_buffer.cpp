@@ -0,0 +1,94 @@
+#include "uniform_buffer.h"
+
+#include <cassert>
+
+#include "frame_ring_buffer.h"
+#include "../includes.h"
+#include "../camera.h"
+
+UniformBuffer::~UniformBuffer()
+{
+	if (buffer_id)
+		glDeleteBuffers(1, &buffer_id);
+}
+
+bool UniformBuffer::create(size_t size)
+{
+	if (!buffer_id)
+		glGenBuffers(1, &buffer_id);
+	this->size = size;
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer_id);
+	glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	return glGetError() == GL_NO_ERROR;
+}
+
+void UniformBuffer::update(const void* data, size_t size, size_t offset)
+{
+	assert(buffer_id && offset + size <= this->size);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer_id);
+	glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffer::bind(unsigned int binding)
+{
+	glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer_id);
+}
+
+size_t UniformBuffer::get_offset_alignment()
+{
+	static GLint alignment = 0;
+	if (!alignment)
+	{
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		if (alignment <= 0)
+			alignment = 256; //the biggest value in the drivers
+	}
+	return (size_t)alignment;
+}
+
+void UniformBuffer::bind_range(unsigned int buffer_id, unsigned int binding, size_t offset, size_t size)
+{
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer_id, offset, size);
+}
+
+void UniformBuffer::update_frame_uniforms(Camera* camera, float time)
+{
+	static UniformBuffer frame_buffer;
+	if (!frame_buffer.buffer_id)
+		frame_buffer.create(sizeof(sFrameUniforms));
+
+	sFrameUniforms data;
+	data.view = camera->view_matrix;
+	data.projection = camera->projection_matrix;
+	data.viewprojection = camera->viewprojection_matrix;
+	data.camera_position = camera->eye;
+	data.time = time;
+
+	//orphan the old contents, the previous frame can still be reading them
+	glBindBuffer(GL_UNIFORM_BUFFER, frame_buffer.buffer_id);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(sFrameUniforms), &data, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	frame_buffer.bind(UBO_BINDING_FRAME);
+}
+
+void UniformBuffer::bind_object_uniforms(const sObjectUniforms& data)
+{
+	FrameRingBuffer* ring = FrameRingBuffer::get();
+	long long offset = ring->upload(&data, sizeof(sObjectUniforms), get_offset_alignment());
+	if (offset >= 0)
+	{
+		bind_range(ring->get_buffer_id(), UBO_BINDING_OBJECT, (size_t)offset, sizeof(sObjectUniforms));
+		return;
+	}
+
+	//the frame slice is full: a buffer of our own, orphaned on every draw so the previous ones keep their data
+	static UniformBuffer object_buffer;
+	if (!object_buffer.buffer_id)
+		object_buffer.create(sizeof(sObjectUniforms));
+	glBindBuffer(GL_UNIFORM_BUFFER, object_buffer.buffer_id);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(sObjectUniforms), &data, GL_STREAM_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	object_buffer.bind(UBO_BINDING_OBJECT);
+}
@@ -0,0 +1,61 @@
+/*  Uniform buffer objects (std140) shared by all the shaders.
+	FrameBlock has the camera and the time, it is uploaded and bound once per frame.
+	ObjectBlock has the data of one draw, the blocks of every draw of the frame are written in the FrameRingBuffer
+	and every draw only binds its range, so there are no uniform lookups by name.
+	The layouts must match the blocks declared in res/shaders.
+*/
+
+#pragma once
+
+#include <cstddef>
+
+#include "../math/vec3.h"
+#include "../math/mat4.h"
+
+class Camera;
+
+#define UBO_BINDING_FRAME 0
+#define UBO_BINDING_OBJECT 1
+
+#define UBO_FRAME_BLOCK_NAME "FrameBlock"
+#define UBO_OBJECT_BLOCK_NAME "ObjectBlock"
+
+//std140: mat4 are 4 columns of vec4, a float can fill the gap after a vec3
+struct sFrameUniforms
+{
+	mat4 view;
+	mat4 projection;
+	mat4 viewprojection;
+	vec3 camera_position;
+	float time;
+};
+static_assert(sizeof(sFrameUniforms) == 208, "sFrameUniforms does not match the std140 layout");
+
+struct sObjectUniforms
+{
+	mat4 model;
+};
+static_assert(sizeof(sObjectUniforms) == 64, "sObjectUniforms does not match the std140 layout");
+
+class UniformBuffer
+{
+public:
+	unsigned int buffer_id = 0;
+	size_t size = 0;
+
+	~UniformBuffer();
+
+	bool create(size_t size);
+	void update(const void* data, size_t size, size_t offset = 0);
+	void bind(unsigned int binding);
+
+	//GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, ranges bound to a block must start at a multiple of it
+	static size_t get_offset_alignment();
+	//binds a range of any buffer to a block (i.e. a slice of the FrameRingBuffer)
+	static void bind_range(unsigned int buffer_id, unsigned int binding, size_t offset, size_t size);
+
+	//fills and binds the shared FrameBlock, once per frame before rendering
+	static void update_frame_uniforms(Camera* camera, float time);
+	//uploads one ObjectBlock to the FrameRingBuffer and binds it, or to a buffer of its own when the ring is full
+	static void bind_object_uniforms(const sObjectUniforms& data);
+};
@@ -0,0 +1,161 @@
+#include "job_system.h"
+
+#include <chrono>
+#include <memory>
+#include <algorithm>
+
+std::vector<std::thread> JobSystem::workers;
+std::deque<std::function<void()>> JobSystem::jobs;
+std::deque<std::function<void()>> JobSystem::main_thread_jobs;
+std::mutex JobSystem::jobs_mutex;
+std::mutex JobSystem::main_thread_mutex;
+std::condition_variable JobSystem::jobs_condition;
+std::atomic<int> JobSystem::num_pending_jobs(0);
+bool JobSystem::stopping = false;
+
+void JobSystem::init(int num_threads)
+{
+	if (workers.size())
+		return;
+
+	if (num_threads <= 0)
+		num_threads = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+
+	stopping = false;
+	for (int i = 0; i < num_threads; ++i)
+		workers.push_back(std::thread(worker_loop));
+}
+
+void JobSystem::shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(jobs_mutex);
+		stopping = true;
+	}
+	jobs_condition.notify_all();
+
+	//workers finish the queued jobs before leaving
+	for (size_t i = 0; i < workers.size(); ++i)
+		workers[i].join();
+	workers.clear();
+
+	//main thread jobs left can still touch GL, the context is alive at this point
+	process_main_thread_jobs(-1.0);
+}
+
+void JobSystem::enqueue(std::function<void()> job)
+{
+	if (!workers.size())
+		init();
+
+	num_pending_jobs++;
+	{
+		std::lock_guard<std::mutex> lock(jobs_mutex);
+		jobs.push_back(std::move(job));
+	}
+	jobs_condition.notify_one();
+}
+
+void JobSystem::parallel_for(int count, const std::function<void(int)>& fn)
+{
+	if (count <= 0)
+		return;
+
+	//shared with the helper jobs, which can start after this returns (then they find nothing to do)
+	struct sParallelFor
+	{
+		const std::function<void(int)>* fn;
+		int count;
+		std::atomic<int> next{ 0 };
+		std::atomic<int> done{ 0 };
+		std::mutex mutex;
+		std::condition_variable condition;
+	};
+	std::shared_ptr<sParallelFor> state = std::make_shared<sParallelFor>();
+	state->fn = &fn;
+	state->count = count;
+
+	auto run = [](sParallelFor* s) {
+		int i;
+		while ((i = s->next++) < s->count)
+		{
+			(*s->fn)(i);
+			if (++s->done == s->count)
+			{
+				std::lock_guard<std::mutex> lock(s->mutex);
+				s->condition.notify_all();
+			}
+		}
+	};
+
+	if (!workers.size())
+		init();
+	int num_helpers = std::min(count - 1, (int)workers.size());
+	for (int i = 0; i < num_helpers; ++i)
+		enqueue([state, run]() { run(state.get()); });
+
+	run(state.get());
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->condition.wait(lock, [&]() { return state->done == state->count; });
+}
+
+void JobSystem::enqueue_main_thread(std::function<void()> job)
+{
+	std::lock_guard<std::mutex> lock(main_thread_mutex);
+	main_thread_jobs.push_back(std::move(job));
+}
+
+int JobSystem::process_main_thread_jobs(double budget_ms)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	int num_processed = 0;
+
+	while (true)
+	{
+		std::function<void()> job;
+		{
+			std::lock_guard<std::mutex> lock(main_thread_mutex);
+			if (main_thread_jobs.empty())
+				break;
+			job = std::move(main_thread_jobs.front());
+			main_thread_jobs.pop_front();
+		}
+
+		job();
+		num_processed++;
+
+		if (budget_ms >= 0.0)
+		{
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+			if (elapsed.count() >= budget_ms)
+				break;
+		}
+	}
+
+	return num_processed;
+}
+
+int JobSystem::get_num_pending_main_thread_jobs()
+{
+	std::lock_guard<std::mutex> lock(main_thread_mutex);
+	return (int)main_thread_jobs.size();
+}
+
+void JobSystem::worker_loop()
+{
+	while (true)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(jobs_mutex);
+			jobs_condition.wait(lock, [] { return stopping || !jobs.empty(); });
+			if (jobs.empty())
+				return; //stopping and nothing left
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+
+		job();
+		num_pending_jobs--;
+	}
+}
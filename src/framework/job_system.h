@@ -0,0 +1,52 @@
+/*  Small pool of worker threads for background work (file IO, parsing, decoding...)
+	plus a queue of jobs that must run in the main thread (everything that touches OpenGL).
+	The main thread queue is processed once per frame with a time budget so uploads never stall a frame.
+*/
+
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+class JobSystem
+{
+public:
+	//num_threads = 0 uses one thread per core minus the main thread
+	static void init(int num_threads = 0);
+	static void shutdown();
+
+	//runs in a worker thread (starts the workers if init was not called)
+	static void enqueue(std::function<void()> job);
+
+	//runs fn(0) .. fn(count - 1) in the workers and in the calling thread, returns when all are done
+	//the caller takes work too, so it can be used from inside a job without waiting on busy workers
+	static void parallel_for(int count, const std::function<void(int)>& fn);
+
+	//runs in the main thread during process_main_thread_jobs
+	static void enqueue_main_thread(std::function<void()> job);
+
+	//call once per frame from the main thread, runs main thread jobs until budget_ms is spent
+	//(at least one job is always executed so the queue keeps moving), budget_ms < 0 runs them all
+	static int process_main_thread_jobs(double budget_ms);
+
+	static int get_num_pending_jobs() { return num_pending_jobs; }
+	static int get_num_pending_main_thread_jobs();
+	static int get_num_workers() { return (int)workers.size(); }
+
+private:
+	static void worker_loop();
+
+	static std::vector<std::thread> workers;
+	static std::deque<std::function<void()>> jobs;
+	static std::deque<std::function<void()>> main_thread_jobs;
+	static std::mutex jobs_mutex;
+	static std::mutex main_thread_mutex;
+	static std::condition_variable jobs_condition;
+	static std::atomic<int> num_pending_jobs;
+	static bool stopping;
+};
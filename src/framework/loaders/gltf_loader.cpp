@@ -0,0 +1,810 @@
+#include "gltf_loader.h"
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/mman.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define GLTF_USE_SSE2
+#endif
+
+#define CGLTF_IMPLEMENTATION
+#include "cgltf.h"
+
+#include "../graphics/mesh.h"
+#include "../graphics/mesh_bin.h"
+#include "../graphics/image_kernels.h"
+
+#define GLTF_JOINT_NAME_SIZE 64
+
+//read only view of a whole file, the GLB binary chunk is used straight from here
+struct sMappedFile
+{
+	const uint8_t* data = NULL;
+	size_t size = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+#endif
+
+	bool open(const char* filename)
+	{
+#ifdef _WIN32
+		file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+		{
+			close();
+			return false;
+		}
+		size = (size_t)file_size.QuadPart;
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping)
+			data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+		int fd = ::open(filename, O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size > 0)
+		{
+			size = (size_t)st.st_size;
+			void* ptr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (ptr != MAP_FAILED)
+				data = (const uint8_t*)ptr;
+		}
+		::close(fd); //the mapping keeps the file alive
+#endif
+		if (!data)
+		{
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close()
+	{
+#ifdef _WIN32
+		if (data) UnmapViewOfFile(data);
+		if (mapping) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+		mapping = NULL;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (data) munmap((void*)data, size);
+#endif
+		data = NULL;
+		size = 0;
+	}
+
+	~sMappedFile() { close(); }
+};
+
+//ACCESSORS ************************************
+
+#ifdef GLTF_USE_SSE2
+//8 normalized shorts to floats per iteration
+static size_t unorm16_to_float_sse2(const uint16_t* src, size_t count, float* dst)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 scale = _mm_set1_ps(1.0f / 65535.0f);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)), scale));
+		_mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)), scale));
+	}
+	return i;
+}
+#endif
+
+//pointer to the first element or NULL if the accessor needs cgltf to be read (sparse, compressed...)
+static const uint8_t* accessor_data(const cgltf_accessor* accessor)
+{
+	if (accessor->is_sparse || !accessor->buffer_view)
+		return NULL;
+	const uint8_t* view = (const uint8_t*)cgltf_buffer_view_data(accessor->buffer_view);
+	return view ? view + accessor->offset : NULL;
+}
+
+//converts an accessor to num_components floats per element (missing components are left untouched)
+static bool read_floats(const cgltf_accessor* accessor, float* out, int num_components)
+{
+	size_t count = accessor->count;
+	int src_components = (int)cgltf_num_components(accessor->type);
+	const uint8_t* src = accessor_data(accessor);
+
+	if (src && src_components == num_components)
+	{
+		size_t stride = accessor->stride;
+		size_t n = (size_t)num_components;
+		switch (accessor->component_type)
+		{
+		case cgltf_component_type_r_32f:
+			if (stride == n * sizeof(float))
+				memcpy(out, src, count * stride);
+			else
+				for (size_t i = 0; i < count; ++i)
+					memcpy(out + i * n, src + i * stride, n * sizeof(float));
+			return true;
+		case cgltf_component_type_r_8u:
+			if (!accessor->normalized)
+				break;
+			if (stride == n)
+				image_unorm8_to_float(src, out, (int)(count * n));
+			else
+				for (size_t i = 0; i < count; ++i)
+					for (size_t j = 0; j < n; ++j)
+						out[i * n + j] = src[i * stride + j] * (1.0f / 255.0f);
+			return true;
+		case cgltf_component_type_r_16u:
+			if (!accessor->normalized)
+				break;
+			if (stride == n * sizeof(uint16_t) && ((size_t)src & 1) == 0)
+			{
+				const uint16_t* src16 = (const uint16_t*)src;
+				size_t i = 0;
+#ifdef GLTF_USE_SSE2
+				i = unorm16_to_float_sse2(src16, count * n, out);
+#endif
+				for (; i < count * n; ++i)
+					out[i] = src16[i] * (1.0f / 65535.0f);
+			}
+			else
+				for (size_t i = 0; i < count; ++i)
+					for (size_t j = 0; j < n; ++j)
+					{
+						uint16_t v;
+						memcpy(&v, src + i * stride + j * sizeof(uint16_t), sizeof(uint16_t));
+						out[i * n + j] = v * (1.0f / 65535.0f);
+					}
+			return true;
+		default:
+			break;
+		}
+	}
+
+	//generic path (sparse accessors, signed normalized, different number of components...)
+	std::vector<float> unpacked(count * src_components);
+	if (cgltf_accessor_unpack_floats(accessor, unpacked.data(), unpacked.size()) != unpacked.size())
+		return false;
+	int n = src_components < num_components ? src_components : num_components;
+	for (size_t i = 0; i < count; ++i)
+		memcpy(out + i * num_components, unpacked.data() + i * src_components, n * sizeof(float));
+	return true;
+}
+
+//integer accessors (indices and joints)
+static bool read_uints(const cgltf_accessor* accessor, unsigned int* out, int num_components)
+{
+	size_t count = accessor->count;
+	size_t n = (size_t)num_components;
+	if ((int)cgltf_num_components(accessor->type) != num_components)
+		return false;
+
+	const uint8_t* src = accessor_data(accessor);
+	if (src)
+	{
+		size_t stride = accessor->stride;
+		switch (accessor->component_type)
+		{
+		case cgltf_component_type_r_8u:
+			for (size_t i = 0; i < count; ++i)
+				for (size_t j = 0; j < n; ++j)
+					out[i * n + j] = src[i * stride + j];
+			return true;
+		case cgltf_component_type_r_16u:
+			for (size_t i = 0; i < count; ++i)
+				for (size_t j = 0; j < n; ++j)
+				{
+					uint16_t v;
+					memcpy(&v, src + i * stride + j * sizeof(uint16_t), sizeof(uint16_t));
+					out[i * n + j] = v;
+				}
+			return true;
+		case cgltf_component_type_r_32u:
+			if (stride == n * sizeof(uint32_t))
+				memcpy(out, src, count * stride);
+			else
+				for (size_t i = 0; i < count; ++i)
+					memcpy(out + i * n, src + i * stride, n * sizeof(uint32_t));
+			return true;
+		default:
+			break;
+		}
+	}
+
+	for (size_t i = 0; i < count; ++i)
+		if (!cgltf_accessor_read_uint(accessor, i, out + i * n, n))
+			return false;
+	return true;
+}
+
+//SCENE ****************************************
+
+static Transform node_local_transform(const cgltf_node* node)
+{
+	if (node->has_matrix)
+		return mat4_to_transform(mat4((float*)node->matrix));
+
+	Transform t;
+	if (node->has_translation)
+		t.position = vec3(node->translation[0], node->translation[1], node->translation[2]);
+	if (node->has_rotation)
+		t.rotation = quat(node->rotation[0], node->rotation[1], node->rotation[2], node->rotation[3]);
+	if (node->has_scale)
+		t.scale = vec3(node->scale[0], node->scale[1], node->scale[2]);
+	return t;
+}
+
+static const cgltf_accessor* find_attribute(const cgltf_primitive* primitive, cgltf_attribute_type type, int index = 0)
+{
+	for (size_t i = 0; i < primitive->attributes_count; ++i)
+		if (primitive->attributes[i].type == type && primitive->attributes[i].index == index)
+			return primitive->attributes[i].data;
+	return NULL;
+}
+
+//merges the triangles of every node in the mesh
+static bool build_mesh(const cgltf_data* data, const cgltf_skin* skin, Mesh* mesh)
+{
+	//first pass: which streams are used by any primitive
+	bool has_normals = false, has_uvs = false, has_uvs1 = false, has_colors = false, has_skin = false;
+	for (size_t i = 0; i < data->nodes_count; ++i)
+	{
+		const cgltf_mesh* gmesh = data->nodes[i].mesh;
+		if (!gmesh)
+			continue;
+		for (size_t j = 0; j < gmesh->primitives_count; ++j)
+		{
+			const cgltf_primitive* p = &gmesh->primitives[j];
+			has_normals |= find_attribute(p, cgltf_attribute_type_normal) != NULL;
+			has_uvs |= find_attribute(p, cgltf_attribute_type_texcoord, 0) != NULL;
+			has_uvs1 |= find_attribute(p, cgltf_attribute_type_texcoord, 1) != NULL;
+			has_colors |= find_attribute(p, cgltf_attribute_type_color) != NULL;
+			has_skin |= data->nodes[i].skin == skin && skin && find_attribute(p, cgltf_attribute_type_joints) != NULL;
+		}
+	}
+
+	bool other_skins = false;
+	std::vector<unsigned int> joints;
+
+	for (size_t i = 0; i < data->nodes_count; ++i)
+	{
+		const cgltf_node* node = &data->nodes[i];
+		const cgltf_mesh* gmesh = node->mesh;
+		if (!gmesh)
+			continue;
+
+		//skinned vertices are already in the space of the skeleton, the rest are baked in world space
+		bool skinned = node->skin && node->skin == skin;
+		other_skins |= node->skin && node->skin != skin;
+		mat4 world;
+		if (!skinned)
+			cgltf_node_transform_world(node, world.data);
+		mat4 normal_matrix = transposed(inverse(world));
+
+		sSubmeshInfo submesh;
+		memset(&submesh, 0, sizeof(submesh));
+		strncpy(submesh.name, gmesh->name ? gmesh->name : (node->name ? node->name : "mesh"), sizeof(submesh.name) - 1);
+
+		for (size_t j = 0; j < gmesh->primitives_count; ++j)
+		{
+			const cgltf_primitive* p = &gmesh->primitives[j];
+			const cgltf_accessor* positions = find_attribute(p, cgltf_attribute_type_position);
+			if (p->type != cgltf_primitive_type_triangles || !positions)
+				continue;
+
+			if (submesh.num_draw_calls == MAX_SUBMESH_DRAW_CALLS)
+			{
+				std::cout << "[WARN] glTF: too many primitives in " << submesh.name << ", merging them" << std::endl;
+				submesh.num_draw_calls--;
+			}
+
+			size_t base = mesh->vertices.size();
+			size_t count = positions->count;
+
+			mesh->vertices.resize(base + count);
+			if (!read_floats(positions, &mesh->vertices[base].x, 3))
+				return false;
+
+			if (has_normals)
+			{
+				mesh->normals.resize(base + count, vec3(0, 1, 0));
+				const cgltf_accessor* a = find_attribute(p, cgltf_attribute_type_normal);
+				if (a && a->count == count && !read_floats(a, &mesh->normals[base].x, 3))
+					return false;
+			}
+			if (has_uvs)
+			{
+				mesh->uvs.resize(base + count, vec2(0, 0));
+				const cgltf_accessor* a = find_attribute(p, cgltf_attribute_type_texcoord, 0);
+				if (a && a->count == count && !read_floats(a, &mesh->uvs[base].x, 2))
+					return false;
+			}
+			if (has_uvs1)
+			{
+				mesh->uvs1.resize(base + count, vec2(0, 0));
+				const cgltf_accessor* a = find_attribute(p, cgltf_attribute_type_texcoord, 1);
+				if (a && a->count == count && !read_floats(a, &mesh->uvs1[base].x, 2))
+					return false;
+			}
+			if (has_colors)
+			{
+				mesh->colors.resize(base + count, vec4(1, 1, 1, 1)); //rgb colors keep the alpha
+				const cgltf_accessor* a = find_attribute(p, cgltf_attribute_type_color);
+				if (a && a->count == count && !read_floats(a, &mesh->colors[base].x, 4))
+					return false;
+			}
+			if (has_skin)
+			{
+				mesh->bones.resize(base + count, ivec4(0, 0, 0, 0));
+				mesh->weights.resize(base + count, vec4(1, 0, 0, 0));
+				const cgltf_accessor* ja = skinned ? find_attribute(p, cgltf_attribute_type_joints) : NULL;
+				const cgltf_accessor* wa = skinned ? find_attribute(p, cgltf_attribute_type_weights) : NULL;
+				if (ja && wa && ja->count == count && wa->count == count)
+				{
+					joints.resize(count * 4);
+					if (!read_uints(ja, joints.data(), 4) || !read_floats(wa, &mesh->weights[base].x, 4))
+						return false;
+					for (size_t k = 0; k < count; ++k)
+					{
+						mesh->bones[base + k] = ivec4(joints[k * 4], joints[k * 4 + 1], joints[k * 4 + 2], joints[k * 4 + 3]);
+						//quantized weights do not always add up to one
+						vec4& w = mesh->weights[base + k];
+						float sum = w.x + w.y + w.z + w.w;
+						if (sum > 0.0f)
+							w = w * (1.0f / sum);
+					}
+				}
+			}
+
+			if (!skinned)
+				for (size_t k = base; k < base + count; ++k)
+				{
+					mesh->vertices[k] = transform_point(world, mesh->vertices[k]);
+					if (has_normals)
+						mesh->normals[k] = normalized(transform_vector(normal_matrix, mesh->normals[k]));
+				}
+
+			//indices, offset to the merged vertices
+			size_t first_index = mesh->indices.size();
+			if (p->indices)
+			{
+				mesh->indices.resize(first_index + p->indices->count);
+				if (!read_uints(p->indices, &mesh->indices[first_index], 1))
+					return false;
+				for (size_t k = first_index; k < mesh->indices.size(); ++k)
+					mesh->indices[k] += (unsigned int)base;
+			}
+			else
+				for (size_t k = 0; k < count; ++k)
+					mesh->indices.push_back((unsigned int)(base + k));
+
+			sSubmeshDrawCallInfo& dc = submesh.draw_calls[submesh.num_draw_calls];
+			if (dc.length == 0)
+			{
+				dc.start = first_index;
+				if (p->material && p->material->name)
+					strncpy(dc.material, p->material->name, sizeof(dc.material) - 1);
+			}
+			dc.length = mesh->indices.size() - dc.start;
+			submesh.num_draw_calls++;
+
+			if (p->material && p->material->name && p->material->has_pbr_metallic_roughness)
+			{
+				const cgltf_float* color = p->material->pbr_metallic_roughness.base_color_factor;
+				sMaterialInfo& info = mesh->materials[p->material->name];
+				info.Ka = vec3(0, 0, 0);
+				info.Kd = vec3(color[0], color[1], color[2]);
+				info.Ks = vec3(0, 0, 0);
+			}
+		}
+
+		if (submesh.num_draw_calls)
+			mesh->submeshes.push_back(submesh);
+	}
+
+	if (other_skins)
+		std::cout << "[WARN] glTF: only the first skin is supported, other skinned meshes use their rest position" << std::endl;
+
+	if (mesh->vertices.empty())
+	{
+		std::cout << "[ERROR] glTF: no triangles found" << std::endl;
+		return false;
+	}
+
+	mesh->update_bounding_box();
+	return true;
+}
+
+static void build_skeleton(const cgltf_skin* skin, Mesh* mesh, sGLTFAsset& asset)
+{
+	unsigned int num_joints = (unsigned int)skin->joints_count;
+	std::map<const cgltf_node*, int> joint_ids;
+	for (unsigned int i = 0; i < num_joints; ++i)
+		joint_ids[skin->joints[i]] = i;
+
+	std::vector<mat4> inv_bind(num_joints);
+	//read_floats writes the whole accessor, so it has to hold exactly one matrix per joint
+	if (num_joints && skin->inverse_bind_matrices)
+	{
+		if (skin->inverse_bind_matrices->count != num_joints)
+			std::cout << "[WARN] glTF: the skin inverse bind matrices do not match its joints, using identity" << std::endl;
+		else
+			read_floats(skin->inverse_bind_matrices, inv_bind[0].data, 16);
+	}
+
+	asset.rest_pose.resize(num_joints);
+	asset.bind_pose.resize(num_joints);
+	asset.joint_names.resize(num_joints);
+	mesh->bones_info.resize(num_joints);
+
+	std::vector<Transform> world_bind(num_joints);
+	for (unsigned int i = 0; i < num_joints; ++i)
+		world_bind[i] = mat4_to_transform(inverse(inv_bind[i]));
+
+	for (unsigned int i = 0; i < num_joints; ++i)
+	{
+		const cgltf_node* node = skin->joints[i];
+		asset.joint_names[i] = node->name ? node->name : "joint_" + std::to_string(i);
+
+		//nodes in between joints (or above the root) are folded in the local transform
+		Transform rest = node_local_transform(node);
+		const cgltf_node* parent = node->parent;
+		while (parent && joint_ids.find(parent) == joint_ids.end())
+		{
+			rest = combine(node_local_transform(parent), rest);
+			parent = parent->parent;
+		}
+		int parent_id = parent ? joint_ids[parent] : -1;
+
+		asset.rest_pose.set_parent(i, parent_id);
+		asset.rest_pose.set_local_transform(i, rest);
+		asset.bind_pose.set_parent(i, parent_id);
+		asset.bind_pose.set_local_transform(i, parent_id >= 0 ? combine(inverse(world_bind[parent_id]), world_bind[i]) : world_bind[i]);
+
+		BoneInfo& info = mesh->bones_info[i];
+		memset(info.name, 0, sizeof(info.name));
+		strncpy(info.name, asset.joint_names[i].c_str(), sizeof(info.name) - 1);
+		info.bind_pose = inv_bind[i];
+	}
+	mesh->bind_matrix = mat4();
+}
+
+template<typename T>
+static bool read_track(const cgltf_animation_sampler* sampler, Track<T>& track, int num_components)
+{
+	switch (sampler->interpolation)
+	{
+	case cgltf_interpolation_type_step: track.interpolation = INTERPOLATION_CONSTANT; break;
+	case cgltf_interpolation_type_cubic_spline: track.interpolation = INTERPOLATION_CUBIC; break;
+	default: track.interpolation = INTERPOLATION_LINEAR; break;
+	}
+
+	size_t num_keys = sampler->input->count;
+	size_t num_values = num_keys * (track.interpolation == INTERPOLATION_CUBIC ? 3 : 1);
+	if (sampler->output->count != num_values)
+		return false;
+
+	track.times.resize(num_keys);
+	track.values.resize(num_values);
+	return read_floats(sampler->input, track.times.data(), 1) && read_floats(sampler->output, (float*)track.values.data(), num_components);
+}
+
+static void build_clips(const cgltf_data* data, const cgltf_skin* skin, sGLTFAsset& asset)
+{
+	std::map<const cgltf_node*, int> joint_ids;
+	for (size_t i = 0; i < skin->joints_count; ++i)
+		joint_ids[skin->joints[i]] = (int)i;
+
+	for (size_t i = 0; i < data->animations_count; ++i)
+	{
+		const cgltf_animation* animation = &data->animations[i];
+		Clip clip;
+		clip.name = animation->name ? animation->name : "clip_" + std::to_string(i);
+
+		std::map<int, size_t> track_ids; //joint to track
+		for (size_t j = 0; j < animation->channels_count; ++j)
+		{
+			const cgltf_animation_channel* channel = &animation->channels[j];
+			std::map<const cgltf_node*, int>::iterator it = joint_ids.find(channel->target_node);
+			if (it == joint_ids.end() || !channel->sampler)
+				continue;
+
+			if (track_ids.find(it->second) == track_ids.end())
+			{
+				track_ids[it->second] = clip.tracks.size();
+				clip.tracks.push_back(TransformTrack());
+				clip.tracks.back().joint_id = it->second;
+			}
+			TransformTrack& track = clip.tracks[track_ids[it->second]];
+
+			bool ok = true;
+			switch (channel->target_path)
+			{
+			case cgltf_animation_path_type_translation: ok = read_track(channel->sampler, track.position, 3); break;
+			case cgltf_animation_path_type_rotation: ok = read_track(channel->sampler, track.rotation, 4); break;
+			case cgltf_animation_path_type_scale: ok = read_track(channel->sampler, track.scale, 3); break;
+			default: break; //morph target weights are not supported
+			}
+			if (!ok)
+				std::cout << "[WARN] glTF: wrong channel in animation " << clip.name << std::endl;
+		}
+
+		clip.recalculate_duration();
+		asset.clips.push_back(clip);
+	}
+}
+
+//external .bin files are mapped too, cgltf only loads the buffers it finds empty
+static void map_external_buffers(cgltf_data* data, const char* filename, std::vector<sMappedFile>& files)
+{
+	std::string path = filename;
+	size_t slash = path.find_last_of("/\\");
+	path = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+
+	files.resize(data->buffers_count);
+	for (size_t i = 0; i < data->buffers_count; ++i)
+	{
+		cgltf_buffer& buffer = data->buffers[i];
+		if (buffer.data || !buffer.uri || strncmp(buffer.uri, "data:", 5) == 0 || strchr(buffer.uri, '%'))
+			continue;
+		if (!files[i].open((path + buffer.uri).c_str()) || files[i].size < buffer.size)
+			continue;
+		buffer.data = (void*)files[i].data;
+		buffer.data_free_method = cgltf_data_free_method_none;
+	}
+}
+
+//CACHE ****************************************
+
+//tiny helpers to serialize the skeleton and the clips
+struct sBlobWriter
+{
+	std::vector<uint8_t> data;
+	void write(const void* src, size_t size) { data.insert(data.end(), (const uint8_t*)src, (const uint8_t*)src + size); }
+	template<typename T> void write(const T& value) { write(&value, sizeof(T)); }
+	template<typename T> void write_vector(const std::vector<T>& values) { write((uint32_t)values.size()); if (values.size()) write(values.data(), values.size() * sizeof(T)); }
+};
+
+struct sBlobReader
+{
+	const uint8_t* data;
+	size_t size;
+	size_t pos = 0;
+	bool error = false;
+	sBlobReader(const std::vector<uint8_t>& blob) : data(blob.data()), size(blob.size()) {}
+	void read(void* dst, size_t bytes) { if (error || pos + bytes > size) { error = true; memset(dst, 0, bytes); return; } memcpy(dst, data + pos, bytes); pos += bytes; }
+	template<typename T> T read() { T value; read(&value, sizeof(T)); return value; }
+	template<typename T> void read_vector(std::vector<T>& values) {
+		uint32_t count = read<uint32_t>();
+		if (error || (size_t)count * sizeof(T) > size - pos) { error = true; return; }
+		values.resize(count);
+		if (count) read(values.data(), count * sizeof(T));
+	}
+};
+
+struct sGLTFJoint
+{
+	char name[GLTF_JOINT_NAME_SIZE];
+	int parent;
+	Transform rest;
+	Transform bind;
+};
+
+template<typename T>
+static void write_track(sBlobWriter& blob, const Track<T>& track)
+{
+	blob.write((uint32_t)track.interpolation);
+	blob.write_vector(track.times);
+	blob.write_vector(track.values);
+}
+
+template<typename T>
+static void read_track(sBlobReader& blob, Track<T>& track)
+{
+	track.interpolation = (eInterpolation)blob.read<uint32_t>();
+	blob.read_vector(track.times);
+	blob.read_vector(track.values);
+}
+
+static bool write_cache(const char* filename, Mesh* mesh, sGLTFAsset& asset)
+{
+	MeshBinWriter writer;
+	mesh->write_bin_chunks(writer);
+
+	sBlobWriter skeleton;
+	skeleton.write((uint32_t)asset.joint_names.size());
+	for (unsigned int i = 0; i < asset.joint_names.size(); ++i)
+	{
+		sGLTFJoint joint;
+		memset(joint.name, 0, sizeof(joint.name));
+		strncpy(joint.name, asset.joint_names[i].c_str(), sizeof(joint.name) - 1);
+		joint.parent = asset.rest_pose.get_parent(i);
+		joint.rest = asset.rest_pose.get_local_transform(i);
+		joint.bind = asset.bind_pose.get_local_transform(i);
+		skeleton.write(joint);
+	}
+	writer.add_chunk(MBIN_CHUNK_SKELETON, skeleton.data, Mesh::compress_bin);
+
+	sBlobWriter clips;
+	clips.write((uint32_t)asset.clips.size());
+	for (unsigned int i = 0; i < asset.clips.size(); ++i)
+	{
+		Clip& clip = asset.clips[i];
+		clips.write((uint32_t)clip.name.size());
+		clips.write(clip.name.data(), clip.name.size());
+		clips.write(clip.start_time);
+		clips.write(clip.end_time);
+		clips.write((uint8_t)clip.looping);
+		clips.write((uint32_t)clip.tracks.size());
+		for (unsigned int j = 0; j < clip.tracks.size(); ++j)
+		{
+			clips.write(clip.tracks[j].joint_id);
+			write_track(clips, clip.tracks[j].position);
+			write_track(clips, clip.tracks[j].rotation);
+			write_track(clips, clip.tracks[j].scale);
+		}
+	}
+	writer.add_chunk(MBIN_CHUNK_ANIMATIONS, clips.data, Mesh::compress_bin);
+
+	return writer.save(filename, MESH_BIN_VERSION);
+}
+
+static bool read_cache(const char* filename, const char* source, Mesh* mesh, sGLTFAsset& asset)
+{
+	//outdated if the glTF was saved after the cache
+	struct stat cache_stat, source_stat;
+	if (stat(filename, &cache_stat) != 0 || (stat(source, &source_stat) == 0 && source_stat.st_mtime > cache_stat.st_mtime))
+		return false;
+
+	MeshBinReader reader;
+	if (!reader.load(filename) || reader.header.version != MESH_BIN_VERSION || !reader.has(MBIN_CHUNK_SKELETON))
+		return false;
+	if (!mesh->read_bin_chunks(reader))
+		return false;
+
+	std::vector<uint8_t> data;
+	if (!reader.decode(MBIN_CHUNK_SKELETON, data))
+		return false;
+	sBlobReader skeleton(data);
+	uint32_t num_joints = skeleton.read<uint32_t>();
+	if (skeleton.error || (size_t)num_joints * sizeof(sGLTFJoint) > data.size())
+		return false;
+	asset.rest_pose.resize(num_joints);
+	asset.bind_pose.resize(num_joints);
+	asset.joint_names.resize(num_joints);
+	for (unsigned int i = 0; i < num_joints; ++i)
+	{
+		sGLTFJoint joint = skeleton.read<sGLTFJoint>();
+		joint.name[GLTF_JOINT_NAME_SIZE - 1] = 0;
+		asset.joint_names[i] = joint.name;
+		asset.rest_pose.set_parent(i, joint.parent);
+		asset.rest_pose.set_local_transform(i, joint.rest);
+		asset.bind_pose.set_parent(i, joint.parent);
+		asset.bind_pose.set_local_transform(i, joint.bind);
+	}
+	if (skeleton.error)
+		return false;
+
+	if (!reader.decode(MBIN_CHUNK_ANIMATIONS, data))
+		return false;
+	sBlobReader clips(data);
+	uint32_t num_clips = clips.read<uint32_t>();
+	for (uint32_t i = 0; i < num_clips && !clips.error; ++i)
+	{
+		Clip clip;
+		uint32_t name_size = clips.read<uint32_t>();
+		if (name_size > data.size())
+			return false;
+		clip.name.resize(name_size);
+		clips.read(&clip.name[0], name_size);
+		clip.start_time = clips.read<float>();
+		clip.end_time = clips.read<float>();
+		clip.looping = clips.read<uint8_t>() != 0;
+		uint32_t num_tracks = clips.read<uint32_t>();
+		if (num_tracks > data.size())
+			return false;
+		clip.tracks.resize(num_tracks);
+		for (uint32_t j = 0; j < num_tracks && !clips.error; ++j)
+		{
+			clip.tracks[j].joint_id = clips.read<uint32_t>();
+			read_track(clips, clip.tracks[j].position);
+			read_track(clips, clip.tracks[j].rotation);
+			read_track(clips, clip.tracks[j].scale);
+		}
+		asset.clips.push_back(clip);
+	}
+	return !clips.error;
+}
+
+//LOADER ***************************************
+
+bool load_gltf(const char* filename, sGLTFAsset& asset, bool use_cache)
+{
+	assert(filename);
+	bool own_mesh = asset.mesh == NULL;
+	Mesh* mesh = own_mesh ? new Mesh() : asset.mesh;
+	std::string cache_filename = std::string(filename) + ".mbin";
+
+	asset.mesh = mesh;
+	asset.joint_names.clear();
+	asset.clips.clear();
+
+	if (use_cache && read_cache(cache_filename.c_str(), filename, mesh, asset))
+	{
+		if (Mesh::interleave_meshes && mesh->interleaved.size() == 0)
+			mesh->interleave_buffers();
+		return true;
+	}
+	mesh->clear();
+	asset.joint_names.clear();
+	asset.clips.clear();
+
+	sMappedFile file;
+	if (!file.open(filename))
+	{
+		std::cout << "[ERROR] glTF not found: " << filename << std::endl;
+		if (own_mesh) { delete mesh; asset.mesh = NULL; }
+		return false;
+	}
+
+	//GLB binary chunk points to the mapped file (cgltf does not copy it)
+	cgltf_options options;
+	memset(&options, 0, sizeof(options));
+	cgltf_data* data = NULL;
+	cgltf_result result = cgltf_parse(&options, file.data, file.size, &data);
+	std::vector<sMappedFile> buffers;
+	if (result == cgltf_result_success)
+	{
+		map_external_buffers(data, filename, buffers);
+		result = cgltf_load_buffers(&options, data, filename);
+	}
+
+	bool ok = result == cgltf_result_success;
+	if (!ok)
+		std::cout << "[ERROR] glTF: cannot parse " << filename << " (" << (int)result << ")" << std::endl;
+
+	const cgltf_skin* skin = ok && data->skins_count ? &data->skins[0] : NULL;
+	ok = ok && build_mesh(data, skin, mesh);
+	if (ok && skin)
+	{
+		build_skeleton(skin, mesh, asset);
+		build_clips(data, skin, asset);
+	}
+
+	cgltf_free(data); //buffers we mapped are not freed by cgltf
+	if (!ok)
+	{
+		if (own_mesh) { delete mesh; asset.mesh = NULL; }
+		return false;
+	}
+
+	if (Mesh::auto_generate_lods)
+		mesh->generate_lods();
+	if (Mesh::interleave_meshes)
+		mesh->interleave_buffers();
+
+	if (use_cache && !write_cache(cache_filename.c_str(), mesh, asset))
+		std::cout << "[WARN] glTF: cannot write cache " << cache_filename << std::endl;
+
+	return true;
+}
@@ -0,0 +1,30 @@
+/*  glTF 2.0 loader (.gltf and .glb) based on cgltf.
+	Reads the meshes of the scene merged in a single Mesh (one submesh per glTF mesh, one draw call per primitive),
+	the skeleton of the first skin and the animations as clips.
+	The result is cached next to the file (filename + ".mbin") using the chunked mesh format.
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include "../animations/pose.h"
+#include "../animations/clip.h"
+
+class Mesh;
+
+struct sGLTFAsset
+{
+	Mesh* mesh = NULL; //created by the loader if NULL
+	Pose rest_pose;
+	Pose bind_pose;
+	std::vector<std::string> joint_names;
+	std::vector<Clip> clips;
+
+	bool has_skeleton() const { return joint_names.size() > 0; }
+};
+
+//cpu side only (can run in any thread), the mesh still has to be uploaded to VRAM
+//i.e. entity->set_skeleton(asset.rest_pose, asset.bind_pose, asset.joint_names)
+bool load_gltf(const char* filename, sGLTFAsset& asset, bool use_cache = true);
@@ -0,0 +1,240 @@
+#include "transform_hierarchy.h"
+
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+
+#include "math/transform.h"
+
+int TransformHierarchy::create(int parent)
+{
+	int handle;
+	if (free_handles.size())
+	{
+		handle = free_handles.back();
+		free_handles.pop_back();
+	}
+	else
+	{
+		handle = (int)handle_index.size();
+		handle_index.push_back(-1);
+		handle_parent.push_back(-1);
+	}
+
+	//appended, the sort moves it after its parent
+	int index = (int)local.size();
+	local.push_back(mat4());
+	world.push_back(mat4());
+	parents.push_back(-1);
+	dirty.push_back(1);
+	index_handle.push_back(handle);
+	previous.push_back(mat4());
+	has_previous.push_back(0);
+	handle_index[handle] = index;
+	handle_parent[handle] = -1;
+	has_dirty = true;
+
+	if (parent != -1)
+		set_parent(handle, parent);
+	return handle;
+}
+
+void TransformHierarchy::destroy(int handle)
+{
+	assert(handle >= 0 && handle < (int)handle_index.size() && handle_index[handle] != -1);
+
+	for (size_t i = 0; i < handle_parent.size(); ++i)
+		if (handle_parent[i] == handle)
+			set_parent((int)i, -1);
+
+	//the last node fills the hole, the order is fixed in the next sort
+	int index = handle_index[handle];
+	int last = (int)local.size() - 1;
+	if (index != last)
+	{
+		local[index] = local[last];
+		world[index] = world[last];
+		dirty[index] = 1;
+		index_handle[index] = index_handle[last];
+		previous[index] = previous[last];
+		has_previous[index] = has_previous[last];
+		handle_index[index_handle[index]] = index;
+	}
+	local.pop_back();
+	world.pop_back();
+	parents.pop_back();
+	dirty.pop_back();
+	index_handle.pop_back();
+	previous.pop_back();
+	has_previous.pop_back();
+
+	handle_index[handle] = -1;
+	handle_parent[handle] = -1;
+	free_handles.push_back(handle);
+	needs_sort = true;
+	has_dirty = true;
+}
+
+void TransformHierarchy::set_parent(int handle, int parent)
+{
+	assert(handle_index[handle] != -1 && (parent == -1 || handle_index[parent] != -1));
+	for (int ancestor = parent; ancestor != -1; ancestor = handle_parent[ancestor])
+		assert(ancestor != handle && "the parent is a descendant of the node");
+	if (handle_parent[handle] == parent)
+		return;
+	handle_parent[handle] = parent;
+	dirty[handle_index[handle]] = 1;
+	needs_sort = true;
+	has_dirty = true;
+}
+
+int TransformHierarchy::get_parent(int handle) const
+{
+	return handle_parent[handle];
+}
+
+void TransformHierarchy::set_local(int handle, const mat4& m)
+{
+	int index = handle_index[handle];
+	local[index] = m;
+	dirty[index] = 1;
+	has_dirty = true;
+}
+
+const mat4& TransformHierarchy::get_world(int handle)
+{
+	if (has_dirty || needs_sort)
+		update();
+	return world[handle_index[handle]];
+}
+
+int TransformHierarchy::get_depth(int handle, std::vector<int>& depths) const
+{
+	if (depths[handle] != -1)
+		return depths[handle];
+	int parent = handle_parent[handle];
+	depths[handle] = parent == -1 ? 0 : get_depth(parent, depths) + 1;
+	return depths[handle];
+}
+
+void TransformHierarchy::sort()
+{
+	needs_sort = false;
+
+	int num_nodes = (int)local.size();
+	std::vector<int> depths(handle_index.size(), -1);
+	int max_depth = 0;
+	for (int i = 0; i < num_nodes; ++i)
+		max_depth = std::max(max_depth, get_depth(index_handle[i], depths));
+
+	//counting sort by depth, stable so the siblings keep their order
+	std::vector<int> offsets(max_depth + 2, 0);
+	for (int i = 0; i < num_nodes; ++i)
+		offsets[depths[index_handle[i]] + 1]++;
+	for (int d = 1; d <= max_depth + 1; ++d)
+		offsets[d] += offsets[d - 1];
+
+	std::vector<int> order(num_nodes);
+	for (int i = 0; i < num_nodes; ++i)
+		order[offsets[depths[index_handle[i]]]++] = i;
+
+	std::vector<mat4> sorted_local(num_nodes), sorted_world(num_nodes), sorted_previous(num_nodes);
+	std::vector<uint8_t> sorted_dirty(num_nodes), sorted_has_previous(num_nodes);
+	std::vector<int> sorted_handles(num_nodes);
+	for (int i = 0; i < num_nodes; ++i)
+	{
+		sorted_local[i] = local[order[i]];
+		sorted_world[i] = world[order[i]];
+		sorted_previous[i] = previous[order[i]];
+		sorted_dirty[i] = dirty[order[i]];
+		sorted_has_previous[i] = has_previous[order[i]];
+		sorted_handles[i] = index_handle[order[i]];
+		handle_index[sorted_handles[i]] = i;
+	}
+	local.swap(sorted_local);
+	world.swap(sorted_world);
+	previous.swap(sorted_previous);
+	dirty.swap(sorted_dirty);
+	has_previous.swap(sorted_has_previous);
+	index_handle.swap(sorted_handles);
+
+	for (int i = 0; i < num_nodes; ++i)
+	{
+		int parent = handle_parent[index_handle[i]];
+		parents[i] = parent == -1 ? -1 : handle_index[parent];
+	}
+}
+
+void TransformHierarchy::update()
+{
+	if (needs_sort)
+		sort();
+
+	num_updated = 0;
+	if (!has_dirty)
+		return;
+	has_dirty = false;
+
+	//the parents are updated before their children, so a dirty parent is already known
+	int num_nodes = (int)local.size();
+	for (int i = 0; i < num_nodes; ++i)
+	{
+		int parent = parents[i];
+		if (parent != -1 && dirty[parent])
+			dirty[i] = 1;
+		if (!dirty[i])
+			continue;
+		world[i] = parent == -1 ? local[i] : world[parent] * local[i];
+		num_updated++;
+	}
+	std::fill(dirty.begin(), dirty.end(), 0);
+}
+
+void TransformHierarchy::save_previous()
+{
+	assert(interpolated.empty() && "end_interpolation was not called");
+	update();
+	previous = world;
+	std::fill(has_previous.begin(), has_previous.end(), 1);
+}
+
+void TransformHierarchy::begin_interpolation(float alpha)
+{
+	interpolated.clear();
+	update();
+	if (alpha >= 1.0f)
+		return;
+
+	//only the nodes that moved in the last step, decomposed so the rotations do not shrink
+	int num_nodes = (int)world.size();
+	for (int i = 0; i < num_nodes; ++i)
+	{
+		if (!has_previous[i] || memcmp(&previous[i], &world[i], sizeof(mat4)) == 0)
+			continue;
+		world[i] = transform_to_mat4(mix(mat4_to_transform(previous[i]), mat4_to_transform(world[i]), alpha));
+		interpolated.push_back(index_handle[i]);
+	}
+}
+
+void TransformHierarchy::end_interpolation()
+{
+	//recomputed from the locals in the next update, which also covers the nodes moved while rendering
+	for (size_t i = 0; i < interpolated.size(); ++i)
+	{
+		int index = handle_index[interpolated[i]];
+		if (index != -1)
+		{
+			dirty[index] = 1;
+			has_dirty = true;
+		}
+	}
+	interpolated.clear();
+}
+
+TransformHierarchy* TransformHierarchy::get()
+{
+	static TransformHierarchy* hierarchy = NULL;
+	if (!hierarchy)
+		hierarchy = new TransformHierarchy();
+	return hierarchy;
+}
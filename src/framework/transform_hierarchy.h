@@ -0,0 +1,64 @@
+/*  Scene transforms stored flat: the local and world matrices of every node live in contiguous arrays
+	sorted by depth, so the parents always come before their children and one pass in order updates the whole tree.
+	Only the nodes that changed (or whose parent changed) are recomputed, one multiply each (world = parent * local).
+	Nodes are referenced by handles, which stay valid when the arrays are reordered.
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "math/mat4.h"
+
+class TransformHierarchy
+{
+public:
+	//returns the handle of a new node with the identity as local matrix
+	int create(int parent = -1);
+	void destroy(int handle); //the children become roots
+	void set_parent(int handle, int parent); //-1 to make it a root
+	int get_parent(int handle) const;
+
+	void set_local(int handle, const mat4& local);
+	const mat4& get_local(int handle) const { return local[handle_index[handle]]; }
+	//cached, the dirty nodes are updated first if there are any
+	const mat4& get_world(int handle);
+
+	//sorts the nodes if the tree changed and propagates the dirty ones, once per frame
+	void update();
+
+	//fixed step simulation: the worlds of the last step are kept and the render sees a mix of both
+	void save_previous(); //before every simulation step
+	void begin_interpolation(float alpha); //worlds between the previous and the current step (0 to 1)
+	void end_interpolation(); //back to the worlds of the current step
+
+	int get_num_nodes() const { return (int)local.size(); }
+	int get_num_updated() const { return num_updated; } //in the last update
+
+	//shared by the entities
+	static TransformHierarchy* get();
+
+private:
+	//by index, sorted by depth
+	std::vector<mat4> local;
+	std::vector<mat4> world;
+	std::vector<int> parents; //index of the parent, -1 for the roots
+	std::vector<uint8_t> dirty;
+	std::vector<int> index_handle;
+	std::vector<mat4> previous; //world before the last simulation step
+	std::vector<uint8_t> has_previous; //0 for the nodes created after it, they are not interpolated
+
+	//by handle
+	std::vector<int> handle_index; //-1 if the handle is free
+	std::vector<int> handle_parent;
+	std::vector<int> free_handles;
+	std::vector<int> interpolated; //changed by begin_interpolation
+
+	bool needs_sort = false;
+	bool has_dirty = false;
+	int num_updated = 0;
+
+	void sort();
+	int get_depth(int handle, std::vector<int>& depths) const;
+};
@@ -209,6 +209,27 @@ bool check_gl_errors()
 	return true;
 }
 
+bool has_gl_extension(const char* name)
+{
+	GLint num_extensions = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+	for (GLint i = 0; i < num_extensions; ++i)
+	{
+		const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+		if (extension && strcmp(extension, name) == 0)
+			return true;
+	}
+	return false;
+}
+
+int get_gl_version()
+{
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	return major * 10 + minor;
+}
+
 std::vector<std::string>& split(const std::string& s, char delim, std::vector<std::string>& elems) {
 	std::stringstream ss(s);
 	std::string item;
@@ -24,6 +24,10 @@ vec3 transform_quat(const vec3& a, const quat& q);
 //check opengl errors
 bool check_gl_errors();
 
+//opengl capabilities
+bool has_gl_extension(const char* name); //i.e. "GL_ARB_buffer_storage"
+int get_gl_version(); //major * 10 + minor, i.e. 33 or 45
+
 std::string get_path();
 
 //Vector2 getDesktopSize(int display_index = 0);
@@ -1,6 +1,8 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <iostream> // to output
+#include <cmath>
+#include <cstring>
 
 // IMGUI
 #include "imgui.h"
@@ -10,6 +12,13 @@
 #include "ImGuizmo.h"
 
 #include "framework/application.h"
+#include "framework/job_system.h"
+#include "framework/graphics/frame_ring_buffer.h"
+#include "framework/graphics/texture_cook.h"
+#include "framework/graphics/texture_array.h"
+
+#define UPLOAD_BUDGET_MS 2.0 //time per frame for the main thread jobs (GPU uploads of async resources)
+#define SHADER_COMPILE_BUDGET_MS 4.0f //time per frame for the shader compiles when the driver cannot do them in the background
 
 // Globals
 Application* app;
@@ -26,9 +35,23 @@ void render_gui(GLFWwindow* window, Application* app)
 		ImGui::Begin("Controls");
 
 		ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / io.Framerate, io.Framerate);
+		ImGui::Text("Entities visible: %u, culled: %u", app->num_visible_entities, app->num_culled_entities);
+		ImGui::Text("Draws: %u, programs: %u, materials: %u, VAOs: %u", app->render_queue.stats.num_draws, app->render_queue.stats.num_program_binds,
+			app->render_queue.stats.num_material_binds, app->render_queue.stats.num_vao_binds);
+		ImGui::Text("Instanced draws: %u (%u instances)", app->render_queue.stats.num_instanced_draws, app->render_queue.stats.num_instances);
+		if (Shader::get_num_pending())
+			ImGui::Text("Shaders compiling: %u%s", (unsigned int)Shader::get_num_pending(), Shader::s_parallel_compile ? " (parallel)" : "");
+		if (ImGui::TreeNode("Simulation")) {
+			ImGui::Checkbox("Fixed timestep", &app->flag_fixed_step);
+			ImGui::SliderFloat("Rate (Hz)", &app->simulation_hz, 10.0f, 240.0f);
+			ImGui::SliderInt("Max steps per frame", &app->max_simulation_steps, 1, 10);
+			ImGui::Text("Steps: %u, interpolation: %.2f", app->num_simulation_steps, app->interpolation_alpha);
+			ImGui::TreePop();
+		}
 		if (ImGui::TreeNode("Debugger")) {
 			ImGui::Checkbox("View wireframe", &app->flag_wireframe);
 			ImGui::Checkbox("View grid", &app->flag_grid);
+			ImGui::Checkbox("Frustum culling", &app->flag_culling);
 			if (ImGui::IsMousePosValid())
 				ImGui::Text("Mouse pos: (%g, %g)", xpos, ypos);
 			else
@@ -129,7 +152,8 @@ void main_loop(GLFWwindow* window)
 {
 	int32_t width, height;
 	glfwGetFramebufferSize(window, &width, &height);
-	double prev_frame_time = 0.0;
+	double prev_frame_time = glfwGetTime();
+	double accumulator = 0.0; // simulation time not stepped yet
 	double xpos, ypos; // mouse position vars
 
 	/* Loop until the user closes the window */
@@ -147,10 +171,42 @@ void main_loop(GLFWwindow* window)
 		double curr_time = glfwGetTime();
 		double delta_time = curr_time - prev_frame_time;
 		prev_frame_time = curr_time;
-		app->update(delta_time);
+
+		// Simulate in fixed steps, the render interpolates between the last two
+		app->num_simulation_steps = 0;
+		if (app->flag_fixed_step) {
+			double step = 1.0 / app->simulation_hz;
+			accumulator += delta_time;
+			while (accumulator >= step && app->num_simulation_steps < (unsigned int)app->max_simulation_steps) {
+				app->update((float)step);
+				accumulator -= step;
+				app->num_simulation_steps++;
+			}
+			// too far behind (a hitch, a breakpoint...), the time left is dropped instead of catching up in the next frames
+			if (accumulator >= step)
+				accumulator = fmod(accumulator, step);
+			app->interpolation_alpha = (float)(accumulator / step);
+		}
+		else {
+			accumulator = 0.0;
+			app->update((float)delta_time);
+			app->num_simulation_steps = 1;
+			app->interpolation_alpha = 1.0f;
+		}
 
 		if (app->close) break;
 
+		// Finish async loads (GL uploads must happen in this thread)
+		JobSystem::process_main_thread_jobs(UPLOAD_BUDGET_MS);
+
+		// Reload the shaders whose files changed and finish the ones compiling in the background
+		Shader::update_hot_reload();
+		Shader::update_pending(SHADER_COMPILE_BUDGET_MS);
+
+		// Build the mips of the shared textures that got images, once for all the images added
+		TextureArray::finalize_all();
+		TextureAtlas::finalize_all();
+
 		// Start the Dear ImGui frame
 		ImGui_ImplOpenGL3_NewFrame();
 		ImGui_ImplGlfw_NewFrame();
@@ -161,9 +217,14 @@ void main_loop(GLFWwindow* window)
 
 		//ImGui::ShowDemoWindow();
 
+		// Per frame dynamic data (instances...) goes to a slice of the ring buffer
+		FrameRingBuffer::get()->begin_frame();
+
 		app->render();
 
 		render_gui(window, app);
+
+		FrameRingBuffer::get()->end_frame();
 		
 		/* Swap front and back buffers */
 		glfwSwapBuffers(window);
@@ -172,8 +233,16 @@ void main_loop(GLFWwindow* window)
 	}
 }
 
-int main(void) 
+int main(int argc, char** argv) 
 {
+	//offline step: "--cook folder" writes the .ctex of the textures and exits, without opening a window
+	if (argc >= 3 && strcmp(argv[1], "--cook") == 0)
+	{
+		int num_cooked = cook_textures_in_folder(argv[2]);
+		std::cout << "[INFO] Cooked " << num_cooked << " textures in " << argv[2] << std::endl;
+		return 0;
+	}
+
 	/* Glfw (Window API) */
 	if (!glfwInit())
 		return -1;
@@ -225,6 +294,8 @@ int main(void)
 	ImGui_ImplGlfw_InitForOpenGL(window, true);
 	ImGui_ImplOpenGL3_Init(glsl_version);
 
+	JobSystem::init();
+
 	app = new Application();
 	app->init(window);
 
@@ -232,6 +303,7 @@ int main(void)
 	main_loop(window);
 
 	// Free memory
+	JobSystem::shutdown();
 	delete app;
 
 	ImGui_ImplOpenGL3_Shutdown();